@@ -33,6 +33,8 @@
 #include <linux/init.h>
 #include <linux/flat.h>
 #include <linux/config.h>
+#include <linux/proc_fs.h>
+#include <linux/spinlock.h>
 
 #include <asm/byteorder.h>
 #include <asm/system.h>
@@ -314,6 +316,577 @@ static int decompress_exec(
 #endif /* CONFIG_BINFMT_ZFLAT */
 
 
+/*
+ * Relocation offsets are handed out FLAT_RELOC_BLOCK at a time,  in
+ * host order,  whether the file has one word for each or the sorted
+ * delta encoding (FLAT_FLAG_RELOCDELTA,  see flat.h).  A block is small
+ * enough to stay in the cache while it is checked and applied.
+ */
+#define FLAT_RELOC_BLOCK	32
+
+struct flat_reloc_iter {
+	unsigned long	*reloc;		/* next word,  plain table */
+	unsigned char	*p, *end;	/* next byte,  delta encoded */
+	unsigned long	left;		/* relocations still to come */
+	unsigned long	off;		/* last offset decoded */
+};
+
+static void flat_reloc_start(
+	struct flat_reloc_iter *it,
+	unsigned long *reloc,
+	unsigned long relocs,
+	unsigned long flags)
+{
+	memset(it, 0, sizeof(*it));
+	if (!(flags & FLAT_FLAG_RELOCDELTA)) {
+		it->reloc = reloc;
+		it->left = relocs;
+	} else if (relocs) {
+		it->left = ntohl(reloc[0]);
+		it->p = (unsigned char *) (reloc + 1);
+		it->end = (unsigned char *) (reloc + relocs);
+	}
+}
+
+/*
+ * fill buf with the next block of offsets,  and hi with the largest.
+ * Returns how many,  0 at the end,  or -1 if the encoding runs past the
+ * end of the reloc section.
+ */
+static int flat_reloc_next(
+	struct flat_reloc_iter *it,
+	unsigned long *buf,
+	unsigned long *hi)
+{
+	unsigned long off, max = 0;
+	int i, n;
+
+	n = it->left < FLAT_RELOC_BLOCK ? it->left : FLAT_RELOC_BLOCK;
+	if (it->reloc) {
+		for (i = 0; i < n; i++) {
+			buf[i] = off = ntohl(it->reloc[i]);
+			if (off > max)
+				max = off;
+		}
+		it->reloc += n;
+	} else {
+		off = it->off;
+		for (i = 0; i < n; i++) {
+			if (it->p >= it->end)
+				return -1;
+			if (*it->p) {
+				off += *it->p++ << 1;
+			} else {
+				if (it->end - it->p < 5)
+					return -1;
+				off = ((unsigned long) it->p[1] << 24) | (it->p[2] << 16) |
+						(it->p[3] << 8) | it->p[4];
+				it->p += 5;
+			}
+			buf[i] = off;
+			if (off > max)
+				max = off;
+		}
+		it->off = off;
+	}
+	it->left -= n;
+	*hi = max;
+	return n;
+}
+
+
+/*
+ * Where exec time goes,  for /proc/flat_times.  Setting flat_trace
+ * there (or booting with flat_trace) logs each exec as well.
+ */
+struct flat_times {
+	unsigned long	read;		/* reading the file,  or the cache */
+	unsigned long	inflate;	/* decompressing it */
+	unsigned long	reloc;		/* relocating the GOT and reloc table */
+	unsigned long	relocs;		/* ... how many relocations */
+};
+
+static struct flat_times flat_total;
+static unsigned long flat_execs, flat_exec_us;
+static int flat_trace;
+
+static unsigned long flat_usecs(struct timeval *since)
+{
+	struct timeval now;
+
+	do_gettimeofday(&now);
+	return (now.tv_sec - since->tv_sec) * 1000000 +
+			now.tv_usec - since->tv_usec;
+}
+
+static int __init flat_trace_setup(char *str)
+{
+	flat_trace = 1;
+	return 1;
+}
+
+__setup("flat_trace", flat_trace_setup);
+
+#ifdef CONFIG_BINFMT_ZFLAT
+static int flat_decompress(
+	struct linux_binprm *bprm,
+	unsigned long offset,
+	char *buffer,
+	long len,
+	struct flat_times *times)
+{
+	struct timeval start;
+	int res;
+
+	do_gettimeofday(&start);
+	res = decompress_exec(bprm, offset, buffer, len, 0);
+	times->inflate += flat_usecs(&start);
+	return res;
+}
+#endif
+
+#ifdef CONFIG_PROC_FS
+static int flat_times_read_proc(char *page, char **start, off_t off,
+		int count, int *eof, void *data)
+{
+	struct flat_times t = flat_total;
+	unsigned long n = flat_execs ? flat_execs : 1;
+	int len;
+
+	len = sprintf(page, "%-8s %10s %8s\n"
+			"%-8s %10lu %8lu\n%-8s %10lu %8lu\n"
+			"%-8s %10lu %8lu\n%-8s %10lu %8lu\n"
+			"%lu execs, %lu relocations, trace %s\n",
+			"", "total us", "avg us",
+			"read", t.read, t.read / n,
+			"inflate", t.inflate, t.inflate / n,
+			"reloc", t.reloc, t.reloc / n,
+			"exec", flat_exec_us, flat_exec_us / n,
+			flat_execs, t.relocs, flat_trace ? "on" : "off");
+
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+
+/*
+ * write 1 to log every exec,  0 to stop.  Either clears the totals.
+ */
+static int flat_times_write_proc(struct file *file, const char *buffer,
+		unsigned long count, void *data)
+{
+	char buf[16];
+	unsigned long n = count < sizeof(buf) - 1 ? count : sizeof(buf) - 1;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (copy_from_user(buf, buffer, n))
+		return -EFAULT;
+	buf[n] = '\0';
+
+	flat_trace = simple_strtoul(buf, NULL, 0) != 0;
+	memset(&flat_total, 0, sizeof(flat_total));
+	flat_execs = flat_exec_us = 0;
+	return count;
+}
+#endif /* CONFIG_PROC_FS */
+
+
+
+#ifdef CONFIG_BINFMT_ZFLAT_CACHE
+/*
+ * Decompressed ZFLAT images,  so exec'ing the same program again skips
+ * the inflate.  An image is laid out as in the file (header, text, data,
+ * relocs) in an rblock like any other process memory,  and the cache
+ * holds one reference to it.  If the text is never relocated, processes
+ * run it straight from the cache by taking a reference of their own,  so
+ * all copies of a program share one text;  otherwise,  or if they are
+ * being traced,  they get a copy.  Data and relocs are always copied.
+ *
+ * Entries are keyed by device, inode and mtime and kept in LRU order.
+ * Idle ones (no process running their text, no exec in progress) are
+ * dropped once the cache is over flat_cache_limit bytes,  and by
+ * shrink_flat_cache() when memory is short.
+ *
+ * The text is not decompressed on demand:  without an MMU there is no
+ * page fault to hang that on,  and the text must be whole and contiguous
+ * before the program starts.  Keeping whole inflated images gets the
+ * saving demand decompression was after,  no inflate on a repeat exec.
+ *
+ * Writing a size in kB to /proc/flat_cache sets the limit.  Writing 0
+ * drops every idle entry and leaves the limit as it was.
+ */
+
+struct flat_cache {
+	struct list_head		list;
+	kdev_t					dev;
+	unsigned long			ino;
+	time_t					mtime;
+	loff_t					size;
+	struct mm_rblock_struct	*rblock;
+	int						shared;		/* text is not relocated */
+	int						loading;	/* execs using the image */
+	char					name[16];
+	/* for /proc/flat_cache */
+	unsigned long			execs, hits;
+	unsigned long			inflate_us, exec_us, max_exec_us;
+};
+
+extern unsigned long askedalloc, realalloc;
+
+static LIST_HEAD(flat_cache_lru);
+static spinlock_t flat_cache_lock = SPIN_LOCK_UNLOCKED;
+static unsigned long flat_cache_bytes, flat_cache_limit;
+
+#define flat_cache_is_idle(zc) \
+	((zc)->loading == 0 && (zc)->rblock->refcount == 1)
+
+/*
+ * drop an rblock reference,  as exit_mmap() does
+ */
+static void flat_rblock_put(struct mm_rblock_struct *rblock)
+{
+	if (--rblock->refcount)
+		return;
+	realalloc -= ksize(rblock->kblock);
+	askedalloc -= rblock->size;
+	kfree(rblock->kblock);
+	realalloc -= ksize(rblock);
+	askedalloc -= sizeof(struct mm_rblock_struct);
+	kfree(rblock);
+}
+
+/* called with flat_cache_lock held,  and zc->loading == 0 */
+static void flat_cache_drop(struct flat_cache *zc)
+{
+	list_del(&zc->list);
+	flat_cache_bytes -= ksize(zc->rblock->kblock);
+	flat_rblock_put(zc->rblock);
+	kfree(zc);
+}
+
+/*
+ * entries go idle when the last process running their text exits,
+ * which we don't hear about,  so they are counted when needed
+ */
+static int flat_cache_count_idle(void)
+{
+	struct list_head *l;
+	int n = 0;
+
+	list_for_each(l, &flat_cache_lru)
+		if (flat_cache_is_idle(list_entry(l, struct flat_cache, list)))
+			n++;
+	return n;
+}
+
+/* drop idle entries, oldest first,  called with flat_cache_lock held */
+static int flat_cache_prune(int count, unsigned long limit)
+{
+	struct list_head *l, *prev;
+	struct flat_cache *zc;
+	int dropped = 0;
+
+	for (l = flat_cache_lru.prev; l != &flat_cache_lru; l = prev) {
+		prev = l->prev;
+		if (dropped >= count && flat_cache_bytes <= limit)
+			break;
+		zc = list_entry(l, struct flat_cache, list);
+		if (!flat_cache_is_idle(zc))
+			continue;
+		flat_cache_drop(zc);
+		dropped++;
+	}
+	return dropped;
+}
+
+int shrink_flat_cache(int priority, unsigned int gfp_mask)
+{
+	int count;
+
+	spin_lock(&flat_cache_lock);
+	count = flat_cache_count_idle() / priority;
+	if (count)
+		flat_cache_prune(count, flat_cache_limit);
+	spin_unlock(&flat_cache_lock);
+	return 0;
+}
+
+/*
+ * find the image for the file being exec'd,  decompressing and adding
+ * it if need be.  Returns NULL if it can't be cached,  and the caller
+ * decompresses it as usual.
+ */
+static struct flat_cache *flat_cache_get(
+	struct linux_binprm *bprm,
+	unsigned long text_len,
+	unsigned long data_len,
+	unsigned long relocs,
+	unsigned long flags,
+	unsigned long *inflate_us)
+{
+	struct inode *inode = bprm->file->f_dentry->d_inode;
+	struct flat_hdr *hdr = (struct flat_hdr *) bprm->buf;
+	unsigned long image_len, reloc_start, off[FLAT_RELOC_BLOCK], hi;
+	struct flat_reloc_iter it;
+	struct mm_rblock_struct *rblock;
+	struct flat_cache *zc, *old;
+	struct list_head *l;
+	struct timeval start;
+	const char *name;
+	int i, n;
+
+	spin_lock(&flat_cache_lock);
+	list_for_each(l, &flat_cache_lru) {
+		zc = list_entry(l, struct flat_cache, list);
+		if (zc->dev != inode->i_dev || zc->ino != inode->i_ino)
+			continue;
+		if (zc->mtime == inode->i_mtime && zc->size == inode->i_size) {
+			zc->loading++;
+			zc->hits++;
+			list_del(&zc->list);
+			list_add(&zc->list, &flat_cache_lru);
+			spin_unlock(&flat_cache_lock);
+			return zc;
+		}
+		/* the file has changed,  the old image goes when it can */
+		if (zc->loading == 0)
+			flat_cache_drop(zc);
+		break;
+	}
+	spin_unlock(&flat_cache_lock);
+
+	image_len = text_len + data_len + relocs * sizeof(unsigned long);
+	reloc_start = ntohl(hdr->reloc_start);
+	if (reloc_start < text_len ||
+			reloc_start + relocs * sizeof(unsigned long) > image_len)
+		return NULL;
+
+	zc = kmalloc(sizeof(*zc), GFP_KERNEL);
+	rblock = kmalloc(sizeof(*rblock), GFP_KERNEL);
+	if (rblock)
+		rblock->kblock = kmalloc(image_len, GFP_KERNEL);
+	if (!zc || !rblock || !rblock->kblock) {
+		if (rblock)
+			kfree(rblock);
+		if (zc)
+			kfree(zc);
+		return NULL;
+	}
+	memset(zc, 0, sizeof(*zc));
+
+	do_gettimeofday(&start);
+	memcpy(rblock->kblock, hdr, sizeof(struct flat_hdr));
+	if (decompress_exec(bprm, sizeof(struct flat_hdr),
+			(char *) rblock->kblock + sizeof(struct flat_hdr),
+			image_len - sizeof(struct flat_hdr), 0)) {
+		kfree(rblock->kblock);
+		kfree(rblock);
+		kfree(zc);
+		return NULL;
+	}
+	zc->inflate_us = flat_usecs(&start);
+	*inflate_us += zc->inflate_us;
+
+	/*
+	 * the text can be shared unless a reloc points into it,  or the
+	 * program asks for it all to be in RAM
+	 */
+	zc->shared = !(flags & FLAT_FLAG_RAM);
+	flat_reloc_start(&it,
+			(unsigned long *) ((char *) rblock->kblock + reloc_start),
+			relocs, flags);
+	while (zc->shared && (n = flat_reloc_next(&it, off, &hi)) != 0) {
+		if (n < 0)
+			zc->shared = 0;
+		for (i = 0; i < n; i++)
+			if (off[i] < text_len - sizeof(struct flat_hdr))
+				zc->shared = 0;
+	}
+
+	rblock->refcount = 1;
+	rblock->size = image_len;
+	realalloc += ksize(rblock->kblock) + ksize(rblock);
+	askedalloc += image_len + sizeof(*rblock);
+
+	zc->dev = inode->i_dev;
+	zc->ino = inode->i_ino;
+	zc->mtime = inode->i_mtime;
+	zc->size = inode->i_size;
+	zc->rblock = rblock;
+	zc->loading = 1;
+	name = strrchr(bprm->filename, '/');
+	strncpy(zc->name, name ? name + 1 : bprm->filename, sizeof(zc->name) - 1);
+
+	spin_lock(&flat_cache_lock);
+	list_add(&zc->list, &flat_cache_lru);
+	flat_cache_bytes += ksize(rblock->kblock);
+	/* someone may have beaten us to it */
+	for (l = zc->list.next; l != &flat_cache_lru; l = l->next) {
+		old = list_entry(l, struct flat_cache, list);
+		if (old->dev == zc->dev && old->ino == zc->ino) {
+			if (old->loading == 0) {
+				zc->execs += old->execs;
+				zc->hits += old->hits;
+				flat_cache_drop(old);
+			}
+			break;
+		}
+	}
+	if (flat_cache_bytes > flat_cache_limit)
+		flat_cache_prune(0, flat_cache_limit);
+	spin_unlock(&flat_cache_lock);
+	return zc;
+}
+
+/*
+ * run the text from the cached image,  it is unmapped like any other
+ * block when the process exits
+ */
+static int flat_cache_map(struct flat_cache *zc)
+{
+	struct mm_tblock_struct *tblock;
+
+	tblock = kmalloc(sizeof(*tblock), GFP_KERNEL);
+	if (!tblock)
+		return -ENOMEM;
+	realalloc += ksize(tblock);
+	askedalloc += sizeof(*tblock);
+
+	spin_lock(&flat_cache_lock);
+	tblock->rblock = zc->rblock;
+	zc->rblock->refcount++;
+	spin_unlock(&flat_cache_lock);
+
+	tblock->next = current->mm->tblock.next;
+	current->mm->tblock.next = tblock;
+	return 0;
+}
+
+/*
+ * the exec is done with the image,  count it if it worked
+ */
+static void flat_cache_put(struct flat_cache *zc, struct timeval *start)
+{
+	unsigned long us;
+
+	spin_lock(&flat_cache_lock);
+	if (start) {
+		us = flat_usecs(start);
+		zc->execs++;
+		zc->exec_us += us;
+		if (us > zc->max_exec_us)
+			zc->max_exec_us = us;
+	}
+	zc->loading--;
+	if (flat_cache_bytes > flat_cache_limit)
+		flat_cache_prune(0, flat_cache_limit);
+	spin_unlock(&flat_cache_lock);
+}
+
+#ifdef CONFIG_PROC_FS
+/*
+ * one line per cached program:  the execs that found it cached, the time
+ * the one that didn't spent inflating,  and the average and worst time
+ * for the whole exec.  Write a size in kB to change the limit,  0 drops
+ * everything that is idle.
+ */
+static int flat_cache_read_proc(char *page, char **start, off_t off,
+		int count, int *eof, void *data)
+{
+	struct flat_cache *zc;
+	struct list_head *l;
+	int len;
+
+	spin_lock(&flat_cache_lock);
+	len = sprintf(page, "limit %lukB, used %lukB, %d idle\n"
+			"%-15s %10s %6s %5s %6s %6s %8s %8s %8s\n",
+			flat_cache_limit >> 10, flat_cache_bytes >> 10,
+			flat_cache_count_idle(),
+			"program", "dev:inode", "kB", "users", "execs", "hits",
+			"inflate", "avg us", "max us");
+	list_for_each(l, &flat_cache_lru) {
+		if (len > PAGE_SIZE - 100)
+			break;
+		zc = list_entry(l, struct flat_cache, list);
+		len += sprintf(page + len,
+				"%-15s %04x:%-5lu %6u %5d%c %6lu %6lu %8lu %8lu %8lu\n",
+				zc->name, kdev_t_to_nr(zc->dev), zc->ino,
+				ksize(zc->rblock->kblock) >> 10, zc->rblock->refcount - 1,
+				zc->shared ? ' ' : '*', zc->execs, zc->hits, zc->inflate_us,
+				zc->execs ? zc->exec_us / zc->execs : 0, zc->max_exec_us);
+	}
+	spin_unlock(&flat_cache_lock);
+
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+
+static int flat_cache_write_proc(struct file *file, const char *buffer,
+		unsigned long count, void *data)
+{
+	char buf[16], *end;
+	unsigned long n = count < sizeof(buf) - 1 ? count : sizeof(buf) - 1;
+	unsigned long kb;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (copy_from_user(buf, buffer, n))
+		return -EFAULT;
+	buf[n] = '\0';
+
+	kb = simple_strtoul(buf, &end, 0);
+	if (end == buf)
+		return -EINVAL;
+	while (*end == ' ' || *end == '\t' || *end == '\n')
+		end++;
+	if (*end != '\0')
+		return -EINVAL;
+
+	spin_lock(&flat_cache_lock);
+	if (kb == 0) {
+		/* flush,  the limit stays */
+		flat_cache_prune(0, 0);
+	} else {
+		flat_cache_limit = kb << 10;
+		flat_cache_prune(0, flat_cache_limit);
+	}
+	spin_unlock(&flat_cache_lock);
+	return count;
+}
+#endif /* CONFIG_PROC_FS */
+
+static void __init flat_cache_init(void)
+{
+#ifdef CONFIG_PROC_FS
+	struct proc_dir_entry *ent;
+#endif
+
+	flat_cache_limit = (num_physpages << PAGE_SHIFT) / 8;
+#ifdef CONFIG_PROC_FS
+	ent = create_proc_entry("flat_cache", S_IFREG | S_IRUGO | S_IWUSR, NULL);
+	if (ent) {
+		ent->read_proc = flat_cache_read_proc;
+		ent->write_proc = flat_cache_write_proc;
+	}
+#endif
+}
+#endif /* CONFIG_BINFMT_ZFLAT_CACHE */
+
+
 
 static unsigned long
 calc_reloc(unsigned long r, unsigned long text_len)
@@ -357,6 +930,72 @@ calc_reloc(unsigned long r, unsigned long text_len)
 }
 
 
+/*
+ * calc_reloc() for the common case,  with the bits of current->mm it
+ * needs kept to hand.  An offset no bigger than limit is always inside
+ * the text or data,  anything else goes to calc_reloc() to be reported.
+ */
+struct flat_reloc {
+	unsigned long	start_code;
+	unsigned long	start_data;
+	unsigned long	text_len;
+	unsigned long	limit;
+};
+
+static inline unsigned long
+flat_reloc_addr(struct flat_reloc *fr, unsigned long r)
+{
+	if (r > fr->limit)
+		return calc_reloc(r, fr->text_len);
+	if (r < fr->text_len)
+		return r + fr->start_code;
+	return r - fr->text_len + fr->start_data;
+}
+
+/*
+ * apply a block of relocations.  Checking the largest offset covers the
+ * whole block;  if that fails calc_reloc() goes through them one by one
+ * to find the bad one.
+ */
+static void
+flat_reloc_block(
+	struct flat_reloc *fr,
+	unsigned long *off,
+	int n,
+	unsigned long hi,
+	int gotpic)
+{
+	unsigned long addr, *rp;
+	int i;
+
+	if (hi > fr->limit) {
+		for (i = 0; i < n; i++) {
+			rp = (unsigned long *) calc_reloc(off[i], fr->text_len);
+			addr = get_unaligned(rp);
+			if (addr != 0) {
+				addr = calc_reloc(gotpic ? addr : ntohl(addr), fr->text_len);
+				put_unaligned(addr, rp);
+			}
+		}
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (off[i] < fr->text_len)
+			rp = (unsigned long *) (off[i] + fr->start_code);
+		else
+			rp = (unsigned long *) (off[i] - fr->text_len + fr->start_data);
+		addr = get_unaligned(rp);
+		if (addr != 0) {
+			/* PIC relocs in the data section are already in target order */
+			if (!gotpic)
+				addr = ntohl(addr);
+			put_unaligned(flat_reloc_addr(fr, addr), rp);
+		}
+	}
+}
+
+
 void old_reloc(unsigned long rl)
 {
 #ifdef DEBUG
@@ -413,9 +1052,21 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 	unsigned long extra, rlim;
 	unsigned long p = bprm->p;
 	unsigned long *reloc = 0, *rp;
+	unsigned long off[FLAT_RELOC_BLOCK], hi, us;
+	struct flat_reloc_iter it;
+	struct flat_reloc fr;
+	struct flat_times times;
+	struct timeval start, t;
 	struct inode *inode;
-	int i, rev, relocs = 0;
+	int i, n, rev, relocs = 0;
 	loff_t fpos;
+#ifdef CONFIG_BINFMT_ZFLAT_CACHE
+	struct flat_cache *zc = NULL;
+	unsigned long image_end;
+#endif
+
+	do_gettimeofday(&start);
+	memset(&times, 0, sizeof(times));
 
 	DBG_FLT("BINFMT_FLAT: Loading file: %x\n", bprm->file);
 
@@ -506,8 +1157,65 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 	/*
 	 * there are a couple of cases here,  the seperate code/data
 	 * case,  and then the fully copied to RAM case which lumps
-	 * it all together.
+	 * it all together.  Compressed programs already in the cache
+	 * can be either.
 	 */
+	do_gettimeofday(&t);
+#ifdef CONFIG_BINFMT_ZFLAT_CACHE
+	if ((flags & FLAT_FLAG_GZIP) && rev == FLAT_VERSION)
+		zc = flat_cache_get(bprm, text_len, data_len, relocs, flags,
+				&times.inflate);
+	if (zc) {
+		extra = MAX(bss_len + stack_len, relocs * sizeof(unsigned long));
+		image_end = ntohl(hdr->reloc_start) + relocs * sizeof(unsigned long);
+
+		if (zc->shared && !(current->ptrace & PT_PTRACED) &&
+				flat_cache_map(zc) == 0) {
+			DBG_FLT("BINFMT_FLAT: shared text from the cache\n");
+			textpos = (unsigned long) zc->rblock->kblock;
+
+			down_write(&current->mm->mmap_sem);
+			datapos = do_mmap(0, 0, data_len + extra,
+					PROT_READ|PROT_WRITE|PROT_EXEC, 0, 0);
+			up_write(&current->mm->mmap_sem);
+			if (!datapos || datapos >= (unsigned long)-4096) {
+				if (!datapos)
+					datapos = (unsigned long) -ENOMEM;
+				printk("Unable to allocate RAM for process data, errno %d\n",
+						(int)-datapos);
+				do_munmap(current->mm, textpos, text_len);
+				flat_cache_put(zc, NULL);
+				return datapos;
+			}
+			memcpy((char *) datapos, (char *) textpos + text_len,
+					image_end - text_len);
+			reloc = (unsigned long *) (datapos+(ntohl(hdr->reloc_start)-text_len));
+			memp = datapos;
+			memkasked = data_len + extra;
+		} else {
+			DBG_FLT("BINFMT_FLAT: private copy from the cache\n");
+			down_write(&current->mm->mmap_sem);
+			textpos = do_mmap(0, 0, text_len + data_len + extra,
+					PROT_READ | PROT_EXEC | PROT_WRITE, 0, 0);
+			up_write(&current->mm->mmap_sem);
+			if (!textpos  || textpos >= (unsigned long) -4096) {
+				if (!textpos)
+					textpos = (unsigned long) -ENOMEM;
+				printk("Unable to allocate RAM for process text/data, errno %d\n",
+						(int)-textpos);
+				flat_cache_put(zc, NULL);
+				return textpos;
+			}
+			memcpy((char *) textpos + sizeof(struct flat_hdr),
+					(char *) zc->rblock->kblock + sizeof(struct flat_hdr),
+					image_end - sizeof(struct flat_hdr));
+			datapos = textpos + ntohl(hdr->data_start);
+			reloc = (unsigned long *) (textpos + ntohl(hdr->reloc_start));
+			memp = textpos;
+			memkasked = text_len + data_len + extra;
+		}
+	} else
+#endif
 	if ((flags & (FLAT_FLAG_RAM|FLAT_FLAG_GZIP)) == 0) {
 		/*
 		 * this should give us a ROM ptr,  but if it doesn't we don't
@@ -546,8 +1254,8 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 		fpos = ntohl(hdr->data_start);
 #ifdef CONFIG_BINFMT_ZFLAT
 		if (flags & FLAT_FLAG_GZDATA) {
-			result = decompress_exec(bprm, fpos, (char *) datapos, 
-						 data_len + (relocs * sizeof(unsigned long)), 0);
+			result = flat_decompress(bprm, fpos, (char *) datapos, 
+						 data_len + (relocs * sizeof(unsigned long)), &times);
 		} else
 #endif
 		{
@@ -594,18 +1302,18 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 		 * load it all in and treat it like a RAM load from now on
 		 */
 		if (flags & FLAT_FLAG_GZIP) {
-			result = decompress_exec(bprm, sizeof (struct flat_hdr),
+			result = flat_decompress(bprm, sizeof (struct flat_hdr),
 					 (((char *) textpos) + sizeof (struct flat_hdr)),
 					 (text_len + data_len + (relocs * sizeof(unsigned long))
 						  - sizeof (struct flat_hdr)),
-					 0);
+					 &times);
 		} else if (flags & FLAT_FLAG_GZDATA) {
 			fpos = 0;
 			result = bprm->file->f_op->read(bprm->file,
 					(char *) textpos, text_len, &fpos);
 			if (result < (unsigned long) -4096)
-				result = decompress_exec(bprm, text_len, (char *) datapos,
-						 data_len + (relocs * sizeof(unsigned long)), 0);
+				result = flat_decompress(bprm, text_len, (char *) datapos,
+						 data_len + (relocs * sizeof(unsigned long)), &times);
 		}
 		else
 #endif
@@ -621,6 +1329,8 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 		}
 	}
 
+	times.read = flat_usecs(&t) - times.inflate;
+
 	DBG_FLT("Mapping is %x, Entry point is %x, data_start is %x\n",
 			textpos, ntohl(hdr->entry), ntohl(hdr->data_start));
 
@@ -650,6 +1360,12 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 
 	text_len -= sizeof(struct flat_hdr); /* the real code len */
 
+	fr.start_code = current->mm->start_code;
+	fr.start_data = current->mm->start_data;
+	fr.text_len = text_len;
+	fr.limit = current->mm->start_brk - current->mm->start_data + text_len;
+	do_gettimeofday(&t);
+
 	/*
 	 * We just load the allocations into some temporary memory to
 	 * help simplify all this mumbo jumbo
@@ -665,7 +1381,7 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 	
 	if (flags & FLAT_FLAG_GOTPIC) {
 		for (rp = (unsigned long *)datapos; *rp != 0xffffffff; rp++)
-			*rp = calc_reloc(*rp, text_len);
+			*rp = flat_reloc_addr(&fr, *rp);
 	}
 
 	/*
@@ -678,36 +1394,28 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 	 * This has the negative side effect of not allowing a global data
 	 * reference to be statically initialised to _stext (I've moved
 	 * __start to address 4 so that is okay).
+	 *
+	 * Each entry is the offset of a pointer,  which is relocated
+	 * (of course, the offset has to be relocated first).
 	 */
 
 	if (rev > OLD_FLAT_VERSION) {
-		for (i=0; i < relocs; i++) {
-			unsigned long addr;
-
-			/* Get the address of the pointer to be
-			   relocated (of course, the address has to be
-			   relocated first).  */
-			rp = (unsigned long *) calc_reloc(ntohl(reloc[i]), text_len);
-
-			/* Get the pointer's value.  */
-			addr = get_unaligned (rp);
-
-			if (addr != 0) {
-				/*
-				 * Do the relocation.  PIC relocs in the data section are
-				 * already in target order
-				 */
-				addr = calc_reloc(
-						(flags & FLAT_FLAG_GOTPIC) ? addr : ntohl(addr),
-						text_len);
-				/* Write back the relocated pointer.  */
-				put_unaligned (addr, rp);
-			}
+		flat_reloc_start(&it, reloc, relocs, flags);
+		while ((n = flat_reloc_next(&it, off, &hi)) > 0) {
+			flat_reloc_block(&fr, off, n, hi, flags & FLAT_FLAG_GOTPIC);
+			times.relocs += n;
+		}
+		if (n < 0) {
+			printk("BINFMT_FLAT: relocations run past the end of the "
+					"table, killing!\n");
+			send_sig(SIGSEGV, current, 0);
 		}
 	} else {
 		for (i=0; i < relocs; i++)
 			old_reloc(ntohl(reloc[i]));
+		times.relocs = relocs;
 	}
+	times.reloc = flat_usecs(&t);
 
 	/* zero the BSS,  BRK and stack areas */
 	memset((void*)(datapos + data_len), 0, bss_len + 
@@ -731,6 +1439,23 @@ static int load_flat_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 
 	current->mm->start_stack = (unsigned long) create_flat_tables(p, bprm);
 
+#ifdef CONFIG_BINFMT_ZFLAT_CACHE
+	if (zc)
+		flat_cache_put(zc, &start);
+#endif
+
+	us = flat_usecs(&start);
+	flat_total.read += times.read;
+	flat_total.inflate += times.inflate;
+	flat_total.reloc += times.reloc;
+	flat_total.relocs += times.relocs;
+	flat_exec_us += us;
+	flat_execs++;
+	if (flat_trace)
+		printk(KERN_DEBUG "BINFMT_FLAT: %s read %luus inflate %luus "
+				"reloc %luus (%lu) exec %luus\n", bprm->filename,
+				times.read, times.inflate, times.reloc, times.relocs, us);
+
 	DBG_FLT("start_thread(regs=0x%x, entry=0x%x, start_stack=0x%x)\n",
 		regs, textpos + ntohl(hdr->entry), current->mm->start_stack);
 	start_thread(regs,
@@ -750,11 +1475,26 @@ static int load_flat_library(struct file *file)
 
 static int __init init_flat_binfmt(void)
 {
+#ifdef CONFIG_PROC_FS
+	struct proc_dir_entry *ent;
+
+	ent = create_proc_entry("flat_times", S_IFREG | S_IRUGO | S_IWUSR, NULL);
+	if (ent) {
+		ent->read_proc = flat_times_read_proc;
+		ent->write_proc = flat_times_write_proc;
+	}
+#endif
+#ifdef CONFIG_BINFMT_ZFLAT_CACHE
+	flat_cache_init();
+#endif
 	return register_binfmt(&flat_format);
 }
 
 static void __exit exit_flat_binfmt(void)
 {
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("flat_times", NULL);
+#endif
 	unregister_binfmt(&flat_format);
 }
 
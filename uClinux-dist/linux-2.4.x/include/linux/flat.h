@@ -40,6 +40,18 @@ struct flat_hdr {
 #define FLAT_FLAG_GOTPIC 0x0002 /* program is PIC with GOT */
 #define FLAT_FLAG_GZIP   0x0004 /* all but the header is compressed */
 #define FLAT_FLAG_GZDATA 0x0008 /* only data/relocs are compressed (for XIP) */
+#define FLAT_FLAG_RELOCDELTA 0x0100 /* relocs are sorted and delta encoded */
+
+/*
+ * With FLAT_FLAG_RELOCDELTA the reloc_count words at reloc_start do not
+ * hold one offset each.  The first word is the number of relocations,
+ * and the rest is a byte stream of their offsets in ascending order:
+ * a byte n from 1 to 255 is the previous offset (0 to begin with) plus
+ * 2n,  and a 0 byte is followed by the next offset in full,  4 bytes in
+ * network order.  The stream is padded with zeroes to a whole word.
+ * Most relocations are a word or two after the last one,  so the table
+ * is about a quarter of the size.
+ */
 
 
 /*
@@ -79,4 +91,9 @@ typedef union {
 	} reloc;
 } flat_v2_reloc_t;
 
+#ifdef __KERNEL__
+/* drop decompressed ZFLAT programs that are not running (binfmt_flat.c) */
+extern int shrink_flat_cache(int priority, unsigned int gfp_mask);
+#endif
+
 #endif /* _LINUX_FLAT_H */
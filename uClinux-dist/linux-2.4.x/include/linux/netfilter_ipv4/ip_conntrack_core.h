@@ -47,5 +47,16 @@ static inline int ip_conntrack_confirm(struct sk_buff *skb)
 extern struct list_head *ip_conntrack_hash;
 extern struct list_head expect_list;
 DECLARE_RWLOCK_EXTERN(ip_conntrack_lock);
+
+/* Each hash chain is covered by one of these: chain n by lock n %
+   IP_CONNTRACK_LOCKS, which is also the lock for any tuple whose
+   hash_conntrack() value is n (the table size is always a multiple,
+   and resizing takes them all).  Walking every chain needs a read
+   lock on ip_conntrack_lock too, taken first, to keep the table from
+   being resized half way. */
+#define IP_CONNTRACK_LOCKS 16
+DECLARE_RWLOCK_EXTERN(ip_conntrack_chain_lock[]);
+#define IP_CONNTRACK_CHAIN_LOCK(n) \
+	(&ip_conntrack_chain_lock[(n) % IP_CONNTRACK_LOCKS])
 #endif /* _IP_CONNTRACK_CORE_H */
 
@@ -26,6 +26,8 @@
 #include <linux/init.h>
 #include <linux/module.h>
 
+#include "page_extent.h"
+
 /****************************************************************************/
 /*
  *	do we want nasty stuff checking enabled
@@ -34,6 +36,14 @@
 #define SADISTIC_PAGE_ALLOC 1
 #endif
 
+/*
+ *	log every allocation and free,  scripts/pagealloc-replay.c can
+ *	replay the output of dmesg
+ */
+#if 0
+#define TRACE_PAGE_ALLOC 1
+#endif
+
 /*
  *	Some accounting stuff
  */
@@ -57,13 +67,12 @@ pg_data_t *pgdat_list;
 static char *zone_names[MAX_NR_ZONES] = { "DMA", "Normal", "HighMem" };
 
 /*
- *	A simple method to save us searching all the reserved kernel
- *	pages every time is to remember where the first free page is
+ *	A bit for every page that is not free,  the free pages themselves
+ *	are found through the run index in page_extent.c
  */
 
 static char *bit_map = NULL;
 static int	 bit_map_size = 0;
-static int	 first_usable_page = 0;
 static int   _nr_free_pages = 0;
 
 unsigned int nr_free_pages() { return _nr_free_pages; }
@@ -76,6 +85,12 @@ extern struct wait_queue *buffer_wait;
 
 #define DBG_ALLOC(fmt...)
 
+#ifdef TRACE_PAGE_ALLOC
+#define TRACE_ALLOC(fmt...)	printk(fmt)
+#else
+#define TRACE_ALLOC(fmt...)
+#endif
+
 extern unsigned long __get_contiguous_pages(unsigned int gfp_mask,
 			unsigned long num_adjpages, unsigned int align_order);
 static void find_some_memory(int n);
@@ -159,14 +174,13 @@ void free_contiguous_pages(unsigned long addr, unsigned int num_adjpages)
 #ifdef SADISTIC_PAGE_ALLOC
 			mem_set((char *) page_address(p), PAGE_SIZE);
 #endif
-			if (p-mem_map < first_usable_page)
-				first_usable_page = p-mem_map;
-			clear_bit(p-mem_map, bit_map);
 			set_page_count(p, 0);
 			freed++;
 			_nr_free_pages++;
 		}
+		extent_free(map_nr, num_adjpages);
 		restore_flags(flags);
+		TRACE_ALLOC("pa2: f 0x%lx %u\n", addr, num_adjpages);
 
 		if (waitqueue_active(&kswapd_wait))
 			wake_up_interruptible(&kswapd_wait);
@@ -277,8 +291,9 @@ static void find_some_memory(int n)
 
 /****************************************************************************/
 /*
- *	look through the map for a run of consecutive pages that will
- *	hold a # of pages
+ *	find the smallest run of free pages that will hold a # of pages,
+ *	small allocations are taken from the top of the run to keep them
+ *	away from the big ones
  */
 
 unsigned long
@@ -308,39 +323,13 @@ repeat:
  */
 	if (num_adjpages <= _nr_free_pages) {
 
-		int n = 0, little_alloc = 0, ff;
-
-		p = NULL;
-		if (num_adjpages <= 2)
-			little_alloc = bit_map_size;
+		unsigned long n = extent_alloc(num_adjpages, align_order,
+				num_adjpages <= 2);
 
-		ff = find_next_zero_bit(bit_map, bit_map_size,
-				num_adjpages <= 2 ? (little_alloc -= 16) : first_usable_page);
-
-		while (ff + num_adjpages <= bit_map_size || little_alloc > 0) {
-			if (ff + num_adjpages <= bit_map_size) {
-				p = mem_map + ff;
-				if (((unsigned long) page_address(p)) &
-						((PAGE_SIZE << align_order) - 1))
-					n = 0;
-				else
-					for (n = 0; n < num_adjpages; n++, p++) {
-						if (test_bit(p-mem_map, bit_map))
-							break;
-#if 0
-						if (dma && !PageDMA(p))
-							break;
-#endif
-					}
-				if (n >= num_adjpages)
-					break;
-			}
-			ff = find_next_zero_bit(bit_map, bit_map_size,
-					num_adjpages <= 2 ? (little_alloc -= 16) : (ff + n + 1));
-		}
-
-		if (p && n >= num_adjpages) {
+		if (n != EXTENT_NONE) {
+			p = mem_map + n + num_adjpages;
 			_nr_free_pages -= num_adjpages;
+			n = num_adjpages;
 			while (n-- > 0) {
 				p--;
 #ifdef SADISTIC_PAGE_ALLOC
@@ -348,7 +337,6 @@ repeat:
 					printk("allocated a non-free page\n");
 #endif
 				set_page_count(p, 1);
-				set_bit(p-mem_map, bit_map);
 				p->index = 0xa110c200 | num_adjpages;
 				if (num_adjpages > 0x1ff)
 					BUG();
@@ -367,6 +355,8 @@ repeat:
 				}
 			} while ((pgdat = pgdat->node_next));
 			restore_flags(flags);
+			TRACE_ALLOC("pa2: a 0x%lx %lu %u\n",
+					(unsigned long) page_address(p), num_adjpages, align_order);
 			return((unsigned long) page_address(p));
 		}
 	}
@@ -377,6 +367,7 @@ repeat:
 			goto repeat;
 		printk("%s: allocation of %d pages failed!\n", current->comm,
 				(int) num_adjpages);
+		TRACE_ALLOC("pa2: a 0 %lu %u\n", num_adjpages, align_order);
 #ifdef CONFIG_MEM_MAP
 		mem_map_read_proc(NULL, NULL, 0, 0, 0, 0);
 #endif
@@ -415,6 +406,8 @@ print_free_areas(char *buffer, int count)
  	unsigned long	min_used = bit_map_size * PAGE_SIZE;
 	unsigned long	max_free=0, avg_free=0, free_blks=0;
 	unsigned long	max_used=0, avg_used=0, used_blks=0;
+	unsigned long	largest;
+	int				i;
 
 	find_some_memory(1);
 
@@ -472,6 +465,28 @@ print_free_areas(char *buffer, int count)
 			used_blks, min_used, max_used, avg_used / used_blks);
 	FIXUP(got_data);
 
+	/*
+	 *	how much of the free memory a big allocation can't use
+	 */
+	largest = extent_largest();
+	PRINTK("Largest free:%6lu (%lukB), %lu%% unusable\n", largest,
+			largest << (PAGE_SHIFT-10), _nr_free_pages ?
+			100 - (largest * 100) / _nr_free_pages : 0);
+	FIXUP(got_data);
+	PRINTK("Free runs: ");
+	for (i = 0; i < EXTENT_CLASSES; i++) {
+		if (extent_stats.runs[i] == 0)
+			continue;
+		PRINTK(" %d:%lu", 1 << i, extent_stats.runs[i]);
+		FIXUP(got_data);
+	}
+	PRINTK("\n");
+	FIXUP(got_data);
+	PRINTK("Allocs: %10lu failed=%lu runs scanned=%lu merged=%lu\n",
+			extent_stats.allocs, extent_stats.fails,
+			extent_stats.scanned, extent_stats.merges);
+	FIXUP(got_data);
+
 got_data:
 	restore_flags(flags);
 	return(len);
@@ -621,8 +636,7 @@ void __init free_area_init_core(int nid, pg_data_t *pgdat, struct page **gmap,
 		memlist_init(&p->list);
 		set_bit(p-mem_map, bit_map);
 	}
-
-	first_usable_page = MAP_NR(p);
+	extent_init(mem_map, bit_map, bit_map_size);
 
 	offset = lmem_map - mem_map;	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
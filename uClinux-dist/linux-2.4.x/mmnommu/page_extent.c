@@ -0,0 +1,226 @@
+/****************************************************************************/
+/*
+ *  linux/mmnommu/page_extent.c
+ *
+ *	Free run index for page_alloc2.c.
+ *
+ *	Every maximal run of free pages sits on one of EXTENT_CLASSES
+ *	lists,  chosen by the log2 of its length.  The first and last page
+ *	of a run hold its length in page->index,  so freed pages are merged
+ *	with the runs either side of them without a search,  and the first
+ *	page is linked onto its list through page->list.  Neither field is
+ *	used while a page is free.
+ *
+ *	Allocation is best fit.  The lists are looked at from the size of
+ *	the request up,  and every run on a list is larger than any run on
+ *	the lists before it,  so the first list with a run that holds the
+ *	request (once aligned) has the best one.
+ *
+ *	The bit map page_alloc2.c uses for /proc/mem_map is kept up to date
+ *	here.  Everything is called with interrupts off.
+ *
+ *	scripts/pagealloc-replay.c builds this file in user space.
+ */
+/****************************************************************************/
+
+#ifdef __KERNEL__
+#include <linux/config.h>
+#include <linux/mm.h>
+#include <linux/list.h>
+#include <linux/string.h>
+#include <asm/bitops.h>
+#endif
+
+#include "page_extent.h"
+
+/****************************************************************************/
+
+static struct list_head	extent_lists[EXTENT_CLASSES];
+static unsigned long	extent_used;	/* a bit for each non-empty list */
+static struct page		*extent_map;
+static void				*extent_bits;
+static unsigned long	extent_size;
+
+struct extent_stats extent_stats;
+
+/****************************************************************************/
+
+static inline int
+extent_class(unsigned long n)
+{
+	int c = 0;
+
+	while ((n >>= 1) && c < EXTENT_CLASSES - 1)
+		c++;
+	return(c);
+}
+
+static void
+extent_link(unsigned long start, unsigned long n)
+{
+	int c = extent_class(n);
+
+	extent_map[start].index = n;
+	extent_map[start + n - 1].index = n;
+	list_add(&extent_map[start].list, &extent_lists[c]);
+	extent_used |= 1UL << c;
+	extent_stats.runs[c]++;
+}
+
+static void
+extent_unlink(unsigned long start)
+{
+	int c = extent_class(extent_map[start].index);
+
+	list_del(&extent_map[start].list);
+	INIT_LIST_HEAD(&extent_map[start].list);
+	if (list_empty(&extent_lists[c]))
+		extent_used &= ~(1UL << c);
+	extent_stats.runs[c]--;
+}
+
+/****************************************************************************/
+/*
+ *	where n pages aligned to mask would go in the run at start,
+ *	at the bottom of the run or the top
+ */
+
+static unsigned long
+extent_place(unsigned long start, unsigned long len, unsigned long n,
+		unsigned long mask, int top)
+{
+	unsigned long addr, skip;
+
+	if (len < n)
+		return(EXTENT_NONE);
+	if (top) {
+		addr = (unsigned long) page_address(extent_map + start + len - n);
+		skip = (addr & mask) >> PAGE_SHIFT;
+		return(skip <= len - n ? start + len - n - skip : EXTENT_NONE);
+	}
+	addr = (unsigned long) page_address(extent_map + start);
+	skip = ((mask + 1 - (addr & mask)) & mask) >> PAGE_SHIFT;
+	return(skip <= len - n ? start + skip : EXTENT_NONE);
+}
+
+/****************************************************************************/
+
+void
+extent_init(struct page *map, void *bits, unsigned long npages)
+{
+	int c;
+
+	for (c = 0; c < EXTENT_CLASSES; c++)
+		INIT_LIST_HEAD(&extent_lists[c]);
+	extent_used = 0;
+	extent_map = map;
+	extent_bits = bits;
+	extent_size = npages;
+	memset(&extent_stats, 0, sizeof(extent_stats));
+}
+
+/****************************************************************************/
+/*
+ *	take num_adjpages from the smallest run that holds them,  return
+ *	the first page number or EXTENT_NONE
+ */
+
+unsigned long
+extent_alloc(unsigned long num_adjpages, unsigned int align_order, int top)
+{
+	unsigned long		 mask = (PAGE_SIZE << align_order) - 1;
+	unsigned long		 best = EXTENT_NONE, best_len = 0, pos = 0;
+	unsigned long		 start, len, p, i;
+	struct list_head	*l;
+	int					 c;
+
+	extent_stats.allocs++;
+	for (c = extent_class(num_adjpages); c < EXTENT_CLASSES; c++) {
+		if ((extent_used & (1UL << c)) == 0)
+			continue;
+		list_for_each(l, &extent_lists[c]) {
+			start = list_entry(l, struct page, list) - extent_map;
+			len = extent_map[start].index;
+			extent_stats.scanned++;
+			if (best != EXTENT_NONE && len >= best_len)
+				continue;
+			p = extent_place(start, len, num_adjpages, mask, top);
+			if (p == EXTENT_NONE)
+				continue;
+			best = start;
+			best_len = len;
+			pos = p;
+			if (len == num_adjpages)
+				break;
+		}
+		if (best != EXTENT_NONE)
+			break;
+	}
+	if (best == EXTENT_NONE) {
+		extent_stats.fails++;
+		return(EXTENT_NONE);
+	}
+
+	extent_unlink(best);
+	if (pos > best)
+		extent_link(best, pos - best);
+	if (pos + num_adjpages < best + best_len)
+		extent_link(pos + num_adjpages, best + best_len - pos - num_adjpages);
+	for (i = pos; i < pos + num_adjpages; i++)
+		set_bit(i, extent_bits);
+	return(pos);
+}
+
+/****************************************************************************/
+/*
+ *	give back pages that were allocated,  joining them to the free
+ *	runs either side
+ */
+
+void
+extent_free(unsigned long start, unsigned long num_adjpages)
+{
+	unsigned long i, n = num_adjpages;
+
+	for (i = start; i < start + n; i++)
+		clear_bit(i, extent_bits);
+
+	if (start > 0 && !test_bit(start - 1, extent_bits)) {
+		i = extent_map[start - 1].index;
+		start -= i;
+		n += i;
+		extent_unlink(start);
+		extent_stats.merges++;
+	}
+	if (start + n < extent_size && !test_bit(start + n, extent_bits)) {
+		i = extent_map[start + n].index;
+		extent_unlink(start + n);
+		n += i;
+		extent_stats.merges++;
+	}
+	extent_link(start, n);
+}
+
+/****************************************************************************/
+
+unsigned long
+extent_largest(void)
+{
+	unsigned long		 len, max = 0;
+	struct list_head	*l;
+	int					 c;
+
+	for (c = EXTENT_CLASSES - 1; c >= 0; c--) {
+		if ((extent_used & (1UL << c)) == 0)
+			continue;
+		list_for_each(l, &extent_lists[c]) {
+			len = list_entry(l, struct page, list)->index;
+			if (len > max)
+				max = len;
+		}
+		break;
+	}
+	return(max);
+}
+
+/****************************************************************************/
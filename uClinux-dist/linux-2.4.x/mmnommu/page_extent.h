@@ -0,0 +1,35 @@
+/****************************************************************************/
+/*
+ *  linux/mmnommu/page_extent.h
+ *
+ *	Free run index used by page_alloc2.c,  see page_extent.c
+ */
+/****************************************************************************/
+#ifndef _MMNOMMU_PAGE_EXTENT_H
+#define _MMNOMMU_PAGE_EXTENT_H
+
+/*
+ *	runs of 2^n to 2^(n+1)-1 pages are kept on list n,  the last list
+ *	takes everything bigger
+ */
+#define EXTENT_CLASSES	16
+#define EXTENT_NONE		(~0UL)
+
+struct extent_stats {
+	unsigned long	allocs;		/* calls to extent_alloc */
+	unsigned long	fails;		/* ... that found nothing */
+	unsigned long	scanned;	/* free runs looked at */
+	unsigned long	merges;		/* frees joined to a neighbouring run */
+	unsigned long	runs[EXTENT_CLASSES];	/* free runs on each list */
+};
+
+extern struct extent_stats extent_stats;
+
+extern void extent_init(struct page *map, void *bits, unsigned long npages);
+extern unsigned long extent_alloc(unsigned long num_adjpages,
+			unsigned int align_order, int top);
+extern void extent_free(unsigned long start, unsigned long num_adjpages);
+extern unsigned long extent_largest(void);
+
+/****************************************************************************/
+#endif /* _MMNOMMU_PAGE_EXTENT_H */
@@ -26,6 +26,7 @@
 #include <linux/file.h>
 #include <linux/compiler.h>
 #include <linux/config.h>
+#include <linux/flat.h>
 
 #include <asm/pgalloc.h>
 
@@ -598,6 +599,9 @@ static int shrink_caches(zone_t * classzone, int priority, unsigned int gfp_mask
 #ifdef CONFIG_QUOTA
 	shrink_dqcache_memory(DEF_PRIORITY, gfp_mask);
 #endif
+#ifdef CONFIG_BINFMT_ZFLAT_CACHE
+	shrink_flat_cache(priority, gfp_mask);
+#endif
 
 	return nr_pages;
 }
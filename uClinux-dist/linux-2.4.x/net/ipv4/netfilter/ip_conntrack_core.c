@@ -23,13 +23,21 @@
 #include <linux/stddef.h>
 #include <linux/sysctl.h>
 #include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/jhash.h>
 /* For ERR_PTR().  Yeah, I know... --RR */
 #include <linux/fs.h>
 
-/* This rwlock protects the main hash table, protocol/helper/expected
-   registrations, conntrack timers*/
-#define ASSERT_READ_LOCK(x) MUST_BE_READ_LOCKED(&ip_conntrack_lock)
-#define ASSERT_WRITE_LOCK(x) MUST_BE_WRITE_LOCKED(&ip_conntrack_lock)
+/* This rwlock protects protocol/helper/expected registrations,
+   conntrack timers and the size of the hash table; the hash chains
+   have their own locks (see ip_conntrack_core.h). */
+#define ASSERT_READ_LOCK(x) MUST_BE_READ_LOCKED(conntrack_lock_of(x))
+#define ASSERT_WRITE_LOCK(x) MUST_BE_WRITE_LOCKED(conntrack_lock_of(x))
+#ifdef CONFIG_NETFILTER_DEBUG
+struct rwlock_debug;
+static inline struct rwlock_debug *
+conntrack_lock_of(const struct list_head *head);
+#endif
 
 #include <linux/netfilter_ipv4/ip_conntrack.h>
 #include <linux/netfilter_ipv4/ip_conntrack_protocol.h>
@@ -44,6 +52,7 @@
 #endif
 
 DECLARE_RWLOCK(ip_conntrack_lock);
+DECLARE_RWLOCKS(ip_conntrack_chain_lock, IP_CONNTRACK_LOCKS);
 
 void (*ip_conntrack_destroyed)(struct ip_conntrack *conntrack) = NULL;
 LIST_HEAD(expect_list);
@@ -54,9 +63,24 @@ static int ip_conntrack_max = 0;
 static atomic_t ip_conntrack_count = ATOMIC_INIT(0);
 struct list_head *ip_conntrack_hash;
 static kmem_cache_t *ip_conntrack_cachep;
+static u_int32_t ip_conntrack_hash_rnd;
+static int ip_conntrack_hash_rnd_initted;
+static unsigned long ip_conntrack_resizes;
 
 extern struct ip_conntrack_protocol ip_conntrack_generic_protocol;
 
+#ifdef CONFIG_NETFILTER_DEBUG
+/* Which lock should be held to look at a list */
+static inline struct rwlock_debug *
+conntrack_lock_of(const struct list_head *head)
+{
+	if (head >= ip_conntrack_hash
+	    && head < ip_conntrack_hash + ip_conntrack_htable_size)
+		return IP_CONNTRACK_CHAIN_LOCK(head - ip_conntrack_hash);
+	return &ip_conntrack_lock;
+}
+#endif
+
 static inline int proto_cmpfn(const struct ip_conntrack_protocol *curr,
 			      u_int8_t protocol)
 {
@@ -95,20 +119,49 @@ static inline void ip_conntrack_put(struct ip_conntrack *ct)
 	nf_conntrack_put(&ct->infos[0]);
 }
 
+/* Keyed, so a sender can't pick tuples that all land in one chain
+   (adding the fields up put most flows from behind a NAT box in a
+   handful).  The key is set with the first connection, and doesn't
+   change when the table is resized, so a tuple's hash and chain lock
+   stay the same; only the chain, conntrack_chain(), moves. */
 static inline u_int32_t
 hash_conntrack(const struct ip_conntrack_tuple *tuple)
 {
 #if 0
 	dump_tuple(tuple);
 #endif
-	/* ntohl because more differences in low bits. */
-	/* To ensure that halves of the same connection don't hash
-	   clash, we add the source per-proto again. */
-	return (ntohl(tuple->src.ip + tuple->dst.ip
-		     + tuple->src.u.all + tuple->dst.u.all
-		     + tuple->dst.protonum)
-		+ ntohs(tuple->src.u.all))
-		% ip_conntrack_htable_size;
+	return jhash_3words(tuple->src.ip,
+			    tuple->dst.ip ^ tuple->dst.protonum,
+			    tuple->src.u.all
+			    | ((u_int32_t)tuple->dst.u.all << 16),
+			    ip_conntrack_hash_rnd);
+}
+
+/* Needs the chain lock for hash. */
+#define conntrack_chain(hash) \
+	(&ip_conntrack_hash[(hash) % ip_conntrack_htable_size])
+
+/* Write lock the chains for two hashes, lowest lock first. */
+static inline void
+write_lock_chains(u_int32_t hash, u_int32_t repl_hash)
+{
+	unsigned int a = hash % IP_CONNTRACK_LOCKS;
+	unsigned int b = repl_hash % IP_CONNTRACK_LOCKS;
+
+	WRITE_LOCK(&ip_conntrack_chain_lock[a < b ? a : b]);
+	if (a != b)
+		WRITE_LOCK(&ip_conntrack_chain_lock[a < b ? b : a]);
+}
+
+static inline void
+write_unlock_chains(u_int32_t hash, u_int32_t repl_hash)
+{
+	unsigned int a = hash % IP_CONNTRACK_LOCKS;
+	unsigned int b = repl_hash % IP_CONNTRACK_LOCKS;
+
+	if (a != b)
+		WRITE_UNLOCK(&ip_conntrack_chain_lock[a < b ? b : a]);
+	WRITE_UNLOCK(&ip_conntrack_chain_lock[a < b ? a : b]);
 }
 
 inline int
@@ -153,16 +206,19 @@ invert_tuple(struct ip_conntrack_tuple *inverse,
 static void
 clean_from_lists(struct ip_conntrack *ct)
 {
+	u_int32_t hash, repl_hash;
+
 	MUST_BE_WRITE_LOCKED(&ip_conntrack_lock);
+	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+
 	/* Remove from both hash lists: must not NULL out next ptrs,
            otherwise we'll look unconfirmed.  Fortunately, LIST_DELETE
            doesn't do this. --RR */
-	LIST_DELETE(&ip_conntrack_hash
-		    [hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple)],
-		    &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-	LIST_DELETE(&ip_conntrack_hash
-		    [hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple)],
-		    &ct->tuplehash[IP_CT_DIR_REPLY]);
+	write_lock_chains(hash, repl_hash);
+	LIST_DELETE(conntrack_chain(hash), &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
+	LIST_DELETE(conntrack_chain(repl_hash), &ct->tuplehash[IP_CT_DIR_REPLY]);
+	write_unlock_chains(hash, repl_hash);
 	/* If our expected is in the list, take it out. */
 	if (ct->expected.expectant) {
 		IP_NF_ASSERT(list_inlist(&expect_list, &ct->expected));
@@ -203,19 +259,19 @@ conntrack_tuple_cmp(const struct ip_conntrack_tuple_hash *i,
 		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
 	return i->ctrack != ignored_conntrack
 		&& ip_ct_tuple_equal(tuple, &i->tuple);
 }
 
+/* Needs the chain lock for hash. */
 static struct ip_conntrack_tuple_hash *
-__ip_conntrack_find(const struct ip_conntrack_tuple *tuple,
+__ip_conntrack_find(const struct ip_conntrack_tuple *tuple, u_int32_t hash,
 		    const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-	h = LIST_FIND(&ip_conntrack_hash[hash_conntrack(tuple)],
+	MUST_BE_READ_LOCKED(IP_CONNTRACK_CHAIN_LOCK(hash));
+	h = LIST_FIND(conntrack_chain(hash),
 		      conntrack_tuple_cmp,
 		      struct ip_conntrack_tuple_hash *,
 		      tuple, ignored_conntrack);
@@ -228,12 +284,13 @@ ip_conntrack_find_get(const struct ip_conntrack_tuple *tuple,
 		      const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+	u_int32_t hash = hash_conntrack(tuple);
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
+	READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
+	h = __ip_conntrack_find(tuple, hash, ignored_conntrack);
 	if (h)
 		atomic_inc(&h->ctrack->ct_general.use);
-	READ_UNLOCK(&ip_conntrack_lock);
+	READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
 
 	return h;
 }
@@ -263,7 +320,7 @@ ip_conntrack_get(struct sk_buff *skb, enum ip_conntrack_info *ctinfo)
 int
 __ip_conntrack_confirm(struct nf_ct_info *nfct)
 {
-	unsigned int hash, repl_hash;
+	u_int32_t hash, repl_hash;
 	struct ip_conntrack *ct;
 	enum ip_conntrack_info ctinfo;
 
@@ -289,21 +346,24 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 	IP_NF_ASSERT(!is_confirmed(ct));
 	DEBUGP("Confirming conntrack %p\n", ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	/* A read lock keeps ip_ct_refresh() off the timer; other
+	   confirms only wait if they want the same chains. */
+	READ_LOCK(&ip_conntrack_lock);
+	write_lock_chains(hash, repl_hash);
 	/* See if there's one in the list already, including reverse:
            NAT could have grabbed it without realizing, since we're
            not in the hash.  If there is, we lost race. */
-	if (!LIST_FIND(&ip_conntrack_hash[hash],
+	if (!LIST_FIND(conntrack_chain(hash),
 		       conntrack_tuple_cmp,
 		       struct ip_conntrack_tuple_hash *,
 		       &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, NULL)
-	    && !LIST_FIND(&ip_conntrack_hash[repl_hash],
+	    && !LIST_FIND(conntrack_chain(repl_hash),
 			  conntrack_tuple_cmp,
 			  struct ip_conntrack_tuple_hash *,
 			  &ct->tuplehash[IP_CT_DIR_REPLY].tuple, NULL)) {
-		list_prepend(&ip_conntrack_hash[hash],
+		list_prepend(conntrack_chain(hash),
 			     &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-		list_prepend(&ip_conntrack_hash[repl_hash],
+		list_prepend(conntrack_chain(repl_hash),
 			     &ct->tuplehash[IP_CT_DIR_REPLY]);
 		/* Timer relative to confirmation time, not original
 		   setting time, otherwise we'd get timer wrap in
@@ -311,11 +371,13 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 		ct->timeout.expires += jiffies;
 		add_timer(&ct->timeout);
 		atomic_inc(&ct->ct_general.use);
-		WRITE_UNLOCK(&ip_conntrack_lock);
+		write_unlock_chains(hash, repl_hash);
+		READ_UNLOCK(&ip_conntrack_lock);
 		return NF_ACCEPT;
 	}
 
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	write_unlock_chains(hash, repl_hash);
+	READ_UNLOCK(&ip_conntrack_lock);
 	return NF_DROP;
 }
 
@@ -326,10 +388,11 @@ ip_conntrack_tuple_taken(const struct ip_conntrack_tuple *tuple,
 			 const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+	u_int32_t hash = hash_conntrack(tuple);
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	READ_UNLOCK(&ip_conntrack_lock);
+	READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
+	h = __ip_conntrack_find(tuple, hash, ignored_conntrack);
+	READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
 
 	return h != NULL;
 }
@@ -432,17 +495,19 @@ static inline int unreplied(const struct ip_conntrack_tuple_hash *i)
 	return !(i->ctrack->status & IPS_ASSURED);
 }
 
-static int early_drop(struct list_head *chain)
+/* Drop from the chain hash falls in: a hash, or a chain number */
+static int early_drop(u_int32_t hash)
 {
 	/* Traverse backwards: gives us oldest, which is roughly LRU */
 	struct ip_conntrack_tuple_hash *h;
 	int dropped = 0;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = LIST_FIND(chain, unreplied, struct ip_conntrack_tuple_hash *);
+	READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
+	h = LIST_FIND(conntrack_chain(hash), unreplied,
+		      struct ip_conntrack_tuple_hash *);
 	if (h)
 		atomic_inc(&h->ctrack->ct_general.use);
-	READ_UNLOCK(&ip_conntrack_lock);
+	READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
 
 	if (!h)
 		return dropped;
@@ -477,11 +542,19 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 {
 	struct ip_conntrack *conntrack;
 	struct ip_conntrack_tuple repl_tuple;
-	size_t hash, repl_hash;
+	u_int32_t hash;
 	struct ip_conntrack_expect *expected;
 	int i;
 	static unsigned int drop_next = 0;
 
+	/* Nothing is hashed before the first connection, so this is the
+	   last chance to pick the key with some entropy about. */
+	if (!ip_conntrack_hash_rnd_initted) {
+		get_random_bytes(&ip_conntrack_hash_rnd,
+				 sizeof(ip_conntrack_hash_rnd));
+		ip_conntrack_hash_rnd_initted = 1;
+	}
+
 	hash = hash_conntrack(tuple);
 
 	if (ip_conntrack_max &&
@@ -491,8 +564,8 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
                    bomb one hash chain). */
 		if (drop_next >= ip_conntrack_htable_size)
 			drop_next = 0;
-		if (!early_drop(&ip_conntrack_hash[drop_next++])
-		    && !early_drop(&ip_conntrack_hash[hash])) {
+		if (!early_drop(drop_next++)
+		    && !early_drop(hash)) {
 			if (net_ratelimit())
 				printk(KERN_WARNING
 				       "ip_conntrack: table full, dropping"
@@ -505,7 +578,6 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 		DEBUGP("Can't invert tuple.\n");
 		return NULL;
 	}
-	repl_hash = hash_conntrack(&repl_tuple);
 
 	conntrack = kmem_cache_alloc(ip_conntrack_cachep, GFP_ATOMIC);
 	if (!conntrack) {
@@ -770,8 +842,14 @@ void ip_conntrack_unexpect_related(struct ip_conntrack *related_to)
 int ip_conntrack_alter_reply(struct ip_conntrack *conntrack,
 			     const struct ip_conntrack_tuple *newreply)
 {
+	u_int32_t hash = hash_conntrack(newreply);
+	int taken;
+
 	WRITE_LOCK(&ip_conntrack_lock);
-	if (__ip_conntrack_find(newreply, conntrack)) {
+	READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
+	taken = __ip_conntrack_find(newreply, hash, conntrack) != NULL;
+	READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(hash));
+	if (taken) {
 		WRITE_UNLOCK(&ip_conntrack_lock);
 		return 0;
 	}
@@ -825,9 +903,12 @@ void ip_conntrack_helper_unregister(struct ip_conntrack_helper *me)
 	LIST_DELETE(&helpers, me);
 
 	/* Get rid of expecteds, set helpers to NULL. */
-	for (i = 0; i < ip_conntrack_htable_size; i++)
+	for (i = 0; i < ip_conntrack_htable_size; i++) {
+		WRITE_LOCK(IP_CONNTRACK_CHAIN_LOCK(i));
 		LIST_FIND_W(&ip_conntrack_hash[i], unhelp,
 			    struct ip_conntrack_tuple_hash *, me);
+		WRITE_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(i));
+	}
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
 	/* Someone could be still looking at the helper in a bh. */
@@ -934,11 +1015,13 @@ get_next_corpse(int (*kill)(const struct ip_conntrack *i, void *data),
 
 	READ_LOCK(&ip_conntrack_lock);
 	for (i = 0; !h && i < ip_conntrack_htable_size; i++) {
+		READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(i));
 		h = LIST_FIND(&ip_conntrack_hash[i], do_kill,
 			      struct ip_conntrack_tuple_hash *, kill, data);
+		if (h)
+			atomic_inc(&h->ctrack->ct_general.use);
+		READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(i));
 	}
-	if (h)
-		atomic_inc(&h->ctrack->ct_general.use);
 	READ_UNLOCK(&ip_conntrack_lock);
 
 	return h;
@@ -1015,15 +1098,150 @@ static struct nf_sockopt_ops so_getorigdst
     SO_ORIGINAL_DST, SO_ORIGINAL_DST+1, &getorigdst,
     0, NULL };
 
+/* Most chains the table may have: 8MB of list heads on 32-bit. */
+#define IP_CONNTRACK_MAX_BUCKETS (1 << 20)
+
+/* Chains come in multiples of IP_CONNTRACK_LOCKS, so a hash maps to
+   the same chain lock whatever the size. */
+static struct list_head *alloc_hashtable(unsigned int *size)
+{
+	struct list_head *hash;
+	unsigned int i;
+
+	if (*size > IP_CONNTRACK_MAX_BUCKETS)
+		*size = IP_CONNTRACK_MAX_BUCKETS;
+	*size = (*size + IP_CONNTRACK_LOCKS - 1) / IP_CONNTRACK_LOCKS
+		* IP_CONNTRACK_LOCKS;
+	if (*size == 0)
+		*size = IP_CONNTRACK_LOCKS;
+	if (*size > ~0UL / sizeof(struct list_head))
+		return NULL;
+
+	hash = vmalloc(sizeof(struct list_head) * *size);
+	if (hash)
+		for (i = 0; i < *size; i++)
+			INIT_LIST_HEAD(&hash[i]);
+	return hash;
+}
+
+/* Move every connection to a new table of (about) size chains.  Takes
+   all the locks, so everything else waits while it runs. */
+static int ip_conntrack_resize(unsigned int size)
+{
+	struct list_head *hash, *old;
+	struct ip_conntrack_tuple_hash *h;
+	unsigned int i, old_size;
+
+	hash = alloc_hashtable(&size);
+	if (!hash)
+		return -ENOMEM;
+
+	WRITE_LOCK(&ip_conntrack_lock);
+	for (i = 0; i < IP_CONNTRACK_LOCKS; i++)
+		WRITE_LOCK(&ip_conntrack_chain_lock[i]);
+
+	old = ip_conntrack_hash;
+	old_size = ip_conntrack_htable_size;
+	for (i = 0; i < old_size; i++) {
+		/* Keep the order of each chain, early_drop() likes it */
+		while (!list_empty(&old[i])) {
+			h = (struct ip_conntrack_tuple_hash *)old[i].next;
+			list_del(&h->list);
+			list_add_tail(&h->list,
+				      &hash[hash_conntrack(&h->tuple) % size]);
+		}
+	}
+	ip_conntrack_hash = hash;
+	ip_conntrack_htable_size = size;
+	ip_conntrack_resizes++;
+
+	for (i = IP_CONNTRACK_LOCKS; i-- > 0; )
+		WRITE_UNLOCK(&ip_conntrack_chain_lock[i]);
+	WRITE_UNLOCK(&ip_conntrack_lock);
+
+	vfree(old);
+	return 0;
+}
+
+/* How long the chains are, for /proc/net/ip_conntrack_hash. */
+static int
+conntrack_hash_info(char *buffer, char **start, off_t offset, int length)
+{
+	unsigned int chains[17], i, n, entries = 0, longest = 0;
+	struct list_head *l;
+	int len;
+
+	memset(chains, 0, sizeof(chains));
+	READ_LOCK(&ip_conntrack_lock);
+	for (i = 0; i < ip_conntrack_htable_size; i++) {
+		n = 0;
+		READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(i));
+		list_for_each(l, &ip_conntrack_hash[i])
+			n++;
+		READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(i));
+		chains[n < 16 ? n : 16]++;
+		entries += n;
+		if (n > longest)
+			longest = n;
+	}
+
+	len = sprintf(buffer, "buckets %u entries %u longest %u resizes %lu\n"
+		      "length buckets\n", ip_conntrack_htable_size, entries,
+		      longest, ip_conntrack_resizes);
+	READ_UNLOCK(&ip_conntrack_lock);
+	for (i = 0; i < 17; i++)
+		len += sprintf(buffer + len, "%5u%c %7u\n",
+			       i, i == 16 ? '+' : ' ', chains[i]);
+
+	if (offset >= len) {
+		*start = buffer;
+		return 0;
+	}
+	*start = buffer + offset;
+	len -= offset;
+	if (len > length)
+		len = length;
+	return len;
+}
+
 #define NET_IP_CONNTRACK_MAX 2089
 #define NET_IP_CONNTRACK_MAX_NAME "ip_conntrack_max"
+#define NET_IP_CONNTRACK_BUCKETS 2090
+#define NET_IP_CONNTRACK_BUCKETS_NAME "ip_conntrack_buckets"
 
 #ifdef CONFIG_SYSCTL
 static struct ctl_table_header *ip_conntrack_sysctl_header;
+static int ip_conntrack_buckets;
+static DECLARE_MUTEX(ip_conntrack_buckets_sem);
+
+/* Writing ip_conntrack_buckets resizes the table; ip_conntrack_max
+   stays as it is.  Sizes past IP_CONNTRACK_MAX_BUCKETS are refused. */
+static int
+proc_conntrack_buckets(ctl_table *ctl, int write, struct file *filp,
+		       void *buffer, size_t *lenp)
+{
+	int ret;
+
+	down(&ip_conntrack_buckets_sem);
+	ip_conntrack_buckets = ip_conntrack_htable_size;
+	ret = proc_dointvec(ctl, write, filp, buffer, lenp);
+	if (ret == 0 && write) {
+		if (ip_conntrack_buckets <= 0
+		    || ip_conntrack_buckets > IP_CONNTRACK_MAX_BUCKETS)
+			ret = -EINVAL;
+		else if (ip_conntrack_buckets != ip_conntrack_htable_size)
+			ret = ip_conntrack_resize(ip_conntrack_buckets);
+	}
+	up(&ip_conntrack_buckets_sem);
+	return ret;
+}
 
 static ctl_table ip_conntrack_table[] = {
 	{ NET_IP_CONNTRACK_MAX, NET_IP_CONNTRACK_MAX_NAME, &ip_conntrack_max,
 	  sizeof(ip_conntrack_max), 0644,  NULL, proc_dointvec },
+	{ NET_IP_CONNTRACK_BUCKETS, NET_IP_CONNTRACK_BUCKETS_NAME,
+	  &ip_conntrack_buckets, sizeof(ip_conntrack_buckets), 0644, NULL,
+	  proc_conntrack_buckets },
  	{ 0 }
 };
 
@@ -1050,6 +1268,7 @@ void ip_conntrack_cleanup(void)
 #ifdef CONFIG_SYSCTL
 	unregister_sysctl_table(ip_conntrack_sysctl_header);
 #endif
+	proc_net_remove("ip_conntrack_hash");
 	ip_ct_attach = NULL;
 	/* This makes sure all current packets have passed through
            netfilter framework.  Roll on, two-stage module
@@ -1074,7 +1293,6 @@ MODULE_PARM(hashsize, "i");
 
 int __init ip_conntrack_init(void)
 {
-	unsigned int i;
 	int ret;
 
 	/* Idea from tcp.c: use 1/16384 of memory.  On i386: 32MB
@@ -1090,17 +1308,16 @@ int __init ip_conntrack_init(void)
 		if (ip_conntrack_htable_size < 16)
 			ip_conntrack_htable_size = 16;
 	}
+	ret = nf_register_sockopt(&so_getorigdst);
+	if (ret != 0)
+		return ret;
+
+	ip_conntrack_hash = alloc_hashtable(&ip_conntrack_htable_size);
 	ip_conntrack_max = 8 * ip_conntrack_htable_size;
 
 	printk("ip_conntrack (%u buckets, %d max)\n",
 	       ip_conntrack_htable_size, ip_conntrack_max);
 
-	ret = nf_register_sockopt(&so_getorigdst);
-	if (ret != 0)
-		return ret;
-
-	ip_conntrack_hash = vmalloc(sizeof(struct list_head)
-				    * ip_conntrack_htable_size);
 	if (!ip_conntrack_hash) {
 		nf_unregister_sockopt(&so_getorigdst);
 		return -ENOMEM;
@@ -1124,9 +1341,6 @@ int __init ip_conntrack_init(void)
 	list_append(&protocol_list, &ip_conntrack_protocol_icmp);
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
-	for (i = 0; i < ip_conntrack_htable_size; i++)
-		INIT_LIST_HEAD(&ip_conntrack_hash[i]);
-
 /* This is fucking braindead.  There is NO WAY of doing this without
    the CONFIG_SYSCTL unless you don't want to detect errors.
    Grrr... --RR */
@@ -1141,6 +1355,8 @@ int __init ip_conntrack_init(void)
 	}
 #endif /*CONFIG_SYSCTL*/
 
+	proc_net_create("ip_conntrack_hash", 0, conntrack_hash_info);
+
 	/* For use by ipt_REJECT */
 	ip_ct_attach = ip_conntrack_attach;
 	return ret;
@@ -137,10 +137,14 @@ list_conntracks(char *buffer, char **start, off_t offset, int length)
 	READ_LOCK(&ip_conntrack_lock);
 	/* Traverse hash; print originals then reply. */
 	for (i = 0; i < ip_conntrack_htable_size; i++) {
+		READ_LOCK(IP_CONNTRACK_CHAIN_LOCK(i));
 		if (LIST_FIND(&ip_conntrack_hash[i], conntrack_iterate,
 			      struct ip_conntrack_tuple_hash *,
-			      buffer, offset, &upto, &len, length))
+			      buffer, offset, &upto, &len, length)) {
+			READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(i));
 			goto finished;
+		}
+		READ_UNLOCK(IP_CONNTRACK_CHAIN_LOCK(i));
 	}
 
 	/* Now iterate through expecteds. */
@@ -345,3 +349,4 @@ EXPORT_SYMBOL(ip_conntrack_expect_related);
 EXPORT_SYMBOL(ip_conntrack_tuple_taken);
 EXPORT_SYMBOL(ip_ct_gather_frags);
 EXPORT_SYMBOL(ip_conntrack_htable_size);
+EXPORT_SYMBOL(ip_conntrack_chain_lock);
@@ -18,6 +18,9 @@
 #include <linux/proc_fs.h>
 
 #include <linux/netfilter_ipv4/ip_tables.h>
+#ifdef CONFIG_IP_NF_CLASSIFY
+#include "ipt_classify.h"
+#endif
 
 /*#define DEBUG_IP_FIREWALL*/
 /*#define DEBUG_ALLOW_ALL*/ /* Useful for remote debugging */
@@ -89,6 +92,9 @@ struct ipt_table_info
 	unsigned int hook_entry[NF_IP_NUMHOOKS];
 	unsigned int underflow[NF_IP_NUMHOOKS];
 
+	/* Compiled classifier (shared by all CPUs), or NULL */
+	struct ipt_classifier *cls;
+
 	/* ipt_entry tables: one per CPU */
 	char entries[0] __attribute__((aligned(SMP_CACHE_BYTES)));
 };
@@ -263,6 +269,11 @@ ipt_do_table(struct sk_buff **pskb,
 	const char *indev, *outdev;
 	void *table_base;
 	struct ipt_entry *e, *back;
+#ifdef CONFIG_IP_NF_CLASSIFY
+	struct ipt_classifier *cls;
+	struct ipt_cls_key key;
+	unsigned int hint = 0;
+#endif
 
 	/* Initialization */
 	ip = (*pskb)->nh.iph;
@@ -301,7 +312,21 @@ ipt_do_table(struct sk_buff **pskb,
 	/* For return from builtin chain */
 	back = get_entry(table_base, table->private->underflow[hook]);
 
+#ifdef CONFIG_IP_NF_CLASSIFY
+	cls = table->private->cls;
+	if (cls) {
+		ipt_cls_key(cls, &key, ip->protocol, ip->daddr, indev);
+		/* The entries we step over would have added theirs. */
+		(*pskb)->nfcache |= cls->nfcache;
+	}
+#endif
+
 	do {
+#ifdef CONFIG_IP_NF_CLASSIFY
+		/* Straight to the next entry which could match. */
+		if (cls)
+			e = ipt_cls_skip(cls, &key, table_base, e, &hint);
+#endif
 		IP_NF_ASSERT(e);
 		IP_NF_ASSERT(back);
 		(*pskb)->nfcache |= e->nfcache;
@@ -374,6 +399,11 @@ ipt_do_table(struct sk_buff **pskb,
 				ip = (*pskb)->nh.iph;
 				protohdr = (u_int32_t *)ip + ip->ihl;
 				datalen = (*pskb)->len - ip->ihl * 4;
+#ifdef CONFIG_IP_NF_CLASSIFY
+				if (cls)
+					ipt_cls_key(cls, &key, ip->protocol,
+						    ip->daddr, indev);
+#endif
 
 				if (verdict == IPT_CONTINUE)
 					e = (void *)e + e->next_offset;
@@ -864,9 +894,25 @@ translate_table(const char *name,
 		       SMP_ALIGN(newinfo->size));
 	}
 
+#ifdef CONFIG_IP_NF_CLASSIFY
+	/* Entry offsets are the same in every copy.  If this fails we
+	   just walk the whole table. */
+	newinfo->cls = ipt_cls_build(newinfo->entries, size, number);
+#endif
+
 	return ret;
 }
 
+/* Frees a table, and its classifier if it has one. */
+static void
+free_table_info(struct ipt_table_info *info)
+{
+#ifdef CONFIG_IP_NF_CLASSIFY
+	ipt_cls_free(info->cls);
+#endif
+	vfree(info);
+}
+
 static struct ipt_table_info *
 replace_table(struct ipt_table *table,
 	      unsigned int num_counters,
@@ -1067,6 +1113,7 @@ do_replace(void *user, unsigned int len)
 			  + SMP_ALIGN(tmp.size) * smp_num_cpus);
 	if (!newinfo)
 		return -ENOMEM;
+	newinfo->cls = NULL;
 
 	if (copy_from_user(newinfo->entries, user + sizeof(tmp),
 			   tmp.size) != 0) {
@@ -1109,7 +1156,7 @@ do_replace(void *user, unsigned int len)
 	get_counters(oldinfo, counters);
 	/* Decrease module usage counts and free resource */
 	IPT_ENTRY_ITERATE(oldinfo->entries, oldinfo->size, cleanup_entry,NULL);
-	vfree(oldinfo);
+	free_table_info(oldinfo);
 	/* Silent error: too late now. */
 	copy_to_user(tmp.counters, counters,
 		     sizeof(struct ipt_counters) * tmp.num_counters);
@@ -1124,7 +1171,7 @@ do_replace(void *user, unsigned int len)
  free_newinfo_counters:
 	vfree(counters);
  free_newinfo:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	return ret;
 }
 
@@ -1363,7 +1410,7 @@ int ipt_register_table(struct ipt_table *table)
 	int ret;
 	struct ipt_table_info *newinfo;
 	static struct ipt_table_info bootstrap
-		= { 0, 0, { 0 }, { 0 }, __E };
+		= { 0, 0, { 0 }, { 0 }, NULL, __E };
 
 	MOD_INC_USE_COUNT;
 	newinfo = vmalloc(sizeof(struct ipt_table_info)
@@ -1373,6 +1420,7 @@ int ipt_register_table(struct ipt_table *table)
 		MOD_DEC_USE_COUNT;
 		return ret;
 	}
+	newinfo->cls = NULL;
 	memcpy(newinfo->entries, table->table->entries, table->table->size);
 
 	ret = translate_table(table->name, table->valid_hooks,
@@ -1388,7 +1436,7 @@ int ipt_register_table(struct ipt_table *table)
 
 	ret = down_interruptible(&ipt_mutex);
 	if (ret != 0) {
-		vfree(newinfo);
+		free_table_info(newinfo);
 		MOD_DEC_USE_COUNT;
 		return ret;
 	}
@@ -1415,7 +1463,7 @@ int ipt_register_table(struct ipt_table *table)
 	return ret;
 
  free_unlock:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	MOD_DEC_USE_COUNT;
 	goto unlock;
 }
@@ -1429,7 +1477,7 @@ void ipt_unregister_table(struct ipt_table *table)
 	/* Decrease module usage counts and free resources */
 	IPT_ENTRY_ITERATE(table->private->entries, table->private->size,
 			  cleanup_entry, NULL);
-	vfree(table->private);
+	free_table_info(table->private);
 	MOD_DEC_USE_COUNT;
 }
 
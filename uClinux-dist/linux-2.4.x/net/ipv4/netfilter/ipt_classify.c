@@ -0,0 +1,400 @@
+/*
+ * Compiled classification for ip_tables.
+ *
+ * Built when a table is replaced, this says for any packet which
+ * entries could pass ip_packet_match, so ipt_do_table can step over
+ * the rest without touching them.  Three fields are looked at: the
+ * input interface, the protocol and the destination address.  For
+ * each there is a bit map (one bit per entry, in table order) of the
+ * entries a packet with a given value could match:
+ *
+ *	input interface	one map for each interface some rule names
+ *			exactly, one for everything else,
+ *	protocol	one for each protocol some rule names, one for
+ *			everything else,
+ *	destination	a path compressed binary trie of the prefixes the
+ *			rules name; the deepest node which holds the
+ *			address has the map.
+ *
+ * A rule that inverts a field, or uses a mask we don't understand
+ * there, is in every map for that field.  The packet's maps are found
+ * once (a few name compares, an array index and a trie walk) and ANDed
+ * a word at a time as the walk goes down the table, so a packet that
+ * matches early pays only for the words it gets to.
+ *
+ * Only entries which cannot match are skipped: every other entry is
+ * still checked in full and in order, so verdicts, jumps, RETURN and
+ * the counters are just as before.
+ *
+ * scripts/ipt-classify-check.c builds this file in user space.
+ */
+#ifdef __KERNEL__
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/netdevice.h>
+#include <asm/bitops.h>
+#include <asm/byteorder.h>
+
+#include <linux/netfilter_ipv4/ip_tables.h>
+#endif
+
+#include "ipt_classify.h"
+
+#if 0
+#define dprintf(format, args...) printk(format , ## args)
+#else
+#define dprintf(format, args...)
+#endif
+
+#define PREFIX_MASK(len) ((len) ? ~0U << (32 - (len)) : 0)
+#define PREFIX_BIT(addr, len) (((addr) >> (31 - (len))) & 1)
+
+static inline void
+set_entry(u_int32_t *map, unsigned int i)
+{
+	map[i / 32] |= 1U << (i % 32);
+}
+
+/* Returns length of prefix if mask is contiguous, else -1. */
+static int
+mask_len(u_int32_t mask)
+{
+	int len = 0;
+
+	mask = ntohl(mask);
+	while (mask & 0x80000000) {
+		mask <<= 1;
+		len++;
+	}
+	return mask ? -1 : len;
+}
+
+/* Returns 1 if the rule asks for exactly one interface name. */
+static int
+exact_iface(const struct ipt_ip *ip)
+{
+	unsigned int i;
+
+	if (ip->invflags & IPT_INV_VIA_IN)
+		return 0;
+	for (i = 0; i < IFNAMSIZ; i++) {
+		if ((unsigned char)ip->iniface_mask[i] != 0xFF)
+			return 0;
+		if (ip->iniface[i] == '\0')
+			return 1;
+	}
+	return 0;
+}
+
+/* Could the rule match an interface called name?  Mask bytes past the
+   end of the name are ignored: the device may have anything there. */
+static int
+iface_may_match(const struct ipt_ip *ip, const char *name)
+{
+	unsigned int i;
+
+	if (ip->invflags & IPT_INV_VIA_IN)
+		return 1;
+	for (i = 0; i < IFNAMSIZ; i++) {
+		if ((name[i] ^ ip->iniface[i]) & ip->iniface_mask[i])
+			return 0;
+		if (name[i] == '\0')
+			break;
+	}
+	return 1;
+}
+
+static int
+find_iface(const struct ipt_classifier *cls, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < cls->nifaces; i++)
+		if (strncmp(cls->ifname[i], name, IFNAMSIZ) == 0)
+			return i;
+	return -1;
+}
+
+/* The prefix the rule asks the destination to be in; 0 length if it
+   could be anything. */
+static void
+dst_prefix(const struct ipt_ip *ip, u_int32_t *addr, unsigned int *len)
+{
+	int l = mask_len(ip->dmsk.s_addr);
+
+	if ((ip->invflags & IPT_INV_DSTIP) || l <= 0) {
+		*addr = 0;
+		*len = 0;
+		return;
+	}
+	*len = l;
+	*addr = ntohl(ip->dst.s_addr) & PREFIX_MASK(l);
+}
+
+static unsigned int
+new_node(struct ipt_classifier *cls, unsigned int *nodes,
+	 u_int32_t addr, unsigned int len)
+{
+	struct ipt_cls_node *n = &cls->trie[*nodes];
+
+	n->addr = addr & PREFIX_MASK(len);
+	n->len = len;
+	n->own = 0;
+	n->child[0] = n->child[1] = 0;
+	n->map = NULL;
+	return (*nodes)++;
+}
+
+/* Returns the node for a prefix, adding it (and at most one more to
+   branch at) if it isn't there. */
+static unsigned int
+trie_insert(struct ipt_classifier *cls, unsigned int *nodes,
+	    u_int32_t addr, unsigned int len)
+{
+	struct ipt_cls_node *t = cls->trie;
+	unsigned int n = 0, c, b, m, l, common, max;
+
+	for (;;) {
+		if (t[n].len == len)
+			return n;
+
+		b = PREFIX_BIT(addr, t[n].len);
+		c = t[n].child[b];
+		if (!c) {
+			c = new_node(cls, nodes, addr, len);
+			t[n].child[b] = c;
+			return c;
+		}
+
+		max = len < t[c].len ? len : t[c].len;
+		for (common = t[n].len + 1; common < max; common++)
+			if (PREFIX_BIT(addr ^ t[c].addr, common))
+				break;
+		if (common == t[c].len) {
+			n = c;
+			continue;
+		}
+
+		/* Split the edge to c where we part. */
+		m = new_node(cls, nodes, addr, common);
+		t[n].child[b] = m;
+		t[m].child[PREFIX_BIT(t[c].addr, common)] = c;
+		if (common == len)
+			return m;
+		l = new_node(cls, nodes, addr, len);
+		t[m].child[PREFIX_BIT(addr, common)] = l;
+		return l;
+	}
+}
+
+/* Hands each node the map of the nearest node above with one of its
+   own, and adds that to the nodes which have one. */
+static void
+trie_fill(struct ipt_classifier *cls)
+{
+	/* One per level, and one more for the child left to do */
+	unsigned int stack[2 * 33 + 2];
+	struct ipt_cls_node *t = cls->trie, *p;
+	unsigned int sp = 0, n, b, w;
+
+	stack[sp++] = 0;
+	while (sp) {
+		p = &t[stack[--sp]];
+		for (b = 0; b < 2; b++) {
+			n = p->child[b];
+			if (!n)
+				continue;
+			if (t[n].own) {
+				for (w = 0; w < cls->words; w++)
+					t[n].map[w] |= p->map[w];
+			} else
+				t[n].map = p->map;
+			stack[sp++] = n;
+		}
+	}
+}
+
+void
+ipt_cls_free(struct ipt_classifier *cls)
+{
+	if (!cls)
+		return;
+	vfree(cls->offset);
+	vfree(cls->ifname);
+	vfree(cls->ifmap);
+	vfree(cls->trie);
+	vfree(cls->maps);
+	vfree(cls);
+}
+
+/* Returns NULL if the table is small or memory is short: the caller
+   then walks every entry, as it always did. */
+struct ipt_classifier *
+ipt_cls_build(void *entries, unsigned int size, unsigned int number)
+{
+	struct ipt_classifier *cls;
+	struct ipt_entry *e;
+	unsigned int *rnode = NULL;
+	unsigned int i, j, off, nodes, len, nprotos, nmaps;
+	u_int32_t addr, *map, *wildproto;
+	int p;
+
+	if (number < IPT_CLS_MIN)
+		return NULL;
+
+	cls = vmalloc(sizeof(*cls));
+	if (!cls)
+		return NULL;
+	memset(cls, 0, sizeof(*cls));
+	cls->number = number;
+	cls->words = (number + 31) / 32;
+
+	cls->offset = vmalloc(number * sizeof(unsigned int));
+	cls->ifname = vmalloc(IPT_CLS_IFACES * IFNAMSIZ);
+	cls->ifmap = vmalloc(IPT_CLS_IFACES * sizeof(u_int32_t *));
+	cls->trie = vmalloc((2 * number + 1) * sizeof(struct ipt_cls_node));
+	rnode = vmalloc(number * sizeof(unsigned int));
+	if (!cls->offset || !cls->ifname || !cls->ifmap || !cls->trie
+	    || !rnode)
+		goto fail;
+
+	/* Entry offsets, interface names, protocols and prefixes. */
+	nodes = 0;
+	new_node(cls, &nodes, 0, 0);
+	nprotos = 0;
+	for (off = 0, i = 0; i < number; off += e->next_offset, i++) {
+		e = (struct ipt_entry *)(entries + off);
+		if (off >= size)
+			goto fail;
+		cls->offset[i] = off;
+		cls->nfcache |= e->nfcache;
+
+		if (exact_iface(&e->ip)
+		    && find_iface(cls, e->ip.iniface) < 0
+		    && cls->nifaces < IPT_CLS_IFACES) {
+			memset(cls->ifname[cls->nifaces], 0, IFNAMSIZ);
+			strncpy(cls->ifname[cls->nifaces], e->ip.iniface,
+				IFNAMSIZ);
+			cls->nifaces++;
+		}
+
+		if (e->ip.proto && !(e->ip.invflags & IPT_INV_PROTO)
+		    && !cls->protomap[e->ip.proto & 0xFF]) {
+			/* Marked for now, given a map below */
+			cls->protomap[e->ip.proto & 0xFF] = (u_int32_t *)cls;
+			nprotos++;
+		}
+
+		dst_prefix(&e->ip, &addr, &len);
+		rnode[i] = trie_insert(cls, &nodes, addr, len);
+		cls->trie[rnode[i]].own = 1;
+	}
+	cls->trie[0].own = 1;
+
+	nmaps = cls->nifaces + 1 + nprotos + 1;
+	for (i = 0; i < nodes; i++)
+		nmaps += cls->trie[i].own;
+
+	cls->maps = vmalloc(nmaps * cls->words * sizeof(u_int32_t));
+	if (!cls->maps)
+		goto fail;
+	memset(cls->maps, 0, nmaps * cls->words * sizeof(u_int32_t));
+
+	map = cls->maps;
+	for (i = 0; i < cls->nifaces; i++, map += cls->words)
+		cls->ifmap[i] = map;
+	cls->ifother = map;
+	map += cls->words;
+	wildproto = map;
+	map += cls->words;
+	for (p = 0; p < 256; p++) {
+		if (cls->protomap[p]) {
+			cls->protomap[p] = map;
+			map += cls->words;
+		}
+	}
+	for (i = 0; i < nodes; i++) {
+		if (cls->trie[i].own) {
+			cls->trie[i].map = map;
+			map += cls->words;
+		}
+	}
+
+	/* Now which entries go in which maps. */
+	for (i = 0; i < number; i++) {
+		e = (struct ipt_entry *)(entries + cls->offset[i]);
+
+		p = exact_iface(&e->ip) ? find_iface(cls, e->ip.iniface) : -1;
+		for (j = 0; j < cls->nifaces; j++)
+			if (j == p || (p < 0 && iface_may_match(&e->ip,
+							  cls->ifname[j])))
+				set_entry(cls->ifmap[j], i);
+		if (p < 0)
+			set_entry(cls->ifother, i);
+
+		if (e->ip.proto && !(e->ip.invflags & IPT_INV_PROTO))
+			set_entry(cls->protomap[e->ip.proto & 0xFF], i);
+		else {
+			set_entry(wildproto, i);
+			for (p = 0; p < 256; p++)
+				if (cls->protomap[p])
+					set_entry(cls->protomap[p], i);
+		}
+
+		set_entry(cls->trie[rnode[i]].map, i);
+	}
+	for (p = 0; p < 256; p++)
+		if (!cls->protomap[p])
+			cls->protomap[p] = wildproto;
+	trie_fill(cls);
+
+	dprintf("ipt_cls_build: %u entries, %u interfaces, %u protocols, "
+		"%u trie nodes, %u maps of %u words\n", number, cls->nifaces,
+		nprotos, nodes, nmaps, cls->words);
+
+	vfree(rnode);
+	return cls;
+
+ fail:
+	vfree(rnode);
+	ipt_cls_free(cls);
+	return NULL;
+}
+
+/* Finds the maps for a packet: daddr is network order. */
+void
+ipt_cls_key(const struct ipt_classifier *cls,
+	    struct ipt_cls_key *key,
+	    u_int8_t protocol, u_int32_t daddr,
+	    const char *indev)
+{
+	const struct ipt_cls_node *n = cls->trie;
+	unsigned int c;
+	int i;
+
+	i = find_iface(cls, indev);
+	key->in = i < 0 ? cls->ifother : cls->ifmap[i];
+	key->proto = cls->protomap[protocol];
+
+	daddr = ntohl(daddr);
+	key->dst = n->map;
+	while (n->len < 32) {
+		c = n->child[PREFIX_BIT(daddr, n->len)];
+		if (!c)
+			break;
+		n = &cls->trie[c];
+		if ((daddr ^ n->addr) & PREFIX_MASK(n->len))
+			break;
+		key->dst = n->map;
+	}
+}
+
+#ifdef __KERNEL__
+EXPORT_SYMBOL(ipt_cls_build);
+EXPORT_SYMBOL(ipt_cls_free);
+EXPORT_SYMBOL(ipt_cls_key);
+MODULE_LICENSE("GPL");
+#endif
@@ -0,0 +1,131 @@
+/* Compiled classification of ip_tables rules: see ipt_classify.c */
+#ifndef _IPT_CLASSIFY_H
+#define _IPT_CLASSIFY_H
+
+/* Tables with fewer entries than this are just walked: finding a
+   packet's maps costs about as much as looking at a few dozen. */
+#define IPT_CLS_MIN	64
+/* Most input interfaces looked up by name; rules naming others are
+   treated as matching any interface. */
+#define IPT_CLS_IFACES	32
+#define IPT_CLS_NONE	0xFFFFFFFF
+
+/* A node of the destination prefix trie. */
+struct ipt_cls_node
+{
+	/* Prefix, host order, bits past len clear */
+	u_int32_t addr;
+	unsigned int len;
+	/* Rules asking for exactly this prefix? */
+	unsigned int own;
+	/* Index of each child, 0 for none (0 is the root) */
+	unsigned int child[2];
+	/* Rules that can match any address under this node */
+	u_int32_t *map;
+};
+
+struct ipt_classifier
+{
+	/* Number of entries, and of words in each bit map */
+	unsigned int number;
+	unsigned int words;
+
+	/* Offset of each entry in the table, ascending */
+	unsigned int *offset;
+
+	/* nfcache bits of every entry, since we skip some */
+	unsigned int nfcache;
+
+	/* Input interfaces named exactly by some rule, the entries which
+	   can match each, and those which can match any other. */
+	unsigned int nifaces;
+	char (*ifname)[IFNAMSIZ];
+	u_int32_t **ifmap;
+	u_int32_t *ifother;
+
+	/* Entries which can match each protocol */
+	u_int32_t *protomap[256];
+
+	/* Destination prefixes */
+	struct ipt_cls_node *trie;
+
+	/* Storage for all the bit maps */
+	u_int32_t *maps;
+};
+
+/* The maps that apply to one packet. */
+struct ipt_cls_key
+{
+	const u_int32_t *in, *proto, *dst;
+};
+
+extern struct ipt_classifier *ipt_cls_build(void *entries, unsigned int size,
+					    unsigned int number);
+extern void ipt_cls_free(struct ipt_classifier *cls);
+extern void ipt_cls_key(const struct ipt_classifier *cls,
+			struct ipt_cls_key *key,
+			u_int8_t protocol, u_int32_t daddr,
+			const char *indev);
+
+/* Index of the entry at offset, or IPT_CLS_NONE.  Tries hint first. */
+static inline unsigned int
+ipt_cls_index(const struct ipt_classifier *cls, unsigned int offset,
+	      unsigned int hint)
+{
+	unsigned int lo = 0, hi = cls->number, mid;
+
+	if (hint < cls->number && cls->offset[hint] == offset)
+		return hint;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cls->offset[mid] < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < cls->number && cls->offset[lo] == offset)
+		return lo;
+	return IPT_CLS_NONE;
+}
+
+/* First entry from i on which the packet could match, or number. */
+static inline unsigned int
+ipt_cls_next(const struct ipt_classifier *cls,
+	     const struct ipt_cls_key *key,
+	     unsigned int i)
+{
+	unsigned int w = i / 32;
+	u_int32_t bits;
+
+	bits = key->in[w] & key->proto[w] & key->dst[w] & (~0U << (i % 32));
+	while (!bits) {
+		if (++w == cls->words)
+			return cls->number;
+		bits = key->in[w] & key->proto[w] & key->dst[w];
+	}
+	return w * 32 + ffs(bits) - 1;
+}
+
+/* Entries before the one returned would fail ip_packet_match, so the
+   walk can start there.  Anything we don't know is left alone. */
+static inline struct ipt_entry *
+ipt_cls_skip(const struct ipt_classifier *cls,
+	     const struct ipt_cls_key *key,
+	     void *table_base,
+	     struct ipt_entry *e,
+	     unsigned int *hint)
+{
+	unsigned int i;
+
+	i = ipt_cls_index(cls, (void *)e - table_base, *hint);
+	if (i == IPT_CLS_NONE)
+		return e;
+	i = ipt_cls_next(cls, key, i);
+	if (i >= cls->number)
+		return e;
+	*hint = i + 1;
+	return (struct ipt_entry *)(table_base + cls->offset[i]);
+}
+
+#endif /* _IPT_CLASSIFY_H */
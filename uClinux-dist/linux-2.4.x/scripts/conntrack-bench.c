@@ -0,0 +1,262 @@
+/*
+ * conntrack-bench.c
+ *
+ * Hashes synthetic flows into a conntrack table the way
+ * net/ipv4/netfilter/ip_conntrack_core.c does, with the keyed hash it
+ * uses now (include/linux/jhash.h) and with the sum of the tuple
+ * fields it used before, and reports the chain lengths (as in
+ * /proc/net/ip_conntrack_hash), the time to look every tuple up
+ * again, and the time to rehash into a table twice the size.
+ *
+ * Both directions of each flow go in, as they do in the kernel.  The
+ * flows are either
+ *
+ *	nat	clients behind a few masquerading addresses, talking to a
+ *		few servers on a few ports, source ports handed out in
+ *		order (the case that crowded the old hash),
+ *	random	every field random.
+ *
+ *	conntrack-bench [-n flows] [-b buckets] [-m nat|random]
+ *			[-l lookups] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+typedef unsigned int u32;
+#include "../include/linux/jhash.h"
+
+#define IP_CONNTRACK_LOCKS	16
+
+/* just the fields of struct ip_conntrack_tuple the hashes use */
+struct tuple {
+	u32		src_ip;
+	unsigned short	src_u;
+	u32		dst_ip;
+	unsigned short	dst_u;
+	unsigned char	protonum;
+};
+
+struct entry {
+	struct entry	*next;
+	struct tuple	t;
+};
+
+static u32 rnd;
+
+static u32
+hash_jenkins(const struct tuple *t)
+{
+	return jhash_3words(t->src_ip, t->dst_ip ^ t->protonum,
+			    t->src_u | ((u32)t->dst_u << 16), rnd);
+}
+
+/* what ip_conntrack_core.c had, before the table size is taken off */
+static u32
+hash_sum(const struct tuple *t)
+{
+	return ntohl(t->src_ip + t->dst_ip + t->src_u + t->dst_u
+		     + t->protonum) + ntohs(t->src_u);
+}
+
+static struct {
+	const char	*name;
+	u32		(*hash)(const struct tuple *);
+} hashes[] = {
+	{ "jhash", hash_jenkins },
+	{ "sum", hash_sum },
+};
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static u32
+random32(void)
+{
+	return ((u32)random() << 16) ^ (u32)random();
+}
+
+static void
+make_flows(struct tuple *t, int n, int nat)
+{
+	u32 masq[4], server[16];
+	unsigned short port[] = { 80, 443, 53, 25, 110, 8080 };
+	unsigned short next_port = 1024;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		masq[i] = htonl(0xc0a80001 + i);	/* 192.168.0.1 */
+	for (i = 0; i < 16; i++)
+		server[i] = htonl(0x0a000001 + (random32() & 0xffff));
+
+	for (i = 0; i < n; i++) {
+		if (nat) {
+			t[i].src_ip = masq[random32() % 4];
+			t[i].src_u = htons(next_port);
+			if (++next_port == 0)
+				next_port = 1024;
+			t[i].dst_ip = server[random32() % 16];
+			t[i].dst_u = htons(port[random32() % 6]);
+			t[i].protonum = (t[i].dst_u == htons(53)) ? 17 : 6;
+		} else {
+			t[i].src_ip = random32();
+			t[i].src_u = random32();
+			t[i].dst_ip = random32();
+			t[i].dst_u = random32();
+			t[i].protonum = random32() & 1 ? 6 : 17;
+		}
+	}
+}
+
+static void
+invert(struct tuple *r, const struct tuple *t)
+{
+	r->src_ip = t->dst_ip;
+	r->src_u = t->dst_u;
+	r->dst_ip = t->src_ip;
+	r->dst_u = t->src_u;
+	r->protonum = t->protonum;
+}
+
+static int
+equal(const struct tuple *a, const struct tuple *b)
+{
+	return a->src_ip == b->src_ip && a->src_u == b->src_u
+		&& a->dst_ip == b->dst_ip && a->dst_u == b->dst_u
+		&& a->protonum == b->protonum;
+}
+
+static void
+run(int h, struct tuple *flows, int n, unsigned int size, int lookups)
+{
+	u32 (*hash)(const struct tuple *) = hashes[h].hash;
+	struct entry **table, **bigger, *e, *entries;
+	unsigned int chains[17], i, len, longest = 0;
+	unsigned long steps = 0, found = 0;
+	double t0, t_lookup, t_resize;
+	int j;
+
+	table = calloc(size, sizeof(*table));
+	bigger = calloc(2 * size, sizeof(*bigger));
+	entries = malloc(2 * n * sizeof(*entries));
+	if (!table || !bigger || !entries) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (j = 0; j < n; j++) {
+		entries[2 * j].t = flows[j];
+		invert(&entries[2 * j + 1].t, &flows[j]);
+	}
+	for (j = 0; j < 2 * n; j++) {
+		e = &entries[j];
+		i = hash(&e->t) % size;
+		e->next = table[i];
+		table[i] = e;
+	}
+
+	memset(chains, 0, sizeof(chains));
+	for (i = 0; i < size; i++) {
+		for (len = 0, e = table[i]; e; e = e->next)
+			len++;
+		chains[len < 16 ? len : 16]++;
+		if (len > longest)
+			longest = len;
+	}
+
+	t0 = now();
+	for (j = 0; j < lookups; j++) {
+		const struct tuple *t = &entries[j % (2 * n)].t;
+
+		for (e = table[hash(t) % size]; e; e = e->next) {
+			steps++;
+			if (equal(&e->t, t)) {
+				found++;
+				break;
+			}
+		}
+	}
+	t_lookup = now() - t0;
+
+	t0 = now();
+	for (i = 0; i < size; i++) {
+		while ((e = table[i]) != NULL) {
+			table[i] = e->next;
+			len = hash(&e->t) % (2 * size);
+			e->next = bigger[len];
+			bigger[len] = e;
+		}
+	}
+	t_resize = now() - t0;
+
+	printf("%-6s longest %4u  %6.2f compares/lookup  %7.1f ns/lookup"
+	       "  rehash %.2f ms\n", hashes[h].name, longest,
+	       (double) steps / lookups, t_lookup * 1e9 / lookups,
+	       t_resize * 1e3);
+	printf("       chains:");
+	for (i = 0; i < 17; i++)
+		printf(" %u%s:%u", i, i == 16 ? "+" : "", chains[i]);
+	printf("\n");
+	if (found != (unsigned long) lookups) {
+		fprintf(stderr, "%s: found %lu of %d\n", hashes[h].name,
+			found, lookups);
+		exit(1);
+	}
+
+	free(table);
+	free(bigger);
+	free(entries);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int n = 8192, lookups = 1000000, nat = 1, c, h;
+	unsigned int size = 1024, seed = 1;
+	struct tuple *flows;
+
+	while ((c = getopt(argc, argv, "n:b:m:l:s:")) != -1) {
+		switch (c) {
+		case 'n': n = atoi(optarg); break;
+		case 'b': size = atoi(optarg); break;
+		case 'm': nat = strcmp(optarg, "random") != 0; break;
+		case 'l': lookups = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: conntrack-bench [-n flows] "
+				"[-b buckets] [-m nat|random] [-l lookups] "
+				"[-s seed]\n");
+			return 2;
+		}
+	}
+	if (n <= 0 || lookups <= 0)
+		return 2;
+	/* as alloc_hashtable() rounds it */
+	size = (size + IP_CONNTRACK_LOCKS - 1) / IP_CONNTRACK_LOCKS
+		* IP_CONNTRACK_LOCKS;
+	if (size == 0)
+		size = IP_CONNTRACK_LOCKS;
+
+	srandom(seed);
+	rnd = random32();
+	flows = malloc(n * sizeof(*flows));
+	if (!flows)
+		return 1;
+	make_flows(flows, n, nat);
+
+	printf("%d %s flows, %d entries in %u buckets\n", n,
+	       nat ? "nat" : "random", 2 * n, size);
+	for (h = 0; h < (int) (sizeof(hashes) / sizeof(hashes[0])); h++)
+		run(h, flows, n, size, lookups);
+	return 0;
+}
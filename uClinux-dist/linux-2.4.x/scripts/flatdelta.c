@@ -0,0 +1,196 @@
+/*
+ * flatdelta.c
+ *
+ * Rewrites the relocation table of a flat binary in the sorted, delta
+ * encoded form fs/binfmt_flat.c loads when FLAT_FLAG_RELOCDELTA is set
+ * (see include/linux/flat.h), for tool chains whose elf2flt does not
+ * write it.  The table shrinks to about a quarter of its size and the
+ * loader walks the program in address order.
+ *
+ * Only uncompressed files can be converted;  compress them afterwards
+ * (flthdr -z).  The new table is decoded again and compared with the
+ * old one before anything is written.
+ *
+ *	flatdelta [-v] infile [outfile]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+/* include/linux/flat.h,  with fixed size fields */
+struct flat_hdr {
+	char		magic[4];
+	unsigned int	rev;
+	unsigned int	entry;
+	unsigned int	data_start;
+	unsigned int	data_end;
+	unsigned int	bss_end;
+	unsigned int	stack_size;
+	unsigned int	reloc_start;
+	unsigned int	reloc_count;
+	unsigned int	flags;
+	unsigned int	filler[6];
+};
+
+#define FLAT_VERSION		4
+#define FLAT_FLAG_GZIP		0x0004
+#define FLAT_FLAG_GZDATA	0x0008
+#define FLAT_FLAG_RELOCDELTA	0x0100
+
+static int
+cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* returns the length of the stream at out */
+static unsigned int
+encode(unsigned int *off, unsigned int n, unsigned char *out)
+{
+	unsigned int i, last = 0, d;
+	unsigned char *p = out;
+
+	for (i = 0; i < n; i++) {
+		d = off[i] - last;
+		if (off[i] > last && (d & 1) == 0 && d <= 2 * 255) {
+			*p++ = d >> 1;
+		} else {
+			*p++ = 0;
+			*p++ = off[i] >> 24;
+			*p++ = off[i] >> 16;
+			*p++ = off[i] >> 8;
+			*p++ = off[i];
+		}
+		last = off[i];
+	}
+	return p - out;
+}
+
+/* as flat_reloc_next() does it,  returns -1 if the stream is short */
+static int
+decode(unsigned char *p, unsigned char *end, unsigned int n, unsigned int *off)
+{
+	unsigned int i, last = 0;
+
+	for (i = 0; i < n; i++) {
+		if (p >= end)
+			return -1;
+		if (*p) {
+			last += *p++ << 1;
+		} else {
+			if (end - p < 5)
+				return -1;
+			last = ((unsigned int) p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+			p += 5;
+		}
+		off[i] = last;
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct flat_hdr *hdr;
+	unsigned char *buf, *stream;
+	unsigned int *reloc, *off, *check;
+	unsigned int n, i, len, words, start, flags, escapes;
+	long size;
+	FILE *fp;
+	int verbose = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		verbose = 1;
+		argc--;
+		argv++;
+	}
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: flatdelta [-v] infile [outfile]\n");
+		return 2;
+	}
+
+	if ((fp = fopen(argv[1], "rb")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+	if (size < (long) sizeof(*hdr) || (buf = malloc(size)) == NULL ||
+			fread(buf, 1, size, fp) != (size_t) size) {
+		fprintf(stderr, "%s: cannot read\n", argv[1]);
+		return 1;
+	}
+	fclose(fp);
+
+	hdr = (struct flat_hdr *) buf;
+	flags = ntohl(hdr->flags);
+	start = ntohl(hdr->reloc_start);
+	n = ntohl(hdr->reloc_count);
+	if (memcmp(hdr->magic, "bFLT", 4) || ntohl(hdr->rev) != FLAT_VERSION) {
+		fprintf(stderr, "%s: not a version %d flat binary\n", argv[1],
+				FLAT_VERSION);
+		return 1;
+	}
+	if (flags & (FLAT_FLAG_GZIP | FLAT_FLAG_GZDATA)) {
+		fprintf(stderr, "%s: compressed,  convert it first\n", argv[1]);
+		return 1;
+	}
+	if (flags & FLAT_FLAG_RELOCDELTA) {
+		fprintf(stderr, "%s: already converted\n", argv[1]);
+		return 1;
+	}
+	if ((start & 3) || start + (unsigned long) n * 4 > (unsigned long) size) {
+		fprintf(stderr, "%s: relocations outside the file\n", argv[1]);
+		return 1;
+	}
+
+	reloc = (unsigned int *) (buf + start);
+	off = malloc((n + 1) * sizeof(*off));
+	check = malloc((n + 1) * sizeof(*check));
+	stream = calloc(1, 5 * n + 8);
+	if (!off || !check || !stream) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < n; i++)
+		off[i] = ntohl(reloc[i]);
+	qsort(off, n, sizeof(*off), cmp);
+
+	/* the count,  then the stream padded to a word */
+	*(unsigned int *) stream = htonl(n);
+	len = n ? 4 + encode(off, n, stream + 4) : 0;
+	words = (len + 3) / 4;
+
+	if (decode(stream + 4, stream + words * 4, n, check) ||
+			memcmp(off, check, n * sizeof(*off))) {
+		fprintf(stderr, "%s: encoding does not decode\n", argv[1]);
+		return 1;
+	}
+	escapes = n ? (len - 4 - n) / 4 : 0;	/* 4 more bytes each */
+
+	hdr->reloc_count = htonl(words);
+	hdr->flags = htonl(flags | FLAT_FLAG_RELOCDELTA);
+
+	if ((fp = fopen(argc > 2 ? argv[2] : argv[1], "wb")) == NULL) {
+		perror(argc > 2 ? argv[2] : argv[1]);
+		return 1;
+	}
+	if (fwrite(buf, 1, start, fp) != start ||
+			fwrite(stream, 4, words, fp) != words ||
+			fwrite(buf + start + n * 4, 1, size - start - n * 4, fp) !=
+					(size_t) (size - start - n * 4) ||
+			fclose(fp)) {
+		fprintf(stderr, "write failed\n");
+		return 1;
+	}
+
+	if (verbose)
+		printf("%u relocations, %u bytes -> %u (%u in full)\n",
+				n, n * 4, words * 4, escapes);
+	return 0;
+}
@@ -0,0 +1,554 @@
+/*
+ * ipt-classify-check.c
+ *
+ * Builds the ip_tables rule classifier (net/ipv4/netfilter/ipt_classify.c)
+ * in user space, gives it a synthetic table and sends random packets
+ * through that table twice: once looking at every entry, as ipt_do_table
+ * did before, and once stepping over the entries the classifier rules
+ * out.  The verdicts, every rule's counters and the nfcache bits must
+ * agree, so this doubles as a test:  it exits non-zero if they don't.
+ * It also reports how many entries each walk looked at and how long
+ * it took.
+ *
+ * The table is laid out the way iptables lays one out: the built in
+ * chain ending in its policy, user chains each headed by an ERROR entry
+ * and ended by a RETURN, and an ERROR entry last.  Rules take their
+ * input interface (exact, eth+, inverted or any), protocol and
+ * destination (a prefix, inverted, an odd mask or any) from small pools
+ * so that packets hit them.  A port range stands in for the matches.
+ * Targets are ACCEPT, DROP, RETURN, a jump to a later chain, or one
+ * which rewrites the destination and continues, as DNAT would.
+ *
+ *	ipt-classify-check [-n rules] [-c chains] [-p packets] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+/*
+ *	just enough of the kernel for ipt_classify.c
+ */
+
+#define IFNAMSIZ	16
+#define vmalloc		malloc
+#define vfree		free
+
+/* include/linux/netfilter_ipv4/ip_tables.h */
+struct ipt_ip {
+	struct in_addr src, dst;
+	struct in_addr smsk, dmsk;
+	char iniface[IFNAMSIZ], outiface[IFNAMSIZ];
+	unsigned char iniface_mask[IFNAMSIZ], outiface_mask[IFNAMSIZ];
+	u_int16_t proto;
+	u_int8_t flags;
+	u_int8_t invflags;
+};
+
+struct ipt_counters {
+	u_int64_t pcnt, bcnt;
+};
+
+#define IPT_F_FRAG		0x01
+#define IPT_INV_VIA_IN		0x01
+#define IPT_INV_VIA_OUT		0x02
+#define IPT_INV_SRCIP		0x08
+#define IPT_INV_DSTIP		0x10
+#define IPT_INV_FRAG		0x20
+#define IPT_INV_PROTO		0x40
+
+struct ipt_entry {
+	struct ipt_ip ip;
+	unsigned int nfcache;
+	u_int16_t target_offset;
+	u_int16_t next_offset;
+	unsigned int comefrom;
+	struct ipt_counters counters;
+	unsigned char elems[0];
+};
+
+#define NF_DROP		0
+#define NF_ACCEPT	1
+#define NF_MAX_VERDICT	4	/* NF_REPEAT */
+#define IPT_RETURN	(-NF_MAX_VERDICT - 1)
+
+#include "../net/ipv4/netfilter/ipt_classify.c"
+
+/*
+ *	the table
+ */
+
+/* stands in for the matches and the target */
+struct target {
+	int		kind;
+	int		verdict;	/* STANDARD: as ipt_standard_target */
+	unsigned short	lo, hi;		/* destination ports to match */
+	u_int32_t	newdst;		/* REWRITE: network order */
+};
+
+enum { STANDARD, REWRITE, ERROR };
+
+struct packet {
+	char		indev[IFNAMSIZ];
+	u_int32_t	saddr, daddr;
+	u_int8_t	protocol;
+	unsigned short	dport, len;
+	int		frag;
+};
+
+static unsigned int
+random32(void)
+{
+	return ((unsigned int)random() << 16) ^ (unsigned int)random();
+}
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static const char *ifnames[] = { "eth0", "eth1", "ppp0", "eth2", "lo", "" };
+static const u_int8_t protos[] = { 6, 17, 1, 47 };
+
+/* destinations: prefixes in 10/8, some nested */
+#define NPREFIXES	512
+static u_int32_t prefix_addr[NPREFIXES];	/* host order */
+static int prefix_len[NPREFIXES];
+
+static void
+make_prefixes(void)
+{
+	int i, l;
+
+	for (i = 0; i < NPREFIXES; i++) {
+		switch (i % 16) {
+		case 0: l = 8 + random32() % 9; break;
+		case 1: case 2: case 3: l = 16 + random32() % 9; break;
+		case 4: case 5: case 6: case 7: case 8: case 9:
+			l = 24 + random32() % 8; break;
+		default: l = 32; break;
+		}
+		prefix_addr[i] = 0x0a000000 | ((random32() % 16) << 16)
+			| ((random32() % 64) << 8) | (random32() % 256);
+		prefix_addr[i] &= l ? ~0U << (32 - l) : 0;
+		prefix_len[i] = l;
+	}
+}
+
+static u_int32_t
+len_mask(int l)
+{
+	return htonl(l ? ~0U << (32 - l) : 0);
+}
+
+static void
+random_rule(struct ipt_entry *e, struct target *t)
+{
+	struct ipt_ip *ip = &e->ip;
+	int r, i;
+
+	memset(ip, 0, sizeof(*ip));
+
+	r = random32() % 10;
+	if (r >= 2) {
+		const char *name = r == 9 ? "wlan0" : ifnames[random32() % 3];
+
+		strcpy(ip->iniface, r == 8 ? "eth" : name);
+		memset(ip->iniface_mask, 0xFF, strlen(ip->iniface) + (r != 8));
+		if (r == 7)
+			ip->invflags |= IPT_INV_VIA_IN;
+	}
+
+	r = random32() % 10;
+	if (r >= 2) {
+		ip->proto = protos[random32() % 3];
+		if (r == 9)
+			ip->invflags |= IPT_INV_PROTO;
+	}
+
+	r = random32() % 20;
+	if (r >= 1) {
+		i = random32() % NPREFIXES;
+		ip->dst.s_addr = htonl(prefix_addr[i]);
+		ip->dmsk.s_addr = len_mask(prefix_len[i]);
+		if (r == 18)
+			ip->invflags |= IPT_INV_DSTIP;
+		if (r == 19)
+			ip->dmsk.s_addr = htonl(0xff00ff00);
+		ip->dst.s_addr &= ip->dmsk.s_addr;
+	}
+
+	if (random32() % 5 == 0) {
+		ip->src.s_addr = htonl(0xc0a80000 | (random32() % 4) << 8);
+		ip->smsk.s_addr = len_mask(24);
+	}
+	if (random32() % 20 == 0)
+		ip->flags |= IPT_F_FRAG;
+
+	t->lo = 0;
+	t->hi = 65535;
+	if (random32() % 5 >= 3) {
+		t->lo = random32() % 4096;
+		t->hi = t->lo + random32() % 512;
+	}
+	e->nfcache = 1 << (random32() % 8);
+}
+
+/* entry sizes vary, as matches make them */
+static unsigned int
+entry_size(void)
+{
+	return sizeof(struct ipt_entry) + 8 * (random32() % 4)
+		+ sizeof(struct target);
+}
+
+static struct target *
+get_target(struct ipt_entry *e)
+{
+	return (struct target *)((char *)e + e->target_offset);
+}
+
+static char *table;
+static unsigned int table_size, table_number, hook_entry, underflow;
+
+static void
+make_table(int nrules, int nchains)
+{
+	unsigned int *size, *chain_start, *chain_rules;
+	unsigned int off, i, n, c, k;
+	struct ipt_entry *e;
+	struct target *t;
+
+	/* rules per chain, at least one in each */
+	chain_rules = calloc(nchains, sizeof(*chain_rules));
+	chain_start = calloc(nchains, sizeof(*chain_start));
+	for (c = 0; c < (unsigned int) nchains; c++)
+		chain_rules[c] = 1;
+	for (i = nchains; i < (unsigned int) nrules; i++)
+		chain_rules[random32() % nchains]++;
+
+	/* built in: rules, policy; user: head, rules, RETURN; ERROR */
+	table_number = nrules + 1 + 2 * (nchains - 1) + 1;
+	size = malloc(table_number * sizeof(*size));
+	if (!chain_rules || !chain_start || !size) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (table_size = 0, i = 0; i < table_number; i++)
+		table_size += size[i] = entry_size();
+	table = calloc(1, table_size);
+	if (!table) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	/* where each chain's first rule goes */
+	for (off = 0, n = 0, c = 0; c < (unsigned int) nchains; c++) {
+		if (c)
+			off += size[n++];
+		chain_start[c] = off;
+		for (k = 0; k < chain_rules[c] + 1; k++)
+			off += size[n++];
+	}
+	hook_entry = 0;
+	underflow = chain_start[0];
+	for (k = 0; k < chain_rules[0]; k++)
+		underflow += size[k];
+
+	for (off = 0, n = 0, c = 0; c < (unsigned int) nchains; c++) {
+		for (k = 0; k < chain_rules[c] + 2; k++) {
+			if (k == 0 && c == 0)
+				continue;	/* no head */
+			e = (struct ipt_entry *)(table + off);
+			e->next_offset = size[n];
+			e->target_offset = size[n] - sizeof(struct target);
+			t = get_target(e);
+			t->kind = STANDARD;
+			t->lo = 0;
+			t->hi = 65535;
+			off += size[n++];
+
+			if (k == 0) {
+				t->kind = ERROR;
+			} else if (k == chain_rules[c] + 1) {
+				/* policy, or the chain's RETURN */
+				t->verdict = c ? IPT_RETURN
+					: -(random32() % 2 ? NF_ACCEPT : NF_DROP) - 1;
+			} else {
+				int r = random32() % 20;
+
+				random_rule(e, t);
+				if (r < 4)
+					t->verdict = -NF_ACCEPT - 1;
+				else if (r < 8)
+					t->verdict = -NF_DROP - 1;
+				else if (r < 10)
+					t->verdict = IPT_RETURN;
+				else if (r < 16 && c + 1 < (unsigned int) nchains)
+					t->verdict = chain_start[c + 1 + random32()
+						% (nchains - c - 1)];
+				else if (r < 18) {
+					t->kind = REWRITE;
+					t->newdst = htonl(prefix_addr[random32()
+						% NPREFIXES] | (random32() & 0xff));
+				} else
+					/* falls through to the next rule */
+					t->verdict = (char *)e + e->next_offset
+						- table;
+			}
+		}
+	}
+	e = (struct ipt_entry *)(table + off);
+	e->next_offset = size[n];
+	e->target_offset = size[n] - sizeof(struct target);
+	get_target(e)->kind = ERROR;
+	off += size[n++];
+
+	if (off != table_size || n != table_number) {
+		fprintf(stderr, "table laid out wrong\n");
+		exit(1);
+	}
+	free(size);
+	free(chain_start);
+	free(chain_rules);
+}
+
+static void
+random_packet(struct packet *p)
+{
+	int i;
+
+	memset(p, 0, sizeof(*p));
+	strcpy(p->indev, ifnames[random32() % 6]);
+	p->protocol = protos[random32() % 4];
+	if (random32() % 10 < 7) {
+		i = random32() % NPREFIXES;
+		p->daddr = htonl(prefix_addr[i] | (random32()
+			& ~(prefix_len[i] ? ~0U << (32 - prefix_len[i]) : 0)));
+	} else
+		p->daddr = htonl(0x0a000000 | (random32() & 0x3ffff));
+	p->saddr = htonl(0xc0a80000 | (random32() & 0x3ff));
+	p->dport = random32() % 4096;
+	p->len = 40 + random32() % 1460;
+	p->frag = random32() % 20 == 0;
+}
+
+/* ip_packet_match() in net/ipv4/netfilter/ip_tables.c */
+static int
+packet_match(const struct packet *p, u_int32_t daddr,
+	     const struct ipt_ip *ipinfo)
+{
+	unsigned long ret;
+	size_t i;
+
+#define FWINV(bool,invflg) ((bool) ^ !!(ipinfo->invflags & invflg))
+
+	if (FWINV((p->saddr & ipinfo->smsk.s_addr) != ipinfo->src.s_addr,
+		  IPT_INV_SRCIP)
+	    || FWINV((daddr & ipinfo->dmsk.s_addr) != ipinfo->dst.s_addr,
+		     IPT_INV_DSTIP))
+		return 0;
+
+	for (i = 0, ret = 0; i < IFNAMSIZ; i++)
+		ret |= (p->indev[i] ^ ipinfo->iniface[i])
+			& ipinfo->iniface_mask[i];
+	if (FWINV(ret != 0, IPT_INV_VIA_IN))
+		return 0;
+
+	/* no output device: the rules never name one */
+	for (i = 0, ret = 0; i < IFNAMSIZ; i++)
+		ret |= ipinfo->outiface[i] & ipinfo->outiface_mask[i];
+	if (FWINV(ret != 0, IPT_INV_VIA_OUT))
+		return 0;
+
+	if (ipinfo->proto
+	    && FWINV(p->protocol != ipinfo->proto, IPT_INV_PROTO))
+		return 0;
+
+	if (FWINV((ipinfo->flags & IPT_F_FRAG) && !p->frag, IPT_INV_FRAG))
+		return 0;
+
+	return 1;
+}
+
+#define RUNAWAY		0xFF
+
+/* the loop in ipt_do_table(), with or without the classifier;  a walk
+   that goes on much longer than the table is cut off as RUNAWAY */
+static unsigned int
+do_table(char *base, const struct packet *p,
+	 const struct ipt_classifier *cls,
+	 unsigned int *nfcache, unsigned long *looked)
+{
+	struct ipt_entry *e = (struct ipt_entry *)(base + hook_entry);
+	struct ipt_entry *back = (struct ipt_entry *)(base + underflow);
+	struct ipt_cls_key key;
+	unsigned int hint = 0;
+	u_int32_t daddr = p->daddr;
+	unsigned long steps = 0;
+	struct target *t;
+
+	if (cls) {
+		ipt_cls_key(cls, &key, p->protocol, daddr, p->indev);
+		*nfcache |= cls->nfcache;
+	}
+
+	for (;;) {
+		if (cls)
+			e = ipt_cls_skip(cls, &key, base, e, &hint);
+		*nfcache |= e->nfcache;
+		(*looked)++;
+		if (++steps > 64 * (unsigned long) table_number)
+			return RUNAWAY;
+		t = get_target(e);
+		if (!packet_match(p, daddr, &e->ip)
+		    || p->dport < t->lo || p->dport > t->hi) {
+			e = (void *)e + e->next_offset;
+			continue;
+		}
+
+		e->counters.pcnt++;
+		e->counters.bcnt += p->len;
+
+		if (t->kind == ERROR)
+			return NF_DROP;
+		if (t->kind == REWRITE) {
+			daddr = t->newdst;
+			if (cls)
+				ipt_cls_key(cls, &key, p->protocol, daddr,
+					    p->indev);
+			e = (void *)e + e->next_offset;
+			continue;
+		}
+
+		if (t->verdict < 0) {
+			if (t->verdict != IPT_RETURN)
+				return (unsigned)(-t->verdict) - 1;
+			e = back;
+			back = (struct ipt_entry *)(base + back->comefrom);
+			continue;
+		}
+		if (base + t->verdict != (void *)e + e->next_offset) {
+			struct ipt_entry *next = (void *)e + e->next_offset;
+
+			next->comefrom = (char *)back - base;
+			back = next;
+		}
+		e = (struct ipt_entry *)(base + t->verdict);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int nrules = 2000, nchains = 40, npackets = 200000, c, i;
+	unsigned int seed = 1, off, n, bad = 0;
+	unsigned int nfc_walk = 0, nfc_cls = 0;
+	unsigned long looked_walk = 0, looked_cls = 0;
+	unsigned char *v_walk, *v_cls;
+	struct ipt_classifier *cls;
+	struct packet *pkts;
+	struct ipt_entry *a, *b;
+	double t0, t_walk, t_cls, t_build;
+	char *copy;
+
+	while ((c = getopt(argc, argv, "n:c:p:s:")) != -1) {
+		switch (c) {
+		case 'n': nrules = atoi(optarg); break;
+		case 'c': nchains = atoi(optarg); break;
+		case 'p': npackets = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: ipt-classify-check [-n rules] "
+				"[-c chains] [-p packets] [-s seed]\n");
+			return 2;
+		}
+	}
+	if (nchains < 1 || nrules < nchains || npackets <= 0)
+		return 2;
+
+	srandom(seed);
+	make_prefixes();
+	make_table(nrules, nchains);
+
+	t0 = now();
+	cls = ipt_cls_build(table, table_size, table_number);
+	t_build = now() - t0;
+	if (!cls) {
+		fprintf(stderr, "%u entries: no classifier (fewer than %d?)\n",
+			table_number, IPT_CLS_MIN);
+		return 1;
+	}
+
+	/* a second copy of the table, as for another CPU */
+	copy = malloc(table_size);
+	pkts = malloc(npackets * sizeof(*pkts));
+	v_walk = malloc(npackets);
+	v_cls = malloc(npackets);
+	if (!copy || !pkts || !v_walk || !v_cls) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	memcpy(copy, table, table_size);
+	for (i = 0; i < npackets; i++)
+		random_packet(&pkts[i]);
+
+	t0 = now();
+	for (i = 0; i < npackets; i++)
+		v_walk[i] = do_table(table, &pkts[i], NULL, &nfc_walk,
+				     &looked_walk);
+	t_walk = now() - t0;
+
+	t0 = now();
+	for (i = 0; i < npackets; i++)
+		v_cls[i] = do_table(copy, &pkts[i], cls, &nfc_cls,
+				    &looked_cls);
+	t_cls = now() - t0;
+
+	for (i = 0; i < npackets; i++) {
+		if (v_walk[i] != v_cls[i] && bad++ < 10)
+			fprintf(stderr, "packet %d: verdict %u, classified %u\n",
+				i, v_walk[i], v_cls[i]);
+	}
+	for (off = 0, n = 0; off < table_size; off += a->next_offset, n++) {
+		a = (struct ipt_entry *)(table + off);
+		b = (struct ipt_entry *)(copy + off);
+		if ((a->counters.pcnt != b->counters.pcnt
+		     || a->counters.bcnt != b->counters.bcnt) && bad++ < 10)
+			fprintf(stderr, "entry %u: counters %llu/%llu, "
+				"classified %llu/%llu\n", n,
+				(unsigned long long) a->counters.pcnt,
+				(unsigned long long) a->counters.bcnt,
+				(unsigned long long) b->counters.pcnt,
+				(unsigned long long) b->counters.bcnt);
+	}
+	if (nfc_walk & ~nfc_cls) {
+		fprintf(stderr, "nfcache %x, classified %x\n", nfc_walk,
+			nfc_cls);
+		bad++;
+	}
+
+	printf("%u entries in %d chains: %u interfaces, %u words a map, "
+	       "built in %.2f ms\n", table_number, nchains, cls->nifaces,
+	       cls->words, t_build * 1e3);
+	printf("walk      %8.1f entries/packet  %8.1f ns/packet\n",
+	       (double) looked_walk / npackets, t_walk * 1e9 / npackets);
+	printf("classify  %8.1f entries/packet  %8.1f ns/packet\n",
+	       (double) looked_cls / npackets, t_cls * 1e9 / npackets);
+
+	ipt_cls_free(cls);
+	if (bad) {
+		fprintf(stderr, "%u differences\n", bad);
+		return 1;
+	}
+	return 0;
+}
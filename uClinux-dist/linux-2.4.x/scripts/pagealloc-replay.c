@@ -0,0 +1,555 @@
+/*
+ * pagealloc-replay.c
+ *
+ * Replays page allocations through the free run index used by
+ * mmnommu/page_alloc2.c (mmnommu/page_extent.c, built here in user
+ * space) and through the bit map scanner it replaced, and compares how
+ * long they take and how big the largest free block stays.
+ *
+ * The trace is either generated, or the "pa2:" lines that page_alloc2.c
+ * logs when built with TRACE_PAGE_ALLOC, e.g. the output of dmesg:
+ *
+ *	pa2: a <address> <pages> <align order>	(address 0 if it failed)
+ *	pa2: f <address> <pages>
+ *
+ * Frees of pages the trace did not allocate (free_all_bootmem at boot)
+ * are ignored;  replay starts with everything but the reserved pages
+ * free.  Every allocation is checked for overlap and alignment,  and
+ * the index's idea of the largest free run against the bit map,  so
+ * this doubles as a test.  It exits non-zero if either is wrong.
+ *
+ *	pagealloc-replay [-m pages] [-r reserved] [-n ops] [-s seed]
+ *			[-i interval] [trace]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ *	just enough of the kernel for page_extent.c
+ */
+
+#define PAGE_SHIFT	12
+#define PAGE_SIZE	(1UL << PAGE_SHIFT)
+#define BITS_PER_LONG	(8 * sizeof(unsigned long))
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define INIT_LIST_HEAD(ptr) do { \
+	(ptr)->next = (ptr); (ptr)->prev = (ptr); \
+} while (0)
+#define list_empty(head)	((head)->next == (head))
+#define list_entry(ptr, type, member) \
+	((type *)((char *)(ptr)-(unsigned long)(&((type *)0)->member)))
+#define list_for_each(pos, head) \
+	for (pos = (head)->next; pos != (head); pos = pos->next)
+
+static void list_add(struct list_head *new, struct list_head *head)
+{
+	new->next = head->next;
+	new->prev = head;
+	head->next->prev = new;
+	head->next = new;
+}
+
+static void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+	entry->next = entry->prev = NULL;
+}
+
+struct page {
+	struct list_head list;
+	unsigned long index;
+};
+
+static struct page *ext_pages;
+
+#define page_address(p)	((void *) (((unsigned long) ((p) - ext_pages)) << PAGE_SHIFT))
+
+static void set_bit(unsigned long nr, void *addr)
+{
+	((unsigned long *) addr)[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static void clear_bit(unsigned long nr, void *addr)
+{
+	((unsigned long *) addr)[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+}
+
+static int test_bit(unsigned long nr, const void *addr)
+{
+	return (((const unsigned long *) addr)[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+#include "../mmnommu/page_extent.c"
+
+/****************************************************************************/
+
+static int find_next_zero_bit(const unsigned long *bits, int size, int offset)
+{
+	int i = offset < 0 ? 0 : offset;
+
+	while (i < size) {
+		if ((i % BITS_PER_LONG) == 0 && bits[i / BITS_PER_LONG] == ~0UL) {
+			i += BITS_PER_LONG;
+			continue;
+		}
+		if (!test_bit(i, bits))
+			return i;
+		i++;
+	}
+	return size;
+}
+
+static unsigned long largest_run(const unsigned long *bits, unsigned long npages)
+{
+	unsigned long i, n = 0, max = 0;
+
+	for (i = 0; i < npages; i++) {
+		if (test_bit(i, bits))
+			n = 0;
+		else if (++n > max)
+			max = n;
+	}
+	return max;
+}
+
+/****************************************************************************/
+
+static unsigned long npages = 4096;
+static unsigned long reserved = 256;
+
+/*
+ *	the allocators,  both hand out page numbers,  ~0UL on failure
+ */
+struct allocator {
+	const char *name;
+	unsigned long *bits;
+	void (*init)(struct allocator *);
+	unsigned long (*alloc)(unsigned long n, unsigned int align_order);
+	void (*free)(unsigned long start, unsigned long n);
+};
+
+/*
+ *	__get_contiguous_pages() before the free run index
+ */
+static unsigned long *scan_bits;
+static unsigned long scan_free;
+static int scan_first;
+
+static void scan_init(struct allocator *a)
+{
+	unsigned long i;
+
+	for (i = 0; i < reserved; i++)
+		set_bit(i, scan_bits);
+	scan_free = npages - reserved;
+	scan_first = reserved;
+}
+
+static unsigned long scan_alloc(unsigned long num_adjpages, unsigned int align_order)
+{
+	int n = 0, little_alloc = 0, ff, size = npages;
+	long p = -1;
+
+	if (num_adjpages > scan_free)
+		return ~0UL;
+	if (num_adjpages <= 2)
+		little_alloc = size;
+
+	ff = find_next_zero_bit(scan_bits, size,
+			num_adjpages <= 2 ? (little_alloc -= 16) : scan_first);
+
+	while (ff + num_adjpages <= size || little_alloc > 0) {
+		if (ff + num_adjpages <= size) {
+			p = ff;
+			if ((p << PAGE_SHIFT) & ((PAGE_SIZE << align_order) - 1))
+				n = 0;
+			else
+				for (n = 0; n < num_adjpages; n++, p++)
+					if (test_bit(p, scan_bits))
+						break;
+			if (n >= num_adjpages)
+				break;
+		}
+		ff = find_next_zero_bit(scan_bits, size,
+				num_adjpages <= 2 ? (little_alloc -= 16) : (ff + n + 1));
+	}
+
+	if (p >= 0 && n >= num_adjpages) {
+		scan_free -= num_adjpages;
+		while (n-- > 0)
+			set_bit(--p, scan_bits);
+		return p;
+	}
+	return ~0UL;
+}
+
+static void scan_release(unsigned long start, unsigned long n)
+{
+	unsigned long i;
+
+	for (i = start; i < start + n; i++) {
+		if (i < scan_first)
+			scan_first = i;
+		clear_bit(i, scan_bits);
+	}
+	scan_free += n;
+}
+
+/*
+ *	page_extent.c
+ */
+static unsigned long *ext_bits;
+
+static void ext_init(struct allocator *a)
+{
+	unsigned long i;
+
+	for (i = 0; i < npages; i++)
+		set_bit(i, ext_bits);
+	extent_init(ext_pages, ext_bits, npages);
+	for (i = reserved; i < npages; i++)
+		extent_free(i, 1);
+}
+
+static unsigned long ext_alloc(unsigned long n, unsigned int align_order)
+{
+	return extent_alloc(n, align_order, n <= 2);
+}
+
+static struct allocator allocators[] = {
+	{ "scanner", NULL, scan_init, scan_alloc, scan_release },
+	{ "extent", NULL, ext_init, ext_alloc, extent_free },
+};
+
+#define NR_ALLOCATORS	(sizeof(allocators) / sizeof(allocators[0]))
+
+/****************************************************************************/
+
+/*
+ *	the trace,  allocations are numbered and frees refer to them
+ */
+struct op {
+	char type;			/* 'a' or 'f' */
+	unsigned int align;
+	unsigned long id;
+	unsigned long n;
+};
+
+static struct op *ops;
+static unsigned long nops, maxops, nids;
+
+static void add_op(char type, unsigned long id, unsigned long n, unsigned int align)
+{
+	if (nops == maxops) {
+		maxops = maxops ? maxops * 2 : 4096;
+		ops = realloc(ops, maxops * sizeof(*ops));
+		if (!ops) {
+			perror("realloc");
+			exit(2);
+		}
+	}
+	ops[nops].type = type;
+	ops[nops].id = id;
+	ops[nops].n = n;
+	ops[nops].align = align;
+	nops++;
+}
+
+/*
+ *	recorded address of each live allocation,  open hashed
+ */
+#define LIVE_HASH	65536
+
+static struct {
+	unsigned long addr;
+	unsigned long id;
+	unsigned long n;
+} live[LIVE_HASH];
+
+static unsigned long live_slot(unsigned long addr)
+{
+	unsigned long h = (addr >> PAGE_SHIFT) % LIVE_HASH, i;
+
+	for (i = 0; i < LIVE_HASH; i++, h = (h + 1) % LIVE_HASH)
+		if (live[h].addr == addr || live[h].addr == 0)
+			return h;
+	fprintf(stderr, "too many live allocations in trace\n");
+	exit(2);
+}
+
+static void live_remove(unsigned long h)
+{
+	unsigned long j = h, k;
+
+	/* close the gap so later probes still find their entries */
+	live[h].addr = 0;
+	for (;;) {
+		j = (j + 1) % LIVE_HASH;
+		if (live[j].addr == 0)
+			return;
+		k = (live[j].addr >> PAGE_SHIFT) % LIVE_HASH;
+		if ((j > h && (k <= h || k > j)) || (j < h && (k <= h && k > j))) {
+			live[h] = live[j];
+			live[j].addr = 0;
+			h = j;
+		}
+	}
+}
+
+static void read_trace(FILE *fp)
+{
+	char line[256], *s, type;
+	unsigned long addr, n, h, unmatched = 0;
+	unsigned int align;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if ((s = strstr(line, "pa2: ")) == NULL)
+			continue;
+		align = 0;
+		if (sscanf(s, "pa2: %c %lx %lu %u", &type, &addr, &n, &align) < 3 || n == 0)
+			continue;
+		if (type == 'a') {
+			if (addr == 0)
+				continue;
+			h = live_slot(addr);
+			live[h].addr = addr;
+			live[h].id = nids;
+			live[h].n = n;
+			add_op('a', nids++, n, align);
+		} else if (type == 'f') {
+			h = live_slot(addr);
+			if (live[h].addr == 0) {
+				unmatched++;
+				continue;
+			}
+			add_op('f', live[h].id, n, 0);
+			if (n < live[h].n) {
+				/* the rest is freed later from its own address */
+				unsigned long id = live[h].id, left = live[h].n - n;
+
+				live_remove(h);
+				addr += n << PAGE_SHIFT;
+				h = live_slot(addr);
+				live[h].addr = addr;
+				live[h].id = id;
+				live[h].n = left;
+			} else
+				live_remove(h);
+		}
+	}
+	if (unmatched)
+		printf("ignored %lu frees of pages not allocated in the trace\n", unmatched);
+}
+
+/*
+ *	something like a board running busybox:  mostly single pages for
+ *	the page cache and slab,  some stacks and buffers,  and exec'd
+ *	images of up to a megabyte that come and go
+ */
+static void make_trace(unsigned long n, unsigned int seed)
+{
+	unsigned long *live_ids, *live_n, nlive = 0, pages = 0, i, j, size;
+	unsigned long target = (npages - reserved) * 3 / 4;
+	int r;
+
+	live_ids = malloc(npages * sizeof(*live_ids));
+	live_n = malloc(npages * sizeof(*live_n));
+	if (!live_ids || !live_n) {
+		perror("malloc");
+		exit(2);
+	}
+	srand(seed);
+	for (i = 0; i < n; i++) {
+		if (nlive && (pages >= target || nlive == npages || rand() % 2)) {
+			j = rand() % nlive;
+			add_op('f', live_ids[j], live_n[j], 0);
+			pages -= live_n[j];
+			live_ids[j] = live_ids[--nlive];
+			live_n[j] = live_n[nlive];
+			continue;
+		}
+		r = rand() % 100;
+		if (r < 60)
+			size = 1;
+		else if (r < 75)
+			size = 2;
+		else if (r < 90)
+			size = 3 + rand() % 14;
+		else
+			size = 17 + rand() % 240;
+		add_op('a', nids, size, size == 2);
+		live_ids[nlive] = nids++;
+		live_n[nlive++] = size;
+		pages += size;
+	}
+	free(live_ids);
+	free(live_n);
+}
+
+/****************************************************************************/
+
+static unsigned long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int replay(struct allocator *a, unsigned long interval)
+{
+	unsigned long *start, *left, *owner;
+	unsigned long i, j, t, d, p, n;
+	unsigned long allocs = 0, fails = 0, frees = 0;
+	unsigned long alloc_ns = 0, alloc_max = 0, free_ns = 0, free_max = 0;
+	unsigned long largest, min_largest = npages;
+	int errors = 0;
+
+	start = malloc(nids * sizeof(*start));
+	left = calloc(nids, sizeof(*left));
+	owner = malloc(npages * sizeof(*owner));
+	if ((nids && (!start || !left)) || !owner) {
+		perror("malloc");
+		exit(2);
+	}
+	for (i = 0; i < npages; i++)
+		owner[i] = ~0UL;
+	memset(a->bits, 0, (npages + BITS_PER_LONG - 1) / BITS_PER_LONG * sizeof(long));
+	a->init(a);
+
+	for (i = 0; i < nops; i++) {
+		struct op *o = &ops[i];
+
+		if (o->type == 'a') {
+			t = now_ns();
+			p = a->alloc(o->n, o->align);
+			d = now_ns() - t;
+			alloc_ns += d;
+			if (d > alloc_max)
+				alloc_max = d;
+			allocs++;
+			if (p == ~0UL) {
+				fails++;
+				continue;
+			}
+			if (p < reserved || p + o->n > npages ||
+					(p & ((1UL << o->align) - 1))) {
+				fprintf(stderr, "%s: bad allocation %lu+%lu\n", a->name, p, o->n);
+				errors++;
+			}
+			for (j = p; j < p + o->n && j < npages; j++) {
+				if (owner[j] != ~0UL && !errors++)
+					fprintf(stderr, "%s: page %lu given out twice\n", a->name, j);
+				owner[j] = o->id;
+			}
+			start[o->id] = p;
+			left[o->id] = o->n;
+		} else {
+			if (left[o->id] == 0)
+				continue;	/* the allocation failed */
+			n = o->n < left[o->id] ? o->n : left[o->id];
+			p = start[o->id];
+			for (j = p; j < p + n; j++)
+				owner[j] = ~0UL;
+			t = now_ns();
+			a->free(p, n);
+			d = now_ns() - t;
+			free_ns += d;
+			if (d > free_max)
+				free_max = d;
+			frees++;
+			start[o->id] += n;
+			left[o->id] -= n;
+		}
+		if (interval && (i % interval) == 0) {
+			largest = largest_run(a->bits, npages);
+			if (largest < min_largest)
+				min_largest = largest;
+			if (a->bits == ext_bits && extent_largest() != largest) {
+				fprintf(stderr, "%s: largest run %lu, bit map says %lu\n",
+						a->name, extent_largest(), largest);
+				errors++;
+			}
+		}
+	}
+	largest = largest_run(a->bits, npages);
+	if (largest < min_largest)
+		min_largest = largest;
+
+	printf("%-8s %8lu %7lu %8lu %8lu %8lu %8lu %7lu %7lu\n", a->name,
+			allocs, fails, allocs ? alloc_ns / allocs : 0, alloc_max,
+			frees ? free_ns / frees : 0, free_max, min_largest, largest);
+	free(start);
+	free(left);
+	free(owner);
+	return errors;
+}
+
+/****************************************************************************/
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pagealloc-replay [-m pages] [-r reserved] "
+			"[-n ops] [-s seed] [-i interval] [trace]\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long n = 200000, interval = 64, words, i;
+	unsigned int seed = 1;
+	int c, errors = 0;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "m:r:n:s:i:")) != -1) {
+		switch (c) {
+		case 'm': npages = strtoul(optarg, NULL, 0); break;
+		case 'r': reserved = strtoul(optarg, NULL, 0); break;
+		case 'n': n = strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		case 'i': interval = strtoul(optarg, NULL, 0); break;
+		default: usage();
+		}
+	}
+	if (npages == 0 || reserved >= npages)
+		usage();
+
+	if (optind < argc) {
+		if ((fp = fopen(argv[optind], "r")) == NULL) {
+			perror(argv[optind]);
+			exit(2);
+		}
+		read_trace(fp);
+		fclose(fp);
+	} else
+		make_trace(n, seed);
+
+	words = (npages + BITS_PER_LONG - 1) / BITS_PER_LONG;
+	scan_bits = malloc(words * sizeof(long));
+	ext_bits = malloc(words * sizeof(long));
+	ext_pages = calloc(npages, sizeof(struct page));
+	if (!scan_bits || !ext_bits || !ext_pages) {
+		perror("malloc");
+		exit(2);
+	}
+	allocators[0].bits = scan_bits;
+	allocators[1].bits = ext_bits;
+
+	printf("%lu ops on %lu pages, %lu reserved\n", nops, npages, reserved);
+	printf("%-8s %8s %7s %8s %8s %8s %8s %7s %7s\n", "", "allocs", "failed",
+			"avg ns", "max ns", "free ns", "max ns", "min big", "end big");
+	for (i = 0; i < NR_ALLOCATORS; i++)
+		errors += replay(&allocators[i], interval);
+	if (errors)
+		printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
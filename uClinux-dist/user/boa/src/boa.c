@@ -58,13 +58,10 @@ struct sockaddr_in6 server_sockaddr;		/* boa socket address */
 struct sockaddr_in server_sockaddr;		/* boa socket address */
 #endif
 
-struct timeval req_timeout;		/* timeval for select */
+struct timeval req_timeout;		/* timeval for event_dispatch */
 
 extern char *optarg;			/* getopt */
 
-fd_set block_read_fdset;
-fd_set block_write_fdset;
-
 int sighup_flag = 0;			/* 1 => signal has happened, needs attention */
 int sigchld_flag = 0;			/* 1 => signal has happened, needs attention */
 int lame_duck_mode = 0;
@@ -72,7 +69,7 @@ int lame_duck_mode = 0;
 int sock_opt = 1;
 int do_fork = 1;
 
-static int max_fd = 0;
+static void update_listeners(void);
 
 #ifdef EMBED
 static int log_pid()
@@ -144,6 +141,13 @@ int main(int argc, char **argv)
 #endif
 	create_common_env();
 
+	/* every idle keep-alive connection holds a descriptor; with poll or
+	 * epoll we can use as many as the hard limit allows */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
 #ifdef SERVER_SSL
 	if(InitSSLStuff() != 1){
 		/*TO DO - emit warning the SSL stuff will not work*/
@@ -190,9 +194,6 @@ int main(int argc, char **argv)
 		backlog = MIN(backlog, max_connections);
 	if (listen(server_s, backlog) == -1)
 		die(NO_LISTEN);
-
-	if (server_s > max_fd)
-		max_fd = server_s;
 #ifdef SERVER_SSL
 	}
 #endif /*SERVER_SSL*/
@@ -300,14 +301,20 @@ int main(int argc, char **argv)
 	/* main loop */
 
 	timestamp();
-	FD_ZERO(&block_read_fdset);
-	FD_ZERO(&block_write_fdset);
+	init_request_pools();
+	event_init();
+#ifdef SERVER_SSL
+	if (do_sock)
+#endif
+		event_add_listener(server_s, get_request);
+#ifdef SERVER_SSL
+	event_add_listener(server_ssl, get_ssl_request);
+#endif
 	
 	status.connections = 0;
 	status.requests = 0;
 	status.errors = 0;
 	
-	fdset_update();				/* set server_s and req_timeout */
 	while (1) {
 		if (sighup_flag)
 			sighup_run();
@@ -324,66 +331,66 @@ int main(int argc, char **argv)
 			default:
 		}
 		if (!request_ready) {
-			request *current;
+			update_listeners();
 
-			max_fd = 0;
-			max_fd = MAX(server_s, max_fd);
-#ifdef SERVER_SSL
-			max_fd = MAX(server_ssl, max_fd);
-#endif
-			for (current = request_block; current; current = current->next) {
-				max_fd = MAX(current->fd, max_fd);
-				max_fd = MAX(current->data_fd, max_fd);
-				max_fd = MAX(current->post_data_fd, max_fd);
-			}
-
-			if (select(max_fd + 1, &block_read_fdset, &block_write_fdset, NULL,
-					   (request_block ? &req_timeout : NULL)) == -1)
+			req_timeout.tv_sec = (ka_timeout ? ka_timeout : REQUEST_TIMEOUT);
+			req_timeout.tv_usec = 0l;
+
+			/* moves ready req's from request_block to request_ready */
+			if (event_dispatch(request_block ? &req_timeout : NULL) == -1)
 				if (errno == EINTR || errno == EBADF)
 					continue;	/* while(1) */
 				else
 					die(SELECT);
 
-#ifdef SERVER_SSL
-			if(do_sock){
-				if (FD_ISSET(server_s, &block_read_fdset))
-					get_request();
-			}
-#else
-			if (FD_ISSET(server_s, &block_read_fdset))
-				get_request();
-#endif /*SERVER_SSL*/
-
-#ifdef SERVER_SSL
-			if(FD_ISSET(server_ssl, &block_read_fdset)){ /*If we have the main SSL server socket*/
-/*				printf("SSL request received!!\n");*/
-				get_ssl_request();
-			}
-#endif /*SERVER_SSL*/
-
-			fdset_update();		/* move selected req's from request_block to request_ready */
+			timeout_requests();
 		}
 		process_requests();		/* any blocked req's move from request_ready to request_block */
 	}
 }
 
 /*
- * Name: fdset_update
+ * Name: update_listeners
+ *
+ * Description: Stops accepting while in lame duck mode or at
+ * MaxConnections, and starts again once there is room.
+ */
+
+static void update_listeners(void)
+{
+	int accepting;
+
+	accepting = (max_connections == -1 || status.connections < max_connections);
+
+#ifdef SERVER_SSL
+	if (do_sock)
+#endif
+		event_listen(server_s, accepting && !lame_duck_mode);
+#ifdef SERVER_SSL
+	event_listen(server_ssl, accepting);
+#endif
+}
+
+/*
+ * Name: timeout_requests
  * 
- * Description: iterate through the blocked requests, checking whether
- * that file descriptor has been set by select.  Update the fd_set to
- * reflect current status.
+ * Description: Closes blocked requests that have been idle too long.
+ * Readiness is tracked by the event backend, so this only needs to run
+ * when the clock has moved on rather than on every pass through the loop.
  */
 
-void fdset_update(void)
+void timeout_requests(void)
 {
+	static time_t last_run = 0;
 	request *current, *next;
 	time_t current_time;
-	int i;
-
-	current = request_block;
 
 	current_time = time(NULL);
+	if (current_time == last_run)
+		return;
+	last_run = current_time;
+
+	current = request_block;
 
 	while (current) {
 		time_t time_since;
@@ -404,70 +411,9 @@ void fdset_update(void)
 #endif
 			SQUASH_KA(current);
 			free_request(&request_block, current);
-		} else if (current->buffer_end) {
-			if (FD_ISSET(current->fd, &block_write_fdset))
-				ready_request(current);
-		} else {			
-			switch (current->status) {
-			case PIPE_WRITE:
-			case WRITE:
-				if (FD_ISSET(current->fd, &block_write_fdset))
-					ready_request(current);
-				else
-					FD_SET(current->fd, &block_write_fdset);
-				break;
-			case PIPE_READ:
-				if (FD_ISSET(current->data_fd, &block_read_fdset))
-					ready_request(current);
-				else
-					FD_SET(current->data_fd, &block_read_fdset);
-				break;
-			case BODY_WRITE:
-				if (FD_ISSET(current->post_data_fd, &block_write_fdset))
-					ready_request(current);
-				else
-					FD_SET(current->post_data_fd, &block_write_fdset);
-				break;
-			default:
-				if (FD_ISSET(current->fd, &block_read_fdset))
-					ready_request(current);
-				else
-					FD_SET(current->fd, &block_read_fdset);
-				break;
-			}			
 		}
 		current = next;
 	}
-
-	if (!lame_duck_mode &&
-      (max_connections == -1 || status.connections < max_connections)) { 
-#ifdef SERVER_SSL
-    if (do_sock) {
-			FD_SET(server_s, &block_read_fdset);	/* server always set */
-		}
-#else
-		FD_SET(server_s, &block_read_fdset);	/* server always set */
-#endif /*SERVER_SSL*/
-	} else {
-		if (server_s != -1
-#ifdef SERVER_SSL
-        && do_sock
-#endif
-        )
-			FD_CLR(server_s, &block_read_fdset);
-	}
-
-#ifdef SERVER_SSL
-	if (max_connections == -1 || status.connections < max_connections) {
-	  FD_SET(server_ssl, &block_read_fdset);
-    /* printf("Added server_ssl to fdset\n");*/
-	} else {
-	  FD_CLR(server_ssl, &block_read_fdset);
-	}
-#endif /*SERVER_SSL*/
-
-	req_timeout.tv_sec = (ka_timeout ? ka_timeout : REQUEST_TIMEOUT);
-	req_timeout.tv_usec = 0l;	/* reset timeout */
 }
 
 /*
@@ -597,9 +543,6 @@ InitSSLStuff(void)
 		return 0;		
 	}
 
-	if (server_ssl > max_fd)
-		max_fd = server_ssl;
-
 	/*Init all of the ssl stuff*/
 	syslog(LOG_DEBUG, "%s,%i: About to load error strings\n", __FILE__,__LINE__);fflush(NULL);
 /*	SSL_load_error_strings();*/
@@ -80,7 +80,7 @@ void dump_alias(void);
 /* boa */
 
 void die(int exit_code);
-void fdset_update(void);
+void timeout_requests(void);
 
 /* config */
 
@@ -89,6 +89,16 @@ void read_config_files(void);
 	void set_server_port(int port);
 #endif
 
+/* event */
+
+void event_init(void);
+void event_add_listener(int fd, void (*accept) (void));
+void event_listen(int fd, int on);
+int event_can_watch(int fd);
+void event_watch(request * req);
+void event_unwatch(request * req);
+int event_dispatch(struct timeval *timeout);
+
 /* get */
 
 int init_get(request * req);
@@ -112,6 +122,13 @@ int get_browser_hash_value(char *browser);
 void browser_match_request(request *req);
 #endif
 
+/* mmap_cache */
+
+struct mmap_entry *mmap_cache_get(char *path, struct stat *statbuf);
+char *mmap_cache_map(struct mmap_entry *e);
+void mmap_cache_release(struct mmap_entry *e);
+void mmap_cache_flush(void);
+
 /* log */
 
 void open_logs(void);
@@ -123,6 +140,13 @@ void log_error_time(void);
 void log_error_doc(request * req);
 void boa_perror(request * req, char *message);
 
+/* pool */
+
+void pool_init(struct pool *p, char *name, int size, int per_slab, int max);
+void *pool_get(struct pool *p);
+void pool_put(struct pool *p, void *obj);
+void pool_stats(struct pool *p);
+
 /* queue */
 
 void block_request(request * req);
@@ -138,8 +162,14 @@ int write_body(request * req);
 
 /* request */
 
+void init_request_pools(void);
+void request_pool_stats(void);
 request *new_request(void);
+int get_request_buffers(request * req);
 void get_request(void);
+#ifdef SERVER_SSL
+void get_ssl_request(void);
+#endif
 void free_request(request ** list_head_addr, request * req);
 void process_requests(void);
 int process_header_end(request * req);
@@ -147,7 +177,6 @@ int process_header_line(request * req);
 int process_logline(request * req);
 void process_option_line(request * req);
 void add_accept_header(request * req, char *mime_type);
-void free_requests(void);
 void dump_request(request *req);
 
 /* response */
@@ -140,8 +140,11 @@ struct ccommand clist[] = {
 	{ "DirectoryMaker",   S1A, c_set_string,   &dirmaker },
 	{ "KeepAliveMax",     S1A, c_set_int,      &ka_max },
 	{ "KeepAliveTimeout", S1A, c_set_int,      &ka_timeout },
+	{ "KeepAliveReleaseBuffers", S0A, c_set_unity, &ka_release_buffers },
+	{ "RequestPoolMax",   S1A, c_set_int,      &request_pool_max },
 	{ "MimeTypes",        S1A, c_set_string,   &mime_types },
 	{ "DefaultType",      S1A, c_set_string,   &default_type },
+	{ "EventBackend",     S1A, c_set_string,   &event_backend },
 	
 	{ "LocalCodepage",    S1A, c_set_string,   &local_codepage },
 	{ "Codepage",					S2A, c_codepage,     NULL },
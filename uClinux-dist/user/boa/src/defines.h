@@ -67,11 +67,13 @@
 #define MAX_HEADER_LENGTH			1024
 #define CLIENT_STREAM_SIZE			1024
 #define BUFFER_SIZE				CLIENT_STREAM_SIZE
+#define REQUEST_POOL_SLAB			4		/* requests/buffers per malloc */
 #else
 #define SOCKETBUF_SIZE				4096
 #define MAX_HEADER_LENGTH			1024
 #define CLIENT_STREAM_SIZE			8192
 #define BUFFER_SIZE				CLIENT_STREAM_SIZE
+#define REQUEST_POOL_SLAB			16
 #endif
 
 #define MIME_HASHTABLE_SIZE		47
@@ -81,9 +83,31 @@
 #define VIRTUALHOST_HASHTABLE_SIZE 47
 #define CODEPAGE_HASHTABLE_SIZE 47
 #define AUTH_HASHTABLE_SIZE 47
+#define MMAP_HASHTABLE_SIZE 47
+
+/* Open file / mmap cache for static documents (mmap_cache.c).  Files
+ * larger than MMAP_CACHE_MAX_FILE are never mapped, only sent with
+ * sendfile (or read) from the cached descriptor */
+#ifdef EMBED
+#define MMAP_CACHE_ENTRIES			16
+#define MMAP_CACHE_MAX_FILE			(32 * 1024)
+#define MMAP_CACHE_MAX_BYTES		(256 * 1024)
+#else
+#define MMAP_CACHE_ENTRIES			128
+#define MMAP_CACHE_MAX_FILE			(1024 * 1024)
+#define MMAP_CACHE_MAX_BYTES		(16 * 1024 * 1024)
+#endif
 
 #define REQUEST_TIMEOUT				60
 
+/* Readiness backends compiled in; select() is always available and
+ * EventBackend in boa.conf picks among them at run time */
+#define HAVE_POLL								1
+#define HAVE_SENDFILE							1
+#ifndef EMBED
+#define HAVE_EPOLL							1
+#endif
+
 #define CGI_MIME_TYPE    "application/x-httpd-cgi"
 #ifdef CONFIG_UCLINUX
 #define DEFAULT_PATH     "/bin:/usr/bin"
@@ -216,6 +240,9 @@
 #define CGI_WRITE				1
 #define CGI_CLOSE				2	/* used only for CGI_STATUS */
 
+#define EVENT_READ				1	/* req->event_mask */
+#define EVENT_WRITE				2
+
 #define CLIENT_WRITABLE(status) (status==WRITE || status==PIPE_WRITE)
 #define CLIENT_READABLE(status) (status < BODY_WRITE)
 #define PIPE_READABLE(status) (status == PIPE_READ)
@@ -0,0 +1,523 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1995 Paul Phillips <psp@well.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* boa: event.c */
+
+/*
+ * Readiness backends for the main loop.  Each blocked request registers
+ * exactly one fd (see event_target) when it goes onto the block list and
+ * removes it again when it leaves, so the loop never rebuilds interest
+ * sets.  With epoll only ready connections are touched per iteration;
+ * poll and select still hand the whole set to the kernel, but keep their
+ * arrays up to date incrementally.
+ */
+
+#include "boa.h"
+
+#ifdef HAVE_POLL
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#define BACKEND_SELECT	0
+#define BACKEND_POLL	1
+#define BACKEND_EPOLL	2
+
+#define MAX_LISTENERS	2
+#define EPOLL_BATCH		64
+
+char *event_backend = NULL;		/* EventBackend from boa.conf */
+
+fd_set block_read_fdset;
+fd_set block_write_fdset;
+
+struct listener {
+	int fd;
+	int on;						/* currently registered? */
+	void (*accept) (void);
+};
+
+static struct listener listeners[MAX_LISTENERS];
+static int num_listeners = 0;
+
+static int backend = BACKEND_SELECT;
+
+/* select: fd -> owning request, NULL for listeners or unused */
+static request *select_table[FD_SETSIZE];
+static int select_max_fd = -1;
+
+#ifdef HAVE_POLL
+static struct pollfd *poll_fds = NULL;
+static request **poll_reqs = NULL;	/* parallel to poll_fds, NULL = listener */
+static int poll_count = 0;
+static int poll_size = 0;
+#endif
+
+#ifdef HAVE_EPOLL
+static int epoll_fd = -1;
+#endif
+
+static char *backend_names[] = { "select", "poll", "epoll" };
+
+/*
+ * Name: event_target
+ *
+ * Description: Works out which fd a blocked request is waiting on
+ * and in which direction.  Returns the fd and stores EVENT_READ or
+ * EVENT_WRITE in *mask.
+ */
+
+static int event_target(request * req, int *mask)
+{
+	if (req->buffer_end) {
+		*mask = EVENT_WRITE;
+		return req->fd;
+	}
+
+	switch (req->status) {
+	case PIPE_WRITE:
+	case WRITE:
+		*mask = EVENT_WRITE;
+		return req->fd;
+	case PIPE_READ:
+		*mask = EVENT_READ;
+		return req->data_fd;
+	case BODY_WRITE:
+		*mask = EVENT_WRITE;
+		return req->post_data_fd;
+	default:
+		*mask = EVENT_READ;
+		return req->fd;
+	}
+}
+
+static struct listener *find_listener(int fd)
+{
+	int i;
+
+	for (i = 0; i < num_listeners; i++)
+		if (listeners[i].fd == fd)
+			return &listeners[i];
+	return NULL;
+}
+
+/*
+ * select backend
+ */
+
+static int select_add(int fd, int mask, request * req)
+{
+	if (fd < 0 || fd >= FD_SETSIZE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (mask & EVENT_READ)
+		FD_SET(fd, &block_read_fdset);
+	if (mask & EVENT_WRITE)
+		FD_SET(fd, &block_write_fdset);
+	select_table[fd] = req;
+	if (fd > select_max_fd)
+		select_max_fd = fd;
+	return 0;
+}
+
+static void select_del(int fd)
+{
+	FD_CLR(fd, &block_read_fdset);
+	FD_CLR(fd, &block_write_fdset);
+	select_table[fd] = NULL;
+
+	if (fd == select_max_fd) {
+		while (select_max_fd >= 0 &&
+			   !FD_ISSET(select_max_fd, &block_read_fdset) &&
+			   !FD_ISSET(select_max_fd, &block_write_fdset))
+			select_max_fd--;
+	}
+}
+
+static int select_dispatch(struct timeval *timeout)
+{
+	fd_set rfds, wfds;
+	int fd, n;
+	struct listener *l;
+
+	memcpy(&rfds, &block_read_fdset, sizeof(rfds));
+	memcpy(&wfds, &block_write_fdset, sizeof(wfds));
+
+	n = select(select_max_fd + 1, &rfds, &wfds, NULL, timeout);
+	if (n <= 0)
+		return n;
+
+	for (fd = 0; fd <= select_max_fd && n > 0; fd++) {
+		if (!FD_ISSET(fd, &rfds) && !FD_ISSET(fd, &wfds))
+			continue;
+		n--;
+		if (select_table[fd])
+			ready_request(select_table[fd]);
+		else if ((l = find_listener(fd)) && l->on)
+			l->accept();
+	}
+	return 0;
+}
+
+/*
+ * poll backend
+ */
+
+#ifdef HAVE_POLL
+static int poll_add(int fd, int mask, request * req)
+{
+	if (poll_count == poll_size) {
+		int size = poll_size ? poll_size * 2 : 64;
+		struct pollfd *fds;
+		request **reqs;
+
+		fds = (struct pollfd *) realloc(poll_fds, size * sizeof(*fds));
+		if (!fds)
+			return -1;
+		poll_fds = fds;
+		reqs = (request **) realloc(poll_reqs, size * sizeof(*reqs));
+		if (!reqs)
+			return -1;
+		poll_reqs = reqs;
+		poll_size = size;
+	}
+
+	poll_fds[poll_count].fd = fd;
+	poll_fds[poll_count].events = (mask & EVENT_READ ? POLLIN : 0) |
+		(mask & EVENT_WRITE ? POLLOUT : 0);
+	poll_fds[poll_count].revents = 0;
+	poll_reqs[poll_count] = req;
+	if (req)
+		req->event_index = poll_count;
+	return poll_count++;
+}
+
+static void poll_del(int index)
+{
+	/* move the last slot into the hole so the array stays dense */
+	if (index != --poll_count) {
+		poll_fds[index] = poll_fds[poll_count];
+		poll_reqs[index] = poll_reqs[poll_count];
+		if (poll_reqs[index])
+			poll_reqs[index]->event_index = index;
+	}
+}
+
+static int poll_find_fd(int fd)
+{
+	int i;
+
+	for (i = 0; i < poll_count; i++)
+		if (poll_fds[i].fd == fd && !poll_reqs[i])
+			return i;
+	return -1;
+}
+
+static int poll_dispatch(struct timeval *timeout)
+{
+	int i, n;
+	struct listener *l;
+
+	n = poll(poll_fds, poll_count,
+			 timeout ? timeout->tv_sec * 1000 + timeout->tv_usec / 1000 : -1);
+	if (n <= 0)
+		return n;
+
+	/*
+	 * Walk backwards: ready_request() removes the slot, which pulls
+	 * in an entry from the end that we have already looked at.
+	 */
+	for (i = poll_count - 1; i >= 0 && n > 0; i--) {
+		if (!poll_fds[i].revents)
+			continue;
+		n--;
+		if (poll_reqs[i])
+			ready_request(poll_reqs[i]);
+		else if ((l = find_listener(poll_fds[i].fd)) && l->on)
+			l->accept();
+	}
+	return 0;
+}
+#endif							/* HAVE_POLL */
+
+/*
+ * epoll backend
+ */
+
+#ifdef HAVE_EPOLL
+static int epoll_add(int fd, int mask, void *ptr)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = (mask & EVENT_READ ? EPOLLIN : 0) |
+		(mask & EVENT_WRITE ? EPOLLOUT : 0);
+	ev.data.ptr = ptr;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void epoll_del(int fd)
+{
+	struct epoll_event ev;		/* pre-2.6.9 kernels want non-NULL */
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+static int epoll_dispatch(struct timeval *timeout)
+{
+	struct epoll_event events[EPOLL_BATCH];
+	struct listener *l;
+	int i, n;
+
+	n = epoll_wait(epoll_fd, events, EPOLL_BATCH,
+				   timeout ? timeout->tv_sec * 1000 + timeout->tv_usec / 1000 : -1);
+	if (n <= 0)
+		return n;
+
+	for (i = 0; i < n; i++) {
+		l = (struct listener *) events[i].data.ptr;
+		if (l >= listeners && l < listeners + MAX_LISTENERS) {
+			if (l->on)
+				l->accept();
+		} else
+			ready_request((request *) events[i].data.ptr);
+	}
+	return 0;
+}
+#endif							/* HAVE_EPOLL */
+
+/*
+ * Name: event_init
+ *
+ * Description: Picks the readiness backend.  EventBackend in boa.conf
+ * names a preference; anything that isn't compiled in or fails to
+ * initialise falls back to the next simpler one, ending at select.
+ */
+
+void event_init(void)
+{
+	int want = BACKEND_EPOLL;
+
+	if (event_backend) {
+		if (!strcasecmp(event_backend, "select"))
+			want = BACKEND_SELECT;
+		else if (!strcasecmp(event_backend, "poll"))
+			want = BACKEND_POLL;
+	}
+
+	FD_ZERO(&block_read_fdset);
+	FD_ZERO(&block_write_fdset);
+	backend = BACKEND_SELECT;
+
+#ifdef HAVE_EPOLL
+	if (want == BACKEND_EPOLL) {
+		if ((epoll_fd = epoll_create(1024)) != -1) {
+			fcntl(epoll_fd, F_SETFD, 1);	/* not for CGIs */
+			backend = BACKEND_EPOLL;
+		} else
+			want = BACKEND_POLL;
+	}
+#endif
+#ifdef HAVE_POLL
+	if (backend == BACKEND_SELECT && want != BACKEND_SELECT)
+		backend = BACKEND_POLL;
+#endif
+
+	syslog(LOG_INFO, "using %s event backend", backend_names[backend]);
+}
+
+/*
+ * Name: event_add_listener
+ *
+ * Description: Tells the backend about a listening socket and the
+ * function to call when it has a connection pending.  Listeners start
+ * out disabled; see event_listen.
+ */
+
+void event_add_listener(int fd, void (*accept) (void))
+{
+	if (num_listeners == MAX_LISTENERS)
+		return;
+	listeners[num_listeners].fd = fd;
+	listeners[num_listeners].on = 0;
+	listeners[num_listeners].accept = accept;
+	num_listeners++;
+}
+
+/*
+ * Name: event_listen
+ *
+ * Description: Enables or disables accepting on a listening socket.
+ * Only issues a system call when the state actually changes, so the
+ * main loop can call this every iteration.
+ */
+
+void event_listen(int fd, int on)
+{
+	struct listener *l = find_listener(fd);
+
+	if (!l || l->on == on)
+		return;
+
+	switch (backend) {
+#ifdef HAVE_EPOLL
+	case BACKEND_EPOLL:
+		if (on) {
+			if (epoll_add(fd, EVENT_READ, l) == -1)
+				return;
+		} else
+			epoll_del(fd);
+		break;
+#endif
+#ifdef HAVE_POLL
+	case BACKEND_POLL:
+		if (on) {
+			if (poll_add(fd, EVENT_READ, NULL) == -1)
+				return;
+		} else {
+			int i = poll_find_fd(fd);
+			if (i != -1)
+				poll_del(i);
+		}
+		break;
+#endif
+	default:
+		if (on) {
+			if (select_add(fd, EVENT_READ, NULL) == -1)
+				return;
+		} else
+			select_del(fd);
+	}
+	l->on = on;
+}
+
+/*
+ * Name: event_can_watch
+ *
+ * Description: Returns nonzero if fd can be waited on at all.  Only
+ * select has a hard limit; connections past it are refused at accept
+ * time rather than spinning on the ready list.
+ */
+
+int event_can_watch(int fd)
+{
+	return backend != BACKEND_SELECT || fd < FD_SETSIZE;
+}
+
+/*
+ * Name: event_watch
+ *
+ * Description: Registers interest for a request that has just been
+ * put on the block list.  If the backend refuses the fd (epoll does
+ * for regular files, select for fds past FD_SETSIZE) the request is
+ * moved straight back to the ready list, since such an fd never blocks
+ * anyway or we have no way to wait for it.
+ */
+
+void event_watch(request * req)
+{
+	int fd, mask, ret;
+
+	if (req->event_mask)
+		return;
+
+	fd = event_target(req, &mask);
+
+	switch (backend) {
+#ifdef HAVE_EPOLL
+	case BACKEND_EPOLL:
+		ret = epoll_add(fd, mask, req);
+		break;
+#endif
+#ifdef HAVE_POLL
+	case BACKEND_POLL:
+		ret = poll_add(fd, mask, req);
+		break;
+#endif
+	default:
+		ret = select_add(fd, mask, req);
+	}
+
+	if (ret == -1) {
+		dequeue(&request_block, req);
+		enqueue(&request_ready, req);
+		return;
+	}
+
+	req->event_fd = fd;
+	req->event_mask = mask;
+}
+
+/*
+ * Name: event_unwatch
+ *
+ * Description: Drops whatever interest event_watch registered for req.
+ */
+
+void event_unwatch(request * req)
+{
+	if (!req->event_mask)
+		return;
+
+	switch (backend) {
+#ifdef HAVE_EPOLL
+	case BACKEND_EPOLL:
+		epoll_del(req->event_fd);
+		break;
+#endif
+#ifdef HAVE_POLL
+	case BACKEND_POLL:
+		poll_del(req->event_index);
+		break;
+#endif
+	default:
+		select_del(req->event_fd);
+	}
+
+	req->event_mask = 0;
+}
+
+/*
+ * Name: event_dispatch
+ *
+ * Description: Waits up to timeout (NULL = forever) for registered
+ * fds to become ready.  Ready requests are moved to the ready list and
+ * pending connections are accepted.  Returns -1 on error with errno set.
+ */
+
+int event_dispatch(struct timeval *timeout)
+{
+	switch (backend) {
+#ifdef HAVE_EPOLL
+	case BACKEND_EPOLL:
+		return epoll_dispatch(timeout);
+#endif
+#ifdef HAVE_POLL
+	case BACKEND_POLL:
+		return poll_dispatch(timeout);
+#endif
+	default:
+		return select_dispatch(timeout);
+	}
+}
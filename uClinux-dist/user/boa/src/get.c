@@ -24,6 +24,10 @@
 #include <syslog.h>
 #include "boa.h"
 
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
 /*
  * Name: init_get
  * Description: Initializes a non-script GET or HEAD request. 
@@ -41,9 +45,9 @@ int init_get(request * req)
 
 	req->cgi_env[req->cgi_env_index] = NULL;     /* terminate cgi env */
 	
-	data_fd = open(req->pathname, O_RDONLY);
+	req->mmap_entry = mmap_cache_get(req->pathname, &statbuf);
 
-	if (data_fd == -1) {		/* cannot open */
+	if (!req->mmap_entry && errno != EISDIR) {		/* cannot open */
 #ifdef GUNZIP
 		sprintf(buf, "%s.gz", req->pathname);
 		data_fd = open(buf, O_RDONLY);
@@ -88,11 +92,8 @@ int init_get(request * req)
 		return init_cgi(req);	/* 1 - OK, 2 - die */
 #endif
 	}
-	fstat(data_fd, &statbuf);
-
-	if (S_ISDIR(statbuf.st_mode)) {		/* directory */
-		close(data_fd);			/* close dir */
 
+	if (!req->mmap_entry) {		/* directory */
 		if (req->pathname[strlen(req->pathname) - 1] != '/') {
 			char buffer[3 * MAX_PATH_LENGTH + 128];
 
@@ -114,7 +115,6 @@ int init_get(request * req)
 	if (req->if_modified_since &&
 		!modified_since(&(statbuf.st_mtime), req->if_modified_since)) {
 		send_r_not_modified(req);
-		close(data_fd);
 		return 0;
 	}
 	req->filesize = statbuf.st_size;
@@ -122,25 +122,27 @@ int init_get(request * req)
 
 	if (req->method == M_HEAD) {
 		send_r_request_ok(req);
-		close(data_fd);
 		return 0;
 	}
-	/* MAP_OPTIONS: see compat.h */
-	req->data_mem = mmap(0, statbuf.st_size, 
-#ifdef USE_NLS			
-			PROT_READ|PROT_WRITE
-#else
-			PROT_READ
+
+	/*
+	 * Small files are served from the cache's shared mapping.  Anything
+	 * else goes out with sendfile, or is copied through req->buffer
+	 * where that isn't possible (see get_from_fd).
+	 */
+#ifdef USE_NLS
+	if (req->cp_table) {
+		/* converted in place, so it needs a private copy (see compat.h) */
+		req->data_mem = mmap(0, statbuf.st_size, PROT_READ|PROT_WRITE,
+				MAP_OPTIONS, req->mmap_entry->fd, 0);
+		if ((long) req->data_mem == -1)
+			req->data_mem = NULL;
+	} else
 #endif
-			, MAP_OPTIONS,data_fd, 0);
-	close(data_fd);				/* close data file */
+		req->data_mem = mmap_cache_map(req->mmap_entry);
 
-	if ((long) req->data_mem == -1) {
-		boa_perror(req, "mmap");
-		return 0;
-	}
 	send_r_request_ok(req);		/* All's well */
-	{
+	if (req->data_mem) {
 		static int bob;
 
 		bob = BUFFER_SIZE - req->buffer_end;
@@ -164,6 +166,66 @@ int init_get(request * req)
 	return 1;
 }
 
+/*
+ * Name: get_from_fd
+ * Description: Sends the next chunk of an unmapped file straight from
+ * the cached descriptor with sendfile.  If the filesystem can't do that
+ * (or we need the bytes ourselves for SSL or codepage conversion) the
+ * chunk is read into req->buffer instead, and req_flush sends it.
+ *
+ * Return values: as process_get
+ */
+
+static int get_from_fd(request * req, int bytes_to_write)
+{
+	struct mmap_entry *entry = req->mmap_entry;
+	int bytes;
+
+	if (bytes_to_write > BYTES_TO_WRITE)
+		bytes_to_write = BYTES_TO_WRITE;
+
+#ifdef HAVE_SENDFILE
+	if (!entry->no_sendfile
+#ifdef SERVER_SSL
+		&& req->ssl == NULL
+#endif
+#ifdef USE_NLS
+		&& !req->cp_table
+#endif
+		) {
+		off_t offset = req->filepos;
+
+		bytes = sendfile(req->fd, entry->fd, &offset, bytes_to_write);
+		if (bytes > 0) {
+			req->filepos += bytes;
+			return (req->filepos == req->filesize) ? 0 : 1;
+		}
+		if (bytes == -1) {
+			if (errno == EWOULDBLOCK || errno == EAGAIN)
+				return -1;
+			if (errno != EINVAL && errno != ENOSYS) {
+				if (errno != EPIPE)
+					log_error_doc(req);
+				return 0;
+			}
+		}
+		entry->no_sendfile = 1;	/* not on this filesystem: copy instead */
+	}
+#endif
+
+	if (bytes_to_write > BUFFER_SIZE)
+		bytes_to_write = BUFFER_SIZE;
+	bytes = pread(entry->fd, req->buffer, bytes_to_write, req->filepos);
+	if (bytes <= 0) {
+		log_error_doc(req);		/* file shrank under us */
+		return 0;
+	}
+	req->buffer_start = 0;
+	req->buffer_end = bytes;
+	req->filepos += bytes;
+	return 1;
+}
+
 /*
  * Name: process_get
  * Description: Writes a chunk of data to the socket.
@@ -179,6 +241,10 @@ int process_get(request * req)
 	int bytes_written, bytes_to_write;
 
 	bytes_to_write = req->filesize - req->filepos;
+	if (bytes_to_write == 0)
+		return 0;
+	if (!req->data_mem)
+		return get_from_fd(req, bytes_to_write);
 #ifdef USE_NLS
 	if (req->method != M_HEAD)
 	{
@@ -238,23 +304,24 @@ int process_get(request * req)
  * returns:
  *  -1 error
  *  0  cgi (either gunzip or auto-generated)
- *  >0  file descriptor of file
+ *  1  index file, now in req->mmap_entry
  */
 
 int get_dir(request * req, struct stat *statbuf)
 {
 
 	char pathname_with_index[MAX_PATH_LENGTH];
+#ifdef GUNZIP
 	int data_fd;
+#endif
 
 	sprintf(pathname_with_index, "%s%s", req->pathname, directory_index);
 
-	data_fd = open(pathname_with_index, O_RDONLY);
+	req->mmap_entry = mmap_cache_get(pathname_with_index, statbuf);
 
-	if (data_fd != -1) {		/* user's index file */
+	if (req->mmap_entry) {		/* user's index file */
 		strcat(req->request_uri, directory_index); /* for mimetype */
-		fstat(data_fd, statbuf);
-		return data_fd;
+		return 1;
 	}
 	if (errno == EACCES) {
 		send_r_forbidden(req);
@@ -31,6 +31,35 @@
 #include "defines.h"
 #include "compat.h"
 
+struct pool {					/* see pool.c */
+	char *name;
+	int size;					/* object size, header not included */
+	int per_slab;				/* objects per malloc */
+	int max;					/* objects kept pooled, 0 = no cap */
+	union pool_hdr *free;		/* free list */
+	int total;					/* objects in slabs */
+	int in_use;
+	int high_water;
+	int slabs;
+	long overflow;				/* allocations past max */
+};
+
+struct mmap_entry {				/* cached static document */
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	int fd;						/* kept open for sendfile, or -1 */
+	char *mem;					/* shared mapping, NULL if not mapped */
+	int no_sendfile;			/* sendfile failed once on this file */
+	int use_count;				/* requests using it */
+	int hashed;					/* still findable by path? */
+	time_t checked;				/* last stat() */
+	time_t last_used;			/* for eviction */
+	struct mmap_entry *next;	/* hash chain */
+};
+
 struct request {				/* pending requests */
 	int fd;						/* client's socket fd */
 	char *pathname;				/* pathname of requested file */
@@ -43,6 +72,7 @@ struct request {				/* pending requests */
 	unsigned long filesize;		/* filesize */
 	unsigned long filepos;		/* position in file */
 	char *data_mem;				/* mmapped/malloced char array */
+	struct mmap_entry *mmap_entry;	/* cache entry behind data_mem/sendfile */
 	time_t time_last;			/* time of last succ. op. */
 	int method;					/* M_GET, M_POST, etc. */
 
@@ -105,12 +135,18 @@ struct request {				/* pending requests */
 	char *authorization;
 #endif
 
+	int event_fd;				/* fd registered with event backend */
+	int event_mask;				/* EVENT_READ/WRITE, 0 if not registered */
+	int event_index;			/* slot in the poll array */
+
 	struct request *next;		/* next */
 	struct request *prev;		/* previous */
+
+	/* from the buffer pool; NULL while an idle keep-alive has given them back */
+	char *buffer;				/* generic I/O buffer, BUFFER_SIZE + 1 */
+	char *client_stream;		/* data from client - fit or be hosed */
 	
-	char buffer[BUFFER_SIZE + 1];			/* generic I/O buffer */
 	char request_uri[MAX_HEADER_LENGTH + 1];	/* uri */
-	char client_stream[CLIENT_STREAM_SIZE];		/* data from client - fit or be hosed */
 #ifdef ACCEPT_ON
 	char accept[MAX_ACCEPT_LENGTH];		/* Accept: fields */
 #endif
@@ -123,16 +159,12 @@ struct request {				/* pending requests */
 
 #ifdef ACCEPT_ON
 
-#define NO_ZERO_FILL_LENGTH (BUFFER_SIZE + 1 + \
-                             MAX_HEADER_LENGTH + 1 + \
-                             CLIENT_STREAM_SIZE + \
+#define NO_ZERO_FILL_LENGTH (MAX_HEADER_LENGTH + 1 + \
                              MAX_ACCEPT_LENGTH)
 
 #else
 
-#define NO_ZERO_FILL_LENGTH (BUFFER_SIZE + 1 + \
-                             MAX_HEADER_LENGTH + 1 + \
-                             CLIENT_STREAM_SIZE)
+#define NO_ZERO_FILL_LENGTH (MAX_HEADER_LENGTH + 1)
 
 #endif
 
@@ -173,7 +205,6 @@ extern FILE *yyin;				/* yacc input */
 
 extern request *request_ready;	/* first in ready list */
 extern request *request_block;	/* first in blocked list */
-extern request *request_free;	/* first in free list */
 
 extern fd_set block_read_fdset;	/* fds blocked on read */
 extern fd_set block_write_fdset;	/* fds blocked on write */
@@ -219,6 +250,11 @@ extern int backlog;
 
 extern int max_connections;
 
+extern char *event_backend;		/* EventBackend: select, poll or epoll */
+
+extern int request_pool_max;	/* RequestPoolMax */
+extern int ka_release_buffers;	/* KeepAliveReleaseBuffers */
+
 /* nls.c */
 extern char *local_codepage;
 
@@ -0,0 +1,271 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1995 Paul Phillips <psp@well.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* boa: mmap_cache.c */
+
+/*
+ * Open file / mmap cache for static documents.
+ *
+ * Entries are keyed by pathname and validated against the file's
+ * inode, size and mtime.  stat() is repeated at most once a second per
+ * entry, so a hot file costs no open, stat or mmap per request.  Each
+ * entry keeps its descriptor open for sendfile(); files up to
+ * MMAP_CACHE_MAX_FILE are also mapped once and shared by every request
+ * that serves them.  On no-MMU targets that shared mapping is the one
+ * copy of the file in RAM, instead of one per request.
+ *
+ * An entry whose file changed while requests still use it is unhashed
+ * and freed when the last of them lets go.
+ */
+
+#include "boa.h"
+
+static struct mmap_entry *mmap_hashtable[MMAP_HASHTABLE_SIZE];
+static int mmap_entries = 0;		/* in the hash */
+static long mmap_bytes = 0;			/* currently mapped, hashed or not */
+
+static int get_mmap_hash_value(char *path)
+{
+	unsigned int hash = 0;
+
+	while (*path)
+		hash = hash * 31 + (unsigned char) *path++;
+	return hash % MMAP_HASHTABLE_SIZE;
+}
+
+static void mmap_entry_free(struct mmap_entry *e)
+{
+	if (e->mem) {
+		munmap(e->mem, e->size);
+		mmap_bytes -= e->size;
+	}
+	if (e->fd != -1)
+		close(e->fd);
+	free(e->path);
+	free(e);
+}
+
+static void mmap_unhash(struct mmap_entry *e)
+{
+	struct mmap_entry **p;
+
+	for (p = &mmap_hashtable[get_mmap_hash_value(e->path)]; *p;
+		 p = &(*p)->next) {
+		if (*p == e) {
+			*p = e->next;
+			e->next = NULL;
+			e->hashed = 0;
+			mmap_entries--;
+			break;
+		}
+	}
+
+	if (!e->use_count)
+		mmap_entry_free(e);
+}
+
+/*
+ * Name: mmap_evict
+ *
+ * Description: Drops the least recently used idle entry.  Returns 0 if
+ * every entry is in use.
+ */
+
+static int mmap_evict(void)
+{
+	struct mmap_entry *e, *victim = NULL;
+	int i;
+
+	for (i = 0; i < MMAP_HASHTABLE_SIZE; i++)
+		for (e = mmap_hashtable[i]; e; e = e->next)
+			if (!e->use_count &&
+				(!victim || e->last_used < victim->last_used))
+				victim = e;
+
+	if (!victim)
+		return 0;
+	mmap_unhash(victim);
+	return 1;
+}
+
+/*
+ * Name: mmap_cache_get
+ *
+ * Description: Looks up (or opens and caches) the regular file at path
+ * and fills in statbuf.  The entry is returned referenced; hand it back
+ * with mmap_cache_release.
+ *
+ * Return value: the entry, or NULL with errno set.  errno is EISDIR for
+ * a directory, in which case statbuf is valid.
+ */
+
+struct mmap_entry *mmap_cache_get(char *path, struct stat *statbuf)
+{
+	struct mmap_entry *e;
+	int hash, fd;
+	time_t now = time(NULL);
+
+	hash = get_mmap_hash_value(path);
+	for (e = mmap_hashtable[hash]; e; e = e->next)
+		if (!strcmp(e->path, path))
+			break;
+
+	if (e && e->checked == now)
+		goto hit;
+
+	if (stat(path, statbuf) == -1) {
+		if (e)
+			mmap_unhash(e);
+		return NULL;
+	}
+	if (S_ISDIR(statbuf->st_mode)) {
+		if (e)
+			mmap_unhash(e);
+		errno = EISDIR;
+		return NULL;
+	}
+
+	if (e) {
+		if (e->ino == statbuf->st_ino && e->dev == statbuf->st_dev &&
+			e->mtime == statbuf->st_mtime && e->size == statbuf->st_size) {
+			e->checked = now;
+			goto hit;
+		}
+		mmap_unhash(e);			/* changed underneath us */
+	}
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return NULL;
+	/* the file may have been replaced between stat and open */
+	if (fstat(fd, statbuf) == -1 || !S_ISREG(statbuf->st_mode)) {
+		close(fd);
+		errno = EACCES;
+		return NULL;
+	}
+	fcntl(fd, F_SETFD, 1);		/* don't leak into CGIs */
+
+	if (mmap_entries >= MMAP_CACHE_ENTRIES)
+		mmap_evict();
+
+	e = (struct mmap_entry *) malloc(sizeof(struct mmap_entry));
+	if (!e || !(e->path = strdup(path))) {
+		if (e)
+			free(e);
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+	e->dev = statbuf->st_dev;
+	e->ino = statbuf->st_ino;
+	e->mtime = statbuf->st_mtime;
+	e->size = statbuf->st_size;
+	e->fd = fd;
+	e->mem = NULL;
+	e->no_sendfile = 0;
+	e->use_count = 0;
+	e->checked = now;
+
+	/* over the limit with everything in use: serve it uncached */
+	if (mmap_entries >= MMAP_CACHE_ENTRIES) {
+		e->hashed = 0;
+		e->next = NULL;
+	} else {
+		e->hashed = 1;
+		e->next = mmap_hashtable[hash];
+		mmap_hashtable[hash] = e;
+		mmap_entries++;
+	}
+	e->use_count++;
+	e->last_used = now;
+	return e;
+
+  hit:
+	memset(statbuf, 0, sizeof(*statbuf));
+	statbuf->st_mode = S_IFREG | S_IRUSR;
+	statbuf->st_dev = e->dev;
+	statbuf->st_ino = e->ino;
+	statbuf->st_size = e->size;
+	statbuf->st_mtime = e->mtime;
+	e->use_count++;
+	e->last_used = now;
+	return e;
+}
+
+/*
+ * Name: mmap_cache_map
+ *
+ * Description: Returns a shared read-only mapping of the whole file,
+ * creating it on first use.  Returns NULL if the file is too large to
+ * keep mapped, the byte budget is used up, or mmap isn't possible on
+ * this filesystem; callers should then use sendfile or read.
+ */
+
+char *mmap_cache_map(struct mmap_entry *e)
+{
+	char *mem;
+
+	if (e->mem || e->size == 0)
+		return e->mem;
+	if (e->size > MMAP_CACHE_MAX_FILE)
+		return NULL;
+
+	while (mmap_bytes + e->size > MMAP_CACHE_MAX_BYTES)
+		if (!mmap_evict())
+			return NULL;
+
+	mem = mmap(0, e->size, PROT_READ, MAP_OPTIONS, e->fd, 0);
+	if (mem == (char *) -1)
+		return NULL;
+
+	e->mem = mem;
+	mmap_bytes += e->size;
+	return mem;
+}
+
+/*
+ * Name: mmap_cache_release
+ *
+ * Description: Drops a reference taken by mmap_cache_get.
+ */
+
+void mmap_cache_release(struct mmap_entry *e)
+{
+	if (--e->use_count == 0 && !e->hashed)
+		mmap_entry_free(e);
+}
+
+/*
+ * Name: mmap_cache_flush
+ *
+ * Description: Forgets every idle entry, e.g. on SIGHUP.
+ */
+
+void mmap_cache_flush(void)
+{
+	struct mmap_entry *e, *next;
+	int i;
+
+	for (i = 0; i < MMAP_HASHTABLE_SIZE; i++)
+		for (e = mmap_hashtable[i]; e; e = next) {
+			next = e->next;
+			if (!e->use_count)
+				mmap_unhash(e);
+		}
+}
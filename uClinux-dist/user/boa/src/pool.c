@@ -0,0 +1,150 @@
+/*
+ *  Boa, an http server
+ *  Copyright (C) 1995 Paul Phillips <psp@well.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 1, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* boa: pool.c */
+
+/*
+ * Fixed-size object pools.  Objects are carved out of slabs of
+ * per_slab objects and recycled through a free list.  Slabs are never
+ * given back to malloc, so a long-running server settles on a fixed
+ * set of large blocks instead of fragmenting the heap with one
+ * malloc/free per connection (which hurts on no-MMU targets).
+ *
+ * Once max objects live in slabs, further allocations fall back to
+ * plain malloc and are freed on release, so a burst past the cap
+ * doesn't pin its memory forever.  max == 0 means no cap.
+ */
+
+#include "boa.h"
+
+union pool_hdr {
+	int from_slab;
+	union pool_hdr *next;		/* while on the free list */
+	double align;
+};
+
+#define HDR_SIZE			sizeof(union pool_hdr)
+#define OBJ_SIZE(p)			(HDR_SIZE + (p)->size)
+
+/*
+ * Name: pool_init
+ *
+ * Description: Sets up an empty pool of size-byte objects.
+ */
+
+void pool_init(struct pool *p, char *name, int size, int per_slab, int max)
+{
+	p->name = name;
+	p->size = (size + HDR_SIZE - 1) / HDR_SIZE * HDR_SIZE;
+	p->per_slab = per_slab;
+	p->max = max;
+	p->free = NULL;
+	p->total = p->in_use = p->high_water = p->slabs = 0;
+	p->overflow = 0;
+}
+
+static int pool_grow(struct pool *p)
+{
+	int i, n = p->per_slab;
+	char *slab;
+	union pool_hdr *h;
+
+	if (p->max && p->total + n > p->max)
+		n = p->max - p->total;
+	if (n <= 0)
+		return 0;
+
+	slab = (char *) malloc(n * OBJ_SIZE(p));
+	if (!slab)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		h = (union pool_hdr *) (slab + i * OBJ_SIZE(p));
+		h->next = p->free;
+		p->free = h;
+	}
+	p->total += n;
+	p->slabs++;
+	return 1;
+}
+
+/*
+ * Name: pool_get
+ *
+ * Description: Hands out one object (uninitialised).
+ *
+ * Return value: the object, or NULL if out of memory.
+ */
+
+void *pool_get(struct pool *p)
+{
+	union pool_hdr *h;
+
+	if (!p->free)
+		pool_grow(p);
+
+	if (p->free) {
+		h = p->free;
+		p->free = h->next;
+		h->from_slab = 1;
+	} else {
+		h = (union pool_hdr *) malloc(OBJ_SIZE(p));
+		if (!h)
+			return NULL;
+		h->from_slab = 0;
+		p->overflow++;
+	}
+
+	if (++p->in_use > p->high_water)
+		p->high_water = p->in_use;
+	return (char *) h + HDR_SIZE;
+}
+
+/*
+ * Name: pool_put
+ *
+ * Description: Returns an object obtained from pool_get.
+ */
+
+void pool_put(struct pool *p, void *obj)
+{
+	union pool_hdr *h = (union pool_hdr *) ((char *) obj - HDR_SIZE);
+
+	p->in_use--;
+	if (h->from_slab) {
+		h->next = p->free;
+		p->free = h;
+	} else
+		free(h);
+}
+
+/*
+ * Name: pool_stats
+ *
+ * Description: Logs usage figures for a pool.
+ */
+
+void pool_stats(struct pool *p)
+{
+	syslog(LOG_INFO, "%s pool: %d in use, %d high water, %d pooled in "
+		   "%d slabs (%ld bytes), %ld overflow allocations\n",
+		   p->name, p->in_use, p->high_water, p->total, p->slabs,
+		   (long) p->total * OBJ_SIZE(p), p->overflow);
+}
@@ -25,7 +25,6 @@
 
 request *request_ready = NULL;	/* ready list head */
 request *request_block = NULL;	/* blocked list head */
-request *request_free = NULL;	/* free list head */
 
 /*
  * Name: block_request
@@ -37,25 +36,7 @@ void block_request(request * req)
 {
 	dequeue(&request_ready, req);
 	enqueue(&request_block, req);
-
-	if (req->buffer_end) {
-		FD_SET(req->fd, &block_write_fdset);
-	} else {
-		switch (req->status) {
-		case PIPE_WRITE:
-		case WRITE:
-			FD_SET(req->fd, &block_write_fdset);
-			break;
-		case PIPE_READ:
-			FD_SET(req->data_fd, &block_read_fdset);
-			break;
-		case BODY_WRITE:
-			FD_SET(req->post_data_fd, &block_write_fdset);
-			break;
-		default:
-			FD_SET(req->fd, &block_read_fdset);
-		}
-	}
+	event_watch(req);
 }
 
 /*
@@ -66,27 +47,9 @@ void block_request(request * req)
 
 void ready_request(request * req)
 {
+	event_unwatch(req);
 	dequeue(&request_block, req);
 	enqueue(&request_ready, req);
-
-	if (req->buffer_end) {
-		FD_CLR(req->fd, &block_write_fdset);
-	} else {
-		switch (req->status) {
-		case PIPE_WRITE:
-		case WRITE:
-			FD_CLR(req->fd, &block_write_fdset);
-			break;
-		case PIPE_READ:
-			FD_CLR(req->data_fd, &block_read_fdset);
-			break;
-		case BODY_WRITE:
-			FD_CLR(req->post_data_fd, &block_write_fdset);
-			break;
-		default:
-			FD_CLR(req->fd, &block_read_fdset);
-		}
-	}
 }
 
 
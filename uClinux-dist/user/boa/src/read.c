@@ -43,6 +43,12 @@ int read_header(request * req)
 	int bytes, buf_bytes_left;
 	char *check, *buffer;
 
+	if (!req->client_stream) {	/* idle keep-alive gave its buffers back */
+		if (!get_request_buffers(req))
+			return 0;
+		req->header_line = req->client_stream;
+	}
+
 	if (req->pipeline_start){
 		buffer = req->client_stream;
 		bytes = req->client_stream_pos = req->pipeline_start;
@@ -38,11 +38,21 @@
 
 #include <syslog.h>
 
+#ifdef HAVE_POLL
+#include <sys/poll.h>
+#endif
+
 request *get_sock_request(int sock_fd);
 
 
 int sockbufsize = SOCKETBUF_SIZE;
 
+int request_pool_max = 0;		/* 0 = pool never shrinks past its peak */
+int ka_release_buffers = 0;
+
+static struct pool request_pool;
+static struct pool buffer_pool;	/* buffer + client_stream, in one piece */
+
 extern int server_s;			/* boa socket */
 extern int do_sock;				/*Do normal sockets??*/
 
@@ -52,10 +62,35 @@ extern SSL_CTX *ctx;			/*The global connection context*/
 extern int do_ssl;				/*do ssl sockets??*/
 #endif /*SERVER_SSL
 
+/*
+ * Name: init_request_pools
+ * Description: Sets up the request and I/O buffer pools.  Called once
+ * the config file has been read, since RequestPoolMax caps them.
+ */
+
+void init_request_pools(void)
+{
+	pool_init(&request_pool, "request", sizeof(request),
+			  REQUEST_POOL_SLAB, request_pool_max);
+	pool_init(&buffer_pool, "buffer", BUFFER_SIZE + 1 + CLIENT_STREAM_SIZE,
+			  REQUEST_POOL_SLAB, request_pool_max);
+}
+
+/*
+ * Name: request_pool_stats
+ * Description: Logs pool usage (on SIGUSR1).
+ */
+
+void request_pool_stats(void)
+{
+	pool_stats(&request_pool);
+	pool_stats(&buffer_pool);
+}
+
 /*
  * Name: new_request
- * Description: Obtains a request struct off the free list, or if the
- * free list is empty, allocates memory 
+ * Description: Obtains a request struct from the request pool.  The
+ * I/O buffers are attached separately with get_request_buffers.
  * 
  * Return value: pointer to initialized request
  */
@@ -64,24 +99,46 @@ request *new_request(void)
 {
 	request *req;
 
-	if (request_free) {
-		req = request_free;		/* first on free list */
-		dequeue(&request_free, request_free);	/* dequeue the head */
-	} else {
-		req = (request *) malloc(sizeof(request));
-		if (!req)
-			die(OUT_OF_MEMORY);
-	}
+	req = (request *) pool_get(&request_pool);
+	if (!req)
+		die(OUT_OF_MEMORY);
+
+	memset(req, 0, sizeof(request) - NO_ZERO_FILL_LENGTH);
 
 #ifdef SERVER_SSL 
 	req->ssl = NULL;
 #endif /*SERVER_SSL*/
 
-	memset(req, 0, sizeof(request) - NO_ZERO_FILL_LENGTH);
-
 	return req;
 }
 
+/*
+ * Name: get_request_buffers
+ * Description: Attaches I/O buffers from the buffer pool.
+ *
+ * Return value: 0 if out of memory, 1 otherwise
+ */
+
+int get_request_buffers(request * req)
+{
+	char *mem;
+
+	if (req->buffer)
+		return 1;
+	if (!(mem = (char *) pool_get(&buffer_pool)))
+		return 0;
+	req->buffer = mem;
+	req->client_stream = mem + BUFFER_SIZE + 1;
+	return 1;
+}
+
+static void put_request_buffers(request * req)
+{
+	if (req->buffer)
+		pool_put(&buffer_pool, req->buffer);
+	req->buffer = req->client_stream = NULL;
+}
+
 
 /*
  * Name: get_request
@@ -133,16 +190,28 @@ void get_ssl_request(void)
  * We must not loop here otherwise a DoS will have us for breakfast.
  */
 static void safe_close(int fd) {
+#ifdef HAVE_POLL
+	struct pollfd pfd;
+#else
 	fd_set rfd;
 	struct timeval to;
+#endif
 	char buf[32];
 	
+#ifdef HAVE_POLL
+	/* select() can't take fds past FD_SETSIZE */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+		read(fd, buf, sizeof buf);
+#else
 	to.tv_sec = 0;
 	to.tv_usec = 100;
 	FD_ZERO(&rfd);
 	FD_SET(fd, &rfd);
 	if ((select(fd+1, &rfd, NULL, NULL, &to)) > 0 && FD_ISSET(fd, &rfd))
 		read(fd, buf, sizeof buf);
+#endif
 	close(fd);
 }
 
@@ -159,30 +228,17 @@ void free_request(request ** list_head_addr, request * req)
 		return;
 
 	dequeue(list_head_addr, req);	/* dequeue from ready or block list */
-
-	if (req->buffer_end)
-		FD_CLR(req->fd, &block_write_fdset);
-	else {
-		switch (req->status) {
-		case PIPE_WRITE:
-		case WRITE:
-			FD_CLR(req->fd, &block_write_fdset);
-			break;
-		case PIPE_READ:
-			FD_CLR(req->data_fd, &block_read_fdset);
-			break;
-		case BODY_WRITE:
-			FD_CLR(req->post_data_fd, &block_write_fdset);
-			break;
-		default:
-			FD_CLR(req->fd, &block_read_fdset);
-		}
-	}
+	event_unwatch(req);
 
 	if (req->logline)			/* access log */
 		log_access(req);
 
-	if (req->data_mem)
+	if (req->mmap_entry) {
+		/* data_mem is the entry's shared mapping unless we made our own */
+		if (req->data_mem && req->data_mem != req->mmap_entry->mem)
+			munmap(req->data_mem, req->filesize);
+		mmap_cache_release(req->mmap_entry);
+	} else if (req->data_mem)
 		munmap(req->data_mem, req->filesize);
 	
 	if (req->data_fd)
@@ -200,7 +256,6 @@ void free_request(request ** list_head_addr, request * req)
 		conn = new_request();
 		conn->fd = req->fd;
 		conn->status = READ_HEADER;
-		conn->header_line = conn->client_stream;
 		conn->time_last = time(NULL);
 		conn->kacount = req->kacount;
 #ifdef SERVER_SSL
@@ -227,9 +282,18 @@ void free_request(request ** list_head_addr, request * req)
 		conn->pipeline_start = req->client_stream_pos - 
 								req->pipeline_start;
 		
+		/* the buffers move over to conn, unless it is going to sit
+		 * idle and KeepAliveReleaseBuffers wants them back meanwhile */
+		if (conn->pipeline_start || !ka_release_buffers) {
+			conn->buffer = req->buffer;
+			conn->client_stream = req->client_stream;
+			conn->header_line = conn->client_stream;
+			req->buffer = req->client_stream = NULL;
+		}
+
 		if (conn->pipeline_start) {
-			memcpy(conn->client_stream,
-				req->client_stream + req->pipeline_start,
+			memmove(conn->client_stream,
+				conn->client_stream + req->pipeline_start,
 				conn->pipeline_start);			
 			enqueue(&request_ready, conn);				
 		} else
@@ -277,7 +341,8 @@ void free_request(request ** list_head_addr, request * req)
 		req->post_file_name = NULL;
 	}
 
-	enqueue(&request_free, req);	/* put request on the free list */
+	put_request_buffers(req);
+	pool_put(&request_pool, req);
 
 	return;
 }
@@ -305,11 +370,9 @@ void process_requests(void)
 		crashdebug_current = current;
 #endif		
 		if (current->buffer_end) {
-			req_flush(current);
-			if (current->status == CLOSE)
+			retval = req_flush(current);	/* -1 blocks until writable */
+			if (retval == 1 && current->status == CLOSE)
 				retval = 0;
-			else
-				retval = 1;
 		} else {
 			switch (current->status) {
 			case READ_HEADER:
@@ -643,22 +706,6 @@ void add_accept_header(request * req, char *mime_type)
 #endif
 }
 
-void free_requests(void)
-		
-{
-	request *ptr, *next;
-	
-	ptr = request_free;
-	while(ptr != NULL) {
-		next = ptr->next;
-		/*Free the socket stuff if it exists*/
-		
-		free(ptr);
-		ptr = next;
-	}
-	request_free = NULL;
-}
-
 /*
  * Name: dump_request
  *
@@ -750,6 +797,11 @@ request *get_sock_request(int sock_fd)
 	}
 #endif
 
+	if (!event_can_watch(fd)) {
+		close(fd);
+		return NULL;
+	}
+
 	if ((setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *) &sock_opt,
 		sizeof(sock_opt))) == -1){
 			die(NO_SETSOCKOPT);
@@ -757,6 +809,8 @@ request *get_sock_request(int sock_fd)
 	}
 
 	conn = new_request();
+	if (!get_request_buffers(conn))
+		die(OUT_OF_MEMORY);
 	conn->fd = fd;
 	conn->status = READ_HEADER;
 	conn->header_line = conn->client_stream;
@@ -118,14 +118,13 @@ void sigterm(int dummy)
 
 void lame_duck_mode_run(int server_s)
 {
+    event_listen(server_s, 0);
     close(server_s);
 #ifdef BOA_TIME_LOG
 	log_error_time();
     fputs("caught SIGTERM, starting shutdown\n", stderr);
 #endif
     syslog(LOG_INFO, "caught SIGTERM, starting shutdown\n");
-    FD_CLR(server_s, &block_read_fdset);
-    close(server_s);
     lame_duck_mode = 2;
  }
 
@@ -154,7 +153,7 @@ void sighup_run(void)
 #ifdef USE_AUTH
 	dump_auth();
 #endif
-	free_requests();
+	mmap_cache_flush();
 #ifdef BOA_TIME_LOG
 	log_error_time();
 	fputs("re-reading configuration files\n", stderr);
@@ -212,4 +211,5 @@ void sigusr1(int dummy)
 #endif
 	syslog(LOG_INFO, "%ld requests, %ld errors, %ld connections\n", 
 			status.requests, status.errors, status.connections);
+	request_pool_stats();
 }
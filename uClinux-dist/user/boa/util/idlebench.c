@@ -0,0 +1,172 @@
+/*
+ * idlebench - measure how boa's per-request latency changes as the
+ * number of idle keep-alive connections grows.
+ *
+ * usage: idlebench [-h host] [-p port] [-u uri] [-n requests] idle...
+ *
+ * For each idle count it parks that many keep-alive connections on the
+ * server (one request each, then silence), times -n requests over a
+ * separate keep-alive connection, and prints the mean cost.  With the
+ * epoll backend the figure should stay flat from 100 to 10000 idle
+ * connections; with select it can't go past FD_SETSIZE at all.
+ *
+ * Both ends need a large enough descriptor limit (ulimit -n).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static struct sockaddr_in addr;
+static char request[512];
+
+static int connect_server(void)
+{
+	int fd, one = 1;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+/* send one request and read until the body (Content-Length) is in */
+static int do_request(int fd)
+{
+	char buf[8192], *p;
+	int n, got = 0, need = -1;
+
+	if (write(fd, request, strlen(request)) != strlen(request))
+		return -1;
+
+	for (;;) {
+		if (need < 0) {
+			n = read(fd, buf + got, sizeof(buf) - 1 - got);
+			if (n <= 0)
+				return -1;
+			got += n;
+			buf[got] = '\0';
+			if (!(p = strstr(buf, "\r\n\r\n")))
+				continue;
+			got -= p + 4 - buf;		/* body bytes already here */
+			if ((p = strstr(buf, "Content-Length:")) ||
+				(p = strstr(buf, "Content-length:")))
+				need = atoi(p + 15);
+			else
+				return -1;		/* can't keep-alive without a length */
+		} else {
+			n = read(fd, buf, sizeof(buf));
+			if (n <= 0)
+				return -1;
+			got += n;
+		}
+		if (got >= need)
+			return 0;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char *host = "127.0.0.1", *uri = "/index.html";
+	int port = 80, requests = 1000;
+	int *idle = NULL, nidle = 0, c, i, j;
+	struct rlimit rl;
+
+	while ((c = getopt(argc, argv, "h:p:u:n:")) != -1) {
+		switch (c) {
+		case 'h':
+			host = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'u':
+			uri = optarg;
+			break;
+		case 'n':
+			requests = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-h host] [-p port] [-u uri] "
+					"[-n requests] idle...\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (optind == argc) {
+		static char *defaults[] = { "100", "1000", "10000" };
+		argv = defaults - optind;
+		argc = optind + 3;
+	}
+
+	getrlimit(RLIMIT_NOFILE, &rl);
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(host);
+	snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\n"
+			 "Connection: Keep-Alive\r\n\r\n", uri);
+
+	printf("%8s %12s\n", "idle", "usec/req");
+	for (i = optind; i < argc; i++) {
+		int want = atoi(argv[i]), fd;
+		struct timeval start, end;
+		double usec;
+
+		while (nidle > want)
+			close(idle[--nidle]);
+		if (nidle < want) {
+			idle = realloc(idle, want * sizeof(int));
+			if (idle == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		while (nidle < want) {
+			if ((fd = connect_server()) == -1 || do_request(fd) == -1) {
+				fprintf(stderr, "could only park %d connections: %s\n",
+						nidle, strerror(errno));
+				exit(1);
+			}
+			idle[nidle++] = fd;
+		}
+
+		if ((fd = connect_server()) == -1) {
+			perror("connect");
+			exit(1);
+		}
+		gettimeofday(&start, NULL);
+		for (j = 0; j < requests; j++) {
+			if (do_request(fd) == -1) {
+				/* KeepAliveMax reached, open another */
+				close(fd);
+				if ((fd = connect_server()) == -1 || do_request(fd) == -1) {
+					perror("request");
+					exit(1);
+				}
+			}
+		}
+		gettimeofday(&end, NULL);
+		close(fd);
+
+		usec = (end.tv_sec - start.tv_sec) * 1e6 +
+			(end.tv_usec - start.tv_usec);
+		printf("%8d %12.1f\n", want, usec / requests);
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,394 @@
+/* dnsbench - query throughput benchmark for dnsmasq.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 dated June, 1991.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+/* Replays a query log against a running dnsmasq and plays the
+   upstream server itself, so that the numbers measure dnsmasq and not
+   the network.
+
+   The log has one query per line, either "A <name>", "PTR <a.b.c.d>"
+   or just a name; anything after the name is ignored, so the query
+   column cut out of a tcpdump or named log will do.
+
+   Typical use, as root since the stub has to be on port 53:
+
+     echo nameserver 127.0.0.2 > /tmp/resolv.bench
+     dnsmasq -d -h -c 5000 -p 5353 -r /tmp/resolv.bench &
+     dnsbench -p 5353 -s 127.0.0.2 -n 10 queries.log
+
+   The stub answers every A query with an address made from the name
+   and every PTR query with a name made from the address, with a long
+   TTL, so repeats of a name should be answered from the cache. The
+   "upstream" count shows how many were not. With -S it runs only the
+   stub, for driving dnsmasq with some other client. */
+
+#include <arpa/nameser.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define MAXQUERIES 65536 /* distinct query IDs */
+
+struct query {
+  char name[MAXDNAME];
+  int type;
+};
+
+static struct query *queries;
+static int nqueries;
+static char inflight[MAXQUERIES];
+
+static void die(char *message)
+{
+  perror(message);
+  exit(1);
+}
+
+static void read_log(char *file)
+{
+  FILE *f;
+  char line[MAXDNAME + 16], word1[MAXDNAME], word2[MAXDNAME];
+  int size = 1024, words;
+  unsigned int a, b, c, d;
+
+  if (!(f = fopen(file, "r")))
+    die(file);
+
+  if (!(queries = malloc(size * sizeof(struct query))))
+    die("malloc");
+
+  while (fgets(line, sizeof(line), f))
+    {
+      struct query *q;
+
+      if ((words = sscanf(line, "%1024s %1024s", word1, word2)) < 1 ||
+	  word1[0] == '#')
+	continue;
+
+      if (nqueries == size)
+	{
+	  size *= 2;
+	  if (!(queries = realloc(queries, size * sizeof(struct query))))
+	    die("realloc");
+	}
+      q = &queries[nqueries++];
+
+      if (words == 2 && strcasecmp(word1, "PTR") == 0 &&
+	  sscanf(word2, "%u.%u.%u.%u", &a, &b, &c, &d) == 4)
+	{
+	  sprintf(q->name, "%u.%u.%u.%u.in-addr.arpa", d, c, b, a);
+	  q->type = T_PTR;
+	}
+      else
+	{
+	  strcpy(q->name, (words == 2 && strcasecmp(word1, "A") == 0) ? word2 : word1);
+	  q->type = T_A;
+	}
+    }
+
+  fclose(f);
+
+  if (nqueries == 0)
+    {
+      fprintf(stderr, "dnsbench: no queries in %s\n", file);
+      exit(1);
+    }
+}
+
+/* write name as labels at p, return the byte after it */
+static unsigned char *put_name(unsigned char *p, char *name)
+{
+  while (*name)
+    {
+      unsigned char *len = p++;
+      while (*name && *name != '.')
+	*p++ = *name++;
+      *len = p - len - 1;
+      if (*name)
+	name++;
+    }
+  *p++ = 0;
+  return p;
+}
+
+/* read the labels at p into name, return the byte after them */
+static unsigned char *get_name(unsigned char *p, char *name)
+{
+  char *cp = name;
+
+  while (*p)
+    {
+      int len = *p++;
+      if (cp != name)
+	*cp++ = '.';
+      memcpy(cp, p, len);
+      cp += len;
+      p += len;
+    }
+  *cp = 0;
+  return p + 1;
+}
+
+static int make_query(unsigned char *packet, int id, struct query *q)
+{
+  HEADER *header = (HEADER *)packet;
+  unsigned char *p;
+
+  memset(packet, 0, sizeof(HEADER));
+  header->id = htons(id);
+  header->rd = 1;
+  header->qdcount = htons(1);
+  p = put_name(packet + sizeof(HEADER), q->name);
+  PUTSHORT(q->type, p);
+  PUTSHORT(C_IN, p);
+  return p - packet;
+}
+
+/* The upstream server: turn the query in packet into its answer. */
+static int make_answer(unsigned char *packet, int len)
+{
+  HEADER *header = (HEADER *)packet;
+  char name[MAXDNAME], target[MAXDNAME];
+  unsigned char *p, *rdlen;
+  unsigned int a, b, c, d, h;
+  int type;
+  char *cp;
+
+  if (len < (int)sizeof(HEADER) || header->qr || ntohs(header->qdcount) != 1)
+    return 0;
+
+  p = get_name(packet + sizeof(HEADER), name);
+  GETSHORT(type, p);
+  p += 2; /* class */
+
+  header->qr = 1;
+  header->ra = 1;
+  header->ancount = htons(1);
+  header->nscount = header->arcount = 0;
+
+  PUTSHORT(0xc000 | sizeof(HEADER), p); /* pointer to the question */
+  PUTSHORT(type, p);
+  PUTSHORT(C_IN, p);
+  PUTLONG(86400, p);
+  rdlen = p;
+  p += 2;
+
+  if (type == T_PTR &&
+      sscanf(name, "%u.%u.%u.%u.in-addr.arpa", &d, &c, &b, &a) == 4)
+    {
+      sprintf(target, "host-%u-%u-%u-%u.bench", a, b, c, d);
+      p = put_name(p, target);
+    }
+  else if (type == T_A)
+    {
+      for (h = 0, cp = name; *cp; cp++)
+	h = h*33 + (unsigned char)*cp;
+      *p++ = 10;
+      *p++ = h >> 16;
+      *p++ = h >> 8;
+      *p++ = h;
+    }
+  else
+    {
+      header->ancount = 0;
+      header->rcode = NXDOMAIN;
+      return rdlen - 10 - packet;
+    }
+
+  PUTSHORT(p - rdlen - 2, rdlen);
+
+  /* An authority record too, as real servers send. dnsmasq's
+     extract_name won't take a name which ends the packet, so without
+     it PTR answers would never be cached. */
+  header->nscount = htons(1);
+  *p++ = 0; /* root */
+  PUTSHORT(T_NS, p);
+  PUTSHORT(C_IN, p);
+  PUTLONG(86400, p);
+  PUTSHORT(10, p);
+  p = put_name(p, "ns.bench");
+
+  return p - packet;
+}
+
+static int udp_socket(char *addr, int port)
+{
+  struct sockaddr_in sin;
+  int fd;
+
+  if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1)
+    die("socket");
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(port);
+  sin.sin_addr.s_addr = inet_addr(addr);
+  if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+    die("bind");
+
+  return fd;
+}
+
+static double now_secs(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+  char *server = "127.0.0.1", *stub = "127.0.0.2";
+  int port = 53, window = 32, repeat = 1, stubonly = 0;
+  int c, stubfd, clientfd, sent = 0, total, outstanding = 0;
+  long answered = 0, upstream = 0, lost = 0, bad = 0;
+  struct sockaddr_in dest;
+  unsigned char packet[PACKETSZ];
+  double start, elapsed;
+
+  while ((c = getopt(argc, argv, "a:p:s:w:n:S")) != -1)
+    switch (c)
+      {
+      case 'a': server = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 's': stub = optarg; break;
+      case 'w': window = atoi(optarg); break;
+      case 'n': repeat = atoi(optarg); break;
+      case 'S': stubonly = 1; break;
+      default:
+	fprintf(stderr,
+		"Usage: dnsbench [-a server] [-p port] [-s stub-addr] [-w window] "
+		"[-n repeat] [-S] <query log>\n");
+	exit(1);
+      }
+
+  if (window < 1 || window >= MAXQUERIES)
+    window = 32;
+
+  stubfd = udp_socket(stub, NAMESERVER_PORT);
+
+  if (!stubonly)
+    {
+      if (optind >= argc)
+	{
+	  fprintf(stderr, "dnsbench: no query log\n");
+	  exit(1);
+	}
+      read_log(argv[optind]);
+      clientfd = udp_socket("0.0.0.0", 0);
+      memset(&dest, 0, sizeof(dest));
+      dest.sin_family = AF_INET;
+      dest.sin_port = htons(port);
+      dest.sin_addr.s_addr = inet_addr(server);
+    }
+  else
+    clientfd = -1;
+
+  total = nqueries * repeat;
+  start = now_secs();
+
+  while (stubonly || sent < total || outstanding > 0)
+    {
+      fd_set rset;
+      struct timeval tv;
+      int len, maxfd = stubfd;
+
+      /* keep the window full */
+      while (!stubonly && sent < total && outstanding < window)
+	{
+	  int id = sent % MAXQUERIES;
+	  len = make_query(packet, id, &queries[sent % nqueries]);
+	  if (sendto(clientfd, packet, len, 0,
+		     (struct sockaddr *)&dest, sizeof(dest)) == -1)
+	    die("sendto");
+	  inflight[id] = 1;
+	  sent++;
+	  outstanding++;
+	}
+
+      FD_ZERO(&rset);
+      FD_SET(stubfd, &rset);
+      if (clientfd != -1)
+	{
+	  FD_SET(clientfd, &rset);
+	  if (clientfd > maxfd)
+	    maxfd = clientfd;
+	}
+      tv.tv_sec = 1;
+      tv.tv_usec = 0;
+
+      if ((c = select(maxfd+1, &rset, NULL, NULL, stubonly ? NULL : &tv)) == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  die("select");
+	}
+
+      if (c == 0)
+	{
+	  /* one second with nothing back: give up on the window */
+	  memset(inflight, 0, sizeof(inflight));
+	  lost += outstanding;
+	  outstanding = 0;
+	  continue;
+	}
+
+      if (FD_ISSET(stubfd, &rset))
+	{
+	  struct sockaddr_in from;
+	  socklen_t fromlen = sizeof(from);
+
+	  len = recvfrom(stubfd, packet, sizeof(packet), 0,
+			 (struct sockaddr *)&from, &fromlen);
+	  if (len > 0 && (len = make_answer(packet, len)) > 0)
+	    {
+	      sendto(stubfd, packet, len, 0, (struct sockaddr *)&from, fromlen);
+	      upstream++;
+	    }
+	}
+
+      if (clientfd != -1 && FD_ISSET(clientfd, &rset))
+	{
+	  HEADER *header = (HEADER *)packet;
+	  int id;
+
+	  len = recv(clientfd, packet, sizeof(packet), 0);
+	  if (len < (int)sizeof(HEADER))
+	    continue;
+	  id = ntohs(header->id);
+	  if (!inflight[id])
+	    continue; /* late reply to a query already counted lost */
+	  inflight[id] = 0;
+	  outstanding--;
+	  if (header->rcode != NOERROR || ntohs(header->ancount) == 0)
+	    bad++;
+	  else
+	    answered++;
+	}
+    }
+
+  elapsed = now_secs() - start;
+
+  printf("%d queries (%d in log) in %.3f seconds: %.0f queries/sec\n",
+	 total, nqueries, elapsed, total / elapsed);
+  printf("answered %ld, failed %ld, lost %ld, upstream %ld\n",
+	 answered, bad, lost, upstream);
+
+  return 0;
+}
@@ -16,19 +16,26 @@
 
 #define VERSION "0.992"
 
-#define FTABSIZ 100 /* max number of outstanding requests */
 #ifdef __uClinux__
+#define FTABSIZ 100 /* max number of outstanding requests */
+#define FHASHSIZ 128 /* forward table hash buckets, power of 2 */
 #define CACHESIZ 20 /* default cache size */
+#define BATCHSIZ 4 /* packets read from a socket per select() */
 #define HOSTSFILE "/etc/config/hosts"
 #define RESOLVFILE "/etc/config/resolv.conf"
 #else
+#define FTABSIZ 1000
+#define FHASHSIZ 1024
 #define CACHESIZ 300 /* default cache size */
+#define BATCHSIZ 16
 #define HOSTSFILE "/etc/hosts"
 #define RESOLVFILE "/etc/resolv.conf"
 #endif
 #define MAXLIN 1024 /* line length in config files */
 #define RUNFILE "/var/run/dnsmasq.pid"
 
+#define _GNU_SOURCE /* for recvmmsg and sendmmsg, where libc has them */
+
 #include <arpa/nameser.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
@@ -51,19 +58,30 @@
 #include <time.h>
 #include <errno.h>
 
+/* glibc with recvmmsg() and sendmmsg() defines MSG_WAITFORONE too.
+   The kernel may still lack them, in which case we fall back at run
+   time. */
+#if defined(MSG_WAITFORONE) && defined(__USE_GNU)
+#define HAVE_MMSG
+#endif
+
 struct crec { 
   char name[MAXDNAME];
   struct in_addr addr;
-  struct crec *next, *prev;
+  struct crec *next, *prev; /* LRU list, youngest first */
+  struct crec *name_next; /* name hash chain, if F_FORWARD */
+  struct crec *addr_next; /* address hash chain, if F_REVERSE */
   time_t ttd; /* time to die */
+  unsigned long batch; /* reply which created it, see cache_mark_all_old */
   int flags;
 };
 
 #define F_IMMORTAL 1
-#define F_NEW 2
 #define F_REVERSE 4
 #define F_FORWARD 8
 
+#define MINHASHSIZ 64 /* hash buckets, rounded up to cachesize */
+
 struct server {
   struct sockaddr_in addr;
   struct server *next; /* circle */
@@ -83,6 +101,26 @@ struct frec {
   unsigned short orig_id, new_id;
   int fd;
   time_t time;
+  struct frec *next, *prev; /* in use oldest first, or free list */
+  struct frec *id_next; /* hashed on new_id */
+  struct frec *sender_next; /* hashed on orig_id and source */
+};
+
+/* a received packet, and where from */
+struct packet {
+  /* Size: we check after adding each record, so there must be 
+     memory for the largest packet, and the largest record */
+  char data[PACKETSZ+MAXDNAME+RRFIXEDSZ];
+  int len;
+  struct sockaddr addr;
+};
+
+/* a reply waiting for flush_replies */
+struct reply {
+  int fd;
+  struct sockaddr addr;
+  char *data;
+  int len;
 };
 
 static void cache_insert(struct crec *crecp);
@@ -104,10 +142,16 @@ static void reload_cache(int use_hosts, int cachesize);
 static void reload_servers(char *fname, struct irec *interfaces, int port);
 static struct irec *find_all_interfaces(int fd);
 static void sig_hangup(int sig);
+static void init_frecs(void);
 static struct frec *get_new_frec(time_t now);
+static void hash_frec(struct frec *f);
+static void free_frec(struct frec *f);
 static struct frec *lookup_frec(unsigned short id);
 static struct frec *lookup_frec_by_sender(unsigned short id,
 					  struct sockaddr *addr);
+static int recv_batch(int fd);
+static void queue_reply(int fd, char *data, int len, struct sockaddr *addr);
+static void flush_replies(void);
 static unsigned short get_id(void);
 static void extract_addresses(HEADER *header, int qlen);
 static struct crec *cache_find_by_addr(struct crec *crecp, struct in_addr addr, time_t now);
@@ -118,13 +162,24 @@ static void cache_remove_old_addr(struct in_addr addr, time_t now);
 static void cache_name_insert(char *name, struct in_addr addr, time_t ttd);
 static void cache_addr_insert(char *name, struct in_addr addr, time_t ttd);
 static void cache_host_insert(struct crec *crecp, char *name, struct in_addr addr);
+static void cache_hash_init(int cachesize);
+static void cache_hash(struct crec *crecp);
+static void cache_unhash(struct crec *crecp);
 static int private_net(struct in_addr addr);
 static unsigned char *add_text_record(unsigned int nameoffset, unsigned char *p, unsigned short ttl, 
 				      unsigned short pref, unsigned short type, char *name);
 
 static struct crec *cache_head, *cache_tail;
+static struct crec **name_hash, **addr_hash;
+static unsigned int hash_mask;
+static unsigned long cache_batch = 1;
 static struct server *last_server;  
 static struct frec *ftab;
+static struct frec *frec_free, *frec_oldest, *frec_newest;
+static struct frec *frec_id_hash[FHASHSIZ], *frec_sender_hash[FHASHSIZ];
+static struct packet *packets;
+static struct reply replies[BATCHSIZ];
+static int nreplies;
 
 static int sighup;
 static char *mxname;
@@ -193,8 +248,8 @@ int main (int argc, char **argv)
 	    option = '?'; /* error */
 	  else if ((cachesize > 0) && (cachesize < 20))
 	    cachesize = 20;
-	  else if (cachesize > 1000)
-	    cachesize = 1000;
+	  else if (cachesize > 10000)
+	    cachesize = 10000;
 	}
 
       if (option == 'p')
@@ -245,21 +300,26 @@ int main (int argc, char **argv)
     }
 
   ftab = (struct frec *)malloc(FTABSIZ*sizeof(struct frec));
+  packets = (struct packet *)malloc(BATCHSIZ*sizeof(struct packet));
   crecp = (struct crec *)malloc(cachesize*sizeof(struct crec));
   
-  if (!ftab || !crecp)
+  if (!ftab || !packets || !crecp)
     {
       fprintf(stderr, "dnsmasq: could not get memory");
       exit(1);
     }
 
-  for (i=0; i<FTABSIZ; i++)
-    ftab[i].new_id = 0;
+  init_frecs();
   
+  cache_hash_init(cachesize);
   cache_head = NULL;
   cache_tail = crecp;
   for (i=0; i<cachesize; i++, crecp++)
-    cache_insert(crecp);
+    {
+      crecp->flags = 0;
+      crecp->batch = 0;
+      cache_insert(crecp);
+    }
 
   if (daemon)
     {
@@ -323,9 +383,6 @@ int main (int argc, char **argv)
 
   while (1)
     {
-      /* Size: we check after adding each record, so there must be 
-	 memory for the largest packet, and the largest record */
-      char packet[PACKETSZ+MAXDNAME+RRFIXEDSZ];
       int n, maxfd = peerfd;
       fd_set rset;
       HEADER *header;
@@ -358,44 +415,52 @@ int main (int argc, char **argv)
 	  reload_servers(resolv, interfaces, port);
 	}
 
+      /* Each ready socket is drained of up to BATCHSIZ packets per
+	 wakeup, and the replies go out together once the batch has
+	 been dealt with. */
+
       if (FD_ISSET(peerfd, &rset))
 	{
-	  /* packet from peer server, extract data for cache, and send to
-	     original requester */
-	  n = recvfrom(peerfd, packet, PACKETSZ, 0, NULL, NULL);
- 
-	  header = (HEADER *)packet;
-	  if (n >= sizeof(HEADER) && header->qr)
+	  /* packets from peer servers, extract data for cache, and send to
+	     original requesters */
+	  n = recv_batch(peerfd);
+	  for (i=0; i<n; i++)
 	    {
-	      struct frec *forward = lookup_frec(ntohs(header->id));
-	      if (forward)
+	      header = (HEADER *)packets[i].data;
+	      if (packets[i].len >= sizeof(HEADER) && header->qr)
 		{
-		  last_server = forward->sentto; /* known good */
-		  if (cachesize != 0 && header->opcode == QUERY && header->rcode == NOERROR)
-		    extract_addresses(header, n);
-		  header->id = htons(forward->orig_id);
-		  sendto(forward->fd, packet, n, 0, 
-			 &forward->source, sizeof(forward->source));
-		  forward->new_id = 0; /* cancel */
+		  struct frec *forward = lookup_frec(ntohs(header->id));
+		  if (forward)
+		    {
+		      last_server = forward->sentto; /* known good */
+		      if (cachesize != 0 && header->opcode == QUERY && header->rcode == NOERROR)
+			extract_addresses(header, packets[i].len);
+		      header->id = htons(forward->orig_id);
+		      queue_reply(forward->fd, packets[i].data, packets[i].len,
+				  &forward->source);
+		      free_frec(forward); /* cancel */
+		    }
 		}
 	    }
+	  flush_replies();
 	}
       
       for (iface = interfaces; iface; iface = iface->next)
 	{
 	  if (FD_ISSET(iface->fd, &rset))
 	    {
-	      /* request packet, deal with query */
-	      struct sockaddr udpaddr;
-	      socklen_t udplen;
-	      udplen = sizeof(udpaddr);
-	      n = recvfrom(iface->fd, packet, PACKETSZ, 0, &udpaddr, &udplen); 
-	      /* DS: Kernel 2.2.x complains if AF_INET isn't set */
-	      ((struct sockaddr_in *)&udpaddr)->sin_family = AF_INET;
+	      /* request packets, deal with queries */
+	      n = recv_batch(iface->fd);
+	      for (i=0; i<n; i++)
+		{
+		  /* DS: Kernel 2.2.x complains if AF_INET isn't set */
+		  ((struct sockaddr_in *)&packets[i].addr)->sin_family = AF_INET;
 	      
-	      header = (HEADER *)packet;
-	      if (n >= sizeof(HEADER) && !header->qr)
-		do_one_query(iface->fd, peerfd, &udpaddr, header, n);
+		  header = (HEADER *)packets[i].data;
+		  if (packets[i].len >= sizeof(HEADER) && !header->qr)
+		    do_one_query(iface->fd, peerfd, &packets[i].addr, header, packets[i].len);
+		}
+	      flush_replies();
 	    }
 	}
     }
@@ -483,7 +548,6 @@ static void reload_servers(char *fname, struct irec *interfaces, int port)
 {
   FILE *f;
   char *line, buff[MAXLIN];
-  int i;
 
   f = fopen(fname, "r");
   if (!f)
@@ -496,8 +560,7 @@ static void reload_servers(char *fname, struct irec *interfaces, int port)
 
   /* forward table rules reference servers, so have to blow 
      them away */
-  for (i=0; i<FTABSIZ; i++)
-    ftab[i].new_id = 0;
+  init_frecs();
   
   /* delete existing ones */
   if (last_server)
@@ -562,18 +625,25 @@ static void reload_servers(char *fname, struct irec *interfaces, int port)
 	
 static void reload_cache(int use_hosts, int cachesize)
 {
-  struct crec *cache;
+  struct crec *cache, *tmp;
   FILE *f;
   char *line, buff[MAXLIN];
 
-  for (cache=cache_head; cache; cache = cache->next)
-    if (cache->flags & F_IMMORTAL)
-      {
-	cache_unlink(cache);
-	free(cache);
-      }
-    else
-      cache->flags = 0;
+  /* everything is about to be unhashed */
+  memset(name_hash, 0, (hash_mask+1)*sizeof(struct crec *));
+  memset(addr_hash, 0, (hash_mask+1)*sizeof(struct crec *));
+
+  for (cache=cache_head; cache; cache = tmp)
+    {
+      tmp = cache->next;
+      if (cache->flags & F_IMMORTAL)
+	{
+	  cache_unlink(cache);
+	  free(cache);
+	}
+      else
+	cache->flags = 0;
+    }
   
   if (!use_hosts && (cachesize > 0))
     {
@@ -621,8 +691,7 @@ static void do_one_query(int udpfd,
       (m = process_request(header, ((char *)header) + PACKETSZ, plen)))
     {
       /* answered from cache, send reply */
-      sendto(udpfd, (char *)header, m, 0, 
-	     udpaddr, sizeof(struct sockaddr));
+      queue_reply(udpfd, (char *)header, m, udpaddr);
       return;
     }
   
@@ -645,6 +714,7 @@ static void do_one_query(int udpfd,
       forward->new_id = get_id();
       forward->fd = udpfd;
       forward->orig_id = ntohs(header->id);
+      hash_frec(forward);
       header->id = htons(forward->new_id);
       forward->sentto = last_server;
       last_server = last_server->next;
@@ -672,7 +742,7 @@ static void do_one_query(int udpfd,
       
       /* could not send on, prepare to return */ 
       header->id = htons(forward->orig_id);
-      forward->new_id = 0; /* cancel */
+      free_frec(forward); /* cancel */
     }	  
   
   /* could not send on, return empty answer */
@@ -684,64 +754,253 @@ static void do_one_query(int udpfd,
   header->ancount = htons(0); /* no answers */
   header->nscount = htons(0);
   header->arcount = htons(0);
-  sendto(udpfd, (char *)header, plen, 0, 
-	 udpaddr, sizeof(struct sockaddr));
+  queue_reply(udpfd, (char *)header, plen, udpaddr);
 }
 
-static struct frec *get_new_frec(time_t now)
+/* The forward table is kept as a list of entries in use, oldest
+   first, and a free list. Entries in use are hashed on the id we sent
+   upstream, for replies, and on the requester's id and address, for
+   retries, so neither needs a scan of the table. */
+
+static void init_frecs(void)
 {
   int i;
-  struct frec *oldest = &ftab[0];
-  time_t oldtime = now;
 
-  for(i=0; i<FTABSIZ; i++)
+  memset(frec_id_hash, 0, sizeof(frec_id_hash));
+  memset(frec_sender_hash, 0, sizeof(frec_sender_hash));
+  frec_oldest = frec_newest = frec_free = NULL;
+
+  for (i=0; i<FTABSIZ; i++)
     {
-      struct frec *f = &ftab[i];
-      if (f->time <= oldtime)
-	{
-	  oldtime = f->time;
-	  oldest = f;
-	}
-      if (f->new_id == 0)
-	{
-	  f->time = now;
-	  return f;
-	}
+      ftab[i].new_id = 0;
+      ftab[i].next = frec_free;
+      frec_free = &ftab[i];
     }
+}
 
-  /* table full, use oldest */
+static unsigned int frec_sender_hash_val(unsigned short id,
+					 struct sockaddr *addr)
+{
+  unsigned char *p = (unsigned char *)addr;
+  unsigned int i, h = id;
 
-  oldest->time = now;
-  return oldest;
+  /* all of it, since lookup_frec_by_sender compares all of it */
+  for (i=0; i<sizeof(struct sockaddr); i++)
+    h = h*31 + p[i];
+  return h & (FHASHSIZ-1);
 }
- 
-static struct frec *lookup_frec(unsigned short id)
+
+static void unhash_frec(struct frec *f)
 {
-  int i;
-  for(i=0; i<FTABSIZ; i++)
+  struct frec **up;
+
+  for (up = &frec_id_hash[f->new_id & (FHASHSIZ-1)]; *up; up = &(*up)->id_next)
+    if (*up == f)
+      {
+	*up = f->id_next;
+	break;
+      }
+
+  for (up = &frec_sender_hash[frec_sender_hash_val(f->orig_id, &f->source)];
+       *up; up = &(*up)->sender_next)
+    if (*up == f)
+      {
+	*up = f->sender_next;
+	break;
+      }
+}
+
+static void unlink_frec(struct frec *f)
+{
+  if (f->prev)
+    f->prev->next = f->next;
+  else
+    frec_oldest = f->next;
+
+  if (f->next)
+    f->next->prev = f->prev;
+  else
+    frec_newest = f->prev;
+}
+
+static struct frec *get_new_frec(time_t now)
+{
+  struct frec *f;
+
+  if ((f = frec_free))
+    frec_free = f->next;
+  else
     {
-      struct frec *f = &ftab[i];
-      if (f->new_id == id)
-	return f;
+      /* table full, use oldest */
+      f = frec_oldest;
+      unhash_frec(f);
+      unlink_frec(f);
     }
+
+  f->time = now;
+  f->next = NULL;
+  f->prev = frec_newest;
+  if (frec_newest)
+    frec_newest->next = f;
+  else
+    frec_oldest = f;
+  frec_newest = f;
+
+  return f;
+}
+
+/* call once new_id, orig_id and source are filled in */
+static void hash_frec(struct frec *f)
+{
+  unsigned int h = f->new_id & (FHASHSIZ-1);
+
+  f->id_next = frec_id_hash[h];
+  frec_id_hash[h] = f;
+
+  h = frec_sender_hash_val(f->orig_id, &f->source);
+  f->sender_next = frec_sender_hash[h];
+  frec_sender_hash[h] = f;
+}
+
+static void free_frec(struct frec *f)
+{
+  unhash_frec(f);
+  unlink_frec(f);
+  f->new_id = 0;
+  f->next = frec_free;
+  frec_free = f;
+}
+ 
+static struct frec *lookup_frec(unsigned short id)
+{
+  struct frec *f;
+
+  for (f = frec_id_hash[id & (FHASHSIZ-1)]; f; f = f->id_next)
+    if (f->new_id == id)
+      return f;
   return NULL;
 }
 
 static struct frec *lookup_frec_by_sender(unsigned short id,
 					  struct sockaddr *addr)
+{
+  struct frec *f;
+
+  for (f = frec_sender_hash[frec_sender_hash_val(id, addr)]; f; f = f->sender_next)
+    if (f->orig_id == id && 
+	memcmp(&f->source, addr, sizeof(f->source)) == 0)
+      return f;
+  return NULL;
+}
+
+/* Read up to BATCHSIZ packets from fd into packets[] without blocking,
+   return how many. */
+static int recv_batch(int fd)
 {
   int i;
-  for(i=0; i<FTABSIZ; i++)
+  socklen_t addrlen;
+#ifdef HAVE_MMSG
+  static int no_mmsg = 0;
+
+  if (!no_mmsg)
+    {
+      struct mmsghdr msgs[BATCHSIZ];
+      struct iovec iov[BATCHSIZ];
+      int n;
+
+      memset(msgs, 0, sizeof(msgs));
+      for (i=0; i<BATCHSIZ; i++)
+	{
+	  iov[i].iov_base = packets[i].data;
+	  iov[i].iov_len = PACKETSZ;
+	  msgs[i].msg_hdr.msg_iov = &iov[i];
+	  msgs[i].msg_hdr.msg_iovlen = 1;
+	  msgs[i].msg_hdr.msg_name = &packets[i].addr;
+	  msgs[i].msg_hdr.msg_namelen = sizeof(packets[i].addr);
+	}
+
+      if ((n = recvmmsg(fd, msgs, BATCHSIZ, MSG_DONTWAIT, NULL)) != -1)
+	{
+	  for (i=0; i<n; i++)
+	    packets[i].len = msgs[i].msg_len;
+	  return n;
+	}
+
+      if (errno != ENOSYS)
+	return 0;
+      no_mmsg = 1; /* old kernel */
+    }
+#endif
+
+  for (i=0; i<BATCHSIZ; i++)
     {
-      struct frec *f = &ftab[i];
-      if (f->new_id &&
-	  f->orig_id == id && 
-	  memcmp(&f->source, addr, sizeof(f->source)) == 0)
-	return f;
+      addrlen = sizeof(packets[i].addr);
+      packets[i].len = recvfrom(fd, packets[i].data, PACKETSZ, MSG_DONTWAIT,
+				&packets[i].addr, &addrlen);
+      if (packets[i].len == -1)
+	break;
     }
-  return NULL;
+
+  return i;
+}
+
+/* data must stay put until the next flush_replies() */
+static void queue_reply(int fd, char *data, int len, struct sockaddr *addr)
+{
+  struct reply *r;
+
+  if (nreplies == BATCHSIZ)
+    flush_replies();
+
+  r = &replies[nreplies++];
+  r->fd = fd;
+  r->addr = *addr;
+  r->data = data;
+  r->len = len;
 }
 
+static void flush_replies(void)
+{
+  int i = 0;
+#ifdef HAVE_MMSG
+  static int no_mmsg = 0;
+
+  while (!no_mmsg && i < nreplies)
+    {
+      struct mmsghdr msgs[BATCHSIZ];
+      struct iovec iov[BATCHSIZ];
+      int j, n, fd = replies[i].fd;
+
+      /* one call for each run of replies on the same socket */
+      memset(msgs, 0, sizeof(msgs));
+      for (j=0; i+j < nreplies && replies[i+j].fd == fd; j++)
+	{
+	  iov[j].iov_base = replies[i+j].data;
+	  iov[j].iov_len = replies[i+j].len;
+	  msgs[j].msg_hdr.msg_iov = &iov[j];
+	  msgs[j].msg_hdr.msg_iovlen = 1;
+	  msgs[j].msg_hdr.msg_name = &replies[i+j].addr;
+	  msgs[j].msg_hdr.msg_namelen = sizeof(replies[i+j].addr);
+	}
+
+      if ((n = sendmmsg(fd, msgs, j, 0)) == -1)
+	{
+	  if (errno == ENOSYS)
+	    no_mmsg = 1; /* old kernel */
+	  else
+	    i++; /* drop it, like a failed sendto */
+	}
+      else
+	i += n;
+    }
+#endif
+
+  for (; i<nreplies; i++)
+    sendto(replies[i].fd, replies[i].data, replies[i].len, 0,
+	   &replies[i].addr, sizeof(replies[i].addr));
+
+  nreplies = 0;
+}
 
 /* return unique ids between 1 and 65535 */
 /* These are now random, FSVO random, to frustrate DNS spoofers */
@@ -1239,6 +1498,9 @@ static struct crec *cache_get_free(void)
       return cache_get_free();
     }
 	
+  /* Off the hash chains before the searches below can find it. */
+  cache_unhash(ret);
+
   /* The next bit ensures that if there is more than one entry
      for a name or address, they all get removed at once */
 
@@ -1266,6 +1528,7 @@ static void cache_unlink (struct crec *crecp)
 
 static void cache_free(struct crec *crecp)
 {
+  cache_unhash(crecp);
   cache_unlink(crecp);
   crecp->flags = 0;
   cache_tail->next = crecp;
@@ -1274,27 +1537,97 @@ static void cache_free(struct crec *crecp)
   cache_tail = crecp;
 }
 
+/* Entries made while processing the current reply are "new" and
+   are not removed by cache_remove_old_*. Starting a new batch makes
+   every existing entry old without touching any of them. */
 static void cache_mark_all_old(void)
 {
-  struct crec *crecp;
-  
-  for (crecp = cache_head; crecp; crecp = crecp->next)
-    crecp->flags &= ~F_NEW;
+  cache_batch++;
+}
+
+static unsigned int hash_name(char *name)
+{
+  unsigned int h = 0;
+
+  while (*name)
+    h = h*31 + (unsigned char)*name++;
+  return h & hash_mask;
+}
+
+static unsigned int hash_addr(struct in_addr addr)
+{
+  unsigned int h = ntohl(addr.s_addr);
+
+  return (h ^ (h >> 8) ^ (h >> 16)) & hash_mask;
+}
+
+static void cache_hash_init(int cachesize)
+{
+  unsigned int size = MINHASHSIZ;
+
+  while (size < cachesize)
+    size <<= 1;
+  hash_mask = size - 1;
+  name_hash = (struct crec **)calloc(size, sizeof(struct crec *));
+  addr_hash = (struct crec **)calloc(size, sizeof(struct crec *));
+  if (!name_hash || !addr_hash)
+    {
+      fprintf(stderr, "dnsmasq: could not get memory");
+      exit(1);
+    }
 }
 
+/* put an entry on the hash chains its flags say it belongs on */
+static void cache_hash(struct crec *crecp)
+{
+  unsigned int h;
+
+  if (crecp->flags & F_FORWARD)
+    {
+      h = hash_name(crecp->name);
+      crecp->name_next = name_hash[h];
+      name_hash[h] = crecp;
+    }
+  if (crecp->flags & F_REVERSE)
+    {
+      h = hash_addr(crecp->addr);
+      crecp->addr_next = addr_hash[h];
+      addr_hash[h] = crecp;
+    }
+}
+
+static void cache_unhash(struct crec *crecp)
+{
+  struct crec **up;
+
+  if (crecp->flags & F_FORWARD)
+    for (up = &name_hash[hash_name(crecp->name)]; *up; up = &(*up)->name_next)
+      if (*up == crecp)
+	{
+	  *up = crecp->name_next;
+	  break;
+	}
+  if (crecp->flags & F_REVERSE)
+    for (up = &addr_hash[hash_addr(crecp->addr)]; *up; up = &(*up)->addr_next)
+      if (*up == crecp)
+	{
+	  *up = crecp->addr_next;
+	  break;
+	}
+}
+
+/* Only the name's own hash chain is searched, so expired entries
+   elsewhere are left for cache_get_free or the next lookup. */
 static void cache_remove_old_name(char *name, time_t now)
 {
-  struct crec *crecp = cache_head;
+  struct crec *crecp = name_hash[hash_name(name)];
   while (crecp)
     {
-      struct crec *tmp = crecp->next;
-      if (crecp->flags & F_FORWARD) 
+      struct crec *tmp = crecp->name_next;
+      if (!(crecp->flags & F_IMMORTAL))
 	{
-	  if (strcmp(crecp->name, name) == 0 && 
-	      !(crecp->flags & (F_IMMORTAL | F_NEW)))
-	    cache_free(crecp);
-	  
-	  if ((crecp->ttd < now) && !(crecp->flags & F_IMMORTAL))
+	  if ((strcmp(crecp->name, name) == 0 && crecp->batch != cache_batch) ||
+	      crecp->ttd < now)
 	    cache_free(crecp);
 	}
       crecp = tmp;
@@ -1304,19 +1637,14 @@ static void cache_remove_old_name(char *name, time_t now)
 
 static void cache_remove_old_addr(struct in_addr addr, time_t now)
 {
-  struct crec *crecp = cache_head;
+  struct crec *crecp = addr_hash[hash_addr(addr)];
   while (crecp)
     {
-      struct crec *tmp = crecp->next;
-      if (crecp->flags & F_REVERSE)
+      struct crec *tmp = crecp->addr_next;
+      if (!(crecp->flags & F_IMMORTAL))
 	{
-	  
-	  if (crecp->addr.s_addr == addr.s_addr && 
-	      !(crecp->flags & (F_IMMORTAL | F_NEW)))
-	    cache_free(crecp);
-	  
-	  /* remove expired entries too. */
-	  if ((crecp->ttd < now) && !(crecp->flags & F_IMMORTAL))
+	  if ((crecp->addr.s_addr == addr.s_addr && crecp->batch != cache_batch) ||
+	      crecp->ttd < now)
 	    cache_free(crecp);
 	}
       crecp = tmp;
@@ -1329,26 +1657,31 @@ static void cache_host_insert(struct crec *crecp, char *name, struct in_addr add
   crecp->flags = F_IMMORTAL | F_FORWARD | F_REVERSE;
   strcpy(crecp->name, name);
   crecp->addr = addr;
+  cache_hash(crecp);
   cache_insert(crecp);
 }
 
 static void cache_name_insert(char *name, struct in_addr addr, time_t ttd)
 {
   struct crec *crecp = cache_get_free();
-  crecp->flags = F_NEW | F_FORWARD;
+  crecp->flags = F_FORWARD;
+  crecp->batch = cache_batch;
   strcpy(crecp->name, name);
   crecp->addr = addr;
   crecp->ttd = ttd;
+  cache_hash(crecp);
   cache_insert(crecp);
 }
 
 static void cache_addr_insert(char *name, struct in_addr addr, time_t ttd)
 {
   struct crec *crecp = cache_get_free();
-  crecp->flags = F_NEW | F_REVERSE;
+  crecp->flags = F_REVERSE;
+  crecp->batch = cache_batch;
   strcpy(crecp->name, name);
   crecp->addr = addr;
   crecp->ttd = ttd;
+  cache_hash(crecp);
   cache_insert(crecp);
 }
 
@@ -1367,12 +1700,11 @@ static struct crec *cache_find_by_name(struct crec *crecp, char *name, time_t no
   /* first search, look for relevant entries and push to top of list
      also free anything which has expired */
   
-  crecp = cache_head;
+  crecp = name_hash[hash_name(name)];
   while (crecp)
     {
-      struct crec *tmp = crecp->next;
-      if ((crecp->flags & F_FORWARD) && 
-	  (strcmp(crecp->name, name) == 0))
+      struct crec *tmp = crecp->name_next;
+      if (strcmp(crecp->name, name) == 0)
 	{
 	  if ((crecp->flags & F_IMMORTAL) || crecp->ttd > now)
 	    {
@@ -1407,12 +1739,11 @@ static struct crec *cache_find_by_addr(struct crec *crecp, struct in_addr addr,
   /* first search, look for relevant entries and push to top of list
      also free anything which has expired */
   
-  crecp = cache_head;
+  crecp = addr_hash[hash_addr(addr)];
   while (crecp)
     {
-      struct crec *tmp = crecp->next;
-      if ((crecp->flags & F_REVERSE) && 
-	  crecp->addr.s_addr == addr.s_addr)
+      struct crec *tmp = crecp->addr_next;
+      if (crecp->addr.s_addr == addr.s_addr)
 	{	    
 	  if ((crecp->flags & F_IMMORTAL) || crecp->ttd > now)
 	    {
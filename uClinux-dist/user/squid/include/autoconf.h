@@ -299,6 +299,9 @@
 /* Define if you have the drand48 function.  */
 /* #undef HAVE_DRAND48 */
 
+/* Define if you have the epoll_create function.  */
+/* #undef HAVE_EPOLL_CREATE */
+
 /* Define if you have the fchmod function.  */
 #define HAVE_FCHMOD 1
 
@@ -563,6 +566,9 @@
 /* Define if you have the <sys/dir.h> header file.  */
 /* #undef HAVE_SYS_DIR_H */
 
+/* Define if you have the <sys/epoll.h> header file.  */
+/* #undef HAVE_SYS_EPOLL_H */
+
 /* Define if you have the <sys/file.h> header file.  */
 #define HAVE_SYS_FILE_H 1
 
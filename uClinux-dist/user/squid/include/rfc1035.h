@@ -64,10 +64,12 @@ extern int rfc1035AnswersUnpack(const char *buf,
     rfc1035_rr ** records,
     unsigned short *id);
 extern void rfc1035RRDestroy(rfc1035_rr * rr, int n);
+extern int rfc1035NegativeTtl(const char *buf, size_t sz);
 extern int rfc1035_errno;
 extern const char *rfc1035_error_message;
 
 #define RFC1035_TYPE_A 1
+#define RFC1035_TYPE_SOA 6
 #define RFC1035_TYPE_PTR 12
 #define RFC1035_CLASS_IN 1
 
@@ -454,6 +454,82 @@ rfc1035AnswersUnpack(const char *buf,
     return nr;
 }
 
+/*
+ * rfc1035NameSkip()
+ *
+ * Returns the offset just past the (possibly compressed) name at
+ * 'off', or sz + 1 if the name runs past the end of the message.
+ */
+static off_t
+rfc1035NameSkip(const char *buf, size_t sz, off_t off)
+{
+    unsigned char c;
+    do {
+	if (off >= sz)
+	    return sz + 1;
+	c = *(buf + off);
+	if (c > RFC1035_MAXLABELSZ)
+	    return off + 2;	/* compression pointer ends the name */
+	off += 1 + c;
+    } while (c > 0);
+    return off;
+}
+
+/*
+ * rfc1035NegativeTtl()
+ *
+ * For a negative answer (NXDOMAIN, or no records of the asked for
+ * type), finds the SOA record in the authority section and returns
+ * how long the answer may be cached: the lesser of the SOA's own TTL
+ * and its MINIMUM field, as RFC 2308 says.  Returns -1 if there is no
+ * SOA record.
+ */
+int
+rfc1035NegativeTtl(const char *buf, size_t sz)
+{
+    rfc1035_header hdr;
+    off_t off;
+    unsigned short s;
+    unsigned short type;
+    unsigned short rdlength;
+    unsigned int ttl;
+    unsigned int minimum;
+    int i;
+    if (sz < 12)
+	return -1;
+    off = rfc1035HeaderUnpack(buf, sz, &hdr);
+    for (i = 0; i < (int) hdr.qdcount; i++)
+	off = rfc1035NameSkip(buf, sz, off) + 4;	/* qtype, qclass */
+    for (i = 0; i < (int) hdr.ancount + (int) hdr.nscount; i++) {
+	off = rfc1035NameSkip(buf, sz, off);
+	if (off + 10 > sz)
+	    return -1;
+	memcpy(&s, buf + off, sizeof(s));
+	type = ntohs(s);
+	memcpy(&ttl, buf + off + 4, sizeof(ttl));
+	ttl = ntohl(ttl);
+	memcpy(&s, buf + off + 8, sizeof(s));
+	rdlength = ntohs(s);
+	off += 10;
+	if (off + rdlength > sz)
+	    return -1;
+	off += rdlength;
+	if (i < (int) hdr.ancount)
+	    continue;
+	if (type != RFC1035_TYPE_SOA || rdlength < 22)
+	    continue;
+	/* MINIMUM is the last field of the SOA RDATA */
+	memcpy(&minimum, buf + off - 4, sizeof(minimum));
+	minimum = ntohl(minimum);
+	if (minimum < ttl)
+	    ttl = minimum;
+	if (ttl > 0x7FFFFFFF)
+	    ttl = 0x7FFFFFFF;
+	return (int) ttl;
+    }
+    return -1;
+}
+
 /*
  * rfc1035BuildAQuery()
  * 
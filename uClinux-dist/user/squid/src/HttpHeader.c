@@ -126,6 +126,29 @@ static const HttpHeaderFieldAttrs HeadersAttrs[] =
 };
 static HttpHeaderFieldInfo *Headers = NULL;
 
+/*
+ * Known field names are found through a perfect hash of HeadersAttrs,
+ * built on start up: HeadersHashMult is chosen so that no two names
+ * share a slot, so a lookup is one hash and one compare.  Slots hold
+ * the field id + 1, or 0 if unused.
+ */
+#define HDR_HASH_BITS 9
+#define HDR_HASH_SIZE (1 << HDR_HASH_BITS)
+static unsigned char HeadersHash[HDR_HASH_SIZE];
+static unsigned int HeadersHashMult = 0;
+
+/*
+ * Parsed field names and values are not copied one by one; they
+ * point into a copy of the whole header block, made by
+ * httpHeaderParse().  The blocks are chained from hdr->raw and freed
+ * with the header.
+ */
+typedef struct _HttpHeaderRaw HttpHeaderRaw;
+struct _HttpHeaderRaw {
+    HttpHeaderRaw *next;
+    size_t size;		/* for memFreeBuf() */
+};
+
 /*
  * headers with field values defined as #(values) in HTTP/1.1
  * Headers that are currently not recognized, are commented out.
@@ -218,7 +241,10 @@ static int HeaderEntryParsedCount = 0;
 
 static HttpHeaderEntry *httpHeaderEntryCreate(http_hdr_type id, const char *name, const char *value);
 static void httpHeaderEntryDestroy(HttpHeaderEntry * e);
-static HttpHeaderEntry *httpHeaderEntryParseCreate(const char *field_start, const char *field_end);
+static HttpHeaderEntry *httpHeaderEntryParseCreate(const char *field_start, const char *field_end, char *copy);
+static void httpHeaderInitFieldsInfo(void);
+static unsigned int httpHeaderHashName(const char *name, int name_len, unsigned int mult);
+static int httpHeaderIdByHashedName(const char *name, int name_len);
 static void httpHeaderNoteParsedEntry(http_hdr_type id, String value, int error);
 
 static void httpHeaderStatInit(HttpHeaderStat * hs, const char *label);
@@ -237,7 +263,7 @@ httpHeaderInitModule(void)
     /* all headers must be described */
     assert(countof(HeadersAttrs) == HDR_ENUM_END);
     if (!Headers)
-	Headers = httpHeaderBuildFieldsInfo(HeadersAttrs, HDR_ENUM_END);
+	httpHeaderInitFieldsInfo();
     /* create masks */
     httpHeaderMaskInit(&ListHeadersMask, 0);
     httpHeaderCalcMask(&ListHeadersMask, (const int *) ListHeadersArr, countof(ListHeadersArr));
@@ -270,9 +296,33 @@ httpHeaderCleanModule(void)
 {
     httpHeaderDestroyFieldsInfo(Headers, HDR_ENUM_END);
     Headers = NULL;
+    HeadersHashMult = 0;
     httpHdrCcCleanModule();
 }
 
+static void
+httpHeaderInitFieldsInfo(void)
+{
+    int i;
+    unsigned int h;
+    Headers = httpHeaderBuildFieldsInfo(HeadersAttrs, HDR_ENUM_END);
+    for (HeadersHashMult = 1; HeadersHashMult < 0x10000; HeadersHashMult += 2) {
+	memset(HeadersHash, '\0', sizeof(HeadersHash));
+	for (i = 0; i < HDR_ENUM_END; i++) {
+	    h = httpHeaderHashName(strBuf(Headers[i].name),
+		strLen(Headers[i].name), HeadersHashMult);
+	    if (HeadersHash[h])
+		break;
+	    HeadersHash[h] = i + 1;
+	}
+	if (i == HDR_ENUM_END)
+	    break;
+    }
+    assert(HeadersHashMult < 0x10000);
+    debug(55, 3) ("httpHeaderInitFieldsInfo: hash multiplier %u\n",
+	HeadersHashMult);
+}
+
 static void
 httpHeaderStatInit(HttpHeaderStat * hs, const char *label)
 {
@@ -325,6 +375,11 @@ httpHeaderClean(HttpHeader * hdr)
 	}
     }
     arrayClean(&hdr->entries);
+    while (hdr->raw) {
+	HttpHeaderRaw *r = hdr->raw;
+	hdr->raw = r->next;
+	memFreeBuf(r->size, r);
+    }
 }
 
 /* append entries (also see httpHeaderUpdate) */
@@ -378,11 +433,23 @@ httpHeaderParse(HttpHeader * hdr, const char *header_start, const char *header_e
 {
     const char *field_start = header_start;
     HttpHeaderEntry *e;
+    HttpHeaderRaw *r;
+    char *copy = NULL;
+    size_t sz;
 
     assert(hdr);
     assert(header_start && header_end);
     debug(55, 7) ("parsing hdr: (%p)\n%s\n", hdr, getStringPrefix(header_start, header_end));
     HttpHeaderStats[hdr->owner].parsedCount++;
+    if (header_start < header_end) {
+	/* room for a '\0' after the last field */
+	r = memAllocBuf(sizeof(*r) + (header_end - header_start) + 1, &sz);
+	r->size = sz;
+	r->next = hdr->raw;
+	hdr->raw = r;
+	copy = (char *) (r + 1);
+	xmemcpy(copy, header_start, header_end - header_start);
+    }
     /* commonn format headers are "<name>:[ws]<value>" lines delimited by <CRLF> */
     while (field_start < header_end) {
 	const char *field_end;
@@ -397,7 +464,8 @@ httpHeaderParse(HttpHeader * hdr, const char *header_start, const char *header_e
 	} while (*field_ptr == ' ' || *field_ptr == '\t');
 	if (!*field_end || field_end > header_end)
 	    return httpHeaderReset(hdr);	/* missing <CRLF> */
-	e = httpHeaderEntryParseCreate(field_start, field_end);
+	e = httpHeaderEntryParseCreate(field_start, field_end,
+	    copy + (field_start - header_start));
 	if (e != NULL)
 	    httpHeaderAddEntry(hdr, e);
 	else
@@ -912,9 +980,13 @@ httpHeaderEntryDestroy(HttpHeaderEntry * e)
     memFree(e, MEM_HTTP_HDR_ENTRY);
 }
 
-/* parses and inits header entry, returns new entry on success */
+/*
+ * parses and inits header entry, returns new entry on success;
+ * 'copy' is where the field is in the header's copy of the text,
+ * which the entry will point into
+ */
 static HttpHeaderEntry *
-httpHeaderEntryParseCreate(const char *field_start, const char *field_end)
+httpHeaderEntryParseCreate(const char *field_start, const char *field_end, char *copy)
 {
     HttpHeaderEntry *e;
     int id;
@@ -933,21 +1005,24 @@ httpHeaderEntryParseCreate(const char *field_start, const char *field_end)
     e = memAllocate(MEM_HTTP_HDR_ENTRY);
     debug(55, 9) ("creating entry %p: near '%s'\n", e, getStringPrefix(field_start, field_end));
     /* is it a "known" field? */
-    id = httpHeaderIdByName(field_start, name_len, Headers, HDR_ENUM_END);
+    id = httpHeaderIdByHashedName(field_start, name_len);
     if (id < 0)
 	id = HDR_OTHER;
     assert_eid(id);
     e->id = id;
-    /* set field name */
-    if (id == HDR_OTHER)
-	stringLimitInit(&e->name, field_start, name_len);
-    else
+    /* set field name; the ':' in the copy becomes its terminator */
+    if (id == HDR_OTHER) {
+	copy[name_len] = '\0';
+	stringLimitRef(&e->name, copy, name_len);
+    } else
 	e->name = Headers[id].name;
     /* trim field value */
     while (value_start < field_end && xisspace(*value_start))
 	value_start++;
-    /* set field value */
-    stringLimitInit(&e->value, value_start, field_end - value_start);
+    /* set field value; the CR or LF in the copy becomes its terminator */
+    copy[field_end - field_start] = '\0';
+    stringLimitRef(&e->value, copy + (value_start - field_start),
+	field_end - value_start);
     Headers[id].stat.seenCount++;
     Headers[id].stat.aliveCount++;
     debug(55, 9) ("created entry %p: '%s: %s'\n", e, strBuf(e->name), strBuf(e->value));
@@ -1088,19 +1163,42 @@ httpHeaderIdByName(const char *name, int name_len, const HttpHeaderFieldInfo * i
     return -1;
 }
 
+/* case-insensitive; h = h * mult + c, with the bits mixed at the end */
+static unsigned int
+httpHeaderHashName(const char *name, int name_len, unsigned int mult)
+{
+    unsigned int h = name_len;
+    while (name_len-- > 0)
+	h = h * mult + (*name++ | 0x20);
+    return ((h * 2654435761U) & 0xFFFFFFFF) >> (32 - HDR_HASH_BITS);
+}
+
+static int
+httpHeaderIdByHashedName(const char *name, int name_len)
+{
+    int id = HeadersHash[httpHeaderHashName(name, name_len, HeadersHashMult)] - 1;
+    if (id < 0 || name_len != strLen(Headers[id].name))
+	return -1;
+    if (strncasecmp(name, strBuf(Headers[id].name), name_len))
+	return -1;
+    return id;
+}
+
 int
 httpHeaderIdByNameDef(const char *name, int name_len)
 {
     if (!Headers)
-	Headers = httpHeaderBuildFieldsInfo(HeadersAttrs, HDR_ENUM_END);
-    return httpHeaderIdByName(name, name_len, Headers, HDR_ENUM_END);
+	httpHeaderInitFieldsInfo();
+    if (name_len < 0)
+	name_len = strlen(name);
+    return httpHeaderIdByHashedName(name, name_len);
 }
 
 const char *
 httpHeaderNameById(int id)
 {
     if (!Headers)
-	Headers = httpHeaderBuildFieldsInfo(HeadersAttrs, HDR_ENUM_END);
+	httpHeaderInitFieldsInfo();
     assert(id >= 0 && id < HDR_ENUM_END);
     return HeadersAttrs[id].name;
 }
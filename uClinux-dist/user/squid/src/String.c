@@ -35,40 +35,62 @@
 
 #include "squid.h"
 
+/*
+ * The buffer allocating functions are called through macros that pass
+ * the caller's file and line on to memAllocBufAt(), so that the
+ * "mem_buffers" report names the code asking for the String, not this
+ * file.
+ */
 static void
-stringInitBuf(String * s, size_t sz)
+stringInitBuf(String * s, size_t sz, const char *file, int line)
 {
-    s->buf = memAllocBuf(sz, &sz);
+    s->buf = memAllocBufAt(sz, &sz, file, line);
     assert(sz < 65536);
     s->size = sz;
 }
 
 void
-stringInit(String * s, const char *str)
+stringInitAt(String * s, const char *str, const char *file, int line)
 {
     assert(s);
     if (str)
-	stringLimitInit(s, str, strlen(str));
+	stringLimitInitAt(s, str, strlen(str), file, line);
     else
 	*s = StringNull;
 }
 
 void
-stringLimitInit(String * s, const char *str, int len)
+stringLimitInitAt(String * s, const char *str, int len, const char *file, int line)
 {
     assert(s && str);
-    stringInitBuf(s, len + 1);
+    stringInitBuf(s, len + 1, file, line);
     s->len = len;
     xmemcpy(s->buf, str, len);
     s->buf[len] = '\0';
 }
 
+/*
+ * Like stringLimitInit(), but refer to str instead of copying it.
+ * str[len] must be '\0' and must outlive s.  Such a String has no
+ * buffer of its own (size is 0): stringClean() leaves str alone, and
+ * stringAppend() copies it before appending.
+ */
+void
+stringLimitRef(String * s, const char *str, int len)
+{
+    assert(s && str);
+    assert(len < 65536 && str[len] == '\0');
+    s->size = 0;
+    s->len = len;
+    s->buf = (char *) str;
+}
+
 String
-stringDup(const String * s)
+stringDupAt(const String * s, const char *file, int line)
 {
     String dup;
     assert(s);
-    stringInit(&dup, s->buf);
+    stringInitAt(&dup, s->buf, file, line);
     return dup;
 }
 
@@ -76,20 +98,20 @@ void
 stringClean(String * s)
 {
     assert(s);
-    if (s->buf)
+    if (s->buf && s->size)
 	memFreeBuf(s->size, s->buf);
     *s = StringNull;
 }
 
 void
-stringReset(String * s, const char *str)
+stringResetAt(String * s, const char *str, const char *file, int line)
 {
     stringClean(s);
-    stringInit(s, str);
+    stringInitAt(s, str, file, line);
 }
 
 void
-stringAppend(String * s, const char *str, int len)
+stringAppendAt(String * s, const char *str, int len, const char *file, int line)
 {
     assert(s);
     assert(str && len >= 0);
@@ -99,7 +121,7 @@ stringAppend(String * s, const char *str, int len)
     } else {
 	String snew = StringNull;
 	snew.len = s->len + len;
-	stringInitBuf(&snew, snew.len + 1);
+	stringInitBuf(&snew, snew.len + 1, file, line);
 	if (s->buf)
 	    xmemcpy(snew.buf, s->buf, s->len);
 	if (len)
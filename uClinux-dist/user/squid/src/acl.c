@@ -40,6 +40,18 @@ static int aclFromFile = 0;
 static FILE *aclFile;
 static hash_table *proxy_auth_cache = NULL;
 
+/*
+ * Access lists that only look at the client address are answered
+ * from a small cache of recent decisions, keyed on list and client.
+ */
+#define ACL_DECISION_CACHE_SZ 256
+static struct {
+    const acl_access *list;
+    struct in_addr src_addr;
+    int answer;
+    const char *matched;	/* AclMatchedName, for deny_info */
+} aclDecisions[ACL_DECISION_CACHE_SZ];
+
 static void aclParseDomainList(void *curlist);
 static void aclParseIpList(void *curlist);
 static void aclParseIntlist(void *curlist);
@@ -53,13 +65,16 @@ static void aclDestroyAclList(acl_list * list);
 static void aclDestroyTimeList(acl_time_data * data);
 static void aclDestroyIntRange(intrange *);
 static FREE aclFreeProxyAuthUser;
+static unsigned int aclDecisionHash(const acl_access * A, struct in_addr src);
 static struct _acl *aclFindByName(const char *name);
 static int aclMatchAcl(struct _acl *, aclCheck_t *);
 static int aclMatchIntegerRange(intrange * data, int i);
 static int aclMatchTime(acl_time_data * data, time_t when);
 static int aclMatchUser(wordlist * data, const char *ident);
-static int aclMatchIp(void *dataptr, struct in_addr c);
-static int aclMatchDomainList(void *dataptr, const char *);
+static int aclMatchIp(acl * ae, struct in_addr c);
+static int aclMatchDomainList(acl * ae, const char *);
+static int aclMatchRegexAcl(acl * ae, const char *);
+static void aclFreeCompiled(acl * a);
 static int aclMatchIntegerRange(intrange * data, int i);
 #if SQUID_SNMP
 static int aclMatchWordList(wordlist *, const char *);
@@ -86,7 +101,6 @@ static wordlist *aclDumpIntRangeList(intrange * data);
 static wordlist *aclDumpProtoList(intlist * data);
 static wordlist *aclDumpMethodList(intlist * data);
 static SPLAYCMP aclIpNetworkCompare;
-static SPLAYCMP aclHostDomainCompare;
 static SPLAYCMP aclDomainCompare;
 static SPLAYWALKEE aclDumpIpListWalkee;
 static SPLAYWALKEE aclDumpDomainListWalkee;
@@ -605,6 +619,7 @@ aclParseRegexList(void *curlist)
 	q = memAllocate(MEM_RELIST);
 	q->pattern = xstrdup(t);
 	q->regex = comp;
+	q->flags = flags;
 	*(Tail) = q;
 	Tail = &q->next;
     }
@@ -677,6 +692,7 @@ aclParseAclLine(acl ** head)
 	    return;
 	}
 	debug(28, 3) ("aclParseAclLine: Appending to '%s'\n", aclname);
+	aclFreeCompiled(A);
 	new_acl = 0;
     }
     /*
@@ -860,6 +876,7 @@ aclParseAccessLine(acl_access ** head)
     acl_list *L = NULL;
     acl_list **Tail = NULL;
     acl *a = NULL;
+    int src_only = 1;
 
     /* first expect either 'allow' or 'deny' */
     if ((t = strtok(NULL, w_space)) == NULL) {
@@ -903,6 +920,8 @@ aclParseAccessLine(acl_access ** head)
 	    continue;
 	}
 	L->acl = a;
+	if (a->type != ACL_SRC_IP)
+	    src_only = 0;
 	*Tail = L;
 	Tail = &L->next;
     }
@@ -914,8 +933,10 @@ aclParseAccessLine(acl_access ** head)
 	return;
     }
     A->cfgline = xstrdup(config_input_line);
+    A->src_only = src_only;
     /* Append to the end of this list */
-    for (B = *head, T = head; B; T = &B->next, B = B->next);
+    for (B = *head, T = head; B; T = &B->next, B = B->next)
+	B->src_only &= src_only;
     *T = A;
     /* We lock _acl_access structures in aclCheck() */
     cbdataAdd(A, memFree, MEM_ACL_ACCESS);
@@ -926,13 +947,15 @@ aclParseAccessLine(acl_access ** head)
 /**************/
 
 static int
-aclMatchIp(void *dataptr, struct in_addr c)
+aclMatchIp(acl * ae, struct in_addr c)
 {
-    splayNode **Top = dataptr;
-    *Top = splay_splay(&c, *Top, aclIpNetworkCompare);
+    int rc;
+    if (ae->compiled == NULL)
+	ae->compiled = aclIpTrieCompile(ae->data);
+    rc = aclIpTrieMatch(ae->compiled, c);
     debug(28, 3) ("aclMatchIp: '%s' %s\n",
-	inet_ntoa(c), splayLastResult ? "NOT found" : "found");
-    return !splayLastResult;
+	inet_ntoa(c), rc ? "found" : "NOT found");
+    return rc;
 }
 
 /**********************/
@@ -940,16 +963,18 @@ aclMatchIp(void *dataptr, struct in_addr c)
 /**********************/
 
 static int
-aclMatchDomainList(void *dataptr, const char *host)
+aclMatchDomainList(acl * ae, const char *host)
 {
-    splayNode **Top = dataptr;
+    int rc;
     if (host == NULL)
 	return 0;
     debug(28, 3) ("aclMatchDomainList: checking '%s'\n", host);
-    *Top = splay_splay(host, *Top, aclHostDomainCompare);
+    if (ae->compiled == NULL)
+	ae->compiled = aclDomainTrieCompile(ae->data);
+    rc = aclDomainTrieMatch(ae->compiled, host);
     debug(28, 3) ("aclMatchDomainList: '%s' %s\n",
-	host, splayLastResult ? "NOT found" : "found");
-    return !splayLastResult;
+	host, rc ? "found" : "NOT found");
+    return rc;
 }
 
 int
@@ -979,6 +1004,21 @@ aclMatchRegex(relist * data, const char *word)
     return 0;
 }
 
+/*
+ * Regex ACLs only run the patterns whose literal text turns up in
+ * the word, see aclRegexSetCompile().
+ */
+static int
+aclMatchRegexAcl(acl * ae, const char *word)
+{
+    if (word == NULL)
+	return 0;
+    debug(28, 3) ("aclMatchRegexAcl: checking '%s'\n", word);
+    if (ae->compiled == NULL)
+	ae->compiled = aclRegexSetCompile(ae->data);
+    return aclRegexSetMatch(ae->compiled, word);
+}
+
 static int
 aclMatchUser(wordlist * data, const char *user)
 {
@@ -1279,16 +1319,16 @@ aclMatchAcl(acl * ae, aclCheck_t * checklist)
     debug(28, 3) ("aclMatchAcl: checking '%s'\n", ae->cfgline);
     switch (ae->type) {
     case ACL_SRC_IP:
-	return aclMatchIp(&ae->data, checklist->src_addr);
+	return aclMatchIp(ae, checklist->src_addr);
 	/* NOTREACHED */
     case ACL_MY_IP:
-	return aclMatchIp(&ae->data, checklist->my_addr);
+	return aclMatchIp(ae, checklist->my_addr);
 	/* NOTREACHED */
     case ACL_DST_IP:
 	ia = ipcache_gethostbyname(r->host, IP_LOOKUP_IF_MISS);
 	if (ia) {
 	    for (k = 0; k < (int) ia->count; k++) {
-		if (aclMatchIp(&ae->data, ia->in_addrs[k]))
+		if (aclMatchIp(ae, ia->in_addrs[k]))
 		    return 1;
 	    }
 	    return 0;
@@ -1298,60 +1338,60 @@ aclMatchAcl(acl * ae, aclCheck_t * checklist)
 	    checklist->state[ACL_DST_IP] = ACL_LOOKUP_NEEDED;
 	    return 0;
 	} else {
-	    return aclMatchIp(&ae->data, no_addr);
+	    return aclMatchIp(ae, no_addr);
 	}
 	/* NOTREACHED */
     case ACL_DST_DOMAIN:
 	if ((ia = ipcacheCheckNumeric(r->host)) == NULL)
-	    return aclMatchDomainList(&ae->data, r->host);
+	    return aclMatchDomainList(ae, r->host);
 	fqdn = fqdncache_gethostbyaddr(ia->in_addrs[0], FQDN_LOOKUP_IF_MISS);
 	if (fqdn)
-	    return aclMatchDomainList(&ae->data, fqdn);
+	    return aclMatchDomainList(ae, fqdn);
 	if (checklist->state[ACL_DST_DOMAIN] == ACL_LOOKUP_NONE) {
 	    debug(28, 3) ("aclMatchAcl: Can't yet compare '%s' ACL for '%s'\n",
 		ae->name, inet_ntoa(ia->in_addrs[0]));
 	    checklist->state[ACL_DST_DOMAIN] = ACL_LOOKUP_NEEDED;
 	    return 0;
 	}
-	return aclMatchDomainList(&ae->data, "none");
+	return aclMatchDomainList(ae, "none");
 	/* NOTREACHED */
     case ACL_SRC_DOMAIN:
 	fqdn = fqdncache_gethostbyaddr(checklist->src_addr, FQDN_LOOKUP_IF_MISS);
 	if (fqdn) {
-	    return aclMatchDomainList(&ae->data, fqdn);
+	    return aclMatchDomainList(ae, fqdn);
 	} else if (checklist->state[ACL_SRC_DOMAIN] == ACL_LOOKUP_NONE) {
 	    debug(28, 3) ("aclMatchAcl: Can't yet compare '%s' ACL for '%s'\n",
 		ae->name, inet_ntoa(checklist->src_addr));
 	    checklist->state[ACL_SRC_DOMAIN] = ACL_LOOKUP_NEEDED;
 	    return 0;
 	}
-	return aclMatchDomainList(&ae->data, "none");
+	return aclMatchDomainList(ae, "none");
 	/* NOTREACHED */
     case ACL_DST_DOM_REGEX:
 	if ((ia = ipcacheCheckNumeric(r->host)) == NULL)
-	    return aclMatchRegex(ae->data, r->host);
+	    return aclMatchRegexAcl(ae, r->host);
 	fqdn = fqdncache_gethostbyaddr(ia->in_addrs[0], FQDN_LOOKUP_IF_MISS);
 	if (fqdn)
-	    return aclMatchRegex(ae->data, fqdn);
+	    return aclMatchRegexAcl(ae, fqdn);
 	if (checklist->state[ACL_DST_DOMAIN] == ACL_LOOKUP_NONE) {
 	    debug(28, 3) ("aclMatchAcl: Can't yet compare '%s' ACL for '%s'\n",
 		ae->name, inet_ntoa(ia->in_addrs[0]));
 	    checklist->state[ACL_DST_DOMAIN] = ACL_LOOKUP_NEEDED;
 	    return 0;
 	}
-	return aclMatchRegex(ae->data, "none");
+	return aclMatchRegexAcl(ae, "none");
 	/* NOTREACHED */
     case ACL_SRC_DOM_REGEX:
 	fqdn = fqdncache_gethostbyaddr(checklist->src_addr, FQDN_LOOKUP_IF_MISS);
 	if (fqdn) {
-	    return aclMatchRegex(ae->data, fqdn);
+	    return aclMatchRegexAcl(ae, fqdn);
 	} else if (checklist->state[ACL_SRC_DOMAIN] == ACL_LOOKUP_NONE) {
 	    debug(28, 3) ("aclMatchAcl: Can't yet compare '%s' ACL for '%s'\n",
 		ae->name, inet_ntoa(checklist->src_addr));
 	    checklist->state[ACL_SRC_DOMAIN] = ACL_LOOKUP_NEEDED;
 	    return 0;
 	}
-	return aclMatchRegex(ae->data, "none");
+	return aclMatchRegexAcl(ae, "none");
 	/* NOTREACHED */
     case ACL_TIME:
 	return aclMatchTime(ae->data, squid_curtime);
@@ -1359,14 +1399,14 @@ aclMatchAcl(acl * ae, aclCheck_t * checklist)
     case ACL_URLPATH_REGEX:
 	esc_buf = xstrdup(strBuf(r->urlpath));
 	rfc1738_unescape(esc_buf);
-	k = aclMatchRegex(ae->data, esc_buf);
+	k = aclMatchRegexAcl(ae, esc_buf);
 	safe_free(esc_buf);
 	return k;
 	/* NOTREACHED */
     case ACL_URL_REGEX:
 	esc_buf = xstrdup(urlCanonical(r));
 	rfc1738_unescape(esc_buf);
-	k = aclMatchRegex(ae->data, esc_buf);
+	k = aclMatchRegexAcl(ae, esc_buf);
 	safe_free(esc_buf);
 	return k;
 	/* NOTREACHED */
@@ -1400,7 +1440,7 @@ aclMatchAcl(acl * ae, aclCheck_t * checklist)
 	browser = httpHeaderGetStr(&checklist->request->header, HDR_USER_AGENT);
 	if (NULL == browser)
 	    return 0;
-	return aclMatchRegex(ae->data, browser);
+	return aclMatchRegexAcl(ae, browser);
 	/* NOTREACHED */
     case ACL_PROXY_AUTH:
 	if (NULL == r) {
@@ -1507,19 +1547,49 @@ aclMatchAclList(const acl_list * list, aclCheck_t * checklist)
     return 1;
 }
 
+static unsigned int
+aclDecisionHash(const acl_access * A, struct in_addr src)
+{
+    unsigned int h = ntohl(src.s_addr) ^ ((unsigned long) A >> 4);
+    return (h ^ (h >> 8) ^ (h >> 16)) % ACL_DECISION_CACHE_SZ;
+}
+
 int
 aclCheckFast(const acl_access * A, aclCheck_t * checklist)
 {
     int allow = 0;
+    int answer;
+    int h = -1;
     debug(28, 5) ("aclCheckFast: list: %p\n", A);
+    if (A && A->src_only) {
+	h = aclDecisionHash(A, checklist->src_addr);
+	if (aclDecisions[h].list == A &&
+	    aclDecisions[h].src_addr.s_addr == checklist->src_addr.s_addr) {
+	    AclMatchedName = aclDecisions[h].matched;
+	    debug(28, 5) ("aclCheckFast: cached, returning: %d\n",
+		aclDecisions[h].answer);
+	    return aclDecisions[h].answer;
+	}
+	aclDecisions[h].list = A;
+	aclDecisions[h].src_addr = checklist->src_addr;
+    }
     while (A) {
 	allow = A->allow;
 	if (aclMatchAclList(A->acl_list, checklist))
-	    return allow;
+	    break;
 	A = A->next;
     }
-    debug(28, 5) ("aclCheckFast: no matches, returning: %d\n", !allow);
-    return !allow;
+    if (A) {
+	answer = allow;
+    } else {
+	debug(28, 5) ("aclCheckFast: no matches, returning: %d\n", !allow);
+	answer = !allow;
+    }
+    if (h >= 0) {
+	aclDecisions[h].answer = answer;
+	aclDecisions[h].matched = AclMatchedName;
+    }
+    return answer;
 }
 
 static void
@@ -1756,9 +1826,18 @@ aclChecklistCreate(const acl_access * A,
 void
 aclNBCheck(aclCheck_t * checklist, PF callback, void *callback_data)
 {
+    const acl_access *A = checklist->access_list;
     checklist->callback = callback;
     checklist->callback_data = callback_data;
     cbdataLock(callback_data);
+    if (A && A->src_only) {
+	/* nothing to look up, so aclCheckFast() has the answer */
+	allow_t answer = aclCheckFast(A, checklist);
+	cbdataUnlock(A);
+	checklist->access_list = NULL;
+	aclCheckCallback(checklist, answer);
+	return;
+    }
     aclCheck(checklist);
 }
 
@@ -1809,6 +1888,34 @@ aclFreeIpData(void *p)
     memFree(p, MEM_ACL_IP_DATA);
 }
 
+static void
+aclFreeCompiled(acl * a)
+{
+    if (a->compiled == NULL)
+	return;
+    switch (a->type) {
+    case ACL_SRC_IP:
+    case ACL_DST_IP:
+    case ACL_MY_IP:
+	aclIpTrieDestroy(a->compiled);
+	break;
+    case ACL_DST_DOMAIN:
+    case ACL_SRC_DOMAIN:
+	aclDomainTrieDestroy(a->compiled);
+	break;
+    case ACL_URL_REGEX:
+    case ACL_URLPATH_REGEX:
+    case ACL_BROWSER:
+    case ACL_SRC_DOM_REGEX:
+    case ACL_DST_DOM_REGEX:
+	aclRegexSetDestroy(a->compiled);
+	break;
+    default:
+	break;
+    }
+    a->compiled = NULL;
+}
+
 void
 aclDestroyAcls(acl ** head)
 {
@@ -1817,6 +1924,7 @@ aclDestroyAcls(acl ** head)
     for (a = *head; a; a = next) {
 	next = a->next;
 	debug(28, 3) ("aclDestroyAcls: '%s'\n", a->cfgline);
+	aclFreeCompiled(a);
 	switch (a->type) {
 	case ACL_SRC_IP:
 	case ACL_DST_IP:
@@ -1885,6 +1993,8 @@ aclDestroyAccessList(acl_access ** list)
 {
     acl_access *l = NULL;
     acl_access *next = NULL;
+    if (*list && (*list)->src_only)
+	memset(aclDecisions, '\0', sizeof(aclDecisions));
     for (l = *list; l; l = next) {
 	debug(28, 3) ("aclDestroyAccessList: '%s'\n", l->cfgline);
 	next = l->next;
@@ -1973,14 +2083,6 @@ aclDomainCompare(const void *a, const void *b)
 
 /* compare a host and a domain */
 
-static int
-aclHostDomainCompare(const void *a, const void *b)
-{
-    const char *h = a;
-    const char *d = b;
-    return matchDomainName(h, d);
-}
-
 /* compare two network specs
  * 
  * NOTE: this is very similar to aclIpNetworkCompare and it's not yet
@@ -0,0 +1,657 @@
+/*
+ * $Id$
+ *
+ * DEBUG: section 28    Access Control
+ *
+ * SQUID Internet Object Cache  http://squid.nlanr.net/Squid/
+ * ----------------------------------------------------------
+ *
+ *  Squid is the result of efforts by numerous individuals from the
+ *  Internet community.  Development is led by Duane Wessels of the
+ *  National Laboratory for Applied Network Research and funded by the
+ *  National Science Foundation.  Squid is Copyrighted (C) 2000 by
+ *  the Regents of the University of California.  Please see the
+ *  COPYRIGHT file for full details.  Squid incorporates software
+ *  developed and/or copyrighted by other sources.  Please see the
+ *  CREDITS file for full details.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111, USA.
+ *
+ */
+
+/*
+ * Read-only match structures for the big ACL types.  acl.c builds
+ * one from the parsed splay tree or relist the first time an ACL is
+ * checked; the parsed data is kept for dumping and freeing.
+ */
+
+#include "squid.h"
+#include "splay.h"
+
+/*************************************************/
+/* IP address lists: a Patricia trie of prefixes */
+/*************************************************/
+
+#define PREFIX_MASK(b)	((u_num32) ((b) ? 0xfffffffful << (32 - (b)) : 0))
+#define PREFIX_BIT(a, b)	(((a) >> (31 - (b))) & 1)
+
+typedef struct {
+    u_num32 key;		/* host order, zero past 'bits' */
+    u_num32 mask;
+    int bits;
+    int terminal;		/* a prefix in the list ends here */
+    int child[2];
+} ip_trie_node;
+
+struct _acl_ip_trie {
+    ip_trie_node *nodes;
+    int nnodes;
+    int root;
+    /* entries that are not prefixes, checked in turn */
+    const acl_ip_data **other;
+    int nother;
+};
+
+typedef struct {
+    u_num32 *keys;
+    int *bits;
+    int n;
+    int size;
+    const acl_ip_data **other;
+    int nother;
+} ip_trie_build;
+
+static void
+aclIpTrieAddPrefix(ip_trie_build * b, u_num32 key, int bits)
+{
+    if (b->n == b->size) {
+	b->size = b->size ? b->size * 2 : 64;
+	b->keys = xrealloc(b->keys, b->size * sizeof(*b->keys));
+	b->bits = xrealloc(b->bits, b->size * sizeof(*b->bits));
+    }
+    b->keys[b->n] = key;
+    b->bits[b->n] = bits;
+    b->n++;
+}
+
+/*
+ * An entry matches when (address & mask) is addr1, or lies between
+ * addr1 and addr2 for a range.  With a contiguous mask that is one
+ * prefix, or a range that splits into a few aligned prefixes.
+ */
+static void
+aclIpTrieAddEntry(void *node, void *state)
+{
+    const acl_ip_data *q = node;
+    ip_trie_build *b = state;
+    u_num32 mask = ntohl(q->mask.s_addr);
+    u_num32 lo = ntohl(q->addr1.s_addr);
+    u_num32 hi;
+    u_num32 m;
+    int bits;
+    if ((u_num32) (~mask & (~mask + 1)) != 0) {
+	b->other = xrealloc(b->other, (b->nother + 1) * sizeof(*b->other));
+	b->other[b->nother++] = q;
+	return;
+    }
+    for (bits = 0; bits < 32 && PREFIX_BIT(mask, bits); bits++);
+    if (q->addr2.s_addr == 0) {
+	aclIpTrieAddPrefix(b, lo, bits);
+	return;
+    }
+    hi = ntohl(q->addr2.s_addr) | (u_num32) ~mask;
+    if (lo > hi)
+	return;
+    for (;;) {
+	for (bits = 32; bits > 0; bits--) {
+	    m = ~PREFIX_MASK(bits - 1);
+	    if ((lo & m) || (lo | m) > hi)
+		break;
+	}
+	aclIpTrieAddPrefix(b, lo, bits);
+	m = ~PREFIX_MASK(bits);
+	if ((lo | m) >= hi)
+	    break;
+	lo = (lo | m) + 1;
+    }
+}
+
+static int
+aclIpTrieNewNode(acl_ip_trie * t, u_num32 key, int bits, int terminal)
+{
+    ip_trie_node *n = &t->nodes[t->nnodes];
+    n->mask = PREFIX_MASK(bits);
+    n->key = key & n->mask;
+    n->bits = bits;
+    n->terminal = terminal;
+    n->child[0] = n->child[1] = -1;
+    return t->nnodes++;
+}
+
+/*
+ * Only membership matters, so a prefix under a shorter one is
+ * dropped and a prefix drops everything under it.  The node array
+ * is sized up front; nothing moves while we hold pointers into it.
+ */
+static void
+aclIpTrieInsert(acl_ip_trie * t, u_num32 key, int bits)
+{
+    int *link = &t->root;
+    ip_trie_node *n;
+    int common;
+    int i;
+    key &= PREFIX_MASK(bits);
+    while (*link >= 0) {
+	n = &t->nodes[*link];
+	for (common = 0; common < n->bits && common < bits; common++)
+	    if (PREFIX_BIT(key ^ n->key, common))
+		break;
+	if (common == n->bits) {
+	    if (n->terminal)
+		return;
+	    if (common == bits) {
+		n->terminal = 1;
+		n->child[0] = n->child[1] = -1;
+		return;
+	    }
+	    link = &n->child[PREFIX_BIT(key, common)];
+	    continue;
+	}
+	if (common == bits) {
+	    *link = aclIpTrieNewNode(t, key, bits, 1);
+	    return;
+	}
+	i = aclIpTrieNewNode(t, key, common, 0);
+	t->nodes[i].child[PREFIX_BIT(n->key, common)] = *link;
+	t->nodes[i].child[PREFIX_BIT(key, common)] =
+	    aclIpTrieNewNode(t, key, bits, 1);
+	*link = i;
+	return;
+    }
+    *link = aclIpTrieNewNode(t, key, bits, 1);
+}
+
+acl_ip_trie *
+aclIpTrieCompile(void *data)
+{
+    acl_ip_trie *t = xcalloc(1, sizeof(acl_ip_trie));
+    ip_trie_build b;
+    int i;
+    memset(&b, '\0', sizeof(b));
+    splay_walk(data, aclIpTrieAddEntry, &b);
+    t->nodes = xcalloc(2 * b.n + 1, sizeof(ip_trie_node));
+    t->root = -1;
+    for (i = 0; i < b.n; i++)
+	aclIpTrieInsert(t, b.keys[i], b.bits[i]);
+    t->other = b.other;
+    t->nother = b.nother;
+    debug(28, 3) ("aclIpTrieCompile: %d prefixes, %d nodes, %d other entries\n",
+	b.n, t->nnodes, t->nother);
+    safe_free(b.keys);
+    safe_free(b.bits);
+    return t;
+}
+
+int
+aclIpTrieMatch(const acl_ip_trie * t, struct in_addr c)
+{
+    const ip_trie_node *n;
+    const acl_ip_data *q;
+    u_num32 a = ntohl(c.s_addr);
+    u_num32 m;
+    int i = t->root;
+    while (i >= 0) {
+	n = &t->nodes[i];
+	if ((a ^ n->key) & n->mask)
+	    break;
+	if (n->terminal)
+	    return 1;
+	i = n->child[PREFIX_BIT(a, n->bits)];
+    }
+    for (i = 0; i < t->nother; i++) {
+	q = t->other[i];
+	m = ntohl(c.s_addr & q->mask.s_addr);
+	if (q->addr2.s_addr == 0) {
+	    if (m == ntohl(q->addr1.s_addr))
+		return 1;
+	} else if (m >= ntohl(q->addr1.s_addr) && m <= ntohl(q->addr2.s_addr)) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+void
+aclIpTrieDestroy(acl_ip_trie * t)
+{
+    safe_free(t->nodes);
+    safe_free(t->other);
+    xfree(t);
+}
+
+/******************************************************/
+/* Domain lists: a trie of labels, read right to left */
+/******************************************************/
+
+typedef struct _domain_trie_node domain_trie_node;
+
+struct _domain_trie_node {
+    char *label;
+    int len;
+    int exact;			/* "foo.com" ends here */
+    int subdomains;		/* ".foo.com" ends here */
+    domain_trie_node *child;	/* sorted by aclDomainLabelCompare() */
+    int nchild;
+};
+
+struct _acl_domain_trie {
+    domain_trie_node root;
+    int nnodes;
+};
+
+/* The label that ends at 'end', stopping at 'start'. */
+static const char *
+aclDomainPrevLabel(const char *start, const char *end)
+{
+    while (end > start && *(end - 1) != '.')
+	end--;
+    return end;
+}
+
+/* 'b' is always lower case */
+static int
+aclDomainLabelCompare(const char *a, int alen, const char *b, int blen)
+{
+    int i;
+    int d;
+    for (i = 0; i < alen && i < blen; i++)
+	if ((d = xtolower(a[i]) - (unsigned char) b[i]) != 0)
+	    return d;
+    return alen - blen;
+}
+
+/*
+ * Orders domains label by label from the right, the way the trie
+ * lays out its children.  One leading dot only marks a domain that
+ * also matches its subdomains, as in matchDomainName().
+ */
+static int
+aclDomainListCompare(const void *a, const void *b)
+{
+    const char *d1 = *(char *const *) a;
+    const char *d2 = *(char *const *) b;
+    const char *e1;
+    const char *e2;
+    const char *l1;
+    const char *l2;
+    int rc;
+    if ('.' == *d1)
+	d1++;
+    if ('.' == *d2)
+	d2++;
+    e1 = d1 + strlen(d1);
+    e2 = d2 + strlen(d2);
+    for (;;) {
+	l1 = aclDomainPrevLabel(d1, e1);
+	l2 = aclDomainPrevLabel(d2, e2);
+	if ((rc = aclDomainLabelCompare(l1, e1 - l1, l2, e2 - l2)) != 0)
+	    return rc;
+	if (l1 == d1 || l2 == d2)
+	    return (l1 != d1) - (l2 != d2);
+	e1 = l1 - 1;
+	e2 = l2 - 1;
+    }
+}
+
+static void
+aclDomainTrieCount(void *node, void *state)
+{
+    (*(int *) state)++;
+}
+
+static void
+aclDomainTrieCollect(void *node, void *state)
+{
+    char ***D = state;
+    *(*D)++ = node;
+}
+
+/* Domains arrive sorted, so a shared label is always the last child. */
+static void
+aclDomainTrieInsert(acl_domain_trie * t, const char *d)
+{
+    domain_trie_node *n = &t->root;
+    domain_trie_node *c;
+    const char *end;
+    const char *l;
+    int subdomains = 0;
+    if ('.' == *d) {
+	subdomains = 1;
+	d++;
+    }
+    end = d + strlen(d);
+    for (;;) {
+	l = aclDomainPrevLabel(d, end);
+	c = n->nchild ? &n->child[n->nchild - 1] : NULL;
+	if (c == NULL || aclDomainLabelCompare(l, end - l, c->label, c->len)) {
+	    n->child = xrealloc(n->child, (n->nchild + 1) * sizeof(*n->child));
+	    c = &n->child[n->nchild++];
+	    memset(c, '\0', sizeof(*c));
+	    c->len = end - l;
+	    c->label = xcalloc(c->len + 1, 1);
+	    xmemcpy(c->label, l, c->len);
+	    t->nnodes++;
+	}
+	n = c;
+	if (l == d)
+	    break;
+	end = l - 1;
+    }
+    if (subdomains)
+	n->subdomains = 1;
+    else
+	n->exact = 1;
+}
+
+acl_domain_trie *
+aclDomainTrieCompile(void *data)
+{
+    acl_domain_trie *t = xcalloc(1, sizeof(acl_domain_trie));
+    char **domains;
+    char **D;
+    int n = 0;
+    int i;
+    splay_walk(data, aclDomainTrieCount, &n);
+    D = domains = xcalloc(n + 1, sizeof(char *));
+    splay_walk(data, aclDomainTrieCollect, &D);
+    qsort(domains, n, sizeof(char *), aclDomainListCompare);
+    for (i = 0; i < n; i++)
+	aclDomainTrieInsert(t, domains[i]);
+    debug(28, 3) ("aclDomainTrieCompile: %d domains, %d nodes\n", n, t->nnodes);
+    xfree(domains);
+    return t;
+}
+
+int
+aclDomainTrieMatch(const acl_domain_trie * t, const char *host)
+{
+    const domain_trie_node *n = &t->root;
+    const domain_trie_node *c;
+    const char *end;
+    const char *l;
+    int lo;
+    int hi;
+    int mid;
+    int rc;
+    while ('.' == *host)
+	host++;
+    end = host + strlen(host);
+    for (;;) {
+	l = aclDomainPrevLabel(host, end);
+	lo = 0;
+	hi = n->nchild - 1;
+	c = NULL;
+	while (lo <= hi) {
+	    mid = (lo + hi) / 2;
+	    rc = aclDomainLabelCompare(l, end - l,
+		n->child[mid].label, n->child[mid].len);
+	    if (rc == 0) {
+		c = &n->child[mid];
+		break;
+	    }
+	    if (rc < 0)
+		hi = mid - 1;
+	    else
+		lo = mid + 1;
+	}
+	if ((n = c) == NULL)
+	    return 0;
+	if (n->subdomains)
+	    return 1;
+	if (l == host)
+	    return n->exact;
+	end = l - 1;
+    }
+}
+
+static void
+aclDomainTrieFreeNode(domain_trie_node * n)
+{
+    int i;
+    for (i = 0; i < n->nchild; i++)
+	aclDomainTrieFreeNode(&n->child[i]);
+    safe_free(n->child);
+    safe_free(n->label);
+}
+
+void
+aclDomainTrieDestroy(acl_domain_trie * t)
+{
+    aclDomainTrieFreeNode(&t->root);
+    xfree(t);
+}
+
+/*****************************************************/
+/* Regex lists: one pass for the literals they need */
+/*****************************************************/
+
+/*
+ * Most patterns contain a run of plain characters that every match
+ * has to include.  The set hashes those literals on their first two
+ * characters, so one pass over the word finds the few patterns worth
+ * running.  Patterns without such a literal are always run.
+ */
+
+#define REGEX_BUCKETS 256
+#define REGEX_BUCKET(a, b) \
+    ((xtolower(a) * 31 + xtolower(b)) % REGEX_BUCKETS)
+
+typedef struct {
+    const relist *r;
+    char *literal;		/* lower case, NULL if none */
+    int len;
+    int next;			/* next entry in the bucket */
+    unsigned int checked;	/* word it was last run on */
+} regex_entry;
+
+struct _acl_regex_set {
+    regex_entry *entries;
+    int n;
+    int *always;		/* entries without a literal */
+    int nalways;
+    unsigned int words;
+    int bucket[REGEX_BUCKETS];
+};
+
+/* p is at '['; returns the closing ']' or NULL */
+static const char *
+aclRegexSkipBracket(const char *p)
+{
+    p++;
+    if (*p == '^')
+	p++;
+    if (*p == ']')
+	p++;
+    for (; *p && *p != ']'; p++) {
+	if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+	    if ((p = strchr(p + 2, ']')) == NULL)
+		return NULL;
+	}
+    }
+    return *p ? p : NULL;
+}
+
+/* p is at '('; returns the matching ')' or NULL */
+static const char *
+aclRegexSkipGroup(const char *p)
+{
+    int depth = 1;
+    while (depth && *++p) {
+	if (*p == '\\') {
+	    if (*++p == '\0')
+		return NULL;
+	} else if (*p == '[') {
+	    if ((p = aclRegexSkipBracket(p)) == NULL)
+		return NULL;
+	} else if (*p == '(') {
+	    depth++;
+	} else if (*p == ')') {
+	    depth--;
+	}
+    }
+    return *p ? p : NULL;
+}
+
+/*
+ * The longest run of ordinary characters at the top level of an
+ * extended regex, lower cased.  Anything that is not plainly
+ * ordinary ends the run; a shorter run only means more regexec()s.
+ */
+static char *
+aclRegexLiteral(const char *p, int *lenp)
+{
+    char *cur = xmalloc(strlen(p) + 1);
+    char *best = xmalloc(strlen(p) + 1);
+    int n = 0;
+    int bestlen = 0;
+    for (; *p; p++) {
+	switch (*p) {
+	case '|':
+	    bestlen = 0;	/* nothing is required */
+	    goto done;
+	case '\\':
+	    if (p[1] && strchr(".[]()*+?{}|^$\\", p[1])) {
+		cur[n++] = *++p;
+		continue;
+	    }
+	    if (*++p == '\0')
+		goto done;
+	    break;
+	case '*':
+	case '?':
+	    if (n > 0)
+		n--;
+	    break;
+	case '{':
+	    if (n > 0)
+		n--;
+	    if ((p = strchr(p, '}')) == NULL)
+		goto done;
+	    break;
+	case '[':
+	    if ((p = aclRegexSkipBracket(p)) == NULL)
+		goto done;
+	    break;
+	case '(':
+	    if ((p = aclRegexSkipGroup(p)) == NULL)
+		goto done;
+	    break;
+	case '+':
+	case '.':
+	case '^':
+	case '$':
+	    break;
+	default:
+	    cur[n++] = xtolower(*p);
+	    continue;
+	}
+	/* the run ends here */
+	if (n > bestlen) {
+	    xmemcpy(best, cur, n);
+	    bestlen = n;
+	}
+	n = 0;
+    }
+    if (n > bestlen) {
+	xmemcpy(best, cur, n);
+	bestlen = n;
+    }
+  done:
+    xfree(cur);
+    if (bestlen < 2) {
+	xfree(best);
+	return NULL;
+    }
+    best[bestlen] = '\0';
+    *lenp = bestlen;
+    return best;
+}
+
+acl_regex_set *
+aclRegexSetCompile(relist * data)
+{
+    acl_regex_set *s = xcalloc(1, sizeof(acl_regex_set));
+    regex_entry *e;
+    const relist *r;
+    int i;
+    for (r = data; r; r = r->next)
+	s->n++;
+    s->entries = xcalloc(s->n + 1, sizeof(regex_entry));
+    s->always = xcalloc(s->n + 1, sizeof(int));
+    for (i = 0; i < REGEX_BUCKETS; i++)
+	s->bucket[i] = -1;
+    for (i = 0, r = data; r; i++, r = r->next) {
+	e = &s->entries[i];
+	e->r = r;
+	e->literal = aclRegexLiteral(r->pattern, &e->len);
+	if (e->literal == NULL) {
+	    s->always[s->nalways++] = i;
+	    continue;
+	}
+	e->next = s->bucket[REGEX_BUCKET(e->literal[0], e->literal[1])];
+	s->bucket[REGEX_BUCKET(e->literal[0], e->literal[1])] = i;
+    }
+    debug(28, 3) ("aclRegexSetCompile: %d patterns, %d without a literal\n",
+	s->n, s->nalways);
+    return s;
+}
+
+int
+aclRegexSetMatch(acl_regex_set * s, const char *word)
+{
+    regex_entry *e;
+    const char *w;
+    int i;
+    if (word == NULL)
+	return 0;
+    s->words++;
+    for (w = word; w[0] && w[1]; w++) {
+	for (i = s->bucket[REGEX_BUCKET(w[0], w[1])]; i >= 0; i = e->next) {
+	    e = &s->entries[i];
+	    if (e->checked == s->words)
+		continue;
+	    if (strncasecmp(w, e->literal, e->len))
+		continue;
+	    e->checked = s->words;
+	    if (regexec(&e->r->regex, word, 0, 0, 0) == 0)
+		return 1;
+	}
+    }
+    for (i = 0; i < s->nalways; i++)
+	if (regexec(&s->entries[s->always[i]].r->regex, word, 0, 0, 0) == 0)
+	    return 1;
+    return 0;
+}
+
+void
+aclRegexSetDestroy(acl_regex_set * s)
+{
+    int i;
+    for (i = 0; i < s->n; i++)
+	safe_free(s->entries[i].literal);
+    safe_free(s->entries);
+    safe_free(s->always);
+    xfree(s);
+}
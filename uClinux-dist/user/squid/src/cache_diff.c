@@ -165,7 +165,10 @@ cacheIndexScan(CacheIndex * idx, const char *fname, FILE * file)
 	idx->scanned_count++;
 	/* if (s.op <= SWAP_LOG_NOP || s.op >= SWAP_LOG_MAX)
 	 * continue; */
-	if (s.op == SWAP_LOG_ADD) {
+	if (s.op == SWAP_LOG_NOP) {
+	    /* checkpoint header */
+	    continue;
+	} else if (s.op == SWAP_LOG_ADD) {
 	    CacheEntry *olde = (CacheEntry *) hash_lookup(idx->hash, s.key);
 	    if (olde) {
 		idx->bad_add_count++;
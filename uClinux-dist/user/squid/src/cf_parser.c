@@ -98,6 +98,9 @@ default_all(void)
 	default_line("negative_ttl 5 minutes");
 	default_line("positive_dns_ttl 6 hours");
 	default_line("negative_dns_ttl 5 minutes");
+#if !USE_DNSSERVERS
+	default_line("negative_dns_max_ttl 3 hours");
+#endif
 	default_line("range_offset_limit 0 KB");
 	default_line("connect_timeout 2 minutes");
 	default_line("peer_connect_timeout 30 seconds");
@@ -211,6 +214,9 @@ default_all(void)
 	default_line("incoming_http_average 4");
 	default_line("min_icp_poll_cnt 8");
 	default_line("min_http_poll_cnt 8");
+#if USE_EPOLL
+	default_line("comm_epoll on");
+#endif
 	default_line("max_open_disk_fds 0");
 	default_line("offline_mode off");
 	default_line("uri_whitespace strip");
@@ -437,6 +443,10 @@ parse_line(char *buff)
 		parse_time_t(&Config.positiveDnsTtl);
 	else if (!strcmp(token, "negative_dns_ttl"))
 		parse_time_t(&Config.negativeDnsTtl);
+#if !USE_DNSSERVERS
+	else if (!strcmp(token, "negative_dns_max_ttl"))
+		parse_time_t(&Config.negativeDnsMaxTtl);
+#endif
 	else if (!strcmp(token, "range_offset_limit"))
 		parse_b_size_t(&Config.rangeOffsetLimit);
 	else if (!strcmp(token, "connect_timeout"))
@@ -631,6 +641,10 @@ parse_line(char *buff)
 		parse_int(&Config.comm_incoming.icp_min_poll);
 	else if (!strcmp(token, "min_http_poll_cnt"))
 		parse_int(&Config.comm_incoming.http_min_poll);
+#if USE_EPOLL
+	else if (!strcmp(token, "comm_epoll"))
+		parse_onoff(&Config.onoff.comm_epoll);
+#endif
 	else if (!strcmp(token, "max_open_disk_fds"))
 		parse_int(&Config.max_open_disk_fds);
 	else if (!strcmp(token, "offline_mode"))
@@ -780,6 +794,9 @@ dump_config(StoreEntry *entry)
 	dump_time_t(entry, "negative_ttl", Config.negativeTtl);
 	dump_time_t(entry, "positive_dns_ttl", Config.positiveDnsTtl);
 	dump_time_t(entry, "negative_dns_ttl", Config.negativeDnsTtl);
+#if !USE_DNSSERVERS
+	dump_time_t(entry, "negative_dns_max_ttl", Config.negativeDnsMaxTtl);
+#endif
 	dump_b_size_t(entry, "range_offset_limit", Config.rangeOffsetLimit);
 	dump_time_t(entry, "connect_timeout", Config.Timeout.connect);
 	dump_time_t(entry, "peer_connect_timeout", Config.Timeout.peer_connect);
@@ -892,6 +909,9 @@ dump_config(StoreEntry *entry)
 	dump_int(entry, "incoming_http_average", Config.comm_incoming.http_average);
 	dump_int(entry, "min_icp_poll_cnt", Config.comm_incoming.icp_min_poll);
 	dump_int(entry, "min_http_poll_cnt", Config.comm_incoming.http_min_poll);
+#if USE_EPOLL
+	dump_onoff(entry, "comm_epoll", Config.onoff.comm_epoll);
+#endif
 	dump_int(entry, "max_open_disk_fds", Config.max_open_disk_fds);
 	dump_onoff(entry, "offline_mode", Config.onoff.offline);
 	dump_uri_whitespace(entry, "uri_whitespace", Config.uri_whitespace);
@@ -1016,6 +1036,9 @@ free_all(void)
 	free_time_t(&Config.negativeTtl);
 	free_time_t(&Config.positiveDnsTtl);
 	free_time_t(&Config.negativeDnsTtl);
+#if !USE_DNSSERVERS
+	free_time_t(&Config.negativeDnsMaxTtl);
+#endif
 	free_b_size_t(&Config.rangeOffsetLimit);
 	free_time_t(&Config.Timeout.connect);
 	free_time_t(&Config.Timeout.peer_connect);
@@ -1128,6 +1151,9 @@ free_all(void)
 	free_int(&Config.comm_incoming.http_average);
 	free_int(&Config.comm_incoming.icp_min_poll);
 	free_int(&Config.comm_incoming.http_min_poll);
+#if USE_EPOLL
+	free_onoff(&Config.onoff.comm_epoll);
+#endif
 	free_int(&Config.max_open_disk_fds);
 	free_onoff(&Config.onoff.offline);
 	free_uri_whitespace(&Config.uri_whitespace);
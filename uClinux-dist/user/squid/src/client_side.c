@@ -208,8 +208,7 @@ clientAccessCheckDone(int answer, void *data)
 	AclMatchedName ? AclMatchedName : "NO ACL's");
     http->acl_checklist = NULL;
     if (answer == ACCESS_ALLOWED) {
-	safe_free(http->uri);
-	http->uri = xstrdup(urlCanonical(http->request));
+	http->uri = memArenaStrdup(&http->arena, urlCanonical(http->request));
 	assert(http->redirect_state == REDIRECT_NONE);
 	http->redirect_state = REDIRECT_PENDING;
 	redirectStart(http, clientRedirectDone, http);
@@ -265,7 +264,7 @@ clientRedirectDone(void *data, char *result)
 	    char *t = result;
 	    if ((t = strchr(result, ':')) != NULL) {
 		http->redirect.status = status;
-		http->redirect.location = xstrdup(t + 1);
+		http->redirect.location = memArenaStrdup(&http->arena, t + 1);
 	    } else {
 		debug(33, 1) ("clientRedirectDone: bad input: %s\n", result);
 	    }
@@ -274,8 +273,7 @@ clientRedirectDone(void *data, char *result)
 	    new_request = urlParse(old_request->method, result);
     }
     if (new_request) {
-	safe_free(http->uri);
-	http->uri = xstrdup(urlCanonical(new_request));
+	http->uri = memArenaStrdup(&http->arena, urlCanonical(new_request));
 	new_request->http_ver = old_request->http_ver;
 	httpHeaderAppend(&new_request->header, &old_request->header);
 	new_request->client_addr = old_request->client_addr;
@@ -676,7 +674,7 @@ httpRequestFree(void *data)
 	    httpHeaderPackInto(&request->header, &p);
 	    http->al.http.method = request->method;
 	    http->al.http.version = request->http_ver;
-	    http->al.headers.request = xstrdup(mb.buf);
+	    http->al.headers.request = memArenaStrdup(&http->arena, mb.buf);
 	    http->al.hier = request->hier;
 	    if (request->user_ident[0])
 		http->al.cache.ident = request->user_ident;
@@ -693,11 +691,8 @@ httpRequestFree(void *data)
 	aclChecklistFree(http->acl_checklist);
     if (request)
 	checkFailureRatio(request->err_type, http->al.hier.code);
-    safe_free(http->uri);
-    safe_free(http->log_uri);
-    safe_free(http->al.headers.request);
-    safe_free(http->al.headers.reply);
-    safe_free(http->redirect.location);
+    /* uri, log_uri, redirect.location and the logged headers */
+    memArenaClean(&http->arena);
     stringClean(&http->range_iter.boundary);
     if ((e = http->entry)) {
 	http->entry = NULL;
@@ -1646,8 +1641,7 @@ clientSendMoreData(void *data, char *buf, ssize_t size)
 	if (Config.onoff.log_mime_hdrs) {
 	    size_t k;
 	    if ((k = headersEnd(buf, size))) {
-		safe_free(http->al.headers.reply);
-		http->al.headers.reply = xcalloc(k + 1, 1);
+		http->al.headers.reply = memArenaAlloc(&http->arena, k + 1);
 		xstrncpy(http->al.headers.reply, buf, k);
 	    }
 	}
@@ -2065,8 +2059,8 @@ parseHttpRequestAbort(ConnStateData * conn, const char *uri)
     http->conn = conn;
     http->start = current_time;
     http->req_sz = conn->in.offset;
-    http->uri = xstrdup(uri);
-    http->log_uri = xstrndup(uri, MAX_URL);
+    http->uri = memArenaStrdup(&http->arena, uri);
+    http->log_uri = memArenaStrndup(&http->arena, uri, MAX_URL);
     http->range_iter.boundary = StringNull;
     dlinkAdd(http, &http->active, &ClientActiveRequests);
     return http;
@@ -2211,7 +2205,7 @@ parseHttpRequest(ConnStateData * conn, method_t * method_p, int *status,
     /* handle internal objects */
     if (internalCheck(url)) {
 	/* prepend our name & port */
-	http->uri = xstrdup(internalLocalUri(NULL, url));
+	http->uri = memArenaStrdup(&http->arena, internalLocalUri(NULL, url));
 	http->flags.internal = 1;
 	http->flags.accel = 1;
     }
@@ -2237,14 +2231,14 @@ parseHttpRequest(ConnStateData * conn, method_t * method_p, int *status,
 	    }
 	    url_sz = strlen(url) + 32 + Config.appendDomainLen +
 		strlen(t);
-	    http->uri = xcalloc(url_sz, 1);
+	    http->uri = memArenaAlloc(&http->arena, url_sz);
 	    snprintf(http->uri, url_sz, "http://%s:%d%s",
 		t, vport, url);
 	} else if (vhost_mode) {
 	    int vport;
 	    /* Put the local socket IP address as the hostname */
 	    url_sz = strlen(url) + 32 + Config.appendDomainLen;
-	    http->uri = xcalloc(url_sz, 1);
+	    http->uri = memArenaAlloc(&http->arena, url_sz);
 	    if (vport_mode)
 		vport = (int) ntohs(http->conn->me.sin_port);
 	    else
@@ -2285,21 +2279,22 @@ parseHttpRequest(ConnStateData * conn, method_t * method_p, int *status,
 	} else {
 	    url_sz = strlen(Config2.Accel.prefix) + strlen(url) +
 		Config.appendDomainLen + 1;
-	    http->uri = xcalloc(url_sz, 1);
+	    http->uri = memArenaAlloc(&http->arena, url_sz);
 	    snprintf(http->uri, url_sz, "%s%s", Config2.Accel.prefix, url);
 	}
 	http->flags.accel = 1;
     } else {
 	/* URL may be rewritten later, so make extra room */
 	url_sz = strlen(url) + Config.appendDomainLen + 5;
-	http->uri = xcalloc(url_sz, 1);
+	http->uri = memArenaAlloc(&http->arena, url_sz);
 	strcpy(http->uri, url);
 	http->flags.accel = 0;
     }
     if (!stringHasCntl(http->uri))
-	http->log_uri = xstrndup(http->uri, MAX_URL);
+	http->log_uri = memArenaStrndup(&http->arena, http->uri, MAX_URL);
     else
-	http->log_uri = xstrndup(rfc1738_escape_unescaped(http->uri), MAX_URL);
+	http->log_uri = memArenaStrndup(&http->arena,
+	    rfc1738_escape_unescaped(http->uri), MAX_URL);
     debug(33, 5) ("parseHttpRequest: Complete request received\n");
     if (free_request)
 	safe_free(url);
@@ -2465,8 +2460,7 @@ clientReadRequest(int fd, void *data)
 		HDR_CONTENT_LENGTH);
 	    request->flags.internal = http->flags.internal;
 	    safe_free(prefix);
-	    safe_free(http->log_uri);
-	    http->log_uri = xstrdup(urlCanonicalClean(request));
+	    http->log_uri = memArenaStrdup(&http->arena, urlCanonicalClean(request));
 	    request->client_addr = conn->peer.sin_addr;
 	    request->my_addr = conn->me.sin_addr;
 	    request->my_port = ntohs(conn->me.sin_port);
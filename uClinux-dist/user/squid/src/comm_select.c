@@ -77,6 +77,62 @@ static fd_set global_writefds;
 static int nreadfds;
 static int nwritefds;
 
+/*
+ * Per-loop accounting for the "comm_loops" cache manager page.
+ * 'scanned' is how many descriptors the loop looked at itself to
+ * set up the system call; 'busy' is the time spent outside it,
+ * setting up and calling handlers, in milliseconds.
+ */
+enum {
+    COMM_LOOP_SELECT,
+    COMM_LOOP_POLL,
+    COMM_LOOP_EPOLL,
+    COMM_LOOP_MAX
+};
+static struct {
+    const char *name;
+    int loops;
+    double scanned;
+    double ready;
+    double setup_time;
+    double wait_time;
+    double dispatch_time;
+    StatHist busy;
+} comm_loop_stats[COMM_LOOP_MAX];
+static void commLoopCount(int, int, int, double, double, double);
+static OBJH commLoopStats;
+
+#if USE_EPOLL
+/*
+ * epoll keeps the set of interesting descriptors in the kernel, so
+ * instead of rebuilding it every loop we tell the kernel about
+ * changes as commSetSelect() and fd_close() make them.
+ * epoll_events[] is what the kernel currently has for each FD.
+ *
+ * Two kinds of descriptor can not simply stay registered:
+ * - reads deferred by their defer_check would make a level
+ *   triggered epoll_wait() return at once, forever.  They are
+ *   taken out and kept on the 'deferred' list, which is checked
+ *   at the top of each loop.
+ * - epoll refuses regular files, which poll() always reports as
+ *   ready.  These go on the 'ready' list and are handed to their
+ *   handlers each time round, as poll() would.
+ */
+typedef struct {
+    int n;
+    int fd[SQUID_MAXFD];
+    int pos[SQUID_MAXFD];	/* index + 1 into fd[], 0 if not listed */
+} epoll_fdlist;
+static int kdpfd = -1;
+static int nepollfds;
+static unsigned int epoll_events[SQUID_MAXFD];
+static epoll_fdlist epoll_deferred;
+static epoll_fdlist epoll_ready;
+static int epoll_ctls;
+static void commEpollUpdate(int fd);
+static int comm_epoll(int msec);
+#endif
+
 /*
  * Automatic tuning for incoming requests:
  *
@@ -328,12 +384,18 @@ comm_poll(int msec)
     int calldns = 0;
     static time_t last_timeout = 0;
     double timeout = current_dtime + (msec / 1000.0);
+    double start;
+    double called;
+    double returned;
+#if USE_EPOLL
+    if (kdpfd >= 0)
+	return comm_epoll(msec);
+#endif
     do {
 #if !ALARM_UPDATES_TIME
-	double start;
 	getCurrentTime();
-	start = current_dtime;
 #endif
+	start = current_dtime;
 #if USE_ASYNC_IO
 	aioCheckCallbacks();
 #endif
@@ -385,6 +447,10 @@ comm_poll(int msec)
 	}
 	if (msec > MAX_POLL_TIME)
 	    msec = MAX_POLL_TIME;
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	called = current_dtime;
 	for (;;) {
 	    Counter.syscalls.polls++;
 	    num = poll(pfds, nfds, msec);
@@ -398,6 +464,10 @@ comm_poll(int msec)
 	    return COMM_ERROR;
 	    /* NOTREACHED */
 	}
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	returned = current_dtime;
 	debug(5, num ? 5 : 8) ("comm_poll: %d FDs ready\n", num);
 	statHistCount(&Counter.select_fds_hist, num);
 	/* Check timeout handlers ONCE each second. */
@@ -405,8 +475,10 @@ comm_poll(int msec)
 	    last_timeout = squid_curtime;
 	    checkTimeouts();
 	}
-	if (num == 0)
+	if (num == 0) {
+	    commLoopCount(COMM_LOOP_POLL, maxfd, num, start, called, returned);
 	    continue;
+	}
 	/* scan each socket but the accept socket. Poll this 
 	 * more frequently to minimize losses due to the 5 connect 
 	 * limit in SunOS */
@@ -514,6 +586,7 @@ comm_poll(int msec)
 	getCurrentTime();
 	Counter.select_time += (current_dtime - start);
 #endif
+	commLoopCount(COMM_LOOP_POLL, maxfd, num, start, called, returned);
 	return COMM_OK;
     }
     while (timeout > current_dtime);
@@ -521,6 +594,294 @@ comm_poll(int msec)
     return COMM_TIMEOUT;
 }
 
+#if USE_EPOLL
+static void
+epollListAdd(epoll_fdlist * l, int fd)
+{
+    if (l->pos[fd])
+	return;
+    l->fd[l->n++] = fd;
+    l->pos[fd] = l->n;
+}
+
+static void
+epollListDel(epoll_fdlist * l, int fd)
+{
+    int i = l->pos[fd] - 1;
+    if (i < 0)
+	return;
+    l->fd[i] = l->fd[--l->n];
+    l->pos[l->fd[i]] = i + 1;
+    l->pos[fd] = 0;
+}
+
+/* Bring the kernel's idea of what FD is waiting for up to date. */
+static void
+commEpollUpdate(int fd)
+{
+    fde *F = &fd_table[fd];
+    struct epoll_event ev;
+    unsigned int events = 0;
+    int op;
+    if (kdpfd < 0)
+	return;
+    if (!F->flags.open)
+	epollListDel(&epoll_deferred, fd);
+    else {
+	if (F->read_handler && !epoll_deferred.pos[fd])
+	    events |= EPOLLIN;
+	if (F->write_handler)
+	    events |= EPOLLOUT;
+    }
+    if (epoll_ready.pos[fd]) {
+	if (!events)
+	    epollListDel(&epoll_ready, fd);
+	return;
+    }
+    if (events == epoll_events[fd])
+	return;
+    if (epoll_events[fd] == 0)
+	op = EPOLL_CTL_ADD;
+    else if (events == 0)
+	op = EPOLL_CTL_DEL;
+    else
+	op = EPOLL_CTL_MOD;
+    memset(&ev, '\0', sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctls++;
+    if (epoll_ctl(kdpfd, op, fd, &ev) < 0) {
+	if (op == EPOLL_CTL_ADD && errno == EPERM) {
+	    debug(5, 5) ("commEpollUpdate: FD %d can not be polled\n", fd);
+	    epollListAdd(&epoll_ready, fd);
+	    return;
+	}
+	/* A DEL may find the descriptor already closed. */
+	if (op != EPOLL_CTL_DEL) {
+	    debug(5, 1) ("commEpollUpdate: FD %d: epoll_ctl: %s\n",
+		fd, xstrerror());
+	    return;
+	}
+    }
+    if (epoll_events[fd] == 0)
+	nepollfds++;
+    else if (events == 0)
+	nepollfds--;
+    epoll_events[fd] = events;
+}
+
+/* Give back to epoll the reads that are no longer deferred. */
+static void
+commEpollCheckDeferred(void)
+{
+    int i;
+    int fd;
+    for (i = 0; i < epoll_deferred.n;) {
+	fd = epoll_deferred.fd[i];
+	if (fd_table[fd].read_handler && commDeferRead(fd) == 1) {
+	    i++;
+	    continue;
+	}
+	epollListDel(&epoll_deferred, fd);
+	commEpollUpdate(fd);
+    }
+}
+
+/* comm_poll() for epoll: only the ready descriptors come back. */
+static int
+comm_epoll(int msec)
+{
+    static struct epoll_event events[SQUID_MAXFD];
+    PF *hdl = NULL;
+    fde *F;
+    int fd;
+    int i;
+    int j;
+    int num;
+    int nready;
+    int wait;
+    int revents;
+    int scanned;
+    int callicp = 0, callhttp = 0;
+    int calldns = 0;
+    static time_t last_timeout = 0;
+    double timeout = current_dtime + (msec / 1000.0);
+    double start;
+    double called;
+    double returned;
+    do {
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	start = current_dtime;
+#if USE_ASYNC_IO
+	aioCheckCallbacks();
+#endif
+	if (commCheckICPIncoming)
+	    comm_poll_icp_incoming();
+	if (commCheckDNSIncoming)
+	    comm_poll_dns_incoming();
+	if (commCheckHTTPIncoming)
+	    comm_poll_http_incoming();
+	callicp = calldns = callhttp = 0;
+	scanned = epoll_deferred.n + epoll_ready.n;
+	commEpollCheckDeferred();
+	if (nepollfds + epoll_ready.n == 0) {
+	    assert(shutting_down);
+	    return COMM_SHUTDOWN;
+	}
+	if (msec > MAX_POLL_TIME)
+	    msec = MAX_POLL_TIME;
+	wait = epoll_ready.n ? 0 : msec;
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	called = current_dtime;
+	for (;;) {
+	    Counter.syscalls.polls++;
+	    num = epoll_wait(kdpfd, events, SQUID_MAXFD - epoll_ready.n, wait);
+	    Counter.select_loops++;
+	    if (num >= 0)
+		break;
+	    if (ignoreErrno(errno))
+		continue;
+	    debug(5, 0) ("comm_epoll: epoll_wait failure: %s\n", xstrerror());
+	    assert(errno != EINVAL);
+	    return COMM_ERROR;
+	    /* NOTREACHED */
+	}
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	returned = current_dtime;
+	/* Files are always ready, as far as poll() is concerned. */
+	for (j = 0; j < epoll_ready.n; j++) {
+	    fd = epoll_ready.fd[j];
+	    events[num].events = 0;
+	    if (fd_table[fd].read_handler)
+		events[num].events |= EPOLLIN;
+	    if (fd_table[fd].write_handler)
+		events[num].events |= EPOLLOUT;
+	    events[num++].data.fd = fd;
+	}
+	debug(5, num ? 5 : 8) ("comm_epoll: %d FDs ready\n", num);
+	statHistCount(&Counter.select_fds_hist, num);
+	/* Check timeout handlers ONCE each second. */
+	if (squid_curtime > last_timeout) {
+	    last_timeout = squid_curtime;
+	    checkTimeouts();
+	}
+	if (num == 0) {
+	    commLoopCount(COMM_LOOP_EPOLL, scanned, num, start, called, returned);
+	    continue;
+	}
+	nready = num;
+	for (i = 0; i < nready; i++) {
+	    fd = events[i].data.fd;
+	    revents = events[i].events;
+	    F = &fd_table[fd];
+	    if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR) && F->read_handler) {
+		switch (commDeferRead(fd)) {
+		case 0:
+		    break;
+		case 1:
+		    epollListAdd(&epoll_deferred, fd);
+		    revents &= ~EPOLLIN;
+		    break;
+#if DELAY_POOLS
+		case -1:
+		    if (fdIsHttp(fd) || fdIsIcp(fd) || fdIsDns(fd))
+			break;
+		    commAddSlowFd(fd);
+		    revents &= ~EPOLLIN;
+		    break;
+#endif
+		default:
+		    fatalf("bad return value from commDeferRead(FD %d)\n", fd);
+		}
+	    }
+	    /* Drop whatever nobody is waiting for any more. */
+	    commEpollUpdate(fd);
+	    if (fdIsIcp(fd)) {
+		callicp = 1;
+		continue;
+	    }
+	    if (fdIsDns(fd)) {
+		calldns = 1;
+		continue;
+	    }
+	    if (fdIsHttp(fd)) {
+		callhttp = 1;
+		continue;
+	    }
+	    if (revents & EPOLLIN || (revents & (EPOLLHUP | EPOLLERR)
+		    && !epoll_deferred.pos[fd])) {
+		debug(5, 6) ("comm_epoll: FD %d ready for reading\n", fd);
+		if ((hdl = F->read_handler)) {
+		    F->read_handler = NULL;
+		    hdl(fd, F->read_data);
+		    Counter.select_fds++;
+		    if (commCheckICPIncoming)
+			comm_poll_icp_incoming();
+		    if (commCheckDNSIncoming)
+			comm_poll_dns_incoming();
+		    if (commCheckHTTPIncoming)
+			comm_poll_http_incoming();
+		}
+	    }
+	    if (revents & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+		debug(5, 5) ("comm_epoll: FD %d ready for writing\n", fd);
+		if ((hdl = F->write_handler)) {
+		    F->write_handler = NULL;
+		    hdl(fd, F->write_data);
+		    Counter.select_fds++;
+		    if (commCheckICPIncoming)
+			comm_poll_icp_incoming();
+		    if (commCheckDNSIncoming)
+			comm_poll_dns_incoming();
+		    if (commCheckHTTPIncoming)
+			comm_poll_http_incoming();
+		}
+	    }
+	    commEpollUpdate(fd);
+	}
+	if (callicp)
+	    comm_poll_icp_incoming();
+	if (calldns)
+	    comm_poll_dns_incoming();
+	if (callhttp)
+	    comm_poll_http_incoming();
+#if DELAY_POOLS
+	while ((fd = commGetSlowFd()) != -1) {
+	    F = &fd_table[fd];
+	    debug(5, 6) ("comm_epoll: slow FD %d selected for reading\n", fd);
+	    if ((hdl = F->read_handler)) {
+		F->read_handler = NULL;
+		hdl(fd, F->read_data);
+		Counter.select_fds++;
+		commEpollUpdate(fd);
+		if (commCheckICPIncoming)
+		    comm_poll_icp_incoming();
+		if (commCheckDNSIncoming)
+		    comm_poll_dns_incoming();
+		if (commCheckHTTPIncoming)
+		    comm_poll_http_incoming();
+	    }
+	}
+#endif
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+	Counter.select_time += (current_dtime - start);
+#endif
+	commLoopCount(COMM_LOOP_EPOLL, scanned, num, start, called, returned);
+	return COMM_OK;
+    }
+    while (timeout > current_dtime);
+    debug(5, 8) ("comm_epoll: time out: %d.\n", squid_curtime);
+    return COMM_TIMEOUT;
+}
+#endif /* USE_EPOLL */
+
 #else
 
 static int
@@ -660,11 +1021,15 @@ comm_select(int msec)
     static time_t last_timeout = 0;
     struct timeval poll_time;
     double timeout = current_dtime + (msec / 1000.0);
+    double start;
+    double called;
+    double returned;
     fde *F;
     do {
 #if !ALARM_UPDATES_TIME
 	getCurrentTime();
 #endif
+	start = current_dtime;
 #if USE_ASYNC_IO
 	aioCheckCallbacks();
 #endif
@@ -735,6 +1100,10 @@ comm_select(int msec)
 	if (msec < 0)
 	    msec = MAX_POLL_TIME;
 #endif
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	called = current_dtime;
 	for (;;) {
 	    poll_time.tv_sec = msec / 1000;
 	    poll_time.tv_usec = (msec % 1000) * 1000;
@@ -753,6 +1122,10 @@ comm_select(int msec)
 	}
 	if (num < 0)
 	    continue;
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	returned = current_dtime;
 	debug(5, num ? 5 : 8) ("comm_select: %d FDs ready at %d\n",
 	    num, (int) squid_curtime);
 	statHistCount(&Counter.select_fds_hist, num);
@@ -762,8 +1135,10 @@ comm_select(int msec)
 	    last_timeout = squid_curtime;
 	    checkTimeouts();
 	}
-	if (num == 0)
+	if (num == 0) {
+	    commLoopCount(COMM_LOOP_SELECT, maxfd, num, start, called, returned);
 	    continue;
+	}
 	/* Scan return fd masks for ready descriptors */
 	fdsp = (fd_mask *) & readfds;
 	maxindex = howmany(maxfd, FD_MASK_BITS);
@@ -884,6 +1259,10 @@ comm_select(int msec)
 	    }
 	}
 #endif
+#if !ALARM_UPDATES_TIME
+	getCurrentTime();
+#endif
+	commLoopCount(COMM_LOOP_SELECT, maxfd, num, start, called, returned);
 	return COMM_OK;
     }
     while (timeout > current_dtime);
@@ -926,14 +1305,71 @@ comm_select_dns_incoming(void)
 void
 comm_select_init(void)
 {
+    int i;
     zero_tv.tv_sec = 0;
     zero_tv.tv_usec = 0;
     cachemgrRegister("comm_incoming",
 	"comm_incoming() stats",
 	commIncomingStats, 0, 1);
+    cachemgrRegister("comm_loops",
+	"Main loop statistics",
+	commLoopStats, 0, 1);
     FD_ZERO(&global_readfds);
     FD_ZERO(&global_writefds);
     nreadfds = nwritefds = 0;
+    comm_loop_stats[COMM_LOOP_SELECT].name = "select";
+    comm_loop_stats[COMM_LOOP_POLL].name = "poll";
+    comm_loop_stats[COMM_LOOP_EPOLL].name = "epoll";
+    for (i = 0; i < COMM_LOOP_MAX; i++)
+	statHistLogInit(&comm_loop_stats[i].busy, 100, 0.0, 10000.0);
+    comm_select_configure();
+}
+
+/*
+ * Called at startup and after each reconfigure, to switch between
+ * epoll and poll() if comm_epoll has changed.
+ */
+void
+comm_select_configure(void)
+{
+#if USE_EPOLL
+    int fd;
+    if (Config.onoff.comm_epoll && kdpfd < 0) {
+	if ((kdpfd = epoll_create(Squid_MaxFD)) < 0) {
+	    debug(50, 0) ("comm_select_configure: epoll_create: %s\n",
+		xstrerror());
+	    debug(5, 0) ("WARNING: Can not use epoll, using poll() instead\n");
+	    return;
+	}
+	fd_open(kdpfd, FD_UNKNOWN, "epoll");
+	commSetCloseOnExec(kdpfd);
+	nepollfds = 0;
+	/* Register everything that is already waiting. */
+	for (fd = 0; fd <= Biggest_FD; fd++)
+	    commEpollUpdate(fd);
+	debug(5, 1) ("Using epoll for network I/O\n");
+    } else if (!Config.onoff.comm_epoll && kdpfd >= 0) {
+	comm_select_shutdown();
+	debug(5, 1) ("Using poll() for network I/O\n");
+    }
+#endif
+}
+
+void
+comm_select_shutdown(void)
+{
+#if USE_EPOLL
+    int fd = kdpfd;
+    if (fd < 0)
+	return;
+    kdpfd = -1;
+    fd_close(fd);
+    close(fd);
+    nepollfds = 0;
+    memset(epoll_events, '\0', sizeof(epoll_events));
+    memset(&epoll_deferred, '\0', sizeof(epoll_deferred));
+    memset(&epoll_ready, '\0', sizeof(epoll_ready));
+#endif
 }
 
 #if !HAVE_POLL
@@ -1073,6 +1509,9 @@ commUpdateReadBits(int fd, PF * handler)
 	FD_CLR(fd, &global_readfds);
 	nreadfds--;
     }
+#if USE_EPOLL
+    commEpollUpdate(fd);
+#endif
 }
 
 void
@@ -1085,4 +1524,54 @@ commUpdateWriteBits(int fd, PF * handler)
 	FD_CLR(fd, &global_writefds);
 	nwritefds--;
     }
+#if USE_EPOLL
+    commEpollUpdate(fd);
+#endif
+}
+
+static void
+commLoopCount(int loop, int scanned, int ready, double start, double called, double returned)
+{
+    double busy = (called - start) + (current_dtime - returned);
+    comm_loop_stats[loop].loops++;
+    comm_loop_stats[loop].scanned += scanned;
+    comm_loop_stats[loop].ready += ready;
+    comm_loop_stats[loop].setup_time += called - start;
+    comm_loop_stats[loop].wait_time += returned - called;
+    comm_loop_stats[loop].dispatch_time += current_dtime - returned;
+    statHistCount(&comm_loop_stats[loop].busy, busy * 1000.0);
+}
+
+static void
+commLoopStats(StoreEntry * sentry)
+{
+    int i;
+    int n;
+#if USE_EPOLL
+    storeAppendPrintf(sentry, "Current loop: %s\n", kdpfd >= 0 ? "epoll" : "poll");
+    storeAppendPrintf(sentry, "epoll: %d FDs registered, %d deferred, %d files, %d epoll_ctl calls\n",
+	nepollfds, epoll_deferred.n, epoll_ready.n, epoll_ctls);
+#endif
+    storeAppendPrintf(sentry, "%-8s %10s %10s %10s %10s %10s %10s\n",
+	"loop", "count", "scanned", "ready", "setup", "wait", "dispatch");
+    storeAppendPrintf(sentry, "%-8s %10s %10s %10s %10s %10s %10s\n",
+	"", "", "FDs/loop", "FDs/loop", "usec/loop", "usec/loop", "usec/loop");
+    for (i = 0; i < COMM_LOOP_MAX; i++) {
+	if ((n = comm_loop_stats[i].loops) == 0)
+	    continue;
+	storeAppendPrintf(sentry, "%-8s %10d %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+	    comm_loop_stats[i].name, n,
+	    comm_loop_stats[i].scanned / n,
+	    comm_loop_stats[i].ready / n,
+	    comm_loop_stats[i].setup_time * 1000000.0 / n,
+	    comm_loop_stats[i].wait_time * 1000000.0 / n,
+	    comm_loop_stats[i].dispatch_time * 1000000.0 / n);
+    }
+    for (i = 0; i < COMM_LOOP_MAX; i++) {
+	if (comm_loop_stats[i].loops == 0)
+	    continue;
+	storeAppendPrintf(sentry, "\nHistogram of msec per %s loop, setup plus dispatch:\n",
+	    comm_loop_stats[i].name);
+	statHistDump(&comm_loop_stats[i].busy, sentry, NULL);
+    }
 }
@@ -283,6 +283,12 @@
 #define URI_WHITESPACE_CHOP 3
 #define URI_WHITESPACE_DENY 4
 
+/*
+ * Key of the SWAP_LOG_NOP record at the start of a checkpointed
+ * swap.state; see store_dir_ufs.c.
+ */
+#define SWAP_LOG_CHECKPOINT "swap.state ckpt"
+
 #ifndef _PATH_DEVNULL
 #define _PATH_DEVNULL "/dev/null"
 #endif
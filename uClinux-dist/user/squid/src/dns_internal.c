@@ -50,6 +50,8 @@
 #endif
 
 #define IDNS_MAX_TRIES 20
+#define IDNS_TIMEOUT 5.0	/* seconds before a query is sent again */
+#define IDNS_ID_HASH_SIZE 256
 
 #define MAX_RCODE 6
 #define MAX_ATTEMPT 3
@@ -59,16 +61,21 @@ typedef struct _idns_query idns_query;
 typedef struct _ns ns;
 
 struct _idns_query {
+    hash_link hash;		/* in idns_names, key is 'name' */
+    char name[RFC1035_MAXHOSTNAMESZ + 8];
     char buf[512];
     size_t sz;
     unsigned short id;
     int nsends;
+    unsigned int ns_mask;	/* bit n set if sent to nameservers[n] */
     struct timeval start_t;
     struct timeval sent_t;
     dlink_node lru;
+    dlink_node id_link;		/* in idns_ids[id % IDNS_ID_HASH_SIZE] */
     IDNSCB *callback;
     void *callback_data;
     int attempt;
+    idns_query *queue;		/* same lookups, waiting for this answer */
 };
 
 struct _ns {
@@ -82,6 +89,13 @@ static int nns = 0;
 static int nns_alloc = 0;
 static dlink_list lru_list;
 static int event_queued = 0;
+static dlink_list idns_ids[IDNS_ID_HASH_SIZE];
+static hash_table *idns_names = NULL;
+static int idns_soa_ttl = -1;
+static struct {
+    int coalesced;
+    int soa_negative;
+} IdnsStats;
 
 static OBJH idnsStats;
 static void idnsAddNameserver(const char *buf);
@@ -89,9 +103,12 @@ static void idnsFreeNameservers(void);
 static void idnsParseNameservers(void);
 static void idnsParseResolvConf(void);
 static void idnsSendQuery(idns_query * q);
+static void idnsStartQuery(idns_query * q);
+static int idnsCoalesceQuery(idns_query * q);
+static void idnsCallback(idns_query * q, rfc1035_rr * answers, int n);
 static int idnsFromKnownNameserver(struct sockaddr_in *from);
-static idns_query *idnsFindQuery(unsigned short id);
-static void idnsGrokReply(const char *buf, size_t sz);
+static idns_query *idnsFindQuery(unsigned short id, int ns);
+static void idnsGrokReply(const char *buf, size_t sz, int ns);
 static PF idnsRead;
 static EVH idnsCheckQueue;
 static void idnsTickleQueue(void);
@@ -198,6 +215,10 @@ idnsStats(StoreEntry * sentry)
 	    nameservers[i].nqueries,
 	    nameservers[i].nreplies);
     }
+    storeAppendPrintf(sentry, "\nIdentical lookups joined to one query: %d\n",
+	IdnsStats.coalesced);
+    storeAppendPrintf(sentry, "Negative answers cached for their SOA TTL: %d\n",
+	IdnsStats.soa_negative);
     storeAppendPrintf(sentry, "\nRcode Matrix:\n");
     storeAppendPrintf(sentry, "RCODE");
     for (i = 0; i < MAX_ATTEMPT; i++)
@@ -210,14 +231,25 @@ idnsStats(StoreEntry * sentry)
     }
 }
 
+/*
+ * The oldest query is at the tail of lru_list, so the check is
+ * scheduled for when that one times out.  A newer query can not be
+ * due sooner.
+ */
 static void
 idnsTickleQueue(void)
 {
+    idns_query *q;
+    double delay;
     if (event_queued)
 	return;
     if (NULL == lru_list.tail)
 	return;
-    eventAdd("idnsCheckQueue", idnsCheckQueue, NULL, 1.0, 1);
+    q = lru_list.tail->data;
+    delay = IDNS_TIMEOUT - tvSubDsec(q->sent_t, current_time);
+    if (delay < 0.0)
+	delay = 0.0;
+    eventAdd("idnsCheckQueue", idnsCheckQueue, NULL, delay, 1);
     event_queued = 1;
 }
 
@@ -228,6 +260,11 @@ idnsSendQuery(idns_query * q)
     int ns;
     if (DnsSocket < 0) {
 	debug(78, 1) ("idnsSendQuery: Can't send query, no DNS socket!\n");
+	/* queue it anyway, so it is sent again or given up on */
+	q->nsends++;
+	q->sent_t = current_time;
+	dlinkAdd(q, &q->lru, &lru_list);
+	idnsTickleQueue();
 	return;
     }
     /* XXX Select nameserver */
@@ -249,6 +286,8 @@ idnsSendQuery(idns_query * q)
     }
     q->nsends++;
     q->sent_t = current_time;
+    if (ns < 32)
+	q->ns_mask |= 1U << ns;
     nameservers[ns].nqueries++;
     dlinkAdd(q, &q->lru, &lru_list);
     idnsTickleQueue();
@@ -268,24 +307,87 @@ idnsFromKnownNameserver(struct sockaddr_in *from)
     return -1;
 }
 
+/*
+ * Find the query a reply with this ID from nameservers[ns] answers;
+ * ns is -1 for a nameserver we do not know.  A reply from a known
+ * nameserver must come from one the query was sent to.
+ */
 static idns_query *
-idnsFindQuery(unsigned short id)
+idnsFindQuery(unsigned short id, int ns)
 {
     dlink_node *n;
     idns_query *q;
-    for (n = lru_list.tail; n; n = n->prev) {
+    for (n = idns_ids[id % IDNS_ID_HASH_SIZE].head; n; n = n->next) {
 	q = n->data;
-	if (q->id == id)
-	    return q;
+	if (q->id != id)
+	    continue;
+	if (ns >= 0 && ns < 32 && !(q->ns_mask & (1U << ns)))
+	    continue;
+	return q;
     }
     return NULL;
 }
 
+/* index a new query and send it */
 static void
-idnsGrokReply(const char *buf, size_t sz)
+idnsStartQuery(idns_query * q)
 {
-    int n;
+    q->start_t = current_time;
+    dlinkAdd(q, &q->id_link, &idns_ids[q->id % IDNS_ID_HASH_SIZE]);
+    if (q->hash.key)
+	hash_join(idns_names, &q->hash);
+    idnsSendQuery(q);
+}
+
+/*
+ * If the same lookup is already outstanding, queue q behind it and
+ * return 1; its answer will be passed to q's callback too.
+ */
+static int
+idnsCoalesceQuery(idns_query * q)
+{
+    idns_query *w;
+    if (q->hash.key == NULL)
+	return 0;
+    if ((w = hash_lookup(idns_names, q->name)) == NULL)
+	return 0;
+    debug(78, 3) ("idnsCoalesceQuery: '%s' waits for ID %#hx\n",
+	q->name, w->id);
+    q->queue = w->queue;
+    w->queue = q;
+    IdnsStats.coalesced++;
+    return 1;
+}
+
+/*
+ * Pass the answer to everyone waiting for it.  The query is taken
+ * out of the indexes first, so a callback that starts the same
+ * lookup again gets a new query.  The caller frees q.
+ */
+static void
+idnsCallback(idns_query * q, rfc1035_rr * answers, int n)
+{
+    idns_query *w;
     int valid;
+    dlinkDelete(&q->id_link, &idns_ids[q->id % IDNS_ID_HASH_SIZE]);
+    if (q->hash.key)
+	hash_remove_link(idns_names, &q->hash);
+    for (w = q; w; w = w->queue) {
+	valid = cbdataValid(w->callback_data);
+	cbdataUnlock(w->callback_data);
+	if (valid)
+	    w->callback(w->callback_data, answers, n);
+    }
+    while ((w = q->queue)) {
+	q->queue = w->queue;
+	memFree(w, MEM_IDNS_QUERY);
+    }
+}
+
+static void
+idnsGrokReply(const char *buf, size_t sz, int ns)
+{
+    int n;
     rfc1035_rr *answers = NULL;
     unsigned short rid = 0xFFFF;
     idns_query *q;
@@ -299,7 +401,7 @@ idnsGrokReply(const char *buf, size_t sz)
 	/* XXX leak answers? */
 	return;
     }
-    q = idnsFindQuery(rid);
+    q = idnsFindQuery(rid, ns);
     if (q == NULL) {
 	debug(78, 3) ("idnsGrokReply: Late response\n");
 	rfc1035RRDestroy(answers, n);
@@ -316,16 +418,22 @@ idnsGrokReply(const char *buf, size_t sz)
 	     * the name server."
 	     */
 	    assert(NULL == answers);
+	    dlinkDelete(&q->id_link, &idns_ids[q->id % IDNS_ID_HASH_SIZE]);
 	    q->start_t = current_time;
 	    q->id = rfc1035RetryQuery(q->buf);
+	    q->ns_mask = 0;
+	    dlinkAdd(q, &q->id_link, &idns_ids[q->id % IDNS_ID_HASH_SIZE]);
 	    idnsSendQuery(q);
 	    return;
 	}
     }
-    valid = cbdataValid(q->callback_data);
-    cbdataUnlock(q->callback_data);
-    if (valid)
-	q->callback(q->callback_data, answers, n);
+    /* NXDOMAIN and empty answers carry a SOA saying how long to keep them */
+    idns_soa_ttl = -1;
+    if (n == 0 || (n < 0 && rfc1035_errno == 3))
+	idns_soa_ttl = rfc1035NegativeTtl(buf, sz);
+    if (idns_soa_ttl >= 0)
+	IdnsStats.soa_negative++;
+    idnsCallback(q, answers, n);
     rfc1035RRDestroy(answers, n);
     memFree(q, MEM_IDNS_QUERY);
 }
@@ -379,7 +487,7 @@ idnsRead(int fd, void *data)
 	    }
 	    continue;
 	}
-	idnsGrokReply(rbuf, len);
+	idnsGrokReply(rbuf, len, ns);
     }
     if (lru_list.head)
 	commSetSelect(DnsSocket, COMM_SELECT_READ, idnsRead, NULL, 0);
@@ -394,7 +502,7 @@ idnsCheckQueue(void *unused)
     event_queued = 0;
     for (n = lru_list.tail; n; n = p) {
 	q = n->data;
-	if (tvSubDsec(q->sent_t, current_time) < 5.0)
+	if (tvSubDsec(q->sent_t, current_time) < IDNS_TIMEOUT)
 	    break;
 	debug(78, 3) ("idnsCheckQueue: ID %#04x timeout\n",
 	    q->id);
@@ -403,13 +511,11 @@ idnsCheckQueue(void *unused)
 	if (q->nsends < IDNS_MAX_TRIES) {
 	    idnsSendQuery(q);
 	} else {
-	    int v = cbdataValid(q->callback_data);
 	    debug(78, 1) ("idnsCheckQueue: ID %x: giving up after %d tries and %5.1f seconds\n",
 		(int) q->id, q->nsends,
 		tvSubDsec(q->start_t, current_time));
-	    cbdataUnlock(q->callback_data);
-	    if (v)
-		q->callback(q->callback_data, NULL, 0);
+	    idns_soa_ttl = -1;
+	    idnsCallback(q, NULL, 0);
 	    memFree(q, MEM_IDNS_QUERY);
 	}
     }
@@ -462,6 +568,7 @@ idnsInit(void)
 	    "Internal DNS Statistics",
 	    idnsStats, 0, 1);
 	memset(RcodeMatrix, '\0', sizeof(RcodeMatrix));
+	idns_names = hash_create((HASHCMP *) strcmp, 229, hash_string);
 	init++;
     }
 }
@@ -476,34 +583,62 @@ idnsShutdown(void)
     idnsFreeNameservers();
 }
 
+/*
+ * How long ipcache and fqdncache keep the failed lookup that was just
+ * passed to their callback.  Names that do not exist, or have no
+ * records of the type asked for, are kept for the TTL of the SOA that
+ * came with the answer (RFC 2308), up to negative_dns_max_ttl.  Other
+ * failures, and answers without a SOA, are kept for negative_dns_ttl.
+ */
+time_t
+idnsNegativeTtl(int nr)
+{
+    if (nr < 0 && rfc1035_errno != 3)
+	return Config.negativeDnsTtl;
+    if (idns_soa_ttl < 0)
+	return Config.negativeDnsTtl;
+    if (idns_soa_ttl > Config.negativeDnsMaxTtl)
+	return Config.negativeDnsMaxTtl;
+    return (time_t) idns_soa_ttl;
+}
+
 void
 idnsALookup(const char *name, IDNSCB * callback, void *data)
 {
     idns_query *q = memAllocate(MEM_IDNS_QUERY);
+    q->callback = callback;
+    q->callback_data = data;
+    cbdataLock(q->callback_data);
+    /* names too long for the key are not coalesced */
+    if (strlen(name) + 2 < sizeof(q->name)) {
+	snprintf(q->name, sizeof(q->name), "A %s", name);
+	q->hash.key = q->name;
+    }
+    if (idnsCoalesceQuery(q))
+	return;
     q->sz = sizeof(q->buf);
     q->id = rfc1035BuildAQuery(name, q->buf, &q->sz);
     debug(78, 3) ("idnsALookup: buf is %d bytes for %s, id = %#hx\n",
 	(int) q->sz, name, q->id);
-    q->callback = callback;
-    q->callback_data = data;
-    cbdataLock(q->callback_data);
-    q->start_t = current_time;
-    idnsSendQuery(q);
+    idnsStartQuery(q);
 }
 
 void
 idnsPTRLookup(const struct in_addr addr, IDNSCB * callback, void *data)
 {
     idns_query *q = memAllocate(MEM_IDNS_QUERY);
+    q->callback = callback;
+    q->callback_data = data;
+    cbdataLock(q->callback_data);
+    snprintf(q->name, sizeof(q->name), "PTR %s", inet_ntoa(addr));
+    q->hash.key = q->name;
+    if (idnsCoalesceQuery(q))
+	return;
     q->sz = sizeof(q->buf);
     q->id = rfc1035BuildPTRQuery(addr, q->buf, &q->sz);
     debug(78, 3) ("idnsPTRLookup: buf is %d bytes for %s, id = %#hx\n",
 	(int) q->sz, inet_ntoa(addr), q->id);
-    q->callback = callback;
-    q->callback_data = data;
-    cbdataLock(q->callback_data);
-    q->start_t = current_time;
-    idnsSendQuery(q);
+    idnsStartQuery(q);
 }
 
 #endif /* !USE_DNSSERVERS */
@@ -291,11 +291,13 @@ fqdncacheParse(rfc1035_rr * answers, int nr)
 	    rfc1035_errno);
 	assert(rfc1035_error_message);
 	f.error_message = xstrdup(rfc1035_error_message);
+	f.expires = squid_curtime + idnsNegativeTtl(nr);
 	return &f;
     }
     if (nr == 0) {
 	debug(35, 3) ("fqdncacheParse: No DNS records\n");
 	f.error_message = xstrdup("No DNS records");
+	f.expires = squid_curtime + idnsNegativeTtl(nr);
 	return &f;
     }
     debug(35, 3) ("fqdncacheParse: %d answers\n", nr);
@@ -348,11 +348,13 @@ ipcacheParse(rfc1035_rr * answers, int nr)
 	    rfc1035_errno);
 	assert(rfc1035_error_message);
 	i.error_message = xstrdup(rfc1035_error_message);
+	i.expires = squid_curtime + idnsNegativeTtl(nr);
 	return &i;
     }
     if (nr == 0) {
 	debug(14, 3) ("ipcacheParse: No DNS records\n");
 	i.error_message = xstrdup("No DNS records");
+	i.expires = squid_curtime + idnsNegativeTtl(nr);
 	return &i;
     }
     assert(answers);
@@ -344,7 +344,11 @@ mainReconfigure(void)
     errorClean();
     mimeFreeMemory();
     parseConfigFile(ConfigFile);
+    comm_select_configure();
+    /* the log may not come back on the same FD */
+    fd_close(fileno(debug_log));
     _db_init(Config.Log.log, Config.debugOptions);
+    fd_open(fileno(debug_log), FD_LOG, Config.Log.log);
     ipcache_restart();		/* clear stuck entries */
     fqdncache_restart();	/* sigh, fqdncache too */
     errorInitialize();		/* reload error pages */
@@ -875,6 +879,7 @@ SquidShutdown(void *unused)
     releaseServerSockets();
     commCloseAllSockets();
     unlinkdClose();
+    comm_select_shutdown();
 #if USE_ASYNC_IO
     aioSync();			/* flush pending object writes / unlinks */
 #endif
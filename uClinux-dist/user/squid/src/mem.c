@@ -62,6 +62,59 @@ static struct {
 static MemMeter StrCountMeter;
 static MemMeter StrVolumeMeter;
 
+/*
+ * memAllocBuf() size classes: the string pools, then buffer pools up
+ * to 8 KB.  Above the string pools a buffer pool is only used for
+ * requests of exactly its size, such as arena chunks; rounding the
+ * rest up to the next power of two would waste up to half of each
+ * buffer.  Everything else comes from xcalloc(), at the size asked
+ * for, and is counted in the last class.
+ */
+#define mem_buf_class_count 8
+static struct {
+    MemPool *pool;
+    size_t obj_size;		/* 0 for the xcalloc() class */
+    int count;			/* buffers allocated so far */
+    gb_t net;			/* bytes asked for */
+    gb_t gross;			/* bytes handed out */
+    MemMeter inuse;		/* buffers */
+    MemMeter volume;		/* bytes */
+} BufClasses[mem_buf_class_count];
+static MemPool *Buf1KPool = NULL;
+
+/* where memAllocBuf() is called from, hashed on file and line */
+#define mem_buf_site_count 64
+static struct {
+    const char *file;
+    int line;
+    int count;
+    gb_t gross;
+} BufSites[mem_buf_site_count];
+static int BufSitesLost = 0;
+
+/*
+ * Arenas are carved out of 1 KB chunks from the buffer classes.
+ * Requests for more than a quarter of that get a block of their own,
+ * so a chunk is never abandoned with much room left.
+ */
+#define MEM_ARENA_CHUNK 1024
+#define MEM_ARENA_ALIGN 8
+#define MEM_ARENA_ROUND(n) (((n) + MEM_ARENA_ALIGN - 1) & ~(MEM_ARENA_ALIGN - 1))
+typedef struct _MemArenaChunk MemArenaChunk;
+struct _MemArenaChunk {
+    MemArenaChunk *next;
+    size_t size;		/* for memFreeBuf() */
+    size_t used;		/* including this header */
+};
+#define MEM_ARENA_HDR MEM_ARENA_ROUND(sizeof(MemArenaChunk))
+static struct {
+    int count;			/* allocations so far */
+    int big;			/* ... that got a block of their own */
+    gb_t bytes;			/* bytes asked for */
+    MemMeter chunks;		/* chunks and blocks in use */
+    MemMeter volume;		/* their bytes */
+} ArenaStats;
+
 
 /* local routines */
 
@@ -94,6 +147,52 @@ memStringStats(StoreEntry * sentry)
 	xpercentInt(StrVolumeMeter.level - pooled_volume, StrVolumeMeter.level));
 }
 
+static void
+memBufStats(StoreEntry * sentry)
+{
+    int i;
+    storeAppendPrintf(sentry, "Variable Size Buffers (memAllocBuf):\n");
+    storeAppendPrintf(sentry, "Class\t Allocated\t Used\t"
+	" In Use\t\t\t\t\n"
+	"(bytes)\t (#)\t (%%gross)\t"
+	" (#)\t (KB)\t high (#)\t high (KB)\n");
+    for (i = 0; i < mem_buf_class_count; i++) {
+	if (BufClasses[i].obj_size)
+	    storeAppendPrintf(sentry, "%d\t ", (int) BufClasses[i].obj_size);
+	else
+	    storeAppendPrintf(sentry, "other\t ");
+	storeAppendPrintf(sentry, "%d\t %d\t %d\t %d\t %d\t %d\n",
+	    BufClasses[i].count,
+	    xpercentInt(gb_to_double(&BufClasses[i].net),
+		gb_to_double(&BufClasses[i].gross)),
+	    (int) BufClasses[i].inuse.level,
+	    (int) ((BufClasses[i].volume.level + 1023) >> 10),
+	    (int) BufClasses[i].inuse.hwater_level,
+	    (int) ((BufClasses[i].volume.hwater_level + 1023) >> 10));
+    }
+    storeAppendPrintf(sentry, "\nAllocation Sites:\n");
+    storeAppendPrintf(sentry, "Site\t\t\t Allocated (#)\t Allocated (bytes)\n");
+    for (i = 0; i < mem_buf_site_count; i++) {
+	if (BufSites[i].file == NULL)
+	    continue;
+	storeAppendPrintf(sentry, "%s:%d\t\t %d\t %s\n",
+	    BufSites[i].file, BufSites[i].line,
+	    BufSites[i].count, gb_to_str(&BufSites[i].gross));
+    }
+    if (BufSitesLost)
+	storeAppendPrintf(sentry, "(other sites)\t\t %d\n", BufSitesLost);
+    storeAppendPrintf(sentry, "\nRequest Arenas:\n");
+    storeAppendPrintf(sentry, "\tAllocations: %d, %d of them in blocks of their own\n",
+	ArenaStats.count, ArenaStats.big);
+    storeAppendPrintf(sentry, "\tBytes asked for: %s\n",
+	gb_to_str(&ArenaStats.bytes));
+    storeAppendPrintf(sentry, "\tChunks in use: %d (%d KB), high %d (%d KB)\n",
+	(int) ArenaStats.chunks.level,
+	(int) ((ArenaStats.volume.level + 1023) >> 10),
+	(int) ArenaStats.chunks.hwater_level,
+	(int) ((ArenaStats.volume.hwater_level + 1023) >> 10));
+}
+
 static void
 memStats(StoreEntry * sentry)
 {
@@ -134,23 +233,63 @@ memFree(void *p, int type)
     memPoolFree(MemPools[type], p);
 }
 
-/* allocate a variable size buffer using best-fit pool */
-void *
-memAllocBuf(size_t net_size, size_t * gross_size)
+static int
+memBufClass(size_t size)
 {
     int i;
-    MemPool *pool = NULL;
-    assert(gross_size);
-    for (i = 0; i < mem_str_pool_count; i++) {
-	if (net_size <= StrPoolsAttrs[i].obj_size) {
-	    pool = StrPools[i].pool;
+    for (i = 0; i < mem_buf_class_count - 1; i++)
+	if (size <= BufClasses[i].obj_size)
 	    break;
+    if (i >= mem_str_pool_count && size != BufClasses[i].obj_size)
+	i = mem_buf_class_count - 1;
+    return i;
+}
+
+static void
+memBufCountSite(const char *file, int line, size_t size)
+{
+    unsigned int h = ((unsigned long) file + line) % mem_buf_site_count;
+    int n;
+    for (n = 0; n < mem_buf_site_count; n++) {
+	if (BufSites[h].file == NULL) {
+	    BufSites[h].file = file;
+	    BufSites[h].line = line;
+	}
+	if (BufSites[h].file == file && BufSites[h].line == line) {
+	    BufSites[h].count++;
+	    gb_inc(&BufSites[h].gross, size);
+	    return;
 	}
+	if (++h == mem_buf_site_count)
+	    h = 0;
     }
+    BufSitesLost++;
+}
+
+/*
+ * allocate a variable size buffer using best-fit pool; use the
+ * memAllocBuf() macro, which says where it is called from
+ */
+void *
+memAllocBufAt(size_t net_size, size_t * gross_size, const char *file, int line)
+{
+    int i;
+    MemPool *pool;
+    assert(gross_size);
+    i = memBufClass(net_size);
+    pool = BufClasses[i].pool;
     *gross_size = pool ? pool->obj_size : net_size;
     assert(*gross_size >= net_size);
-    memMeterInc(StrCountMeter);
-    memMeterAdd(StrVolumeMeter, *gross_size);
+    if (i < mem_str_pool_count) {
+	memMeterInc(StrCountMeter);
+	memMeterAdd(StrVolumeMeter, *gross_size);
+    }
+    BufClasses[i].count++;
+    gb_inc(&BufClasses[i].net, net_size);
+    gb_inc(&BufClasses[i].gross, *gross_size);
+    memMeterInc(BufClasses[i].inuse);
+    memMeterAdd(BufClasses[i].volume, *gross_size);
+    memBufCountSite(file, line, *gross_size);
     return pool ? memPoolAlloc(pool) : xcalloc(1, net_size);
 }
 
@@ -159,20 +298,102 @@ void
 memFreeBuf(size_t size, void *buf)
 {
     int i;
-    MemPool *pool = NULL;
+    MemPool *pool;
     assert(size && buf);
-    for (i = 0; i < mem_str_pool_count; i++) {
-	if (size <= StrPoolsAttrs[i].obj_size) {
-	    assert(size == StrPoolsAttrs[i].obj_size);
-	    pool = StrPools[i].pool;
-	    break;
-	}
+    i = memBufClass(size);
+    pool = BufClasses[i].pool;
+    assert(pool == NULL || size == pool->obj_size);
+    if (i < mem_str_pool_count) {
+	memMeterDec(StrCountMeter);
+	memMeterDel(StrVolumeMeter, size);
     }
-    memMeterDec(StrCountMeter);
-    memMeterDel(StrVolumeMeter, size);
+    memMeterDec(BufClasses[i].inuse);
+    memMeterDel(BufClasses[i].volume, size);
     pool ? memPoolFree(pool, buf) : xfree(buf);
 }
 
+/*
+ * Arenas hand out memory that is freed all at once, by
+ * memArenaClean(), e.g. strings that live as long as a client
+ * request.  The memory is zeroed, as from xcalloc().  A zeroed
+ * MemArena is empty.  Each chunk is counted against the allocation
+ * site that opened it.
+ */
+void *
+memArenaAllocAt(MemArena * a, size_t size, const char *file, int line)
+{
+    MemArenaChunk *c = a->chunks;
+    MemArenaChunk *b;
+    size_t gross;
+    void *p;
+    size = MEM_ARENA_ROUND(size ? size : 1);
+    ArenaStats.count++;
+    gb_inc(&ArenaStats.bytes, size);
+    if (size > MEM_ARENA_CHUNK / 4) {
+	/* a block of its own, behind the chunk being filled */
+	b = memAllocBufAt(MEM_ARENA_HDR + size, &gross, file, line);
+	b->size = gross;
+	b->used = MEM_ARENA_HDR + size;
+	if (c) {
+	    b->next = c->next;
+	    c->next = b;
+	} else {
+	    b->next = NULL;
+	    a->chunks = b;
+	}
+	ArenaStats.big++;
+	memMeterInc(ArenaStats.chunks);
+	memMeterAdd(ArenaStats.volume, gross);
+	return (char *) b + MEM_ARENA_HDR;
+    }
+    if (c == NULL || c->used + size > c->size) {
+	c = memAllocBufAt(MEM_ARENA_CHUNK, &gross, file, line);
+	c->size = gross;
+	c->used = MEM_ARENA_HDR;
+	c->next = a->chunks;
+	a->chunks = c;
+	memMeterInc(ArenaStats.chunks);
+	memMeterAdd(ArenaStats.volume, gross);
+    }
+    p = (char *) c + c->used;
+    c->used += size;
+    return p;
+}
+
+char *
+memArenaStrdupAt(MemArena * a, const char *s, const char *file, int line)
+{
+    size_t sz;
+    assert(s);
+    sz = strlen(s) + 1;
+    return xmemcpy(memArenaAllocAt(a, sz, file, line), s, sz);
+}
+
+/* as xstrndup(): at most n - 1 characters are copied */
+char *
+memArenaStrndupAt(MemArena * a, const char *s, size_t n, const char *file, int line)
+{
+    size_t sz;
+    assert(s);
+    assert(n);
+    sz = strlen(s) + 1;
+    if (sz > n)
+	sz = n;
+    return xstrncpy(memArenaAllocAt(a, sz, file, line), s, sz);
+}
+
+void
+memArenaClean(MemArena * a)
+{
+    MemArenaChunk *c;
+    while ((c = a->chunks)) {
+	a->chunks = c->next;
+	memMeterDec(ArenaStats.chunks);
+	memMeterDel(ArenaStats.volume, c->size);
+	memFreeBuf(c->size, c);
+    }
+}
+
 void
 memInit(void)
 {
@@ -294,10 +515,23 @@ memInit(void)
     /* init string pools */
     for (i = 0; i < mem_str_pool_count; i++) {
 	StrPools[i].pool = memPoolCreate(StrPoolsAttrs[i].name, StrPoolsAttrs[i].obj_size);
+	BufClasses[i].pool = StrPools[i].pool;
     }
+    /* larger buffers share the fixed size buffer pools */
+    Buf1KPool = memPoolCreate("1K Buffer", 1024);
+    BufClasses[i++].pool = Buf1KPool;
+    BufClasses[i++].pool = MemPools[MEM_2K_BUF];
+    BufClasses[i++].pool = MemPools[MEM_4K_BUF];
+    BufClasses[i++].pool = MemPools[MEM_8K_BUF];
+    assert(i == mem_buf_class_count - 1);
+    for (i = 0; i < mem_buf_class_count - 1; i++)
+	BufClasses[i].obj_size = BufClasses[i].pool->obj_size;
     cachemgrRegister("mem",
 	"Memory Utilization",
 	memStats, 0, 1);
+    cachemgrRegister("mem_buffers",
+	"Memory by Buffer Size Class and Allocation Site",
+	memBufStats, 0, 1);
 }
 
 /*
@@ -64,6 +64,16 @@ extern const char *aclTypeToStr(squid_acl);
 extern wordlist *aclDumpGeneric(const acl *);
 extern int aclPurgeMethodInUse(acl_access *);
 
+extern acl_ip_trie *aclIpTrieCompile(void *);
+extern int aclIpTrieMatch(const acl_ip_trie *, struct in_addr);
+extern void aclIpTrieDestroy(acl_ip_trie *);
+extern acl_domain_trie *aclDomainTrieCompile(void *);
+extern int aclDomainTrieMatch(const acl_domain_trie *, const char *);
+extern void aclDomainTrieDestroy(acl_domain_trie *);
+extern acl_regex_set *aclRegexSetCompile(relist *);
+extern int aclRegexSetMatch(acl_regex_set *, const char *);
+extern void aclRegexSetDestroy(acl_regex_set *);
+
 #if USE_ASYNC_IO
 extern int aio_cancel(aio_result_t *);
 extern int aio_open(const char *, int, mode_t, aio_result_t *);
@@ -175,6 +185,8 @@ extern void commCloseAllSockets(void);
  * comm_select.c
  */
 extern void comm_select_init(void);
+extern void comm_select_configure(void);
+extern void comm_select_shutdown(void);
 #if HAVE_POLL
 extern int comm_poll(int);
 #else
@@ -228,6 +240,7 @@ extern void idnsInit(void);
 extern void idnsShutdown(void);
 extern void idnsALookup(const char *, IDNSCB *, void *);
 extern void idnsPTRLookup(const struct in_addr, IDNSCB *, void *);
+extern time_t idnsNegativeTtl(int nr);
 
 extern void eventAdd(const char *name, EVH * func, void *arg, double when, int);
 extern void eventAddIsh(const char *name, EVH * func, void *arg, double delta_ish, int);
@@ -760,9 +773,21 @@ extern void memInitModule(void);
 extern void memCleanModule(void);
 extern void memConfigure(void);
 extern void *memAllocate(mem_type);
-extern void *memAllocBuf(size_t net_size, size_t * gross_size);
+extern void *memAllocBufAt(size_t net_size, size_t * gross_size, const char *file, int line);
+#define memAllocBuf(net_size, gross_size) \
+	memAllocBufAt((net_size), (gross_size), __FILE__, __LINE__)
 extern CBDUNL memFree;
 extern void memFreeBuf(size_t size, void *);
+extern void *memArenaAllocAt(MemArena * a, size_t size, const char *file, int line);
+extern char *memArenaStrdupAt(MemArena * a, const char *s, const char *file, int line);
+extern char *memArenaStrndupAt(MemArena * a, const char *s, size_t n, const char *file, int line);
+#define memArenaAlloc(a, size) \
+	memArenaAllocAt((a), (size), __FILE__, __LINE__)
+#define memArenaStrdup(a, s) \
+	memArenaStrdupAt((a), (s), __FILE__, __LINE__)
+#define memArenaStrndup(a, s, n) \
+	memArenaStrndupAt((a), (s), (n), __FILE__, __LINE__)
+extern void memArenaClean(MemArena * a);
 extern void memFree2K(void *);
 extern void memFree4K(void *);
 extern void memFree8K(void *);
@@ -1122,12 +1147,23 @@ extern void htcpSocketClose(void);
 #define strCut(s,pos) (((s).len = pos) , ((s).buf[pos] = '\0'))
 #define strCutPtr(s,ptr) (((s).len = (ptr)-(s).buf) , ((s).buf[(s).len] = '\0'))
 /* #define strCat(s,str)  stringAppend(&(s), (str), strlen(str)+1) */
-extern void stringInit(String * s, const char *str);
-extern void stringLimitInit(String * s, const char *str, int len);
-extern String stringDup(const String * s);
+extern void stringInitAt(String * s, const char *str, const char *file, int line);
+extern void stringLimitInitAt(String * s, const char *str, int len, const char *file, int line);
+extern void stringLimitRef(String * s, const char *str, int len);
+extern String stringDupAt(const String * s, const char *file, int line);
 extern void stringClean(String * s);
-extern void stringReset(String * s, const char *str);
-extern void stringAppend(String * s, const char *buf, int len);
+extern void stringResetAt(String * s, const char *str, const char *file, int line);
+extern void stringAppendAt(String * s, const char *buf, int len, const char *file, int line);
+#define stringInit(s, str) \
+	stringInitAt((s), (str), __FILE__, __LINE__)
+#define stringLimitInit(s, str, len) \
+	stringLimitInitAt((s), (str), (len), __FILE__, __LINE__)
+#define stringDup(s) \
+	stringDupAt((s), __FILE__, __LINE__)
+#define stringReset(s, str) \
+	stringResetAt((s), (str), __FILE__, __LINE__)
+#define stringAppend(s, buf, len) \
+	stringAppendAt((s), (buf), (len), __FILE__, __LINE__)
 /* extern void stringAppendf(String *s, const char *fmt, ...); */
 
 /*
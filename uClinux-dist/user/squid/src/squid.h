@@ -226,6 +226,15 @@
 #endif /* HAVE_POLL_H */
 #endif /* HAVE_POLL */
 
+/*
+ * epoll is only used in place of poll(), and needs a 2.6 kernel
+ * at run time as well as the header and stub at build time.
+ */
+#if HAVE_POLL && HAVE_EPOLL_CREATE && HAVE_SYS_EPOLL_H
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
 #if STDC_HEADERS
 #include <stdarg.h>
 #else
@@ -35,6 +35,31 @@
 
 #include "squid.h"
 
+/*
+ * mem->nodes[] indexes the chain by page.  Every node but the tail
+ * is a full SM_PAGE_SIZE page, because stmemAppend() fills the tail
+ * before adding another, so nodes[i] starts at
+ * origin_offset + i * SM_PAGE_SIZE.
+ */
+static void
+stmemIndexAdd(mem_hdr * mem, mem_node * p)
+{
+    if (mem->nnodes == mem->nodes_sz) {
+	mem->nodes_sz = mem->nodes_sz ? mem->nodes_sz << 1 : 16;
+	mem->nodes = xrealloc(mem->nodes, mem->nodes_sz * sizeof(mem_node *));
+    }
+    mem->nodes[mem->nnodes++] = p;
+}
+
+static void
+stmemIndexShift(mem_hdr * mem, int freed)
+{
+    if (freed == 0)
+	return;
+    mem->nnodes -= freed;
+    xmemmove(mem->nodes, mem->nodes + freed, mem->nnodes * sizeof(mem_node *));
+}
+
 void
 stmemFree(mem_hdr * mem)
 {
@@ -47,12 +72,15 @@ stmemFree(mem_hdr * mem)
     }
     mem->head = mem->tail = NULL;
     mem->origin_offset = 0;
+    safe_free(mem->nodes);
+    mem->nnodes = mem->nodes_sz = 0;
 }
 
 int
 stmemFreeDataUpto(mem_hdr * mem, int target_offset)
 {
     int current_offset = mem->origin_offset;
+    int freed = 0;
     mem_node *lastp;
     mem_node *p = mem->head;
     while (p && ((current_offset + p->len) <= target_offset)) {
@@ -60,6 +88,7 @@ stmemFreeDataUpto(mem_hdr * mem, int target_offset)
 	    /* keep the last one to avoid change to other part of code */
 	    mem->head = mem->tail;
 	    mem->origin_offset = current_offset;
+	    stmemIndexShift(mem, freed);
 	    return current_offset;
 	} else {
 	    lastp = p;
@@ -68,8 +97,10 @@ stmemFreeDataUpto(mem_hdr * mem, int target_offset)
 	    memFree(lastp->data, MEM_STMEM_BUF);
 	    store_mem_size -= SM_PAGE_SIZE;
 	    safe_free(lastp);
+	    freed++;
 	}
     }
+    stmemIndexShift(mem, freed);
     mem->head = p;
     mem->origin_offset = current_offset;
     if (current_offset < target_offset) {
@@ -116,6 +147,7 @@ stmemAppend(mem_hdr * mem, const char *data, int len)
 	    mem->tail->next = p;
 	    mem->tail = p;
 	}
+	stmemIndexAdd(mem, p);
 	len -= len_to_copy;
 	data += len_to_copy;
     }
@@ -130,19 +162,26 @@ stmemCopy(const mem_hdr * mem, off_t offset, char *buf, size_t size)
     char *ptr_to_buf = NULL;
     int bytes_from_this_packet = 0;
     int bytes_into_this_packet = 0;
+    int i;
     debug(19, 6) ("memCopy: offset %d: size %d\n", (int) offset, size);
     if (p == NULL)
 	return 0;
     assert(size > 0);
-    /* Seek our way into store */
-    while ((t_off + p->len) < offset) {
-	t_off += p->len;
-	if (!p->next) {
-	    debug(19, 1) ("memCopy: p->next == NULL\n");
-	    return 0;
-	}
-	assert(p->next);
-	p = p->next;
+    if (offset < t_off) {
+	debug(19, 1) ("memCopy: offset %d already freed, data starts at %d\n",
+	    (int) offset, (int) t_off);
+	return 0;
+    }
+    /* Seek our way into store; an offset at the very end of the
+     * data falls in the tail */
+    i = (offset - t_off) / SM_PAGE_SIZE;
+    if (i >= mem->nnodes)
+	i = mem->nnodes - 1;
+    p = mem->nodes[i];
+    t_off += i * SM_PAGE_SIZE;
+    if ((t_off + p->len) < offset) {
+	debug(19, 1) ("memCopy: offset %d past the end\n", (int) offset);
+	return 0;
     }
     /* Start copying begining with this block until
      * we're satiated */
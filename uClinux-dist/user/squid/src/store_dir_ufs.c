@@ -43,12 +43,14 @@
 #define DefaultLevelOneDirs     16
 #define DefaultLevelTwoDirs     256
 #define STORE_META_BUFSZ 4096
+#define CHECKPOINT_SLICE 1024
 
 typedef struct _RebuildState RebuildState;
 struct _RebuildState {
     SwapDir *sd;
     int n_read;
     FILE *log;
+    int ckpt_n;			/* records up to the end of the checkpoint */
     int speed;
     int curlvl1;
     int curlvl2;
@@ -78,6 +80,9 @@ static void storeUfsCreateSwapSubDirs(SwapDir *);
 static char *storeUfsDirSwapLogFile(SwapDir *, const char *);
 static EVH storeRebuildFromDirectory;
 static EVH storeRebuildFromSwapLog;
+static EVH storeRebuildFromCheckpoint;
+static StoreEntry *storeRebuildLogEntry(RebuildState *, storeSwapLogData *);
+static int storeUfsDirOpenCheckpoint(RebuildState *);
 static int storeGetNextFile(RebuildState *, int *sfileno, int *size);
 static StoreEntry *storeAddDiskRestore(const cache_key * key,
     int file_number,
@@ -96,6 +101,8 @@ static STLOGOPEN storeUfsDirOpenSwapLog;
 static STINIT storeUfsDirInit;
 static STLOGCLEANOPEN storeUfsDirWriteCleanOpen;
 static void storeUfsDirWriteCleanClose(SwapDir * sd);
+static void storeUfsDirSwapLogData(storeSwapLogData *, const StoreEntry *, int op);
+static void storeUfsDirCheckpointHeader(storeSwapLogData *, int count);
 static STLOGCLEANWRITE storeUfsDirWriteCleanEntry;
 static STLOGCLOSE storeUfsDirCloseSwapLog;
 static STLOGWRITE storeUfsDirSwapLog;
@@ -411,9 +418,6 @@ storeRebuildFromSwapLog(void *data)
     storeSwapLogData s;
     size_t ss = sizeof(storeSwapLogData);
     int count;
-    int used;			/* is swapfile already in use? */
-    int disk_entry_newer;	/* is the log entry newer than current entry? */
-    double x;
     assert(rb != NULL);
     /* load a number of objects per invocation */
     for (count = 0; count < rb->speed; count++) {
@@ -429,137 +433,222 @@ storeRebuildFromSwapLog(void *data)
 	    return;
 	}
 	rb->n_read++;
-	if (s.op <= SWAP_LOG_NOP)
-	    continue;
-	if (s.op >= SWAP_LOG_MAX)
-	    continue;
-	s.swap_file_number = storeDirProperFileno(rb->sd->index, s.swap_file_number);
-	debug(20, 3) ("storeRebuildFromSwapLog: %s %s %08X\n",
-	    swap_log_op_str[(int) s.op],
-	    storeKeyText(s.key),
-	    s.swap_file_number);
-	if (s.op == SWAP_LOG_ADD) {
-	    (void) 0;
-	} else if (s.op == SWAP_LOG_DEL) {
-	    if ((e = storeGet(s.key)) != NULL) {
-		/*
-		 * Make sure we don't unlink the file, it might be
-		 * in use by a subsequent entry.  Also note that
-		 * we don't have to subtract from store_swap_size
-		 * because adding to store_swap_size happens in
-		 * the cleanup procedure.
-		 */
-		storeExpireNow(e);
-		storeReleaseRequest(e);
-		if (e->swap_file_number > -1) {
-		    storeDirMapBitReset(e->swap_file_number);
-		    e->swap_file_number = -1;
-		}
-		rb->counts.objcount--;
-		rb->counts.cancelcount++;
-	    }
-	    continue;
-	} else {
-	    x = log(++rb->counts.bad_log_op) / log(10.0);
-	    if (0.0 == x - (double) (int) x)
-		debug(20, 1) ("WARNING: %d invalid swap log entries found\n",
-		    rb->counts.bad_log_op);
-	    rb->counts.invalid++;
-	    continue;
-	}
-	if ((++rb->counts.scancount & 0xFFFF) == 0)
-	    debug(20, 3) ("  %7d %s Entries read so far.\n",
-		rb->counts.scancount, rb->sd->path);
-	if (!storeDirValidFileno(s.swap_file_number, 0)) {
-	    rb->counts.invalid++;
-	    continue;
+	e = storeRebuildLogEntry(rb, &s);
+	if (e != NULL)
+	    storeDirSwapLog(e, SWAP_LOG_ADD);
+    }
+    eventAdd("storeRebuild", storeRebuildFromSwapLog, rb, 0.0, 1);
+}
+
+/*
+ * The records of a checkpoint are read with read() a slice at a time,
+ * at their offset in the file, and the ones we keep go to the new log
+ * with a single file_write() per slice.  With -F the slices follow
+ * each other in one event, so memory use never goes past a slice.
+ * Nothing else writes the swap log while we run, so the order of the
+ * new log is unchanged.
+ */
+static void
+storeRebuildFromCheckpoint(void *data)
+{
+    RebuildState *rb = data;
+    StoreEntry *e = NULL;
+    storeSwapLogData *in;
+    storeSwapLogData *out;
+    size_t ss = sizeof(storeSwapLogData);
+    int fd;
+    int count;
+    int i;
+    int n;
+    assert(rb != NULL);
+    fd = fileno(rb->log);
+    in = xcalloc(CHECKPOINT_SLICE, ss);
+    do {
+	count = rb->ckpt_n - rb->n_read;
+	if (count > CHECKPOINT_SLICE)
+	    count = CHECKPOINT_SLICE;
+	if (lseek(fd, (off_t) rb->n_read * ss, SEEK_SET) < 0 ||
+	    read(fd, in, count * ss) != (ssize_t) (count * ss)) {
+	    debug(50, 1) ("storeRebuildFromCheckpoint: %s: short read\n",
+		rb->sd->path);
+	    /* let storeRebuildFromSwapLog() read what is there */
+	    rb->ckpt_n = rb->n_read;
+	    break;
 	}
-	if (EBIT_TEST(s.flags, KEY_PRIVATE)) {
-	    rb->counts.badflags++;
-	    continue;
+	out = xcalloc(count, ss);
+	n = 0;
+	for (i = 0; i < count; i++) {
+	    rb->n_read++;
+	    e = storeRebuildLogEntry(rb, &in[i]);
+	    if (e == NULL)
+		continue;
+	    if (EBIT_TEST(e->flags, ENTRY_SPECIAL))
+		continue;
+	    storeUfsDirSwapLogData(&out[n++], e, SWAP_LOG_ADD);
 	}
-	e = storeGet(s.key);
-	used = storeDirMapBitTest(s.swap_file_number);
-	/* If this URL already exists in the cache, does the swap log
-	 * appear to have a newer entry?  Compare 'lastref' from the
-	 * swap log to e->lastref. */
-	disk_entry_newer = e ? (s.lastref > e->lastref ? 1 : 0) : 0;
-	if (used && !disk_entry_newer) {
-	    /* log entry is old, ignore it */
-	    rb->counts.clashcount++;
-	    continue;
-	} else if (used && e && e->swap_file_number == s.swap_file_number) {
-	    /* swapfile taken, same URL, newer, update meta */
-	    if (e->store_status == STORE_OK) {
-		e->lastref = s.timestamp;
-		e->timestamp = s.timestamp;
-		e->expires = s.expires;
-		e->lastmod = s.lastmod;
-		e->flags = s.flags;
-		e->refcount += s.refcount;
-#if HEAP_REPLACEMENT
-		storeHeapPositionUpdate(e);
-#endif
-	    } else {
-		debug_trap("storeRebuildFromSwapLog: bad condition");
-		debug(20, 1) ("\tSee %s:%d\n", __FILE__, __LINE__);
-	    }
-	    continue;
-	} else if (used) {
-	    /* swapfile in use, not by this URL, log entry is newer */
-	    /* This is sorta bad: the log entry should NOT be newer at this
-	     * point.  If the log is dirty, the filesize check should have
-	     * caught this.  If the log is clean, there should never be a
-	     * newer entry. */
-	    debug(20, 1) ("WARNING: newer swaplog entry for fileno %08X\n",
-		s.swap_file_number);
-	    /* I'm tempted to remove the swapfile here just to be safe,
-	     * but there is a bad race condition in the NOVM version if
-	     * the swapfile has recently been opened for writing, but
-	     * not yet opened for reading.  Because we can't map
-	     * swapfiles back to StoreEntrys, we don't know the state
-	     * of the entry using that file.  */
-	    /* We'll assume the existing entry is valid, probably because
-	     * were in a slow rebuild and the the swap file number got taken
-	     * and the validation procedure hasn't run. */
-	    assert(rb->flags.need_to_validate);
-	    rb->counts.clashcount++;
-	    continue;
-	} else if (e && !disk_entry_newer) {
-	    /* key already exists, current entry is newer */
-	    /* keep old, ignore new */
-	    rb->counts.dupcount++;
-	    continue;
-	} else if (e) {
-	    /* key already exists, this swapfile not being used */
-	    /* junk old, load new */
+	if (n > 0)
+	    file_write(rb->sd->u.ufs.swaplog_fd,
+		-1,
+		out,
+		n * ss,
+		NULL,
+		NULL,
+		xfree);
+	else
+	    xfree(out);
+    } while (opt_foreground_rebuild && rb->n_read < rb->ckpt_n);
+    xfree(in);
+    if (rb->n_read < rb->ckpt_n) {
+	eventAdd("storeRebuild", storeRebuildFromCheckpoint, rb, 0.0, 1);
+	return;
+    }
+    debug(20, 1) ("Done reading %s checkpoint (%d entries)\n",
+	rb->sd->path, rb->n_read - 1);
+    /* then whatever was logged after it */
+    fseek(rb->log, (long) rb->n_read * ss, SEEK_SET);
+    eventAdd("storeRebuild", storeRebuildFromSwapLog, rb, 0.0, 1);
+}
+
+/*
+ * Apply one swap log record to the store.  Returns the entry if the
+ * record was loaded, so the caller can write it to the new log.
+ */
+static StoreEntry *
+storeRebuildLogEntry(RebuildState * rb, storeSwapLogData * s)
+{
+    StoreEntry *e = NULL;
+    int used;			/* is swapfile already in use? */
+    int disk_entry_newer;	/* is the log entry newer than current entry? */
+    double x;
+    if (s->op <= SWAP_LOG_NOP)
+	return NULL;
+    if (s->op >= SWAP_LOG_MAX)
+	return NULL;
+    s->swap_file_number = storeDirProperFileno(rb->sd->index, s->swap_file_number);
+    debug(20, 3) ("storeRebuildLogEntry: %s %s %08X\n",
+	swap_log_op_str[(int) s->op],
+	storeKeyText(s->key),
+	s->swap_file_number);
+    if (s->op == SWAP_LOG_ADD) {
+	(void) 0;
+    } else if (s->op == SWAP_LOG_DEL) {
+	if ((e = storeGet(s->key)) != NULL) {
+	    /*
+	     * Make sure we don't unlink the file, it might be
+	     * in use by a subsequent entry.  Also note that
+	     * we don't have to subtract from store_swap_size
+	     * because adding to store_swap_size happens in
+	     * the cleanup procedure.
+	     */
 	    storeExpireNow(e);
 	    storeReleaseRequest(e);
 	    if (e->swap_file_number > -1) {
 		storeDirMapBitReset(e->swap_file_number);
 		e->swap_file_number = -1;
 	    }
-	    rb->counts.dupcount++;
+	    rb->counts.objcount--;
+	    rb->counts.cancelcount++;
+	}
+	return NULL;
+    } else {
+	x = log(++rb->counts.bad_log_op) / log(10.0);
+	if (0.0 == x - (double) (int) x)
+	    debug(20, 1) ("WARNING: %d invalid swap log entries found\n",
+		rb->counts.bad_log_op);
+	rb->counts.invalid++;
+	return NULL;
+    }
+    if ((++rb->counts.scancount & 0xFFFF) == 0)
+	debug(20, 3) ("  %7d %s Entries read so far.\n",
+	    rb->counts.scancount, rb->sd->path);
+    if (!storeDirValidFileno(s->swap_file_number, 0)) {
+	rb->counts.invalid++;
+	return NULL;
+    }
+    if (EBIT_TEST(s->flags, KEY_PRIVATE)) {
+	rb->counts.badflags++;
+	return NULL;
+    }
+    e = storeGet(s->key);
+    used = storeDirMapBitTest(s->swap_file_number);
+    /* If this URL already exists in the cache, does the swap log
+     * appear to have a newer entry?  Compare 'lastref' from the
+     * swap log to e->lastref. */
+    disk_entry_newer = e ? (s->lastref > e->lastref ? 1 : 0) : 0;
+    if (used && !disk_entry_newer) {
+	/* log entry is old, ignore it */
+	rb->counts.clashcount++;
+	return NULL;
+    } else if (used && e && e->swap_file_number == s->swap_file_number) {
+	/* swapfile taken, same URL, newer, update meta */
+	if (e->store_status == STORE_OK) {
+	    e->lastref = s->timestamp;
+	    e->timestamp = s->timestamp;
+	    e->expires = s->expires;
+	    e->lastmod = s->lastmod;
+	    e->flags = s->flags;
+	    e->refcount += s->refcount;
+#if HEAP_REPLACEMENT
+	    storeHeapPositionUpdate(e);
+#endif
 	} else {
-	    /* URL doesnt exist, swapfile not in use */
-	    /* load new */
-	    (void) 0;
+	    debug_trap("storeRebuildLogEntry: bad condition");
+	    debug(20, 1) ("\tSee %s:%d\n", __FILE__, __LINE__);
 	}
-	/* update store_swap_size */
-	rb->counts.objcount++;
-	e = storeAddDiskRestore(s.key,
-	    s.swap_file_number,
-	    s.swap_file_sz,
-	    s.expires,
-	    s.timestamp,
-	    s.lastref,
-	    s.lastmod,
-	    s.refcount,
-	    s.flags,
-	    (int) rb->flags.clean);
-	storeDirSwapLog(e, SWAP_LOG_ADD);
+	return NULL;
+    } else if (used) {
+	/* swapfile in use, not by this URL, log entry is newer */
+	/* This is sorta bad: the log entry should NOT be newer at this
+	 * point.  If the log is dirty, the filesize check should have
+	 * caught this.  If the log is clean, there should never be a
+	 * newer entry. */
+	debug(20, 1) ("WARNING: newer swaplog entry for fileno %08X\n",
+	    s->swap_file_number);
+	/* I'm tempted to remove the swapfile here just to be safe,
+	 * but there is a bad race condition in the NOVM version if
+	 * the swapfile has recently been opened for writing, but
+	 * not yet opened for reading.  Because we can't map
+	 * swapfiles back to StoreEntrys, we don't know the state
+	 * of the entry using that file.  */
+	/* We'll assume the existing entry is valid, probably because
+	 * were in a slow rebuild and the the swap file number got taken
+	 * and the validation procedure hasn't run. */
+	assert(rb->flags.need_to_validate);
+	rb->counts.clashcount++;
+	return NULL;
+    } else if (e && !disk_entry_newer) {
+	/* key already exists, current entry is newer */
+	/* keep old, ignore new */
+	rb->counts.dupcount++;
+	return NULL;
+    } else if (e) {
+	/* key already exists, this swapfile not being used */
+	/* junk old, load new */
+	storeExpireNow(e);
+	storeReleaseRequest(e);
+	if (e->swap_file_number > -1) {
+	    storeDirMapBitReset(e->swap_file_number);
+	    e->swap_file_number = -1;
+	}
+	rb->counts.dupcount++;
+    } else {
+	/* URL doesnt exist, swapfile not in use */
+	/* load new */
+	(void) 0;
     }
-    eventAdd("storeRebuild", storeRebuildFromSwapLog, rb, 0.0, 1);
+    /* update store_swap_size */
+    rb->counts.objcount++;
+    e = storeAddDiskRestore(s->key,
+	s->swap_file_number,
+	s->swap_file_sz,
+	s->expires,
+	s->timestamp,
+	s->lastref,
+	s->lastmod,
+	s->refcount,
+	s->flags,
+	(int) rb->flags.clean);
+    return e;
 }
 
 static int
@@ -692,6 +781,49 @@ storeAddDiskRestore(const cache_key * key,
     return e;
 }
 
+/*
+ * A log written by storeUfsDirWriteCleanOpen() begins with a
+ * SWAP_LOG_NOP record keyed SWAP_LOG_CHECKPOINT, whose swap_file_sz
+ * is the number of records written after it from the in-core index.
+ * Those are left for storeRebuildFromCheckpoint() to read in slices,
+ * anything logged after them for storeRebuildFromSwapLog().  Older
+ * readers skip the NOP record like any other.  Both reads here go to
+ * the descriptor at explicit offsets; stdio has not touched the file
+ * yet, and the rebuild fseek()s past the checkpoint when done.
+ */
+static int
+storeUfsDirOpenCheckpoint(RebuildState * rb)
+{
+    storeSwapLogData s;
+    size_t ss = sizeof(storeSwapLogData);
+    int fd = fileno(rb->log);
+    struct stat sb;
+    if (lseek(fd, (off_t) 0, SEEK_SET) < 0)
+	debug(50, 1) ("storeUfsDirOpenCheckpoint: lseek: %s\n", xstrerror());
+    else if (read(fd, &s, ss) != (ssize_t) ss)
+	(void) 0;
+    else if (s.op != SWAP_LOG_NOP)
+	(void) 0;
+    else if (memcmp(s.key, SWAP_LOG_CHECKPOINT, MD5_DIGEST_CHARS))
+	(void) 0;
+    else if (s.swap_file_number != ss)
+	debug(47, 1) ("Cache Dir #%d: checkpoint record size %d, expected %d\n",
+	    rb->sd->index, (int) s.swap_file_number, (int) ss);
+    else if (fstat(fd, &sb) < 0)
+	debug(50, 1) ("storeUfsDirOpenCheckpoint: fstat: %s\n", xstrerror());
+    else if (s.swap_file_sz >= (size_t) sb.st_size / ss)
+	debug(47, 1) ("Cache Dir #%d: checkpoint truncated\n", rb->sd->index);
+    else {
+	rb->ckpt_n = s.swap_file_sz + 1;
+	rb->n_read = 1;
+	debug(47, 2) ("Cache Dir #%d: %d entry checkpoint\n",
+	    rb->sd->index, (int) s.swap_file_sz);
+	return 1;
+    }
+    rewind(rb->log);
+    return 0;
+}
+
 static void
 storeUfsDirRebuild(SwapDir * sd)
 {
@@ -714,9 +846,12 @@ storeUfsDirRebuild(SwapDir * sd)
 	    fclose(fp);
 	func = storeRebuildFromDirectory;
     } else {
-	func = storeRebuildFromSwapLog;
 	rb->log = fp;
 	rb->flags.clean = (unsigned int) clean;
+	if (storeUfsDirOpenCheckpoint(rb))
+	    func = storeRebuildFromCheckpoint;
+	else
+	    func = storeRebuildFromSwapLog;
     }
     if (!clean)
 	rb->flags.need_to_validate = 1;
@@ -809,6 +944,7 @@ struct _clean_state {
     char *outbuf;
     off_t outbuf_offset;
     int fd;
+    int count;
 };
 
 #define CLEAN_BUF_SZ 16384
@@ -840,6 +976,9 @@ storeUfsDirWriteCleanOpen(SwapDir * sd)
     if (stat(state->cur, &sb) == 0)
 	fchmod(state->fd, sb.st_mode);
 #endif
+    /* the count is filled in by storeUfsDirWriteCleanClose() */
+    storeUfsDirCheckpointHeader((storeSwapLogData *) state->outbuf, 0);
+    state->outbuf_offset = sizeof(storeSwapLogData);
     sd->log.clean.write = storeUfsDirWriteCleanEntry;
     sd->log.clean.state = state;
     return 0;
@@ -858,19 +997,10 @@ storeUfsDirWriteCleanEntry(const StoreEntry * e, SwapDir * sd)
 	storeUfsDirWriteCleanClose(sd);
 	return;
     }
-    memset(&s, '\0', ss);
-    s.op = (char) SWAP_LOG_ADD;
-    s.swap_file_number = e->swap_file_number;
-    s.timestamp = e->timestamp;
-    s.lastref = e->lastref;
-    s.expires = e->expires;
-    s.lastmod = e->lastmod;
-    s.swap_file_sz = e->swap_file_sz;
-    s.refcount = e->refcount;
-    s.flags = e->flags;
-    xmemcpy(&s.key, e->key, MD5_DIGEST_CHARS);
+    storeUfsDirSwapLogData(&s, e, SWAP_LOG_ADD);
     xmemcpy(state->outbuf + state->outbuf_offset, &s, ss);
     state->outbuf_offset += ss;
+    state->count++;
     /* buffered write */
     if (state->outbuf_offset + ss > CLEAN_BUF_SZ) {
 	if (write(state->fd, state->outbuf, state->outbuf_offset) < 0) {
@@ -888,13 +1018,33 @@ storeUfsDirWriteCleanEntry(const StoreEntry * e, SwapDir * sd)
     }
 }
 
+/*
+ * Fill in the count of the checkpoint record.  file_open() gave us
+ * an O_APPEND descriptor, so open the file again to get at the start.
+ */
+static int
+storeUfsDirWriteCleanCount(struct _clean_state *state)
+{
+    storeSwapLogData s;
+    int fd = open(state->new, O_WRONLY);
+    if (fd < 0)
+	return -1;
+    storeUfsDirCheckpointHeader(&s, state->count);
+    if (write(fd, &s, sizeof(s)) != sizeof(s)) {
+	close(fd);
+	return -1;
+    }
+    return close(fd);
+}
+
 static void
 storeUfsDirWriteCleanClose(SwapDir * sd)
 {
     struct _clean_state *state = sd->log.clean.state;
     if (state->fd < 0)
 	return;
-    if (write(state->fd, state->outbuf, state->outbuf_offset) < 0) {
+    if (write(state->fd, state->outbuf, state->outbuf_offset) < 0 ||
+	storeUfsDirWriteCleanCount(state) < 0) {
 	debug(50, 0) ("storeDirWriteCleanLogs: %s: write: %s\n",
 	    state->new, xstrerror());
 	debug(20, 0) ("storeDirWriteCleanLogs: Current swap logfile "
@@ -940,9 +1090,9 @@ storeUfsDirWriteCleanClose(SwapDir * sd)
 }
 
 static void
-storeUfsDirSwapLog(const SwapDir * sd, const StoreEntry * e, int op)
+storeUfsDirSwapLogData(storeSwapLogData * s, const StoreEntry * e, int op)
 {
-    storeSwapLogData *s = xcalloc(1, sizeof(storeSwapLogData));
+    memset(s, '\0', sizeof(storeSwapLogData));
     s->op = (char) op;
     s->swap_file_number = e->swap_file_number;
     s->timestamp = e->timestamp;
@@ -953,6 +1103,30 @@ storeUfsDirSwapLog(const SwapDir * sd, const StoreEntry * e, int op)
     s->refcount = e->refcount;
     s->flags = e->flags;
     xmemcpy(s->key, e->key, MD5_DIGEST_CHARS);
+}
+
+/*
+ * The first record of a clean log.  'swap_file_number' holds the
+ * record size, so that a log from a build with a different layout
+ * is left to storeRebuildFromSwapLog() instead of being read in
+ * slices.
+ */
+static void
+storeUfsDirCheckpointHeader(storeSwapLogData * s, int count)
+{
+    memset(s, '\0', sizeof(storeSwapLogData));
+    s->op = (char) SWAP_LOG_NOP;
+    s->swap_file_number = sizeof(storeSwapLogData);
+    s->timestamp = squid_curtime;
+    s->swap_file_sz = count;
+    xmemcpy(s->key, SWAP_LOG_CHECKPOINT, MD5_DIGEST_CHARS);
+}
+
+static void
+storeUfsDirSwapLog(const SwapDir * sd, const StoreEntry * e, int op)
+{
+    storeSwapLogData *s = xmalloc(sizeof(storeSwapLogData));
+    storeUfsDirSwapLogData(s, e, op);
     file_write(sd->u.ufs.swaplog_fd,
 	-1,
 	s,
@@ -122,6 +122,7 @@ struct _acl {
     char name[ACL_NAME_SZ];
     squid_acl type;
     void *data;
+    void *compiled;		/* built from data on first match */
     char *cfgline;
     acl *next;
 };
@@ -134,6 +135,7 @@ struct _acl_list {
 
 struct _acl_access {
     int allow;
+    int src_only;		/* this and later lines only check src */
     acl_list *acl_list;
     char *cfgline;
     acl_access *next;
@@ -188,6 +190,7 @@ struct _ushortlist {
 struct _relist {
     char *pattern;
     regex_t regex;
+    int flags;			/* as given to regcomp() */
     relist *next;
 };
 
@@ -249,6 +252,7 @@ struct _SquidConfig {
     time_t referenceAge;
     time_t negativeTtl;
     time_t negativeDnsTtl;
+    time_t negativeDnsMaxTtl;
     time_t positiveDnsTtl;
     time_t shutdownLifetime;
     struct {
@@ -416,6 +420,9 @@ struct _SquidConfig {
 	int server_pconns;
 #if USE_CACHE_DIGESTS
 	int digest_generation;
+#endif
+#if USE_EPOLL
+	int comm_epoll;
 #endif
     } onoff;
     acl *aclList;
@@ -625,6 +632,11 @@ struct _MemBuf {
     FREE *freefunc;		/* what to use to free the buffer, NULL after memBufFreeFunc() is called */
 };
 
+/* allocations that are all freed together by memArenaClean() */
+struct _MemArena {
+    void *chunks;		/* newest first; private to mem.c */
+};
+
 /* see Packer.c for description */
 struct _Packer {
     /* protected, use interface functions instead */
@@ -735,6 +747,7 @@ struct _HttpHeader {
     HttpHeaderMask mask;	/* bit set <=> entry present */
     http_hdr_owner_type owner;	/* request or reply */
     int len;			/* length when packed, not counting terminating '\0' */
+    void *raw;			/* text parsed entries point into */
 };
 
 struct _HttpReply {
@@ -878,6 +891,7 @@ struct _clientHttpRequest {
 	char *location;
     } redirect;
     dlink_node active;
+    MemArena arena;		/* strings that live as long as the request */
 };
 
 struct _ConnStateData {
@@ -1232,6 +1246,9 @@ struct _mem_hdr {
     mem_node *head;
     mem_node *tail;
     int origin_offset;
+    mem_node **nodes;		/* the chain by page, see stmemCopy() */
+    int nnodes;
+    int nodes_sz;
 };
 
 /* keep track each client receiving data from that particular StoreEntry */
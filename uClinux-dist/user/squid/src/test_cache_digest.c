@@ -367,6 +367,8 @@ swapStateReader(FileIterator * fi)
     entry = fi->entry;
     if (fread(entry, sizeof(*entry), 1, fi->file) != 1)
 	return frEof;
+    if (entry->op == SWAP_LOG_NOP)	/* checkpoint header */
+	return frMore;
     fi->inner_time = entry->lastref;
     if (entry->op != SWAP_LOG_ADD && entry->op != SWAP_LOG_DEL) {
 	fprintf(stderr, "%s:%d: unknown swap log action\n", fi->fname, fi->line_count);
@@ -54,6 +54,9 @@ typedef struct {
  */
 
 typedef struct _acl_ip_data acl_ip_data;
+typedef struct _acl_ip_trie acl_ip_trie;
+typedef struct _acl_domain_trie acl_domain_trie;
+typedef struct _acl_regex_set acl_regex_set;
 typedef struct _acl_time_data acl_time_data;
 typedef struct _acl_name_list acl_name_list;
 typedef struct _acl_deny_info_list acl_deny_info_list;
@@ -153,6 +156,7 @@ typedef struct _String String;
 typedef struct _MemMeter MemMeter;
 typedef struct _MemPoolMeter MemPoolMeter;
 typedef struct _MemPool MemPool;
+typedef struct _MemArena MemArena;
 typedef struct _ClientInfo ClientInfo;
 typedef struct _cd_guess_stats cd_guess_stats;
 typedef struct _CacheDigest CacheDigest;
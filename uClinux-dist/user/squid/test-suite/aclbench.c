@@ -0,0 +1,490 @@
+/*
+ * aclbench - time the compiled src/dst, domain and regex ACL
+ * matchers in acl_compile.c against the splay trees and pattern
+ * lists acl.c used to search.
+ *
+ * Lists and lookups are random but repeatable.  Every lookup is also
+ * answered by a plain scan of the list, and the compiled answer has
+ * to agree with it.  (The splay tree does not always: overlapping
+ * networks and subdomains confuse its ordering.)
+ *
+ * usage: aclbench [-n lookups] [-s seed] [entries ...]
+ */
+
+#include "squid.h"
+#include "splay.h"
+
+int debugLevels[MAX_DEBUG_SECTIONS];
+int _db_level;
+
+#if STDC_HEADERS
+void
+_db_print(const char *format,...)
+{
+}
+#else
+void
+_db_print(va_alist)
+     va_dcl
+{
+}
+#endif
+
+void
+xassert(const char *msg, const char *file, int line)
+{
+    fprintf(stderr, "assertion failed: %s:%d: \"%s\"\n", file, line, msg);
+    abort();
+}
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start->tv_sec) * 1000000.0 +
+	(end.tv_usec - start->tv_usec);
+}
+
+/* as in acl.c */
+static int
+aclIpNetworkCompare(const void *a, const void *b)
+{
+    struct in_addr A = *(const struct in_addr *) a;
+    const acl_ip_data *q = b;
+    const struct in_addr B = q->addr1;
+    const struct in_addr C = q->addr2;
+    A.s_addr &= q->mask.s_addr;
+    if (C.s_addr == 0) {
+	if (ntohl(A.s_addr) > ntohl(B.s_addr))
+	    return 1;
+	if (ntohl(A.s_addr) < ntohl(B.s_addr))
+	    return -1;
+	return 0;
+    }
+    if (ntohl(A.s_addr) > ntohl(C.s_addr))
+	return 1;
+    if (ntohl(A.s_addr) < ntohl(B.s_addr))
+	return -1;
+    return 0;
+}
+
+static int
+aclDomainCompare(const void *a, const void *b)
+{
+    const char *d1 = a;
+    const char *d2 = b;
+    int l1;
+    int l2;
+    while ('.' == *d1)
+	d1++;
+    while ('.' == *d2)
+	d2++;
+    l1 = strlen(d1);
+    l2 = strlen(d2);
+    while (d1[--l1] == d2[--l2]) {
+	if ((l1 == 0) && (l2 == 0))
+	    return 0;
+	if (0 == l1)
+	    return -1;
+	if (0 == l2)
+	    return 1;
+    }
+    return d1[l1] - d2[l2];
+}
+
+/* as in url.c */
+int
+matchDomainName(const char *h, const char *d)
+{
+    int dl;
+    int hl;
+    while ('.' == *h)
+	h++;
+    hl = strlen(h);
+    dl = strlen(d);
+    while (xtolower(h[--hl]) == xtolower(d[--dl])) {
+	if (hl == 0 && dl == 0)
+	    return 0;
+	if (0 == hl)
+	    return (1 == dl && '.' == d[0]) ? 0 : -1;
+	if (0 == dl)
+	    return ('.' == d[0]) ? 0 : 1;
+    }
+    return (xtolower(h[hl]) - xtolower(d[dl]));
+}
+
+static int
+hostDomainCompare(const void *a, const void *b)
+{
+    return matchDomainName(a, b);
+}
+
+static void
+noFree(void *data)
+{
+}
+
+/* splay_insert() drops entries that compare equal, as in acl.c */
+static void
+collect(void *data, void *state)
+{
+    void ***list = state;
+    *(*list)++ = data;
+}
+
+static u_num32
+rnd(void)
+{
+    return ((u_num32) lrand48() << 16) ^ (u_num32) lrand48();
+}
+
+static void
+result(const char *what, int n, double usec_old, double usec_new)
+{
+    printf("  %-8s %7.3f usec/lookup before, %7.3f after (%d lookups)\n",
+	what, usec_old / n, usec_new / n, n);
+}
+
+static void
+mismatch(const char *what, const char *key, int compiled, int scanned)
+{
+    fprintf(stderr, "%s: '%s' compiled says %d, scan says %d\n",
+	what, key, compiled, scanned);
+    exit(1);
+}
+
+/*
+ * Mostly networks from /8 to /32, some ranges, and a few of the
+ * odd non-contiguous masks decode_addr() accepts.
+ */
+static void
+benchIp(int nentries, int nlookups)
+{
+    acl_ip_data *entries = xcalloc(nentries, sizeof(acl_ip_data));
+    struct in_addr *keys = xcalloc(nlookups, sizeof(struct in_addr));
+    acl_ip_data **kept = xcalloc(nentries, sizeof(acl_ip_data *));
+    void **K = (void **) kept;
+    splayNode *top = NULL;
+    acl_ip_trie *t;
+    acl_ip_data *q;
+    int nkept;
+    struct timeval start;
+    double usec_old;
+    double usec_new;
+    u_num32 a;
+    u_num32 m;
+    int hits = 0;
+    int scan;
+    int i;
+    int j;
+    for (i = 0; i < nentries; i++) {
+	q = &entries[i];
+	a = rnd();
+	switch (i % 16) {
+	case 0:
+	    m = 0xffff00f0;
+	    break;
+	case 1:
+	case 2:
+	    m = 0xffffffff;
+	    q->addr2.s_addr = htonl((a & m) + (rnd() % 5000));
+	    break;
+	default:
+	    m = (u_num32) (0xfffffffful << (rnd() % 25));
+	    break;
+	}
+	q->addr1.s_addr = htonl(a & m);
+	q->mask.s_addr = htonl(m);
+	top = splay_insert(q, top, aclIpNetworkCompare);
+    }
+    /* half the lookups land near a listed network */
+    for (i = 0; i < nlookups; i++) {
+	a = rnd();
+	if (i & 1)
+	    a = ntohl(entries[a % nentries].addr1.s_addr) + (rnd() % 300);
+	keys[i].s_addr = htonl(a);
+    }
+    splay_walk(top, collect, &K);
+    nkept = K - (void **) kept;
+    t = aclIpTrieCompile(top);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nlookups; i++)
+	top = splay_splay(&keys[i], top, aclIpNetworkCompare);
+    usec_old = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nlookups; i++)
+	hits += aclIpTrieMatch(t, keys[i]);
+    usec_new = elapsed(&start);
+
+    for (i = 0; i < nlookups; i++) {
+	for (scan = 0, j = 0; j < nkept && !scan; j++)
+	    scan = !aclIpNetworkCompare(&keys[i], kept[j]);
+	if (aclIpTrieMatch(t, keys[i]) != scan)
+	    mismatch("ip", inet_ntoa(keys[i]), !scan, scan);
+    }
+    result("src/dst", nlookups, usec_old, usec_new);
+    printf("  %d%% matched\n", hits * 100 / nlookups);
+    aclIpTrieDestroy(t);
+    splay_destroy(top, noFree);
+    xfree(entries);
+    xfree(kept);
+    xfree(keys);
+}
+
+static void
+randomLabel(char *buf, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+	buf[i] = "abcdefghijklmnopqrstuvwxyz0123456789-"[rnd() % 37];
+    buf[len] = '\0';
+}
+
+/*
+ * Domains two or three labels deep under a few dozen top level
+ * domains, half with a leading dot.  Lookups are listed domains,
+ * hosts under them, and strangers, in mixed case.
+ */
+static void
+benchDomain(int nentries, int nlookups)
+{
+    static const char *tlds[] =
+    {"com", "net", "org", "edu", "gov", "uk", "de", "jp", "fr", "au",
+	"ca", "nl", "it", "se", "no", "fi", "dk", "ch", "at", "be"};
+    char **entries = xcalloc(nentries, sizeof(char *));
+    char **keys = xcalloc(nlookups, sizeof(char *));
+    char **kept = xcalloc(nentries, sizeof(char *));
+    void **K = (void **) kept;
+    splayNode *top = NULL;
+    acl_domain_trie *t;
+    int nkept;
+    struct timeval start;
+    double usec_old;
+    double usec_new;
+    char l1[16];
+    char l2[16];
+    char buf[256];
+    char *s;
+    int hits = 0;
+    int scan;
+    int i;
+    int j;
+    for (i = 0; i < nentries; i++) {
+	randomLabel(l1, 3 + rnd() % 8);
+	randomLabel(l2, 2 + rnd() % 6);
+	if (i % 3)
+	    snprintf(buf, sizeof(buf), "%s%s.%s", i & 1 ? "." : "", l1,
+		tlds[rnd() % 20]);
+	else
+	    snprintf(buf, sizeof(buf), "%s%s.%s.%s", i & 1 ? "." : "", l2, l1,
+		tlds[rnd() % 20]);
+	entries[i] = xstrdup(buf);
+	top = splay_insert(entries[i], top, aclDomainCompare);
+    }
+    for (i = 0; i < nlookups; i++) {
+	s = entries[rnd() % nentries];
+	randomLabel(l1, 1 + rnd() % 10);
+	switch (i % 4) {
+	case 0:
+	    snprintf(buf, sizeof(buf), "www.%s", s + (*s == '.'));
+	    break;
+	case 1:
+	    snprintf(buf, sizeof(buf), "%s", s + (*s == '.'));
+	    break;
+	case 2:
+	    snprintf(buf, sizeof(buf), "%s.%s", l1, tlds[rnd() % 20]);
+	    break;
+	default:
+	    snprintf(buf, sizeof(buf), "%s%s", l1, s);
+	    break;
+	}
+	if (rnd() % 2)
+	    buf[0] = toupper(buf[0]);
+	keys[i] = xstrdup(buf);
+    }
+    splay_walk(top, collect, &K);
+    nkept = K - (void **) kept;
+    t = aclDomainTrieCompile(top);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nlookups; i++)
+	top = splay_splay(keys[i], top, hostDomainCompare);
+    usec_old = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nlookups; i++)
+	hits += aclDomainTrieMatch(t, keys[i]);
+    usec_new = elapsed(&start);
+
+    for (i = 0; i < nlookups; i++) {
+	for (scan = 0, j = 0; j < nkept && !scan; j++)
+	    scan = !matchDomainName(keys[i], kept[j]);
+	if (aclDomainTrieMatch(t, keys[i]) != scan)
+	    mismatch("domain", keys[i], !scan, scan);
+    }
+    result("domain", nlookups, usec_old, usec_new);
+    printf("  %d%% matched\n", hits * 100 / nlookups);
+    aclDomainTrieDestroy(t);
+    splay_destroy(top, noFree);
+    for (i = 0; i < nentries; i++)
+	xfree(entries[i]);
+    for (i = 0; i < nlookups; i++)
+	xfree(keys[i]);
+    xfree(entries);
+    xfree(kept);
+    xfree(keys);
+}
+
+/* aclMatchRegex(), which keeps the last hit near the front */
+static int
+matchRegexList(relist * data, const char *word)
+{
+    relist *first = data;
+    relist *prev = NULL;
+    while (data) {
+	if (regexec(&data->regex, word, 0, 0, 0) == 0) {
+	    if (prev != NULL) {
+		prev->next = data->next;
+		data->next = first->next;
+		first->next = data;
+	    }
+	    return 1;
+	}
+	prev = data;
+	data = data->next;
+    }
+    return 0;
+}
+
+/* url_regex style patterns, a quarter of them case insensitive */
+static void
+benchRegex(int nentries, int nlookups)
+{
+    relist *list = NULL;
+    relist **Tail = &list;
+    relist *r;
+    char **keys = xcalloc(nlookups, sizeof(char *));
+    acl_regex_set *s;
+    struct timeval start;
+    double usec_old;
+    double usec_new;
+    char l1[16];
+    char l2[16];
+    char buf[256];
+    int hits = 0;
+    int scan;
+    int i;
+    for (i = 0; i < nentries; i++) {
+	randomLabel(l1, 4 + rnd() % 6);
+	randomLabel(l2, 3 + rnd() % 5);
+	switch (i % 3) {
+	case 0:
+	    snprintf(buf, sizeof(buf), "^http://([a-z]+\\.)?%s\\.com/", l1);
+	    break;
+	case 1:
+	    snprintf(buf, sizeof(buf), "/%s/.*\\.%s$", l1, i & 1 ? "exe" : "zip");
+	    break;
+	default:
+	    snprintf(buf, sizeof(buf), "%s[0-9]+%s", l1, l2);
+	    break;
+	}
+	r = xcalloc(1, sizeof(relist));
+	r->pattern = xstrdup(buf);
+	r->flags = REG_EXTENDED | REG_NOSUB | (i % 4 ? 0 : REG_ICASE);
+	if (regcomp(&r->regex, r->pattern, r->flags) != 0) {
+	    fprintf(stderr, "bad pattern '%s'\n", r->pattern);
+	    exit(1);
+	}
+	*Tail = r;
+	Tail = &r->next;
+    }
+    for (i = 0; i < nlookups; i++) {
+	randomLabel(l1, 4 + rnd() % 6);
+	randomLabel(l2, 3 + rnd() % 5);
+	if (i % 8 == 0)
+	    snprintf(buf, sizeof(buf), "http://www.%s.com/pub/%s.zip", l1, l2);
+	else
+	    snprintf(buf, sizeof(buf), "http://www.%s.org/%s/%s/index.html",
+		l1, l2, l1);
+	keys[i] = xstrdup(buf);
+    }
+    /* and every sixteenth one hits */
+    for (i = 0, r = list; i < nlookups; r = r->next) {
+	if (r == NULL)
+	    r = list;
+	if (r->pattern[0] != '^')
+	    continue;
+	snprintf(buf, sizeof(buf), "http://%.*s.com/x",
+	    (int) strcspn(r->pattern + 19, "\\"), r->pattern + 19);
+	xfree(keys[i]);
+	keys[i] = xstrdup(buf);
+	i += 16;
+    }
+    s = aclRegexSetCompile(list);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nlookups; i++)
+	matchRegexList(list, keys[i]);
+    usec_old = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nlookups; i++)
+	hits += aclRegexSetMatch(s, keys[i]);
+    usec_new = elapsed(&start);
+
+    for (i = 0; i < nlookups; i++) {
+	scan = matchRegexList(list, keys[i]);
+	if (aclRegexSetMatch(s, keys[i]) != scan)
+	    mismatch("regex", keys[i], !scan, scan);
+    }
+    result("regex", nlookups, usec_old, usec_new);
+    printf("  %d%% matched\n", hits * 100 / nlookups);
+    aclRegexSetDestroy(s);
+    while ((r = list) != NULL) {
+	list = r->next;
+	regfree(&r->regex);
+	xfree(r->pattern);
+	xfree(r);
+    }
+    for (i = 0; i < nlookups; i++)
+	xfree(keys[i]);
+    xfree(keys);
+}
+
+int
+main(int argc, char **argv)
+{
+    static char *default_sizes[] =
+    {"10", "100", "1000", "10000", NULL};
+    char **sizes = default_sizes;
+    int nlookups = 100000;
+    long seed = 1;
+    int n;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+	switch (c) {
+	case 'n':
+	    nlookups = atoi(optarg);
+	    break;
+	case 's':
+	    seed = atol(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-n lookups] [-s seed] [entries ...]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	sizes = argv + optind;
+    for (; *sizes; sizes++) {
+	n = atoi(*sizes);
+	srand48(seed);
+	printf("%d entries:\n", n);
+	benchIp(n, nlookups);
+	benchDomain(n, nlookups);
+	/* pattern lists are rarely long, and the old way is slow */
+	benchRegex(n > 1000 ? 1000 : n, nlookups / 10);
+    }
+    return 0;
+}
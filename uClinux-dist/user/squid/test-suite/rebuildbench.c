@@ -0,0 +1,179 @@
+/*
+ * rebuildbench - write a swap.state for a synthetic cache and time
+ * reading it back.
+ *
+ * The log holds one ADD record per object, behind the checkpoint
+ * record that storeUfsDirWriteCleanOpen() writes, or without it (-o)
+ * the way older Squids wrote clean logs.  -t appends that many
+ * records after the checkpoint, half of them deletions, as if Squid
+ * had been running and then crashed; otherwise swap.state.last-clean
+ * is touched so the log is taken as clean.
+ *
+ * The read times compare a fread() per record, as
+ * storeRebuildFromSwapLog() does, with a read() per slice of SLICE
+ * records, as storeRebuildFromCheckpoint() does.  For the whole
+ * rebuild, point a cache_dir at the directory (run "squid -z"
+ * first), start "squid -N -F", and read the "Finished rebuilding
+ * storage" lines in cache.log.  The cache_dir must be large enough
+ * for the objects, which average 16 KB.
+ *
+ * usage: rebuildbench [-o] [-n objects] [-t tail] swap.state
+ */
+
+#include "squid.h"
+
+#define SLICE 1024		/* CHECKPOINT_SLICE in store_dir_ufs.c */
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start->tv_sec) * 1000000.0 +
+	(end.tv_usec - start->tv_usec);
+}
+
+static void
+makeRecord(storeSwapLogData * s, int op, int i, time_t now)
+{
+    char url[64];
+    MD5_CTX M;
+    memset(s, '\0', sizeof(*s));
+    s->op = (char) op;
+    s->swap_file_number = i & SWAP_FILE_MASK;
+    s->timestamp = now - 86400 + i % 86400;
+    s->lastref = s->timestamp + i % 3600;
+    s->expires = -1;
+    s->lastmod = s->timestamp - 86400 * (i % 30);
+    s->swap_file_sz = 1024 + (i * 7919) % 30720;
+    s->refcount = 1 + i % 7;
+    EBIT_SET(s->flags, ENTRY_CACHABLE);
+    EBIT_SET(s->flags, ENTRY_VALIDATED);
+    snprintf(url, sizeof(url), "http://rebuildbench/%d", i);
+    MD5Init(&M);
+    MD5Update(&M, (unsigned char *) url, strlen(url));
+    MD5Final(s->key, &M);
+}
+
+static void
+writeLog(const char *path, int nobj, int ntail, int checkpoint)
+{
+    storeSwapLogData s;
+    char clean[SQUID_MAXPATHLEN];
+    time_t now = time(NULL);
+    FILE *fp;
+    int i;
+    if ((fp = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    if (checkpoint) {
+	memset(&s, '\0', sizeof(s));
+	s.op = (char) SWAP_LOG_NOP;
+	s.swap_file_number = sizeof(s);
+	s.timestamp = now;
+	s.swap_file_sz = nobj;
+	xmemcpy(s.key, SWAP_LOG_CHECKPOINT, MD5_DIGEST_CHARS);
+	fwrite(&s, sizeof(s), 1, fp);
+    }
+    for (i = 0; i < nobj; i++) {
+	makeRecord(&s, SWAP_LOG_ADD, i, now);
+	fwrite(&s, sizeof(s), 1, fp);
+    }
+    /* delete every other object from the front, then add new ones */
+    for (i = 0; i < ntail; i++) {
+	if (i & 1)
+	    makeRecord(&s, SWAP_LOG_ADD, nobj + i, now);
+	else
+	    makeRecord(&s, SWAP_LOG_DEL, i, now);
+	fwrite(&s, sizeof(s), 1, fp);
+    }
+    if (fclose(fp) != 0) {
+	perror(path);
+	exit(1);
+    }
+    snprintf(clean, sizeof(clean), "%s.last-clean", path);
+    unlink(clean);
+    if (ntail == 0)
+	fclose(fopen(clean, "w"));
+}
+
+static void
+readLog(const char *path)
+{
+    storeSwapLogData s;
+    storeSwapLogData *buf;
+    struct timeval start;
+    double usec;
+    double sum1 = 0.0;
+    double sum2 = 0.0;
+    FILE *fp;
+    int n = 0;
+    int i;
+    int k;
+    if ((fp = fopen(path, "r")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    gettimeofday(&start, NULL);
+    while (fread(&s, sizeof(s), 1, fp) == 1) {
+	if (s.op == SWAP_LOG_ADD)
+	    sum1 += s.swap_file_sz;
+	n++;
+    }
+    usec = elapsed(&start);
+    printf("%8d records  fread %8.3f usec/record", n, usec / n);
+    buf = xcalloc(SLICE, sizeof(s));
+    gettimeofday(&start, NULL);
+    lseek(fileno(fp), (off_t) 0, SEEK_SET);
+    n = 0;
+    while ((k = read(fileno(fp), buf, SLICE * sizeof(s))) > 0) {
+	k /= sizeof(s);
+	for (i = 0; i < k; i++)
+	    if (buf[i].op == SWAP_LOG_ADD)
+		sum2 += buf[i].swap_file_sz;
+	n += k;
+    }
+    usec = elapsed(&start);
+    xfree(buf);
+    printf("  read %8.3f usec/record", usec / n);
+    if (sum1 != sum2) {
+	fprintf(stderr, "\nread() got different records\n");
+	exit(1);
+    }
+    printf("\n");
+    fclose(fp);
+}
+
+int
+main(int argc, char **argv)
+{
+    int nobj = 1000000;
+    int ntail = 0;
+    int checkpoint = 1;
+    int c;
+    while ((c = getopt(argc, argv, "on:t:")) != -1) {
+	switch (c) {
+	case 'o':
+	    checkpoint = 0;
+	    break;
+	case 'n':
+	    nobj = atoi(optarg);
+	    break;
+	case 't':
+	    ntail = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	    break;
+	}
+    }
+    if (optind != argc - 1 || ntail > nobj) {
+	fprintf(stderr, "usage: %s [-o] [-n objects] [-t tail] swap.state\n",
+	    argv[0]);
+	exit(1);
+    }
+    writeLog(argv[optind], nobj, ntail, checkpoint);
+    readLog(argv[optind]);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * stmembench - serve in-memory objects to many readers through
+ * stmemCopy(), the way store_client.c does.
+ *
+ * Each object is appended in odd-sized chunks, as it would come off
+ * a server connection, and then read by every reader in
+ * CLIENT_SOCK_SZ copies, the readers taking turns so that they are
+ * spread across the whole object.  Every copy is checked.  Then the
+ * front half is released with stmemFreeDataUpto(), as swapout does,
+ * and the rest read again.
+ *
+ * usage: stmembench [-r readers] [size-in-MB ...]
+ */
+
+#include "squid.h"
+
+unsigned long store_mem_size = 0;
+int debugLevels[MAX_DEBUG_SECTIONS];
+int _db_level;
+
+#if STDC_HEADERS
+void
+_db_print(const char *format,...)
+{
+}
+#else
+void
+_db_print(va_alist)
+     va_dcl
+{
+}
+#endif
+
+void
+xassert(const char *msg, const char *file, int line)
+{
+    fprintf(stderr, "assertion failed: %s:%d: \"%s\"\n", file, line, msg);
+    abort();
+}
+
+void *
+memAllocate(mem_type type)
+{
+    return xmalloc(SM_PAGE_SIZE);
+}
+
+void
+memFree(void *p, int type)
+{
+    xfree(p);
+}
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start->tv_sec) * 1000000.0 +
+	(end.tv_usec - start->tv_usec);
+}
+
+/* Byte i of every object. */
+#define PATTERN(i) ((char) ((i) * 7 + ((i) >> 12)))
+
+static void
+check(const char *buf, off_t offset, ssize_t len)
+{
+    ssize_t i;
+    for (i = 0; i < len; i++)
+	if (buf[i] != PATTERN(offset + i)) {
+	    fprintf(stderr, "bad data at offset %d\n", (int) (offset + i));
+	    exit(1);
+	}
+}
+
+/* Every reader reads from lo to hi; returns the number of copies. */
+static int
+serve(mem_hdr * mem, off_t * readers, int nreaders, off_t lo, off_t hi)
+{
+    char buf[CLIENT_SOCK_SZ];
+    ssize_t len;
+    int copies = 0;
+    int busy;
+    int r;
+    for (r = 0; r < nreaders; r++)
+	readers[r] = lo + (hi - lo) / nreaders * r;
+    do {
+	busy = 0;
+	for (r = 0; r < nreaders; r++) {
+	    if (readers[r] >= hi)
+		continue;
+	    len = stmemCopy(mem, readers[r], buf, sizeof(buf));
+	    if (len <= 0) {
+		fprintf(stderr, "short copy at offset %d\n", (int) readers[r]);
+		exit(1);
+	    }
+	    check(buf, readers[r], len);
+	    readers[r] += len;
+	    copies++;
+	    busy = 1;
+	}
+    } while (busy);
+    return copies;
+}
+
+int
+main(int argc, char **argv)
+{
+    static char *default_sizes[] =
+    {"1", "4", "16", "64", NULL};
+    char **sizes = default_sizes;
+    char chunk[SQUID_TCP_SO_RCVBUF];
+    mem_hdr mem;
+    off_t *readers;
+    int nreaders = 64;
+    struct timeval start;
+    double usec;
+    int size;
+    int copies;
+    int len;
+    int c;
+    int i;
+
+    while ((c = getopt(argc, argv, "r:")) != -1) {
+	switch (c) {
+	case 'r':
+	    nreaders = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-r readers] [size-in-MB ...]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	sizes = argv + optind;
+    readers = xcalloc(nreaders, sizeof(off_t));
+
+    printf("%d readers, %d byte copies\n", nreaders, CLIENT_SOCK_SZ);
+    for (; *sizes; sizes++) {
+	size = atoi(*sizes) << 20;
+	memset(&mem, '\0', sizeof(mem));
+	for (i = 0; i < size; i += len) {
+	    len = XMIN(size - i, 1000 + i % 3000);
+	    for (c = 0; c < len; c++)
+		chunk[c] = PATTERN(i + c);
+	    stmemAppend(&mem, chunk, len);
+	}
+
+	gettimeofday(&start, NULL);
+	copies = serve(&mem, readers, nreaders, 0, size);
+	usec = elapsed(&start);
+	printf("%4d MB: %8.3f usec/copy, %8.1f MB/s",
+	    size >> 20, usec / copies,
+	    (double) size * nreaders / usec);
+
+	stmemFreeDataUpto(&mem, size / 2);
+	gettimeofday(&start, NULL);
+	copies = serve(&mem, readers, nreaders, size / 2, size);
+	usec = elapsed(&start);
+	printf(", second half %8.3f usec/copy\n", usec / copies);
+
+	stmemFree(&mem);
+	if (store_mem_size != 0) {
+	    fprintf(stderr, "store_mem_size %lu after stmemFree\n", store_mem_size);
+	    exit(1);
+	}
+    }
+    return 0;
+}
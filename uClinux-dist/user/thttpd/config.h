@@ -196,6 +196,14 @@
 */
 #define STATS_TIME 3600
 
+/* CONFIGURE: Most bytes of file data to keep mapped in the mmap cache.
+** Idle files are dropped least recently used first to stay under this;
+** files being sent are never dropped, so it can be exceeded while they
+** are.  A file bigger than this is mapped only while it's being sent.
+** On no-MMU systems every mapped byte is RAM, so keep this small.
+*/
+#define MMC_MAX_BYTES 1048576L
+
 /* CONFIGURE: Minimum and maximum intervals between child-process reaping,
 ** in seconds.
 */
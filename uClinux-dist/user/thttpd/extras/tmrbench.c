@@ -0,0 +1,211 @@
+/* tmrbench.c - micro-benchmark for the timers package
+**
+** Drives ../timers.c the way thttpd does - lots of idle timers that mostly
+** get reset or cancelled before they fire, plus a few periodic ones - on a
+** simulated clock, and reports the cost of each operation.  The same
+** workload is run through the original unsorted list in tmrlist.c, so the
+** two columns can be compared directly; the default of 10000 timers is
+** where the list fell over.
+**
+** usage: tmrbench [-n timers] [-r rounds]
+*/
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "timers.h"
+#include "tmrlist.h"
+
+
+/* One timer package. */
+typedef struct {
+    char* name;
+    Timer* (*create)(
+	struct timeval* nowP, TimerProc* timer_proc, ClientData client_data,
+	long msecs, int periodic );
+    struct timeval* (*timeout)( struct timeval* nowP );
+    void (*run)( struct timeval* nowP );
+    void (*reset)( struct timeval* nowP, Timer* timer );
+    void (*cancel)( Timer* timer );
+    void (*destroy)( void );
+    void (*stats)( int* activeP, int* freeP );
+    } Package;
+
+static Package packages[] = {
+    { "list", tmrlist_create, tmrlist_timeout, tmrlist_run, tmrlist_reset,
+      tmrlist_cancel, tmrlist_destroy, tmrlist_stats },
+    { "wheel", tmr_create, tmr_timeout, tmr_run, tmr_reset,
+      tmr_cancel, tmr_destroy, tmr_stats },
+    };
+#define NPACKAGES ( sizeof(packages) / sizeof(*packages) )
+
+/* What we time, usec per operation. */
+#define T_CREATE 0
+#define T_LOOP 1
+#define T_CANCEL 2
+#define T_EXPIRE 3
+#define NTIMES 4
+
+static char* time_names[NTIMES] = { "create", "loop", "cancel", "expire" };
+
+
+static Timer** timers;
+static long fired;
+
+static void
+count_proc( ClientData client_data, struct timeval* nowP )
+    {
+    ++fired;
+    }
+
+
+/* Like thttpd's idle timers: forget the timer once it has gone off. */
+static void
+idle_proc( ClientData client_data, struct timeval* nowP )
+    {
+    timers[client_data.i] = (Timer*) 0;
+    ++fired;
+    }
+
+
+static double
+elapsed( struct timeval* startP )
+    {
+    struct timeval end;
+
+    (void) gettimeofday( &end, (struct timezone*) 0 );
+    return ( end.tv_sec - startP->tv_sec ) * 1000000.0 +
+	( end.tv_usec - startP->tv_usec );
+    }
+
+
+static void
+tick( struct timeval* nowP, long msecs )
+    {
+    nowP->tv_usec += msecs * 1000L;
+    nowP->tv_sec += nowP->tv_usec / 1000000L;
+    nowP->tv_usec %= 1000000L;
+    }
+
+
+/* Runs the whole workload through one package.  Each run starts from the
+** same clock and random seed, so every package sees identical timers.
+*/
+static void
+bench( Package* p, int ntimers, int rounds, double* times )
+    {
+    int i, r, at, ft;
+    struct timeval now, start;
+    ClientData cd;
+
+    srandom( 1 );
+    now.tv_sec = 1000000000L;
+    now.tv_usec = 0;
+    cd.i = 0;
+
+    /* The periodic timers thttpd always has running. */
+    (void) p->create( &now, count_proc, cd, 2000L, 1 );
+    (void) p->create( &now, count_proc, cd, 120000L, 1 );
+
+    (void) gettimeofday( &start, (struct timezone*) 0 );
+    for ( i = 0; i < ntimers; ++i )
+	{
+	cd.i = i;
+	timers[i] = p->create(
+	    &now, idle_proc, cd, 1000L + random() % 300000L, 0 );
+	}
+    times[T_CREATE] = elapsed( &start ) / ntimers;
+
+    /* One pass of the main loop per connection: ask for the timeout, reset
+    ** that connection's idle timer, run whatever came due a millisecond on.
+    */
+    (void) gettimeofday( &start, (struct timezone*) 0 );
+    for ( r = 0; r < rounds; ++r )
+	for ( i = 0; i < ntimers; ++i )
+	    {
+	    (void) p->timeout( &now );
+	    if ( timers[i] != (Timer*) 0 )
+		p->reset( &now, timers[i] );
+	    else
+		{
+		cd.i = i;
+		timers[i] = p->create(
+		    &now, idle_proc, cd, 1000L + random() % 300000L, 0 );
+		}
+	    tick( &now, 1L );
+	    p->run( &now );
+	    }
+    times[T_LOOP] = elapsed( &start ) / ( (double) rounds * ntimers );
+
+    (void) gettimeofday( &start, (struct timezone*) 0 );
+    for ( i = ntimers - 1; i >= 0; --i )
+	if ( timers[i] != (Timer*) 0 )
+	    p->cancel( timers[i] );
+    times[T_CANCEL] = elapsed( &start ) / ntimers;
+
+    /* Let a full set expire over five simulated minutes. */
+    for ( i = 0; i < ntimers; ++i )
+	{
+	cd.i = i;
+	timers[i] = p->create(
+	    &now, idle_proc, cd, 1000L + random() % 300000L, 0 );
+	}
+    fired = 0;
+    (void) gettimeofday( &start, (struct timezone*) 0 );
+    for ( i = 0; i < 302000; i += 100 )
+	{
+	tick( &now, 100L );
+	p->run( &now );
+	}
+    times[T_EXPIRE] = elapsed( &start ) / fired;
+
+    p->stats( &at, &ft );
+    (void) printf(
+	"%-6s %ld fired, %d active, %d free\n", p->name, fired, at, ft );
+    p->destroy();
+    }
+
+
+int
+main( int argc, char** argv )
+    {
+    int ntimers = 10000, rounds = 10, c, i, j;
+    double times[NPACKAGES][NTIMES];
+
+    while ( ( c = getopt( argc, argv, "n:r:" ) ) != -1 )
+	switch ( c )
+	    {
+	    case 'n': ntimers = atoi( optarg ); break;
+	    case 'r': rounds = atoi( optarg ); break;
+	    default:
+	    (void) fprintf( stderr, "usage: %s [-n timers] [-r rounds]\n", argv[0] );
+	    exit( 1 );
+	    }
+    timers = (Timer**) malloc( ntimers * sizeof(Timer*) );
+    if ( timers == (Timer**) 0 )
+	{
+	perror( "malloc" );
+	exit( 1 );
+	}
+
+    (void) printf( "%d timers, %d rounds\n", ntimers, rounds );
+    for ( j = 0; j < NPACKAGES; ++j )
+	bench( &packages[j], ntimers, rounds, times[j] );
+
+    (void) printf( "\n%-12s", "usec/op" );
+    for ( j = 0; j < NPACKAGES; ++j )
+	(void) printf( " %10s", packages[j].name );
+    (void) printf( "\n" );
+    for ( i = 0; i < NTIMES; ++i )
+	{
+	(void) printf( "%-12s", time_names[i] );
+	for ( j = 0; j < NPACKAGES; ++j )
+	    (void) printf( " %10.3f", times[j][i] );
+	(void) printf( "\n" );
+	}
+    return 0;
+    }
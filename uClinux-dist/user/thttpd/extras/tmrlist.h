@@ -0,0 +1,23 @@
+/* tmrlist.h - header file for the original unsorted-list timer routines
+**
+** Same interface as timers.h, with the entry points renamed so tmrbench
+** can link both packages.  See tmrlist.c.
+*/
+
+#ifndef _TMRLIST_H_
+#define _TMRLIST_H_
+
+#include "timers.h"
+
+extern Timer* tmrlist_create(
+    struct timeval* nowP, TimerProc* timer_proc, ClientData client_data,
+    long msecs, int periodic );
+extern struct timeval* tmrlist_timeout( struct timeval* nowP );
+extern void tmrlist_run( struct timeval* nowP );
+extern void tmrlist_reset( struct timeval* nowP, Timer* timer );
+extern void tmrlist_cancel( Timer* timer );
+extern void tmrlist_cleanup( void );
+extern void tmrlist_destroy( void );
+extern void tmrlist_stats( int* activeP, int* freeP );
+
+#endif /* _TMRLIST_H_ */
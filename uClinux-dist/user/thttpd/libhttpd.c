@@ -967,7 +967,7 @@ expand_symlinks( char* path, char** restP, int chrooted )
 	** URL for the CGI instead of a local symlinked one.
 	*/
 	struct stat sb;
-	if ( stat( path, &sb ) != -1 )
+	if ( mmc_stat( path, &sb, (struct timeval*) 0 ) != -1 )
 	    {
 	    realloc_str( &checked, &maxchecked, strlen( path ) );
 	    (void) strcpy( checked, path );
@@ -1073,8 +1073,20 @@ expand_symlinks( char* path, char** restP, int chrooted )
 	    restlen = 0;
 	    }
 
-	/* Try reading the current filename as a symlink */
-	linklen = readlink( checked, link, sizeof(link) );
+	/* Try reading the current filename as a symlink, unless we already
+	** know it isn't there.
+	*/
+	if ( ( i = mmc_missing( checked, (struct timeval*) 0 ) ) != 0 )
+	    {
+	    linklen = -1;
+	    errno = i;
+	    }
+	else
+	    {
+	    linklen = readlink( checked, link, sizeof(link) );
+	    if ( linklen == -1 && ( errno == ENOENT || errno == ENOTDIR ) )
+		mmc_note_missing( checked, errno, (struct timeval*) 0 );
+	    }
 	if ( linklen == -1 )
 	    {
 	    if ( errno == EINVAL )
@@ -2579,7 +2591,7 @@ really_start_request( httpd_conn* hc )
 	}
 
     /* Stat the file. */
-    if ( stat( hc->expnfilename, &hc->sb ) < 0 )
+    if ( mmc_stat( hc->expnfilename, &hc->sb, (struct timeval*) 0 ) < 0 )
 	{
 	httpd_send_err( hc, 500, err500title, err500form, hc->encodedurl );
 	return -1;
@@ -2624,7 +2636,7 @@ really_start_request( httpd_conn* hc )
 	if ( indxlen == 0 || indexname[indxlen - 1] != '/' )
 	    (void) strcat( indexname, "/" );
 	(void) strcat( indexname, INDEX_NAME );
-	if ( stat( indexname, &hc->sb ) < 0 )
+	if ( mmc_stat( indexname, &hc->sb, (struct timeval*) 0 ) < 0 )
 	    {
 	    /* Nope, no index.html, so it's an actual directory request. */
 #ifdef GENERATE_INDEXES
@@ -2717,15 +2729,14 @@ really_start_request( httpd_conn* hc )
 	return -1;
 	}
 
-    /* Fill in end_byte_loc if necessary. */
-    if ( hc->got_range &&
-	 ( hc->end_byte_loc == -1 || hc->end_byte_loc >= hc->sb.st_size ) )
-	hc->end_byte_loc = hc->sb.st_size - 1;
-
     figure_mime( hc );
 
     if ( hc->method == METHOD_HEAD )
 	{
+	/* Fill in end_byte_loc if necessary. */
+	if ( hc->got_range &&
+	     ( hc->end_byte_loc == -1 || hc->end_byte_loc >= hc->sb.st_size ) )
+	    hc->end_byte_loc = hc->sb.st_size - 1;
 	hc->bytes = 0;
 	send_mime(
 	    hc, 200, ok200title, hc->encodings, "", hc->type, hc->sb.st_size,
@@ -2748,6 +2759,12 @@ really_start_request( httpd_conn* hc )
 	    httpd_send_err( hc, 500, err500title, err500form, hc->encodedurl );
 	    return -1;
 	    }
+	/* Fill in end_byte_loc if necessary, now that mmc_map() has said
+	** how big the file really is.
+	*/
+	if ( hc->got_range &&
+	     ( hc->end_byte_loc == -1 || hc->end_byte_loc >= hc->sb.st_size ) )
+	    hc->end_byte_loc = hc->sb.st_size - 1;
 	hc->bytes = hc->sb.st_size;
 	send_mime(
 	    hc, 200, ok200title, hc->encodings, "", hc->type, hc->sb.st_size,
@@ -24,13 +24,19 @@
 ** SUCH DAMAGE.
 */
 
+
+#include "config.h"
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <syslog.h>
+#include <time.h>
 
 #ifdef HAVE_MMAP
 #include <sys/mman.h>
@@ -51,16 +57,17 @@ typedef struct MapStruct {
     int hash;
     int hash_idx;
     struct MapStruct* next;
+    struct MapStruct* prev;
     } Map;
 
-
-/* Globals. */
-static Map* maps = (Map*) 0;
-static int map_count = 0;
-static Map* free_maps = (Map*) 0;
-static int free_count = 0;
-static Map** hash_table = (Map**) 0;
-static int hash_size;
+/* The StatEntry struct - one remembered stat() result. */
+typedef struct {
+    char* name;
+    int maxname;
+    int err;		/* 0, or the errno stat() failed with */
+    struct stat sb;
+    time_t checked;
+    } StatEntry;
 
 
 /* Defines. */
@@ -73,15 +80,47 @@ static int hash_size;
 #ifndef INITIAL_HASH_SIZE
 #define INITIAL_HASH_SIZE 1009
 #endif
+#ifndef MMC_MAX_BYTES
+#define MMC_MAX_BYTES 1048576L
+#endif
+#ifndef STAT_CACHE_SIZE
+#define STAT_CACHE_SIZE 64
+#endif
+#ifndef STAT_CACHE_AGE
+#define STAT_CACHE_AGE 1
+#endif
+#ifndef NEGATIVE_STAT_AGE
+#define NEGATIVE_STAT_AGE 5
+#endif
+
+
+/* Globals. */
+static Map* maps = (Map*) 0;		/* most recently used first */
+static Map* maps_tail = (Map*) 0;
+static int map_count = 0;
+static long map_bytes = 0;
+static Map* free_maps = (Map*) 0;
+static int free_count = 0;
+static Map** hash_table = (Map**) 0;
+static int hash_size;
+static StatEntry stat_cache[STAT_CACHE_SIZE];
+static long map_hits, map_misses, map_evictions;
+static long stat_hits, stat_misses, negative_hits;
 
 
 /* Forwards. */
-static void really_unmap( Map** mm );
+static void really_unmap( Map* m );
+static void make_room( long bytes );
+static void lru_unlink( Map* m );
+static void lru_push( Map* m );
 static int check_hash_size( void );
 static int is_prime( int n );
 static int add_hash( Map* m );
+static void del_hash( Map* m );
 static Map* find_hash( ino_t ino, dev_t dev, off_t size, time_t mtime );
 static int hash( ino_t ino, dev_t dev, off_t size, time_t mtime );
+static StatEntry* stat_entry( char* filename );
+static void stat_store( StatEntry* s, char* filename, int err, struct stat* sbP, time_t now );
 
 
 void*
@@ -114,8 +153,12 @@ mmc_map( char* filename, struct stat* sbP )
 	{
 	/* Yep. */
 	++m->refcount;
+	lru_unlink( m );
+	lru_push( m );
+	++map_hits;
 	return m->addr;
 	}
+    ++map_misses;
 
     /* Nope.  Open the file. */
     fd = open( filename, O_RDONLY );
@@ -125,6 +168,26 @@ mmc_map( char* filename, struct stat* sbP )
 	return (void*) 0;
 	}
 
+    /* The stat buffer may have come from mmc_stat() and be a second old.
+    ** Map what's really there, and tell the caller how big it really is,
+    ** or it could send past the end of the mapping.
+    */
+    if ( fstat( fd, &sb ) != 0 )
+	{
+	syslog( LOG_ERR, "fstat - %m" );
+	(void) close( fd );
+	return (void*) 0;
+	}
+    if ( sbP != (struct stat*) 0 )
+	*sbP = sb;
+
+    /* Drop idle maps until this one fits in the budget.  A file bigger
+    ** than the whole budget is mapped for as long as it's in use, but
+    ** doesn't get to flush everything else out.
+    */
+    if ( sb.st_size <= MMC_MAX_BYTES )
+	make_room( sb.st_size );
+
     /* Find a free Map entry or make a new one. */
     if ( free_maps != (Map*) 0 )
 	{
@@ -187,10 +250,10 @@ mmc_map( char* filename, struct stat* sbP )
 	return (void*) 0;
 	}
 
-    /* Put the Map on the active list. */
-    m->next = maps;
-    maps = m;
+    /* Put the Map at the head of the active list. */
+    lru_push( m );
     ++map_count;
+    map_bytes += m->size;
 
     /* And return the address. */
     return m->addr;
@@ -202,7 +265,9 @@ mmc_unmap( void* addr, struct timeval* nowP )
     {
     Map* m;
 
-    /* Find the Map entry for this address. */
+    /* Find the Map entry for this address.  It was used recently, so
+    ** it's most likely near the head of the list.
+    */
     for ( m = maps; m != (Map*) 0; m = m->next )
 	{
 	if ( m->addr == addr )
@@ -212,6 +277,21 @@ mmc_unmap( void* addr, struct timeval* nowP )
 		m->reftime = nowP->tv_sec;
 	    else
 		m->reftime = time( (time_t*) 0 );
+	    lru_unlink( m );
+	    lru_push( m );
+	    /* If we went over the budget while this was in use, get back
+	    ** under it now.
+	    */
+	    if ( m->refcount == 0 && map_bytes > MMC_MAX_BYTES )
+		{
+		if ( m->size > MMC_MAX_BYTES )
+		    {
+		    really_unmap( m );
+		    ++map_evictions;
+		    }
+		else
+		    make_room( 0 );
+		}
 	    return;
 	    }
 	}
@@ -223,8 +303,8 @@ void
 mmc_cleanup( struct timeval* nowP )
     {
     time_t now;
-    Map** mm;
     Map* m;
+    Map* prev;
 
     /* Get current time, if necessary. */
     if ( nowP != (struct timeval*) 0 )
@@ -232,15 +312,17 @@ mmc_cleanup( struct timeval* nowP )
     else
 	now = time( (time_t*) 0 );
 
-    /* Really unmap any unreferenced entries older than the limit. */
-    for ( mm = &maps; *mm != (Map*) 0; )
+    /* Really unmap any unreferenced entries older than the limit.  Idle
+    ** entries are in reftime order, so stop at the first recent one.
+    */
+    for ( m = maps_tail; m != (Map*) 0; m = prev )
 	{
-	m = *mm;
-	if ( m->refcount == 0 && now - m->reftime >= EXPIRE_AGE )
-	    really_unmap( mm );
-	else
-	    mm = &(*mm)->next;
-	    
+	prev = m->prev;
+	if ( m->refcount != 0 )
+	    continue;
+	if ( now - m->reftime < EXPIRE_AGE )
+	    break;
+	really_unmap( m );
 	}
 
     /* Really free excess blocks on the free list. */
@@ -254,28 +336,74 @@ mmc_cleanup( struct timeval* nowP )
     }
 
 
+/* Unmap least recently used idle entries until bytes more will fit in
+** the budget, or there's nothing idle left.  Maps still in use are never
+** touched, so the budget can be overrun while they are.
+*/
 static void
-really_unmap( Map** mm )
+make_room( long bytes )
     {
     Map* m;
+    Map* prev;
 
-    m = *mm;
+    for ( m = maps_tail; m != (Map*) 0; m = prev )
+	{
+	if ( map_bytes + bytes <= MMC_MAX_BYTES )
+	    break;
+	prev = m->prev;
+	if ( m->refcount == 0 )
+	    {
+	    really_unmap( m );
+	    ++map_evictions;
+	    }
+	}
+    }
+
+
+static void
+really_unmap( Map* m )
+    {
 #ifdef HAVE_MMAP
     if ( munmap( m->addr, m->size ) < 0 )
 	syslog( LOG_ERR, "munmap - %m" );
 #else /* HAVE_MMAP */
     free( (void*) m->addr );
 #endif /* HAVE_MMAP */
-    /* And move the Map to the free list. */
-    *mm = m->next;
+    del_hash( m );
+    lru_unlink( m );
     --map_count;
+    map_bytes -= m->size;
+    /* And move the Map to the free list. */
     m->next = free_maps;
     free_maps = m;
     ++free_count;
-    /* This will sometimes break hash chains, but that's harmless.
-    ** Worst case we map another copy of the same file.
-    */
-    hash_table[m->hash_idx] = (Map*) 0;	
+    }
+
+
+static void
+lru_unlink( Map* m )
+    {
+    if ( m->prev != (Map*) 0 )
+	m->prev->next = m->next;
+    else
+	maps = m->next;
+    if ( m->next != (Map*) 0 )
+	m->next->prev = m->prev;
+    else
+	maps_tail = m->prev;
+    }
+
+
+static void
+lru_push( Map* m )
+    {
+    m->prev = (Map*) 0;
+    m->next = maps;
+    if ( maps != (Map*) 0 )
+	maps->prev = m;
+    else
+	maps_tail = m;
+    maps = m;
     }
 
 
@@ -283,9 +411,10 @@ void
 mmc_destroy( void )
     {
     Map* m;
+    int i;
 
     while ( maps != (Map*) 0 )
-	really_unmap( &maps );
+	really_unmap( maps );
     while ( free_maps != (Map*) 0 )
 	{
 	m = free_maps;
@@ -293,6 +422,13 @@ mmc_destroy( void )
 	--free_count;
 	free( (void*) m );
 	}
+    for ( i = 0; i < STAT_CACHE_SIZE; ++i )
+	if ( stat_cache[i].name != (char*) 0 )
+	    {
+	    free( (void*) stat_cache[i].name );
+	    stat_cache[i].name = (char*) 0;
+	    stat_cache[i].maxname = 0;
+	    }
     }
 
 
@@ -304,6 +440,143 @@ mmc_stats( int* activeP, int* freeP )
     }
 
 
+void
+mmc_logstats( void )
+    {
+    syslog( LOG_INFO,
+	"  map cache - %d maps (%ld of %ld bytes), %d free, %ld hits, %ld misses, %ld evictions",
+	map_count, map_bytes, (long) MMC_MAX_BYTES, free_count,
+	map_hits, map_misses, map_evictions );
+    syslog( LOG_INFO,
+	"  stat cache - %ld hits, %ld negative hits, %ld misses",
+	stat_hits, negative_hits, stat_misses );
+    map_hits = map_misses = map_evictions = 0;
+    stat_hits = stat_misses = negative_hits = 0;
+    }
+
+
+int
+mmc_stat( char* filename, struct stat* sbP, struct timeval* nowP )
+    {
+    StatEntry* s;
+    time_t now;
+    int err;
+
+    if ( nowP != (struct timeval*) 0 )
+	now = nowP->tv_sec;
+    else
+	now = time( (time_t*) 0 );
+
+    s = stat_entry( filename );
+    if ( s->name != (char*) 0 && strcmp( s->name, filename ) == 0 )
+	{
+	if ( s->err != 0 && now - s->checked < NEGATIVE_STAT_AGE )
+	    {
+	    ++negative_hits;
+	    errno = s->err;
+	    return -1;
+	    }
+	if ( s->err == 0 && now - s->checked < STAT_CACHE_AGE )
+	    {
+	    ++stat_hits;
+	    *sbP = s->sb;
+	    return 0;
+	    }
+	}
+    ++stat_misses;
+
+    if ( stat( filename, sbP ) == 0 )
+	{
+	stat_store( s, filename, 0, sbP, now );
+	return 0;
+	}
+    /* Only remember answers that won't change until somebody creates
+    ** the file; EACCES and the like get asked again.
+    */
+    err = errno;
+    if ( err == ENOENT || err == ENOTDIR )
+	stat_store( s, filename, err, (struct stat*) 0, now );
+    errno = err;
+    return -1;
+    }
+
+
+int
+mmc_missing( char* filename, struct timeval* nowP )
+    {
+    StatEntry* s;
+    time_t now;
+
+    s = stat_entry( filename );
+    if ( s->name == (char*) 0 || s->err == 0 ||
+	 strcmp( s->name, filename ) != 0 )
+	return 0;
+    if ( nowP != (struct timeval*) 0 )
+	now = nowP->tv_sec;
+    else
+	now = time( (time_t*) 0 );
+    if ( now - s->checked >= NEGATIVE_STAT_AGE )
+	return 0;
+    ++negative_hits;
+    return s->err;
+    }
+
+
+void
+mmc_note_missing( char* filename, int err, struct timeval* nowP )
+    {
+    time_t now;
+
+    if ( nowP != (struct timeval*) 0 )
+	now = nowP->tv_sec;
+    else
+	now = time( (time_t*) 0 );
+    stat_store( stat_entry( filename ), filename, err, (struct stat*) 0, now );
+    }
+
+
+/* The stat cache is direct-mapped: each name has exactly one slot, and a
+** new name simply takes it over.  No chains, no LRU, bounded memory.
+*/
+static StatEntry*
+stat_entry( char* filename )
+    {
+    unsigned int h;
+    char* cp;
+
+    h = 0;
+    for ( cp = filename; *cp != '\0'; ++cp )
+	h = h * 31 + (unsigned char) *cp;
+    return &stat_cache[h % STAT_CACHE_SIZE];
+    }
+
+
+static void
+stat_store( StatEntry* s, char* filename, int err, struct stat* sbP, time_t now )
+    {
+    int len;
+
+    len = strlen( filename );
+    if ( len >= s->maxname )
+	{
+	if ( s->name != (char*) 0 )
+	    free( (void*) s->name );
+	s->maxname = len + 1;
+	s->name = (char*) malloc( s->maxname );
+	if ( s->name == (char*) 0 )
+	    {
+	    s->maxname = 0;
+	    return;
+	    }
+	}
+    (void) strcpy( s->name, filename );
+    s->err = err;
+    if ( sbP != (struct stat*) 0 )
+	s->sb = *sbP;
+    s->checked = now;
+    }
+
+
 /* Make sure the hash table is big enough. */
 static int
 check_hash_size( void )
@@ -381,6 +654,29 @@ add_hash( Map* m )
     }
 
 
+/* Take a Map out of the hash table, then re-file the rest of its probe
+** run so that nothing after it becomes unreachable.
+*/
+static void
+del_hash( Map* m )
+    {
+    int i;
+    Map* m2;
+
+    if ( hash_table == (Map**) 0 || hash_table[m->hash_idx] != m )
+	return;
+    hash_table[m->hash_idx] = (Map*) 0;
+    for ( i = ( m->hash_idx + 1 ) % hash_size;
+	  hash_table[i] != (Map*) 0;
+	  i = ( i + 1 ) % hash_size )
+	{
+	m2 = hash_table[i];
+	hash_table[i] = (Map*) 0;
+	(void) add_hash( m2 );
+	}
+    }
+
+
 static Map*
 find_hash( ino_t ino, dev_t dev, off_t size, time_t mtime )
     {
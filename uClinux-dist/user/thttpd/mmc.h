@@ -49,4 +49,25 @@ extern void mmc_destroy( void );
 /* Return usage stats on the mmc package. */
 extern void mmc_stats( int* activeP, int* freeP );
 
+/* Syslog hit, miss and eviction counts since the last call, then zero
+** them.
+*/
+extern void mmc_logstats( void );
+
+/* Like stat(), but remembers the answer for a second, and remembers
+** that a file doesn't exist (ENOENT or ENOTDIR) for a few seconds, so
+** repeated requests for the same path - or the same 404 - cost no
+** system calls.  If you have the current time, pass it in, otherwise
+** pass 0.
+*/
+extern int mmc_stat( char* filename, struct stat* sbP, struct timeval* nowP );
+
+/* Returns the errno from a remembered failed lookup of filename that is
+** still fresh, or 0 if the file isn't known to be missing.
+*/
+extern int mmc_missing( char* filename, struct timeval* nowP );
+
+/* Remember that filename doesn't exist, e.g. after readlink() said so. */
+extern void mmc_note_missing( char* filename, int err, struct timeval* nowP );
+
 #endif /* _MMC_H_ */
@@ -1178,6 +1178,7 @@ show_stats( ClientData client_data, struct timeval* nowP )
     syslog( LOG_INFO,
 	"%d seconds, %d connections, %d simultaneous, %d maps, %d timers",
 	STATS_TIME, stats_connections, stats_simultaneous, am, at );
+    mmc_logstats();
     stats_connections = stats_simultaneous = 0;
     }
 #endif /* STATS_TIME */
@@ -31,14 +31,155 @@
 
 #include "timers.h"
 
-/* It might make sense to store the timers list sorted.  It would
-** depend on things like how often tmr_timeout() gets called during the
-** average life of a timer.
+/* Timers live on a hierarchical timing wheel, as in the Linux kernel.
+** Time is counted in one-millisecond ticks.  The root wheel has one slot
+** per tick for the next 256 ticks; each of the four outer wheels has 64
+** slots, each covering 64 times the range of a slot on the wheel inside
+** it.  When the root wheel comes round, the next slot of the first outer
+** wheel is emptied and its timers are re-filed further in, and so on out.
+**
+** Every timer is on a doubly-linked slot list, so create, cancel and reset
+** are O(1) no matter how many timers there are.  tmr_run only looks at
+** the slots that came due since last time, and tmr_timeout looks at the
+** first non-empty slot of each wheel rather than at every timer.
 */
 
+#define ROOT_BITS 8
+#define ROOT_SIZE ( 1 << ROOT_BITS )
+#define ROOT_MASK ( ROOT_SIZE - 1 )
+#define WHEEL_BITS 6
+#define WHEEL_SIZE ( 1 << WHEEL_BITS )
+#define WHEEL_MASK ( WHEEL_SIZE - 1 )
+#define WHEELS 4
+
+#define WHEEL_SHIFT(w) ( ROOT_BITS + (w) * WHEEL_BITS )
+
+/* Values for Timer.wheel besides the wheel numbers. */
+#define TW_ROOT -1	/* on the root wheel */
+#define TW_DUE -2	/* taken off the wheel by tmr_run, not yet run */
+#define TW_RUNNING -3	/* its timer_proc is being called */
+#define TW_FREE -4	/* on the free list */
+
+static Timer* root[ROOT_SIZE];
+static Timer* wheels[WHEELS][WHEEL_SIZE];
+static int root_count = 0;
+static int active_count = 0;
+static int started = 0;
+static time_t base_sec;
+static unsigned long cur_tick;		/* next tick tmr_run will look at */
 
-static Timer* timers = (Timer*) 0;
 static Timer* free_timers = (Timer*) 0;
+static int free_count = 0;
+
+
+/* Ticks are counted from the first time we were called, so that an
+** unsigned long doesn't wrap for 49 days even where it is 32 bits.  All
+** comparisons are done on differences, so wrapping is harmless anyway.
+*/
+static unsigned long
+tv_ticks( struct timeval* tvP )
+    {
+    if ( ! started )
+	{
+	base_sec = tvP->tv_sec;
+	cur_tick = tvP->tv_usec / 1000L;
+	started = 1;
+	}
+    return (unsigned long) ( tvP->tv_sec - base_sec ) * 1000L +
+	tvP->tv_usec / 1000L;
+    }
+
+
+static void
+l_link( Timer** headP, Timer* t )
+    {
+    t->next = *headP;
+    if ( t->next != (Timer*) 0 )
+	t->next->prevP = &t->next;
+    *headP = t;
+    t->prevP = headP;
+    }
+
+
+static void
+l_unlink( Timer* t )
+    {
+    if ( t->prevP == (Timer**) 0 )
+	return;
+    *t->prevP = t->next;
+    if ( t->next != (Timer*) 0 )
+	t->next->prevP = t->prevP;
+    t->prevP = (Timer**) 0;
+    if ( t->wheel == TW_ROOT )
+	--root_count;
+    }
+
+
+/* File a timer under the right slot for its expiry tick. */
+static void
+l_add( Timer* t )
+    {
+    unsigned long idx = t->expires - cur_tick;
+    int w;
+
+    if ( (long) idx < 0 )
+	{
+	/* Already due; run it at the next opportunity. */
+	t->wheel = TW_ROOT;
+	l_link( &root[cur_tick & ROOT_MASK], t );
+	++root_count;
+	return;
+	}
+    if ( idx < ROOT_SIZE )
+	{
+	t->wheel = TW_ROOT;
+	l_link( &root[t->expires & ROOT_MASK], t );
+	++root_count;
+	return;
+	}
+    /* Anything too far out for the last wheel goes round it again. */
+    for ( w = 0; w < WHEELS - 1; ++w )
+	if ( idx >> WHEEL_SHIFT( w + 1 ) == 0 )
+	    break;
+    t->wheel = w;
+    l_link( &wheels[w][( t->expires >> WHEEL_SHIFT( w ) ) & WHEEL_MASK], t );
+    }
+
+
+static void
+set_time( Timer* t, struct timeval* tvP )
+    {
+    t->time = *tvP;
+    t->time.tv_sec += t->msecs / 1000L;
+    t->time.tv_usec += ( t->msecs % 1000L ) * 1000L;
+    if ( t->time.tv_usec >= 1000000L )
+	{
+	t->time.tv_sec += t->time.tv_usec / 1000000L;
+	t->time.tv_usec %= 1000000L;
+	}
+    /* Round up to the next tick, so a timer never fires early. */
+    t->expires = tv_ticks( &t->time ) + 1;
+    }
+
+
+/* Re-file the timers in the current slot of wheel w, and of the wheels
+** outside it if w has come all the way round too.
+*/
+static void
+cascade( int w )
+    {
+    int index;
+    Timer* t;
+
+    index = ( cur_tick >> WHEEL_SHIFT( w ) ) & WHEEL_MASK;
+    while ( ( t = wheels[w][index] ) != (Timer*) 0 )
+	{
+	l_unlink( t );
+	l_add( t );
+	}
+    if ( index == 0 && w < WHEELS - 1 )
+	cascade( w + 1 );
+    }
 
 
 Timer*
@@ -47,11 +188,13 @@ tmr_create(
     long msecs, int periodic )
     {
     Timer* t;
+    struct timeval now;
 
     if ( free_timers != (Timer*) 0 )
 	{
 	t = free_timers;
 	free_timers = t->next;
+	--free_count;
 	}
     else
 	{
@@ -63,19 +206,16 @@ tmr_create(
     t->client_data = client_data;
     t->msecs = msecs;
     t->periodic = periodic;
-    if ( nowP != (struct timeval*) 0 )
-	t->time = *nowP;
-    else
-	(void) gettimeofday( &t->time, (struct timezone*) 0 );
-    t->time.tv_sec += msecs / 1000L;
-    t->time.tv_usec += ( msecs % 1000L ) * 1000L;
-    if ( t->time.tv_usec >= 1000000L )
+    if ( nowP == (struct timeval*) 0 )
 	{
-	t->time.tv_sec += t->time.tv_usec / 1000000L;
-	t->time.tv_usec %= 1000000L;
+	(void) gettimeofday( &now, (struct timezone*) 0 );
+	nowP = &now;
 	}
-    t->next = timers;
-    timers = t;
+    (void) tv_ticks( nowP );	/* starts the clock on first use */
+    set_time( t, nowP );
+    t->prevP = (Timer**) 0;
+    l_add( t );
+    ++active_count;
     return t;
     }
 
@@ -83,27 +223,43 @@ tmr_create(
 struct timeval*
 tmr_timeout( struct timeval* nowP )
     {
-    int gotone;
-    long msecs, m;
-    Timer* t;
+    unsigned long now, best, when;
+    long msecs;
+    int i, w, base;
     static struct timeval timeout;
 
-    gotone = 0;
-    msecs = 0;		/* make lint happy */
-    for ( t = timers; t != (Timer*) 0; t = t->next )
+    if ( active_count == 0 )
+	return (struct timeval*) 0;
+    now = tv_ticks( nowP );
+
+    /* The earliest tick anything could be due at: the first occupied root
+    ** slot, or the start of the range of the first occupied outer slot,
+    ** whichever is sooner.  An outer slot's timers get re-filed at the
+    ** start of its range, so waking then is never too late.
+    */
+    best = cur_tick - 1;	/* as far off as it gets */
+    if ( root_count > 0 )
+	for ( i = 0; i < ROOT_SIZE; ++i )
+	    if ( root[( cur_tick + i ) & ROOT_MASK] != (Timer*) 0 )
+		{
+		best = cur_tick + i;
+		break;
+		}
+    for ( w = 0; w < WHEELS; ++w )
 	{
-	m = ( t->time.tv_sec - nowP->tv_sec ) * 1000L +
-	    ( t->time.tv_usec - nowP->tv_usec ) / 1000L;
-	if ( ! gotone )
-	    {
-	    msecs = m;
-	    gotone = 1;
-	    }
-	else if ( m < msecs )
-	    msecs = m;
+	base = ( cur_tick >> WHEEL_SHIFT( w ) ) & WHEEL_MASK;
+	for ( i = 1; i <= WHEEL_SIZE; ++i )
+	    if ( wheels[w][( base + i ) & WHEEL_MASK] != (Timer*) 0 )
+		{
+		when = ( ( cur_tick >> WHEEL_SHIFT( w ) ) + i ) <<
+		    WHEEL_SHIFT( w );
+		if ( when - cur_tick < best - cur_tick )
+		    best = when;
+		break;
+		}
 	}
-    if ( ! gotone )
-	return (struct timeval*) 0;
+
+    msecs = (long) ( best - now );
     if ( msecs <= 0 )
 	msecs = 0;
     timeout.tv_sec = msecs / 1000L;
@@ -115,65 +271,97 @@ tmr_timeout( struct timeval* nowP )
 void
 tmr_run( struct timeval* nowP )
     {
+    unsigned long now, skip;
+    int index;
+    Timer* due;
+    Timer* again;
     Timer* t;
-    Timer* next;
 
-    for ( t = timers; t != (Timer*) 0; t = next )
+    now = tv_ticks( nowP );
+    if ( active_count == 0 )
 	{
-	next = t->next;
-	if ( t->time.tv_sec < nowP->tv_sec ||
-	     ( t->time.tv_sec == nowP->tv_sec &&
-	       t->time.tv_usec < nowP->tv_usec ) )
+	cur_tick = now + 1;
+	return;
+	}
+
+    again = (Timer*) 0;
+    while ( (long) ( now - cur_tick ) >= 0 )
+	{
+	index = cur_tick & ROOT_MASK;
+	if ( index == 0 )
+	    cascade( 0 );
+	else if ( root_count == 0 )
 	    {
+	    /* Nothing can come due before the root wheel comes round. */
+	    skip = ROOT_SIZE - index;
+	    if ( skip > now - cur_tick + 1 )
+		skip = now - cur_tick + 1;
+	    cur_tick += skip;
+	    continue;
+	    }
+
+	/* Take the slot's timers off the wheel before running any of them;
+	** the callbacks may create, reset or cancel timers, including the
+	** ones still waiting here.
+	*/
+	due = (Timer*) 0;
+	while ( ( t = root[index] ) != (Timer*) 0 )
+	    {
+	    l_unlink( t );
+	    t->wheel = TW_DUE;
+	    l_link( &due, t );
+	    }
+	++cur_tick;
+
+	while ( ( t = due ) != (Timer*) 0 )
+	    {
+	    l_unlink( t );
+	    t->wheel = TW_RUNNING;
 	    (t->timer_proc)( t->client_data, nowP );
+	    if ( t->wheel != TW_RUNNING )
+		continue;	/* the callback cancelled or reset it */
 	    if ( t->periodic )
 		{
-		/* Reschedule. */
-		t->time.tv_sec += t->msecs / 1000L;
-		t->time.tv_usec += ( t->msecs % 1000L ) * 1000L;
-		if ( t->time.tv_usec >= 1000000L )
-		    {
-		    t->time.tv_sec += t->time.tv_usec / 1000000L;
-		    t->time.tv_usec %= 1000000L;
-		    }
+		/* Reschedule, but don't run it again until next time. */
+		set_time( t, &t->time );
+		t->wheel = TW_DUE;
+		l_link( &again, t );
 		}
 	    else
 		tmr_cancel( t );
 	    }
 	}
+
+    while ( ( t = again ) != (Timer*) 0 )
+	{
+	l_unlink( t );
+	l_add( t );
+	}
     }
 
 
 void
 tmr_reset( struct timeval* nowP, Timer* t )
     {
-    t->time = *nowP;
-    t->time.tv_sec += t->msecs / 1000L;
-    t->time.tv_usec += ( t->msecs % 1000L ) * 1000L;
-    if ( t->time.tv_usec >= 1000000L )
-	{
-	t->time.tv_sec += t->time.tv_usec / 1000000L;
-	t->time.tv_usec %= 1000000L;
-	}
+    if ( t->wheel == TW_FREE )
+	return;
+    l_unlink( t );
+    set_time( t, nowP );
+    l_add( t );
     }
 
 
 void
 tmr_cancel( Timer* t )
     {
-    Timer** tt;
-
-    for ( tt = &timers; *tt != (Timer*) 0; tt = &(*tt)->next )
-	{
-	if ( *tt == t )
-	    {
-	    *tt = t->next;
-	    t->next = free_timers;
-	    free_timers = t;
-	    return;
-	    }
-	}
-    /* Didn't find it.  Shrug. */
+    if ( t->wheel == TW_FREE )
+	return;		/* Already cancelled.  Shrug. */
+    l_unlink( t );
+    t->wheel = TW_FREE;
+    t->next = free_timers;
+    free_timers = t;
+    ++free_count;
+    --active_count;
     }
 
 
@@ -188,14 +376,22 @@ tmr_cleanup( void )
 	free_timers = t->next;
 	free( (void*) t );
 	}
+    free_count = 0;
     }
 
 
 void
 tmr_destroy( void )
     {
-    while ( timers != (Timer*) 0 )
-	tmr_cancel( timers );
+    int i, w;
+
+    for ( i = 0; i < ROOT_SIZE; ++i )
+	while ( root[i] != (Timer*) 0 )
+	    tmr_cancel( root[i] );
+    for ( w = 0; w < WHEELS; ++w )
+	for ( i = 0; i < WHEEL_SIZE; ++i )
+	    while ( wheels[w][i] != (Timer*) 0 )
+		tmr_cancel( wheels[w][i] );
     tmr_cleanup();
     }
 
@@ -203,10 +399,6 @@ tmr_destroy( void )
 void
 tmr_stats( int* activeP, int* freeP )
     {
-    Timer* t;
-
-    for ( *activeP = 0, t = timers; t != (Timer*) 0; ++*activeP, t = t->next )
-	;
-    for ( *freeP = 0, t = free_timers; t != (Timer*) 0; ++*freeP, t = t->next )
-	;
+    *activeP = active_count;
+    *freeP = free_count;
     }
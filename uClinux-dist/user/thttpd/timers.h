@@ -45,14 +45,19 @@ typedef union {
 */
 typedef void TimerProc( ClientData client_data, struct timeval* nowP );
 
-/* The Timer struct. */
+/* The Timer struct.  The last four fields belong to the timing wheel
+** in timers.c and are private to it.
+*/
 typedef struct TimerStruct {
     TimerProc* timer_proc;
     ClientData client_data;
     long msecs;
     int periodic;
     struct timeval time;
+    unsigned long expires;
+    int wheel;
     struct TimerStruct* next;
+    struct TimerStruct** prevP;
     } Timer;
 
 /* Set up a timer, either periodic or one-shot. Returns (Timer*) 0 on errors. */
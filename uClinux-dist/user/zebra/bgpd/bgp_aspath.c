@@ -50,6 +50,20 @@ struct assegment
 
 /* Hash for aspath.  This is the top level structure of AS path. */
 struct Hash *ashash;
+
+/* A full table has some tens of thousands of distinct AS paths. */
+#define ASPATH_HASH_SIZE 4096
+
+/* String form of an uninterned AS path goes stale when it is
+   changed. */
+#define aspath_str_clear(A) \
+  do { \
+    if ((A)->str) \
+      { \
+	XFREE (MTYPE_AS_STR, (A)->str); \
+	(A)->str = NULL; \
+      } \
+  } while (0)
 
 static struct aspath *
 aspath_new ()
@@ -126,9 +140,47 @@ aspath_delimiter_char (u_char type, u_char which)
   return ' ';
 }
 
+/* Check the segments of an AS path and count its ASes, ignoring
+   confederation segments.  Return -1 if it is malformed. */
+static int
+aspath_count_make (struct aspath *as)
+{
+  caddr_t pnt;
+  caddr_t end;
+  struct assegment *assegment;
+  int count = 0;
+
+  pnt = as->data;
+  end = pnt + as->length;
+
+  while (pnt < end)
+    {
+      assegment = (struct assegment *) pnt;
+
+      /* Check AS type validity. */
+      if ((assegment->type != AS_SET) && 
+	  (assegment->type != AS_SEQUENCE) &&
+	  (assegment->type != AS_CONFED_SET) && 
+	  (assegment->type != AS_CONFED_SEQUENCE))
+	return -1;
+
+      /* Check AS length. */
+      if ((pnt + (assegment->length * AS_VALUE_SIZE) + AS_HEADER_SIZE) > end)
+	return -1;
+
+      if (assegment->type != AS_CONFED_SEQUENCE
+	  && assegment->type != AS_CONFED_SET)
+	count += assegment->length;
+
+      pnt += (assegment->length * AS_VALUE_SIZE) + AS_HEADER_SIZE;
+    }
+
+  return count;
+}
+
 /* Convert aspath structure to string expression. */
 static char *
-aspath_make_str_count (struct aspath *as)
+aspath_make_str (struct aspath *as)
 {
   int space;
   u_char type;
@@ -138,14 +190,12 @@ aspath_make_str_count (struct aspath *as)
   int str_size = ASPATH_STR_DEFAULT_LEN;
   int str_pnt;
   u_char *str_buf;
-  int count = 0;
 
   /* Empty aspath. */
   if (as->length == 0)
     {
       str_buf = XMALLOC (MTYPE_AS_STR, 1);
       str_buf[0] = '\0';
-      as->count = count;
       return str_buf;
     }
 
@@ -209,12 +259,6 @@ aspath_make_str_count (struct aspath *as)
 
       space = 0;
 
-      /* Increment count - ignoring CONFED SETS/SEQUENCES */
-      if(assegment->type != AS_CONFED_SEQUENCE && assegment->type != AS_CONFED_SET)
-        {
-          count += assegment->length;
-        }
-
       for (i = 0; i < assegment->length; i++)
 	{
 	  int len;
@@ -237,8 +281,6 @@ aspath_make_str_count (struct aspath *as)
 
   str_buf[str_pnt] = '\0';
 
-  as->count = count;
-
   return str_buf;
 }
 
@@ -250,9 +292,9 @@ aspath_intern (struct aspath *aspath)
   
   /* Assert this AS path structure is not interned. */
   assert (aspath->refcnt == 0);
-  assert (aspath->str == NULL);
 
   /* Check AS path hash. */
+  aspath->key = aspath_key_make (aspath);
   find = hash_search (ashash, aspath);
   if (find)
     {
@@ -261,9 +303,11 @@ aspath_intern (struct aspath *aspath)
       return find;
     }
 
-  /* Push new AS path to AS path hash. */
+  /* Push new AS path to AS path hash.  The count is made again since
+     the path may have been changed since it was parsed. */
   aspath->refcnt = 1;
-  aspath->str = aspath_make_str_count (aspath);
+  aspath->count = aspath_count_make (aspath);
+  aspath_str_clear (aspath);
   hash_push (ashash, aspath);
 
   return aspath;
@@ -311,6 +355,7 @@ aspath_parse (caddr_t pnt, int length)
   /* Looking up aspath hash entry. */
   as.data = pnt;
   as.length = length;
+  as.key = aspath_key_make (&as);
 
   /* If already same aspath exist then return it. */
   find = hash_search (ashash, &as);
@@ -324,6 +369,7 @@ aspath_parse (caddr_t pnt, int length)
   aspath = XMALLOC (MTYPE_AS_PATH, sizeof (struct aspath));
   memset ((void *)aspath, 0, sizeof (struct aspath));
   aspath->length = length;
+  aspath->key = as.key;
 
   /* In case of IBGP connection aspath's length can be zero. */
   if (length)
@@ -334,11 +380,11 @@ aspath_parse (caddr_t pnt, int length)
   else
     aspath->data = NULL;
 
-  /* Make AS path string. */
-  aspath->str = aspath_make_str_count (aspath);
+  /* Count ASes.  The string is left until somebody prints it. */
+  aspath->count = aspath_count_make (aspath);
 
   /* Malformed AS path value. */
-  if (! aspath->str)
+  if (aspath->count < 0)
     {
       aspath_free (aspath);
       return NULL;
@@ -455,6 +501,7 @@ aspath_merge (struct aspath *as1, struct aspath *as2)
   as2->data = data;
   as2->length += as1->length;
   as2->count += as1->count;
+  aspath_str_clear (as2);
   return as2;
 }
 
@@ -479,6 +526,7 @@ aspath_prepend (struct aspath *as1, struct aspath *as2)
       as2->data = XMALLOC (MTYPE_AS_SEG, as1->length);
       as2->count = as1->count;
       memcpy (as2->data, as1->data, as1->length);
+      aspath_str_clear (as2);
       return as2;
     }
 
@@ -516,6 +564,7 @@ aspath_prepend (struct aspath *as1, struct aspath *as2)
       as2->data = newdata;
       as2->length += (as1->length - AS_HEADER_SIZE);
       as2->count += as1->count;
+      aspath_str_clear (as2);
 
       return as2;
     }
@@ -535,6 +584,7 @@ aspath_add_left (struct aspath *aspath, as_t asno)
   struct assegment *assegment;
 
   assegment = (struct assegment *) aspath->data;
+  aspath_str_clear (aspath);
 
   /* In case of empty aspath. */
   if (assegment == NULL || assegment->length == 0)
@@ -644,6 +694,7 @@ aspath_strip_confed (struct aspath *aspath)
 
   if (assegment->type != AS_CONFED_SEQUENCE)
     return aspath;
+  aspath_str_clear (aspath);
 
   /* Strip the first element from the path */
   bytes = AS_HEADER_SIZE + (assegment->length * AS_VALUE_SIZE);
@@ -693,6 +744,7 @@ aspath_add_left_confed (struct aspath *aspath, as_t asno)
   struct assegment *assegment;
 
   assegment = (struct assegment *) aspath->data;
+  aspath_str_clear (aspath);
 
   /* In case of empty aspath. */
   if (assegment == NULL || assegment->length == 0)
@@ -768,6 +820,8 @@ aspath_as_add (struct aspath *as, as_t asno)
   caddr_t end;
   struct assegment *assegment;
 
+  aspath_str_clear (as);
+
   /* Increase as->data for new as value. */
   as->data = XREALLOC (MTYPE_AS_SEG, as->data, as->length + 2);
   as->length += 2;
@@ -796,6 +850,8 @@ aspath_segment_add (struct aspath *as, int type)
 {
   struct assegment *assegment;
 
+  aspath_str_clear (as);
+
   if (as->data == NULL)
     {
       as->data = XMALLOC (MTYPE_AS_SEG, 2);
@@ -953,26 +1009,35 @@ aspath_str2aspath (char *str)
 	}
     }
 
-  aspath->str = aspath_make_str_count (aspath);
+  aspath->count = aspath_count_make (aspath);
 
   return aspath;
 }
 
-/* Make hash value by raw aspath data. */
+/* Make hash value by raw aspath data.  A plain sum of the bytes puts
+   every path through the same ASes in the same bucket, whatever the
+   order, so mix each byte in. */
 unsigned int
 aspath_key_make (struct aspath *aspath)
 {
   unsigned int key = 0;
   int length;
-  caddr_t pnt;
+  u_char *pnt;
 
   length = aspath->length;
-  pnt = aspath->data;
+  pnt = (u_char *) aspath->data;
+
+  while (length--)
+    key = key * 31 + *pnt++;
 
-  while (length)
-    key += pnt[--length];
+  return key;
+}
 
-  return key %= HASHTABSIZE;
+/* Hash function for ashash, the key was made when the path went in. */
+static unsigned int
+aspath_hash_key (struct aspath *aspath)
+{
+  return aspath->key;
 }
 
 /* If two aspath have same value then return 1 else return 0 */
@@ -990,8 +1055,8 @@ aspath_cmp (struct aspath *as1, struct aspath *as2)
 void
 aspath_init ()
 {
-  ashash = hash_new (HASHTABSIZE);
-  ashash->hash_key = aspath_key_make;
+  ashash = hash_new (ASPATH_HASH_SIZE);
+  ashash->hash_key = aspath_hash_key;
   ashash->hash_cmp = aspath_cmp;
 }
 
@@ -999,6 +1064,8 @@ aspath_init ()
 const char *
 aspath_print (struct aspath *as)
 {
+  if (! as->str)
+    as->str = aspath_make_str (as);
   return as->str;
 }
 
@@ -1006,7 +1073,7 @@ aspath_print (struct aspath *as)
 void
 aspath_print_vty (struct vty *vty, struct aspath *as)
 {
-  vty_out (vty, "%s", as->str);
+  vty_out (vty, "%s", aspath_print (as));
 }
 
 /* Print all aspath and hash information.  This function is used from
@@ -1017,7 +1084,7 @@ aspath_print_all_vty (struct vty *vty)
   int i;
   HashBacket *mp;
 
-  for (i = 0; i < HASHTABSIZE; i++)
+  for (i = 0; i < ashash->size; i++)
     if ((mp = hash_head (ashash, i)) != NULL)
       while (mp) 
 	{
@@ -1029,6 +1096,33 @@ aspath_print_all_vty (struct vty *vty)
 	}
 }
 
+/* Memory used by interned AS paths, for `show ip bgp memory'. */
+void
+aspath_memory_vty (struct vty *vty)
+{
+  int i;
+  HashBacket *mp;
+  struct aspath *as;
+  unsigned long count = 0;
+  unsigned long refcnt = 0;
+  unsigned long bytes = 0;
+
+  for (i = 0; i < ashash->size; i++)
+    for (mp = hash_head (ashash, i); mp; mp = mp->next)
+      {
+	as = mp->data;
+	count++;
+	refcnt += as->refcnt;
+	bytes += sizeof (HashBacket) + sizeof (struct aspath) + as->length;
+	if (as->str)
+	  bytes += strlen (as->str) + 1;
+      }
+  bytes += ashash->size * sizeof (HashBacket *);
+
+  vty_out (vty, "%-16s %8ld %8ld %10ld%s", "AS path",
+	   count, refcnt, bytes, VTY_NEWLINE);
+}
+
 #ifdef ASPATH_TEST
 
 #include "regex-gnu.h"
@@ -49,8 +49,12 @@ struct aspath
   /* Rawdata */
   caddr_t data;
 
+  /* Hash key of the rawdata, set when the AS path is interned. */
+  unsigned int key;
+
   /* String expression of AS path.  This string is used by vty output
-     and AS path regular expression match. */
+     and AS path regular expression match.  It is made on first use by
+     aspath_print (), most AS paths are never printed. */
   char *str;
 };
 
@@ -74,6 +78,7 @@ void aspath_unintern (struct aspath *);
 const char *aspath_print (struct aspath *);
 void aspath_print_vty (struct vty *, struct aspath *);
 void aspath_print_all_vty (struct vty *);
+void aspath_memory_vty (struct vty *);
 unsigned int aspath_key_make (struct aspath *);
 int aspath_loop_check (struct aspath *, as_t);
 
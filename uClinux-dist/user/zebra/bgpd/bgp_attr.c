@@ -66,6 +66,28 @@ struct message attr_str [] =
 struct Hash *cluster_hash;
 
 /* Cluster list related functions. */
+unsigned int
+cluster_hash_key_make (struct cluster_list *cluster)
+{
+  unsigned int key = 0;
+  int length;
+  caddr_t pnt;
+
+  length = cluster->length;
+  pnt = (caddr_t) cluster->list;
+  
+  while (length)
+    key = key * 31 + (u_char) pnt[--length];
+
+  return key;
+}
+
+static unsigned int
+cluster_hash_key (struct cluster_list *cluster)
+{
+  return cluster->key;
+}
+
 struct cluster_list *
 cluster_parse (caddr_t pnt, int length)
 {
@@ -75,6 +97,7 @@ cluster_parse (caddr_t pnt, int length)
 
   tmp.length = length;
   tmp.list = (struct in_addr *) pnt;
+  tmp.key = cluster_hash_key_make (&tmp);
 
   find = hash_search (cluster_hash, &tmp);
   if (find)
@@ -85,6 +108,7 @@ cluster_parse (caddr_t pnt, int length)
 
   cluster = XMALLOC (MTYPE_CLUSTER, sizeof (struct cluster_list));
   cluster->length = length;
+  cluster->key = tmp.key;
 
   if (cluster->length)
     {
@@ -112,22 +136,6 @@ cluster_loop_check (struct cluster_list *cluster, struct in_addr originator)
   return 0;
 }
 
-unsigned int
-cluster_hash_key_make (struct cluster_list *cluster)
-{
-  unsigned int key = 0;
-  int length;
-  caddr_t pnt;
-
-  length = cluster->length;
-  pnt = (caddr_t) cluster->list;
-  
-  while (length)
-    key += pnt[--length];
-
-  return key %= HASHTABSIZE;
-}
-
 int
 cluster_hash_cmp (struct cluster_list *cluster1, struct cluster_list *cluster2)
 {
@@ -170,6 +178,7 @@ cluster_intern (struct cluster_list *cluster)
 {
   struct cluster_list *find;
 
+  cluster->key = cluster_hash_key_make (cluster);
   find = hash_search (cluster_hash, cluster);
   if (find)
     {
@@ -203,7 +212,7 @@ void
 cluster_init ()
 {
   cluster_hash = hash_new (HASHTABSIZE);
-  cluster_hash->hash_key = cluster_hash_key_make;
+  cluster_hash->hash_key = cluster_hash_key;
   cluster_hash->hash_cmp = cluster_hash_cmp;
 }
 
@@ -211,42 +220,55 @@ cluster_init ()
 
 struct Hash *attrhash;
 
+/* One attribute per distinct path, so as big as the aspath hash. */
+#define ATTR_HASH_SIZE 4096
+
+#define ATTR_KEY_MIX(K,V)  ((K) = (K) * 31 + (V))
+
+/* The aspath, community and cluster list are interned by the time
+   this is called, so their keys are already made. */
 unsigned int
 attrhash_key_make (struct attr *attr)
 {
   unsigned int key = 0;
 
-  key += attr->origin;
-  key += attr->nexthop.s_addr;
-  key += attr->med;
-  key += attr->local_pref;
-  key += attr->aggregator_as;
-  key += attr->aggregator_addr.s_addr;
-  key += attr->dpa;
-  key += attr->weight;
+  ATTR_KEY_MIX (key, attr->origin);
+  ATTR_KEY_MIX (key, attr->nexthop.s_addr);
+  ATTR_KEY_MIX (key, attr->med);
+  ATTR_KEY_MIX (key, attr->local_pref);
+  ATTR_KEY_MIX (key, attr->aggregator_as);
+  ATTR_KEY_MIX (key, attr->aggregator_addr.s_addr);
+  ATTR_KEY_MIX (key, attr->dpa);
+  ATTR_KEY_MIX (key, attr->weight);
 
 #ifdef HAVE_IPV6
   {
     int i;
 
-    key += attr->mp_nexthop_len;
+    ATTR_KEY_MIX (key, attr->mp_nexthop_len);
     for (i = 0; i < 16; i++)
-      key += attr->mp_nexthop_global.s6_addr[i];
+      ATTR_KEY_MIX (key, attr->mp_nexthop_global.s6_addr[i]);
     for (i = 0; i < 16; i++)
-      key += attr->mp_nexthop_local.s6_addr[i];
+      ATTR_KEY_MIX (key, attr->mp_nexthop_local.s6_addr[i]);
   }
 #endif /* HAVE_IPV6 */
 
   if (attr->aspath)
-    key += aspath_key_make (attr->aspath);
+    ATTR_KEY_MIX (key, attr->aspath->key);
   if (attr->community)
-    key += community_hash_make (attr->community);
+    ATTR_KEY_MIX (key, attr->community->key);
   if (attr->ecommunity)
-    key += ecommunity_hash_make (attr->ecommunity);
+    ATTR_KEY_MIX (key, ecommunity_hash_make (attr->ecommunity));
   if (attr->cluster)
-    key += cluster_hash_key_make (attr->cluster);
+    ATTR_KEY_MIX (key, attr->cluster->key);
 
-  return key %= HASHTABSIZE;
+  return key;
+}
+
+static unsigned int
+attrhash_key (struct attr *attr)
+{
+  return attr->key;
 }
 
 int
@@ -276,8 +298,8 @@ attrhash_cmp (struct attr *attr1, struct attr *attr2)
 void
 attrhash_init ()
 {
-  attrhash = hash_new (HASHTABSIZE);
-  attrhash->hash_key = attrhash_key_make;
+  attrhash = hash_new (ATTR_HASH_SIZE);
+  attrhash->hash_key = attrhash_key;
   attrhash->hash_cmp = attrhash_cmp;
 }
 
@@ -318,6 +340,7 @@ bgp_attr_intern (struct attr *attr)
 	attr->cluster->refcnt++;
     }
 
+  attr->key = attrhash_key_make (attr);
   find = (struct attr *) hash_search (attrhash, attr);
   if (find)
     {
@@ -424,6 +447,45 @@ bgp_attr_flush (struct attr *attr)
     cluster_free (attr->cluster);
 }
 
+/* Memory used by interned attributes and cluster lists, for `show
+   ip bgp memory'. */
+void
+bgp_attr_memory_vty (struct vty *vty)
+{
+  int i;
+  HashBacket *mp;
+  struct cluster_list *cluster;
+  unsigned long count;
+  unsigned long refcnt;
+  unsigned long bytes;
+
+  count = refcnt = 0;
+  for (i = 0; i < attrhash->size; i++)
+    for (mp = hash_head (attrhash, i); mp; mp = mp->next)
+      {
+	count++;
+	refcnt += ((struct attr *) mp->data)->refcnt;
+      }
+  bytes = count * (sizeof (HashBacket) + sizeof (struct attr))
+    + attrhash->size * sizeof (HashBacket *);
+  vty_out (vty, "%-16s %8ld %8ld %10ld%s", "Attribute",
+	   count, refcnt, bytes, VTY_NEWLINE);
+
+  count = refcnt = bytes = 0;
+  for (i = 0; i < cluster_hash->size; i++)
+    for (mp = hash_head (cluster_hash, i); mp; mp = mp->next)
+      {
+	cluster = mp->data;
+	count++;
+	refcnt += cluster->refcnt;
+	bytes += sizeof (HashBacket) + sizeof (struct cluster_list)
+	  + cluster->length;
+      }
+  bytes += cluster_hash->size * sizeof (HashBacket *);
+  vty_out (vty, "%-16s %8ld %8ld %10ld%s", "Cluster list",
+	   count, refcnt, bytes, VTY_NEWLINE);
+}
+
 /* Get origin attribute of the update message. */
 int
 bgp_attr_origin (struct peer *peer, bgp_size_t length, 
@@ -41,6 +41,9 @@ struct cluster_list
   unsigned long refcnt;
   int length;
   struct in_addr *list;
+
+  /* Hash key of list, set when the cluster list is interned. */
+  unsigned int key;
 };
 
 struct attr
@@ -82,6 +85,10 @@ struct attr
 
   /* Invalid. */
   u_char invalid;
+
+  /* Hash key, made from the interned parts above by
+     bgp_attr_intern (). */
+  unsigned int key;
 };
 
 #define ATTR_FLAG_BIT(X)  (1 << ((X) - 1))
@@ -95,6 +102,8 @@ int bgp_attr_check (struct peer *, struct attr *);
 struct attr *bgp_attr_intern (struct attr *attr);
 void bgp_attr_unintern (struct attr *);
 void bgp_attr_flush (struct attr *);
+struct vty;
+void bgp_attr_memory_vty (struct vty *);
 
 struct attr *bgp_attr_default_set (struct attr *attr, u_char);
 struct attr *bgp_attr_default_intern (u_char);
@@ -34,6 +34,17 @@
 /* Hash of community attribute. */
 struct Hash *comhash;
 
+/* String form of an uninterned community goes stale when it is
+   changed. */
+#define community_str_clear(C) \
+  do { \
+    if ((C)->str) \
+      { \
+	XFREE (MTYPE_COMMUNITY_STR, (C)->str); \
+	(C)->str = NULL; \
+      } \
+  } while (0)
+
 /* Create new community attribute. */
 struct community *
 community_parse (char *pnt, u_short length)
@@ -49,6 +60,7 @@ community_parse (char *pnt, u_short length)
   /* Make temporary community for hash look up. */
   tmp.size = length / 4;
   tmp.val = (u_int32_t *) pnt;
+  tmp.key = community_hash_make (&tmp);
 
   /* Looking up hash of community attribute. */
   find = (struct community *) hash_search (comhash, &tmp);
@@ -66,6 +78,8 @@ community_parse (char *pnt, u_short length)
   new->size = length / 4;
   new->val = (u_int32_t *) XMALLOC (MTYPE_COMMUNITY_VAL, length);
   memcpy (new->val, pnt, length);
+  new->key = tmp.key;
+  new->str = NULL;
 
   hash_push (comhash, new);
 
@@ -87,6 +101,8 @@ community_free (struct community *com)
 {
   if (com->val)
     XFREE (MTYPE_COMMUNITY_VAL, com->val);
+  if (com->str)
+    XFREE (MTYPE_COMMUNITY_STR, com->str);
   XFREE (MTYPE_COMMUNITY, com);
 }
 
@@ -117,6 +133,7 @@ community_intern (struct community *com)
   assert (com->refcnt == 0);
 
   /* Lookup community hash. */
+  com->key = community_hash_make (com);
   find = (struct community *) hash_search (comhash, com);
   if (find)
     {
@@ -150,18 +167,21 @@ community_unintern (struct community *com)
     }
 }
 
-/* Pretty printing of community.  For debug and logging purpose. */
-const char *
-community_print (struct community *com)
+/* Make string form of community. */
+static char *
+community_str_make (struct community *com)
 {
-  /* XXX non-re-entrant warning */
-  static char buf[BUFSIZ];
   int i;
+  char *buf;
+  char *pnt;
   u_int32_t comval;
   u_int16_t as;
   u_int16_t val;
 
-  bzero(buf, BUFSIZ);
+  /* " no-advertise" is the longest value. */
+  buf = XMALLOC (MTYPE_COMMUNITY_STR, com->size * 13 + 1);
+  pnt = buf;
+  *pnt = '\0';
 
   for (i = 0; i < com->size; i++) 
     {
@@ -169,27 +189,36 @@ community_print (struct community *com)
       switch (comval) 
 	{
 	case COMMUNITY_NO_EXPORT:
-	  strlcat (buf, " no-export", BUFSIZ);
+	  strcpy (pnt, " no-export");
 	  break;
 	case COMMUNITY_NO_ADVERTISE:
-	  strlcat (buf, " no-advertise", BUFSIZ);
+	  strcpy (pnt, " no-advertise");
 	  break;
 	case COMMUNITY_LOCAL_AS:
-	  strlcat (buf, " local-AS", BUFSIZ);
+	  strcpy (pnt, " local-AS");
 	  break;
 	default:
 	  as = (comval >> 16) & 0xFFFF;
 	  val = comval & 0xFFFF;
-	  snprintf (buf + strlen (buf), BUFSIZ - strlen (buf), 
-		    " %d:%d", as, val);
+	  sprintf (pnt, " %d:%d", as, val);
 	  break;
 	}
+      pnt += strlen (pnt);
     }
   return buf;
 }
 
-/* Make hash value of community attribute. This function is used by
-   hash package.*/
+/* Pretty printing of community.  The string is kept with the
+   community, so it is made only once however often it is shown. */
+const char *
+community_print (struct community *com)
+{
+  if (! com->str)
+    com->str = community_str_make (com);
+  return com->str;
+}
+
+/* Make hash value of community attribute. */
 unsigned int
 community_hash_make (struct community *com)
 {
@@ -201,9 +230,17 @@ community_hash_make (struct community *com)
   pnt = (unsigned char *)com->val;
   
   for(c = 0; c < com->size * 4; c++)
-    key += pnt[c];
+    key = key * 31 + pnt[c];
       
-  return key %= HASHTABSIZE;
+  return key;
+}
+
+/* Hash function for comhash, the key was made when the community
+   went in. */
+static unsigned int
+community_hash_key (struct community *com)
+{
+  return com->key;
 }
 
 int
@@ -254,6 +291,7 @@ community_merge (struct community *com1, struct community *com2)
 
   memcpy (com1->val + com1->size, com2->val, com2->size * 4);
   com1->size += com2->size;
+  community_str_clear (com1);
 
   return com1;
 }
@@ -263,7 +301,7 @@ void
 community_init ()
 {
   comhash = hash_new (HASHTABSIZE);
-  comhash->hash_key = community_hash_make;
+  comhash->hash_key = community_hash_key;
   comhash->hash_cmp = community_cmp;
 }
 
@@ -273,32 +311,7 @@ community_init ()
 void
 community_print_vty (struct vty *vty, struct community *com)
 {
-  int i;
-  u_int32_t comval;
-  u_int16_t as;
-  u_int16_t val;
-
-  for (i = 0; i < com->size; i++) 
-    {
-      comval = ntohl (com_nthval (com, i));
-      switch (comval) 
-	{
-	case COMMUNITY_NO_EXPORT:
-	  vty_out (vty, " no-export");
-	  break;
-	case COMMUNITY_NO_ADVERTISE:
-	  vty_out (vty, " no-advertise");
-	  break;
-	case COMMUNITY_LOCAL_AS:
-	  vty_out (vty, " local-AS");
-	  break;
-	default:
-	  as = (comval >> 16) & 0xFFFF ;
-	  val = comval & 0xFFFF;
-	  vty_out (vty, " %d:%d", as, val);
-	  break;
-	}
-    }
+  vty_out (vty, "%s", community_print (com));
 }
 
 /* For `show ip bgp community' command. */
@@ -308,7 +321,7 @@ community_print_all_vty (struct vty *vty)
   int i;
   HashBacket *mp;
 
-  for (i = 0; i < HASHTABSIZE; i++)
+  for (i = 0; i < comhash->size; i++)
     if ((mp = (HashBacket *) hash_head (comhash, i)) != NULL)
       while (mp) 
 	{
@@ -323,6 +336,34 @@ community_print_all_vty (struct vty *vty)
 	}
 }
 
+/* Memory used by interned communities, for `show ip bgp memory'. */
+void
+community_memory_vty (struct vty *vty)
+{
+  int i;
+  HashBacket *mp;
+  struct community *com;
+  unsigned long count = 0;
+  unsigned long refcnt = 0;
+  unsigned long bytes = 0;
+
+  for (i = 0; i < comhash->size; i++)
+    for (mp = hash_head (comhash, i); mp; mp = mp->next)
+      {
+	com = mp->data;
+	count++;
+	refcnt += com->refcnt;
+	bytes += sizeof (HashBacket) + sizeof (struct community)
+	  + com_length (com);
+	if (com->str)
+	  bytes += strlen (com->str) + 1;
+      }
+  bytes += comhash->size * sizeof (HashBacket *);
+
+  vty_out (vty, "%-16s %8ld %8ld %10ld%s", "Community",
+	   count, refcnt, bytes, VTY_NEWLINE);
+}
+
 /* Community token enum. */
 enum community_token
 {
@@ -419,6 +460,7 @@ community_gettoken (char *buf, enum community_token *token, u_int32_t *val)
 void
 community_add_val (struct community *com, u_int32_t val)
 {
+  community_str_clear (com);
   com->size++;
   if (com->val)
     com->val = XREALLOC (MTYPE_COMMUNITY_VAL, com->val, com_length (com));
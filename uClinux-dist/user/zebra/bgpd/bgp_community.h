@@ -29,6 +29,12 @@ struct community
   unsigned long refcnt;
   int size;
   u_int32_t *val;
+
+  /* Hash key of val, set when the community is interned. */
+  unsigned int key;
+
+  /* String form, made on first use by community_print (). */
+  char *str;
 };
 
 /* Community pre-defined values definition. */
@@ -51,6 +57,7 @@ void community_unintern (struct community *);
 const char *community_print (struct community *);
 void community_print_vty (struct vty *, struct community *);
 void community_print_all_vty (struct vty *);
+void community_memory_vty (struct vty *);
 unsigned int community_hash_make (struct community *);
 struct community *community_str2com (char *);
 int community_match (struct community *, struct community *);
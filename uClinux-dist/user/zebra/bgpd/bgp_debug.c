@@ -461,6 +461,29 @@ DEFUN (no_debug_bgp_events,
   return CMD_SUCCESS;
 }
 
+DEFUN (debug_bgp_update,
+       debug_bgp_update_cmd,
+       "debug bgp updates",
+       DEBUG_STR
+       BGP_STR
+       "BGP updates\n")
+{
+  DEBUG_ON (update, UPDATE);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_debug_bgp_update,
+       no_debug_bgp_update_cmd,
+       "no debug bgp updates",
+       NO_STR
+       DEBUG_STR
+       BGP_STR
+       "BGP updates\n")
+{
+  DEBUG_OFF (update, UPDATE);
+  return CMD_SUCCESS;
+}
+
 DEFUN (show_debugging_bgp,
        show_debugging_bgp_cmd,
        "show debugging bgp",
@@ -474,6 +497,8 @@ DEFUN (show_debugging_bgp,
     vty_out (vty, "  BGP events debugging is on%s", VTY_NEWLINE);
   if (BGP_DEBUG (fsm, FSM))
     vty_out (vty, "  BGP fsm debugging is on%s", VTY_NEWLINE);
+  if (BGP_DEBUG (update, UPDATE))
+    vty_out (vty, "  BGP updates debugging is on%s", VTY_NEWLINE);
   return CMD_SUCCESS;
 }
 
@@ -486,9 +511,13 @@ bgp_debug_init ()
   install_element (CONFIG_NODE, &debug_bgp_fsm_cmd);
   install_element (ENABLE_NODE, &debug_bgp_events_cmd);
   install_element (CONFIG_NODE, &debug_bgp_events_cmd);
+  install_element (ENABLE_NODE, &debug_bgp_update_cmd);
+  install_element (CONFIG_NODE, &debug_bgp_update_cmd);
 
   install_element (ENABLE_NODE, &no_debug_bgp_fsm_cmd);
   install_element (CONFIG_NODE, &no_debug_bgp_fsm_cmd);
   install_element (ENABLE_NODE, &no_debug_bgp_events_cmd);
   install_element (CONFIG_NODE, &no_debug_bgp_events_cmd);
+  install_element (ENABLE_NODE, &no_debug_bgp_update_cmd);
+  install_element (CONFIG_NODE, &no_debug_bgp_update_cmd);
 }
@@ -62,10 +62,12 @@ int debug (unsigned int option);
 unsigned long bgp_debug_fsm;
 unsigned long bgp_debug_events;
 unsigned long bgp_debug_packet;
+unsigned long bgp_debug_update;
 
 #define BGP_DEBUG_FSM                 0x01
 #define BGP_DEBUG_EVENTS              0x01
 #define BGP_DEBUG_PACKET              0x01
+#define BGP_DEBUG_UPDATE              0x01
 
 #define BGP_DEBUG_PACKET_SEND         0x01
 #define BGP_DEBUG_PACKET_SEND_DETAIL  0x02
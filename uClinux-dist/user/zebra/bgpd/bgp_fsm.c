@@ -298,6 +298,7 @@ bgp_stop (struct peer *peer)
 
   /* Clear output buffer. */
   stream_fifo_free (peer->obuf);
+  bgp_update_queue_free (peer);
 
   /* Close of file descriptor. */
   if (peer->fd >= 0)
@@ -233,6 +233,7 @@ main (int argc, char **argv)
   cmd_init ();
   vty_init ();
   memory_init ();
+  thread_init ();
   bgp_init ();
   bgp_mplsvpn_init ();
   sort_node ();
@@ -30,6 +30,8 @@
 #include "memory.h"
 #include "sockunion.h"		/* for inet_ntop () */
 #include "newlist.h"
+#include "hash.h"
+#include "table.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_dump.h"
@@ -121,6 +123,284 @@ bgp_packet_dup (struct stream *s)
   return new;
 }
 
+/* IPv4 unicast routes are not made into an UPDATE each as they are
+   announced.  They are queued on the peer, grouped by their encoded
+   attributes, and packed when the peer is next writable: every prefix
+   of a group goes in as few UPDATEs as BGP_MAX_PACKET_SIZE allows, and
+   withdrawn prefixes likewise.  A table dump to a new peer is then a
+   few hundred packets instead of one per route. */
+
+/* Prefixes which share one set of attributes.  attr is NULL for
+   withdrawn prefixes. */
+struct bgp_update_group
+{
+  struct bgp_update_group *next;
+
+  /* Hash key of attr. */
+  unsigned int key;
+
+  /* Encoded path attributes. */
+  u_char *attr;
+  bgp_size_t attr_len;
+
+  /* Encoded NLRI, one (length, prefix) after another. */
+  u_char *nlri;
+  int nlri_len;
+  int nlri_size;
+};
+
+struct bgp_update_queue
+{
+  /* Groups in the order they were made. */
+  struct bgp_update_group *head;
+  struct bgp_update_group *tail;
+
+  /* Groups by attributes. */
+  struct Hash *hash;
+
+  /* Queued prefixes, info is the group. */
+  struct route_table *prefix;
+
+  /* Either withdrawals or updates are queued, never both, so the
+     neighbor sees them in the order they were made. */
+  int withdraw;
+};
+
+#define BGP_UPDATE_HASH_SIZE  256
+
+/* Attributes are encoded here before they are looked up. */
+static struct stream *bgp_update_attr;
+
+static unsigned int
+bgp_update_group_key_make (u_char *attr, bgp_size_t attr_len)
+{
+  unsigned int key = 0;
+  bgp_size_t i;
+
+  for (i = 0; i < attr_len; i++)
+    key = key * 31 + attr[i];
+  return key;
+}
+
+static unsigned int
+bgp_update_group_key (struct bgp_update_group *group)
+{
+  return group->key;
+}
+
+static int
+bgp_update_group_cmp (struct bgp_update_group *g1,
+		      struct bgp_update_group *g2)
+{
+  if (g1->key == g2->key
+      && g1->attr_len == g2->attr_len
+      && memcmp (g1->attr, g2->attr, g1->attr_len) == 0)
+    return 1;
+  return 0;
+}
+
+static struct bgp_update_queue *
+bgp_update_queue_new ()
+{
+  struct bgp_update_queue *queue;
+
+  queue = XMALLOC (MTYPE_BGP_UPDATE_GROUP, sizeof (struct bgp_update_queue));
+  bzero (queue, sizeof (struct bgp_update_queue));
+
+  queue->hash = hash_new (BGP_UPDATE_HASH_SIZE);
+  queue->hash->hash_key = bgp_update_group_key;
+  queue->hash->hash_cmp = bgp_update_group_cmp;
+
+  queue->prefix = route_table_init ();
+
+  return queue;
+}
+
+/* Free the queued groups. */
+static void
+bgp_update_queue_clean (struct bgp_update_queue *queue)
+{
+  struct bgp_update_group *group;
+  struct bgp_update_group *next;
+
+  for (group = queue->head; group; group = next)
+    {
+      next = group->next;
+      if (group->attr)
+	XFREE (MTYPE_BGP_UPDATE_DATA, group->attr);
+      if (group->nlri)
+	XFREE (MTYPE_BGP_UPDATE_DATA, group->nlri);
+      XFREE (MTYPE_BGP_UPDATE_GROUP, group);
+    }
+  queue->head = queue->tail = NULL;
+
+  hash_clean (queue->hash, NULL);
+  queue->hash->alloc = 0;
+}
+
+/* Discard whatever is queued, when the session goes down. */
+void
+bgp_update_queue_free (struct peer *peer)
+{
+  struct bgp_update_queue *queue;
+
+  queue = peer->update_queue;
+  if (! queue)
+    return;
+
+  bgp_update_queue_clean (queue);
+  hash_free (queue->hash);
+  route_table_finish (queue->prefix);
+  XFREE (MTYPE_BGP_UPDATE_GROUP, queue);
+
+  peer->update_queue = NULL;
+}
+
+/* Make the UPDATEs for one group and put them on the peer's output
+   buffer.  Prefixes are never split across packets. */
+static void
+bgp_update_group_packet (struct peer *peer, struct bgp_update_group *group)
+{
+  struct stream *s;
+  int room;
+  int start;
+  int end;
+  int len;
+
+  /* Room for NLRI (or withdrawn routes) beside the header, the two
+     length fields and the attributes. */
+  room = BGP_MAX_PACKET_SIZE - BGP_MSG_UPDATE_MIN_SIZE - group->attr_len;
+
+  for (start = 0; start < group->nlri_len; start = end)
+    {
+      end = start;
+      do
+	end += PSIZE (group->nlri[end]) + 1;
+      while (end < group->nlri_len
+	     && end - start + PSIZE (group->nlri[end]) + 1 <= room);
+      len = end - start;
+
+      s = stream_new (BGP_MSG_UPDATE_MIN_SIZE + group->attr_len + len);
+      bgp_packet_set_marker (s, BGP_MSG_UPDATE);
+
+      if (group->attr)
+	{
+	  stream_putw (s, 0);
+	  stream_putw (s, group->attr_len);
+	  stream_put (s, group->attr, group->attr_len);
+	  stream_put (s, group->nlri + start, len);
+	}
+      else
+	{
+	  stream_putw (s, len);
+	  stream_put (s, group->nlri + start, len);
+	  stream_putw (s, 0);
+	}
+      bgp_packet_set_size (s, 0);
+
+#ifdef DEBUG
+      bgp_packet_dump (s);
+#endif /* DEBUG */
+
+      bgp_packet_add (peer, s);
+    }
+}
+
+/* Pack everything queued into obuf. */
+static void
+bgp_update_flush (struct peer *peer)
+{
+  struct bgp_update_queue *queue;
+  struct bgp_update_group *group;
+
+  queue = peer->update_queue;
+  if (! queue || ! queue->head)
+    return;
+
+  for (group = queue->head; group; group = group->next)
+    bgp_update_group_packet (peer, group);
+
+  bgp_update_queue_clean (queue);
+  route_table_finish (queue->prefix);
+  queue->prefix = route_table_init ();
+}
+
+/* Queue prefix p with the encoded attributes attr, or as withdrawn
+   when attr is NULL. */
+static void
+bgp_update_queue_add (struct peer *peer, struct prefix *p,
+		      u_char *attr, bgp_size_t attr_len)
+{
+  struct bgp_update_queue *queue;
+  struct bgp_update_group *group;
+  struct bgp_update_group tmp;
+  struct route_node *rn;
+  int withdraw;
+  int size;
+
+  if (! peer->update_queue)
+    peer->update_queue = bgp_update_queue_new ();
+  queue = peer->update_queue;
+
+  /* Updates and withdrawals don't mix. */
+  withdraw = (attr == NULL);
+  if (queue->head && queue->withdraw != withdraw)
+    bgp_update_flush (peer);
+  queue->withdraw = withdraw;
+
+  tmp.key = bgp_update_group_key_make (attr, attr_len);
+  tmp.attr = attr;
+  tmp.attr_len = attr_len;
+  group = hash_search (queue->hash, &tmp);
+
+  /* The same prefix queued again.  If it is in another group the
+     earlier one has to go out first. */
+  rn = route_node_get (queue->prefix, p);
+  if (rn->info)
+    {
+      route_unlock_node (rn);
+      if (rn->info == group)
+	return;
+
+      bgp_update_flush (peer);
+      group = NULL;
+      rn = route_node_get (queue->prefix, p);
+    }
+
+  if (! group)
+    {
+      group = XMALLOC (MTYPE_BGP_UPDATE_GROUP,
+		       sizeof (struct bgp_update_group));
+      bzero (group, sizeof (struct bgp_update_group));
+      group->key = tmp.key;
+      if (attr)
+	{
+	  group->attr = XMALLOC (MTYPE_BGP_UPDATE_DATA, attr_len);
+	  memcpy (group->attr, attr, attr_len);
+	  group->attr_len = attr_len;
+	}
+
+      if (queue->tail)
+	queue->tail->next = group;
+      else
+	queue->head = group;
+      queue->tail = group;
+      hash_push (queue->hash, group);
+    }
+  rn->info = group;
+
+  size = PSIZE (p->prefixlen) + 1;
+  if (group->nlri_len + size > group->nlri_size)
+    {
+      group->nlri_size = group->nlri_size ? group->nlri_size * 2 : 64;
+      group->nlri = XREALLOC (MTYPE_BGP_UPDATE_DATA, group->nlri,
+			      group->nlri_size);
+    }
+  group->nlri[group->nlri_len++] = p->prefixlen;
+  memcpy (group->nlri + group->nlri_len, &p->u.prefix, size - 1);
+  group->nlri_len += size - 1;
+}
+
 /* Check file descriptor whether connect is established. */
 static void
 bgp_connect_check (struct peer *peer)
@@ -159,13 +439,19 @@ bgp_connect_check (struct peer *peer)
     }
 }
 
-/* Write packet to the peer. */
+/* Most packets handed to one writev (). */
+#define BGP_WRITE_IOV_MAX  16
+
+/* Write packets to the peer. */
 int
 bgp_write (struct thread *thread)
 {
   struct peer *peer;
   u_char type;
   struct stream *s; 
+  struct iovec iov[BGP_WRITE_IOV_MAX];
+  int iovcnt;
+  int len;
   int ret;
 
   /* Yes first of all get peer pointer. */
@@ -181,14 +467,34 @@ bgp_write (struct thread *thread)
       return 0;
     }
 
-  /* There should be at least one packet. */
-  s = stream_fifo_head (peer->obuf);
-  if (!s)
+  /* Pack the routes queued since last time. */
+  bgp_update_flush (peer);
+
+  /* Gather the head of the output buffer.  getp of each packet is how
+     much of it has been written already. */
+  iovcnt = 0;
+  for (s = stream_fifo_head (peer->obuf); s && iovcnt < BGP_WRITE_IOV_MAX;
+       s = s->next)
+    {
+      assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
+      iov[iovcnt].iov_base = STREAM_DATA (s) + stream_get_getp (s);
+      iov[iovcnt].iov_len = stream_get_endp (s) - stream_get_getp (s);
+      iovcnt++;
+
+      /* Nothing goes after a NOTIFICATION. */
+      if (STREAM_DATA (s)[BGP_MARKER_SIZE + 2] == BGP_MSG_NOTIFY)
+	break;
+    }
+  if (iovcnt == 0)
     return 0;
-  assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
 
   /* peer->fd is writable. */
-  ret = writen (peer->fd, STREAM_DATA (s), stream_get_endp (s));
+  ret = writev (peer->fd, iov, iovcnt);
+  if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return 0;
+    }
   if (ret <= 0)
     {
       bgp_stop (peer);
@@ -197,40 +503,53 @@ bgp_write (struct thread *thread)
       return 0;
     }
 
-  /* Retrieve BGP packet type. */
-  stream_set_getp (s, BGP_MARKER_SIZE + 2);
-  type = stream_getc (s);
-
-  switch (type)
+  /* Count and delete the packets which went out.  One written only in
+     part stays at the head for next time. */
+  while (ret > 0)
     {
-    case BGP_MSG_OPEN:
-      peer->open_out++;
-      break;
-    case BGP_MSG_UPDATE:
-      peer->update_out++;
-      break;
-    case BGP_MSG_NOTIFY:
-      peer->notify_out++;
-      /* Double start timer. */
-      peer->v_start *= 2;
+      s = stream_fifo_head (peer->obuf);
+      len = stream_get_endp (s) - stream_get_getp (s);
+      if (ret < len)
+	{
+	  stream_forward (s, ret);
+	  break;
+	}
+      ret -= len;
 
-      /* Overflow check. */
-      if (peer->v_start >= (60 * 2))
-	peer->v_start = (60 * 2);
+      /* Retrieve BGP packet type. */
+      type = STREAM_DATA (s)[BGP_MARKER_SIZE + 2];
 
-      /* BGP_EVENT_ADD (peer, BGP_Stop); */
-      bgp_stop (peer);
-      peer->status = Idle;
-      bgp_timer_set (peer);
-      return 0;
-      break;
-    case BGP_MSG_KEEPALIVE:
-      peer->keepalive_out++;
-      break;
-    }
+      switch (type)
+	{
+	case BGP_MSG_OPEN:
+	  peer->open_out++;
+	  break;
+	case BGP_MSG_UPDATE:
+	  peer->update_out++;
+	  break;
+	case BGP_MSG_NOTIFY:
+	  peer->notify_out++;
+	  /* Double start timer. */
+	  peer->v_start *= 2;
+
+	  /* Overflow check. */
+	  if (peer->v_start >= (60 * 2))
+	    peer->v_start = (60 * 2);
+
+	  /* BGP_EVENT_ADD (peer, BGP_Stop); */
+	  bgp_stop (peer);
+	  peer->status = Idle;
+	  bgp_timer_set (peer);
+	  return 0;
+	  break;
+	case BGP_MSG_KEEPALIVE:
+	  peer->keepalive_out++;
+	  break;
+	}
 
-  /* OK we send packet so delete it. */
-  bgp_packet_delete (peer);
+      /* OK we send packet so delete it. */
+      bgp_packet_delete (peer);
+    }
   
   /* If there is a packet still need bgp write thread. */
   if (stream_fifo_head (peer->obuf))
@@ -239,7 +558,9 @@ bgp_write (struct thread *thread)
   return 0;
 }
 
-/* This is only for sending NOTIFICATION message to neighbor. */
+/* This is only for sending NOTIFICATION message to neighbor.  A
+   packet ahead of it that bgp_write () has already started on is
+   finished first. */
 int
 bgp_write_notify (struct peer *peer)
 {
@@ -248,26 +569,42 @@ bgp_write_notify (struct peer *peer)
   struct stream *s; 
 
   /* There should be at least one packet. */
-  s = stream_fifo_head (peer->obuf);
-  if (!s)
-    return 0;
-  assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
-
-  /* I'm not sure fd is writable. */
-  ret = writen (peer->fd, STREAM_DATA (s), stream_get_endp (s));
-  if (ret <= 0)
+  while ((s = stream_fifo_head (peer->obuf)) != NULL)
     {
-      bgp_stop (peer);
-      peer->status = Idle;
-      bgp_timer_set (peer);
-      return 0;
-    }
+      assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
+
+      /* I'm not sure fd is writable. */
+      ret = writen (peer->fd, STREAM_DATA (s) + stream_get_getp (s),
+		    stream_get_endp (s) - stream_get_getp (s));
+      if (ret <= 0)
+	{
+	  bgp_stop (peer);
+	  peer->status = Idle;
+	  bgp_timer_set (peer);
+	  return 0;
+	}
 
-  /* Retrieve BGP packet type. */
-  stream_set_getp (s, BGP_MARKER_SIZE + 2);
-  type = stream_getc (s);
+      /* Retrieve BGP packet type. */
+      type = STREAM_DATA (s)[BGP_MARKER_SIZE + 2];
+      if (type == BGP_MSG_NOTIFY)
+	break;
 
-  assert (type == BGP_MSG_NOTIFY);
+      switch (type)
+	{
+	case BGP_MSG_OPEN:
+	  peer->open_out++;
+	  break;
+	case BGP_MSG_UPDATE:
+	  peer->update_out++;
+	  break;
+	case BGP_MSG_KEEPALIVE:
+	  peer->keepalive_out++;
+	  break;
+	}
+      bgp_packet_delete (peer);
+    }
+  if (!s)
+    return 0;
 
   /* Type should be notify. */
   peer->notify_out++;
@@ -346,6 +683,7 @@ bgp_notify_send_with_data (struct peer *peer, u_char code, u_char sub_code,
 			   u_char *data, size_t datalen)
 {
   struct stream *s;
+  struct stream *head;
 
   /* Allocate new stream. */
   s = stream_new (BGP_MAX_PACKET_SIZE);
@@ -364,8 +702,22 @@ bgp_notify_send_with_data (struct peer *peer, u_char code, u_char sub_code,
   /* Set BGP packet length. */
   bgp_packet_set_size (s, 0);
 
-  /* Add packet to the peer. */
+  /* Drop the packets not yet started.  One already partly written
+     must still go out whole, or the peer would read the NOTIFICATION
+     as the rest of it. */
+  head = stream_fifo_head (peer->obuf);
+  if (head && stream_get_getp (head) > 0)
+    {
+      stream_fifo_pop (peer->obuf);
+      head->next = NULL;
+    }
+  else
+    head = NULL;
   stream_fifo_free (peer->obuf);
+  if (head)
+    bgp_packet_add (peer, head);
+
+  /* Add packet to the peer. */
   bgp_packet_add (peer, s);
 
   /* For debug */
@@ -408,12 +760,32 @@ bgp_update_send (struct peer_conf *conf, struct peer *peer,
   return;
 #endif /* DISABLE_BGP_ANNOUNCE */
 
-  /* Make attribute dump string. */
-  bgp_dump_attr (peer, attr, attrstr, BUFSIZ);
+  if (BGP_DEBUG (update, UPDATE))
+    {
+      /* Make attribute dump string. */
+      bgp_dump_attr (peer, attr, attrstr, BUFSIZ);
 
-  zlog (peer->log, LOG_INFO, "%s [Update:SEND] %s/%d %s",
-	peer->host, inet_ntop(p->family, &(p->u.prefix), buf, BUFSIZ),
-	p->prefixlen, attrstr);
+      zlog (peer->log, LOG_INFO, "%s [Update:SEND] %s/%d %s",
+	    peer->host, inet_ntop(p->family, &(p->u.prefix), buf, BUFSIZ),
+	    p->prefixlen, attrstr);
+    }
+
+  /* IPv4 unicast is queued and packed with the routes which share
+     its attributes. */
+  if (p->family == AF_INET && safi == SAFI_UNICAST)
+    {
+      if (! bgp_update_attr)
+	bgp_update_attr = stream_new (BGP_MAX_PACKET_SIZE);
+      s = bgp_update_attr;
+      stream_reset (s);
+
+      total_attr_len = bgp_packet_attribute (conf, peer, s, attr, p, afi,
+					     safi, from, prd, tag);
+      bgp_update_queue_add (peer, p, STREAM_DATA (s), total_attr_len);
+
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return;
+    }
 
   s = stream_new (BGP_MAX_PACKET_SIZE);
 
@@ -431,10 +803,6 @@ bgp_update_send (struct peer_conf *conf, struct peer *peer,
   /* Set Total Path Attribute Length. */
   stream_putw_at (s, pos, total_attr_len);
 
-  /* NLRI set. */
-  if (p->family == AF_INET && safi == SAFI_UNICAST)
-    stream_put_prefix (s, p);
-
   /* Set size. */
   bgp_packet_set_size (s, 0);
 
@@ -460,8 +828,6 @@ bgp_withdraw_send (struct peer *peer, struct prefix *p, afi_t afi, safi_t safi,
   struct stream *s;
   struct stream *packet;
   unsigned long pos;
-  unsigned long cp;
-  bgp_size_t unfeasible_len;
   bgp_size_t total_attr_len;
   char buf[BUFSIZ];
 
@@ -472,28 +838,28 @@ bgp_withdraw_send (struct peer *peer, struct prefix *p, afi_t afi, safi_t safi,
   total_attr_len = 0;
   pos = 0;
 
-  zlog (peer->log, LOG_INFO, "%s [Withdraw:SEND] %s/%d",
-	peer->host, inet_ntop(p->family, &(p->u.prefix), buf, BUFSIZ),
-	p->prefixlen);
+  if (BGP_DEBUG (update, UPDATE))
+    zlog (peer->log, LOG_INFO, "%s [Withdraw:SEND] %s/%d",
+	  peer->host, inet_ntop(p->family, &(p->u.prefix), buf, BUFSIZ),
+	  p->prefixlen);
+
+  /* IPv4 unicast withdrawals are queued and packed too. */
+  if (p->family == AF_INET && safi == SAFI_UNICAST)
+    {
+      bgp_update_queue_add (peer, p, NULL, 0);
+
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return;
+    }
 
   s = stream_new (BGP_MAX_PACKET_SIZE);
 
   /* Make BGP update packet. */
   bgp_packet_set_marker (s, BGP_MSG_UPDATE);
 
-  /* Unfeasible Routes Length. */;
-  cp = stream_get_putp (s);
+  /* Unfeasible Routes Length. */
   stream_putw (s, 0);
 
-  /* Withdrawn Routes. */
-  if (p->family == AF_INET && safi == SAFI_UNICAST)
-    {
-      stream_put_prefix (s, p);
-
-      unfeasible_len = stream_get_putp (s) - cp - 2;
-      stream_putw_at (s, cp, unfeasible_len);
-    }
-
   /* Make attribute. */
 #ifdef HAVE_IPV6
   if((p->family == AF_INET6)
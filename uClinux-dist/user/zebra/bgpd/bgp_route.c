@@ -1135,10 +1135,14 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
 	}
 
       /* Logging. */
-      bgp_dump_attr (peer, new_attr, attrstr, BUFSIZ);
-      zlog (peer->log, LOG_INFO, "%s [Update:RECV] %s/%d %s",
-	    peer->host, inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-	    p->prefixlen, attrstr);
+      if (BGP_DEBUG (update, UPDATE))
+	{
+	  bgp_dump_attr (peer, new_attr, attrstr, BUFSIZ);
+	  zlog (peer->log, LOG_INFO, "%s [Update:RECV] %s/%d %s",
+		peer->host,
+		inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+		p->prefixlen, attrstr);
+	}
 
       /* Lookup node. */
       rn = bgp_route_node_get (bgp, afi, safi, p, prd);
@@ -1219,9 +1223,11 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
       bgp = conf->bgp;
 
       /* Logging. */
-      zlog (peer->log, LOG_INFO, "%s [Withdraw:RECV] %s/%d",
-	    peer->host, inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
-	    p->prefixlen);
+      if (BGP_DEBUG (update, UPDATE))
+	zlog (peer->log, LOG_INFO, "%s [Withdraw:RECV] %s/%d",
+	      peer->host,
+	      inet_ntop(p->family, &p->u.prefix, buf, SU_ADDRSTRLEN),
+	      p->prefixlen);
 
       /* Lookup node. */
       rn = bgp_route_node_get (bgp, afi, safi, p, prd);
@@ -2709,7 +2715,7 @@ route_vty_out (struct vty *vty, struct prefix *p, struct bgp_info *binfo)
       aspath_print_vty (vty, attr->aspath);
 
     /* Print origin */
-    if (strlen (attr->aspath->str) == 0)
+    if (strlen (aspath_print (attr->aspath)) == 0)
       vty_out (vty, "%s", bgp_origin_str[attr->origin]);
     else
       vty_out (vty, " %s", bgp_origin_str[attr->origin]);
@@ -2769,7 +2775,7 @@ route_vty_out_tmp (struct vty *vty, struct prefix *p, struct attr *attr)
       aspath_print_vty (vty, attr->aspath);
 
     /* Print origin */
-    if (strlen (attr->aspath->str) == 0)
+    if (strlen (aspath_print (attr->aspath)) == 0)
       vty_out (vty, "%s", bgp_origin_str[attr->origin]);
     else
       vty_out (vty, " %s", bgp_origin_str[attr->origin]);
@@ -2895,7 +2901,7 @@ route_vty_out_ipv6 (struct vty *vty, struct prefix *p, struct bgp_info *binfo)
     aspath_print_vty (vty, attr->aspath);
 
   /* Print origin */
-  if (strlen (attr->aspath->str) == 0)
+  if (strlen (aspath_print (attr->aspath)) == 0)
     vty_out (vty, "%s", bgp_origin_str[attr->origin]);
   else
     vty_out (vty, " %s", bgp_origin_str[attr->origin]);
@@ -2947,7 +2953,7 @@ route_vty_out_ipv6_tmp (struct vty *vty, struct prefix *p, struct attr *attr)
     aspath_print_vty (vty, attr->aspath);
 
   /* Print origin */
-  if (strlen (attr->aspath->str) == 0)
+  if (strlen (aspath_print (attr->aspath)) == 0)
     vty_out (vty, "%s", bgp_origin_str[attr->origin]);
   else
     vty_out (vty, " %s", bgp_origin_str[attr->origin]);
@@ -0,0 +1,545 @@
+/* BGP convergence benchmark.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Plays two EBGP neighbors of a running bgpd.  The first announces a
+   full-table sized set of routes, the second counts them as bgpd
+   passes them on, and the time until the last one arrives is
+   reported along with the number of UPDATEs and bytes it took.  Then
+   the same for withdrawing them all.  Both connect from loopback
+   addresses of their own, so bgpd needs something like
+
+     router bgp 65000
+      neighbor 127.0.0.2 remote-as 65001
+      neighbor 127.0.0.3 remote-as 65002
+
+   and is best started with "-p <port>" on an unprivileged port.  The
+   routes carry one of a few thousand AS paths each, about as many as
+   a real table has.
+
+   usage: bgpbench [-a bgpd-addr] [-p port] [-n prefixes] [-P paths] */
+
+#include <zebra.h>
+
+#define BGP_MARKER_SIZE		16
+#define BGP_HEADER_SIZE		19
+#define BGP_MAX_PACKET_SIZE   4096
+
+#define BGP_MSG_OPEN		1
+#define BGP_MSG_UPDATE		2
+#define BGP_MSG_NOTIFY		3
+#define BGP_MSG_KEEPALIVE	4
+
+struct bench_peer
+{
+  char *name;
+  int fd;
+  u_int16_t as;
+  struct in_addr addr;
+
+  /* Partly read packet. */
+  u_char buf[BGP_MAX_PACKET_SIZE];
+  int len;
+
+  /* Received. */
+  long update;
+  long bytes;
+  long nlri;
+  long withdrawn;
+};
+
+u_int32_t *prefixes;
+u_char *prefixlens;
+int nprefix;
+
+static void
+die (char *message)
+{
+  perror (message);
+  exit (1);
+}
+
+/* Made-up table: mostly /24, the rest /18 - /23.  The first octet
+   and the bits above the prefix length are made from the index, so
+   all are different. */
+static void
+make_prefixes (int count)
+{
+  int i;
+
+  prefixes = malloc (sizeof (u_int32_t) * count);
+  prefixlens = malloc (count);
+  srandom (1);
+
+  for (i = 0; i < count; i++)
+    {
+      if (random () % 100 < 60)
+	prefixlens[i] = 24;
+      else
+	prefixlens[i] = 18 + random () % 6;
+
+      prefixes[i] = ((u_int32_t) (1 + i % 223) << 24)
+	| ((i / 223) << (32 - prefixlens[i]));
+    }
+  nprefix = count;
+}
+
+static u_char *
+put_header (u_char *p, int type)
+{
+  memset (p, 0xff, BGP_MARKER_SIZE);
+  p[BGP_MARKER_SIZE + 2] = type;
+  return p + BGP_HEADER_SIZE;
+}
+
+static void
+set_size (u_char *packet, int size)
+{
+  packet[BGP_MARKER_SIZE] = size >> 8;
+  packet[BGP_MARKER_SIZE + 1] = size;
+}
+
+static void
+send_packet (struct bench_peer *peer, u_char *packet, int size)
+{
+  int nbytes;
+
+  set_size (packet, size);
+  while (size > 0)
+    {
+      nbytes = write (peer->fd, packet, size);
+      if (nbytes < 0)
+	die (peer->name);
+      packet += nbytes;
+      size -= nbytes;
+    }
+}
+
+static void
+send_keepalive (struct bench_peer *peer)
+{
+  u_char packet[BGP_HEADER_SIZE];
+
+  put_header (packet, BGP_MSG_KEEPALIVE);
+  send_packet (peer, packet, BGP_HEADER_SIZE);
+}
+
+/* Read one whole packet into peer->buf, return its type or -1 when
+   the connection has gone. */
+static int
+read_packet (struct bench_peer *peer)
+{
+  int nbytes;
+  int size;
+
+  for (;;)
+    {
+      if (peer->len >= BGP_HEADER_SIZE)
+	{
+	  size = (peer->buf[BGP_MARKER_SIZE] << 8)
+	    | peer->buf[BGP_MARKER_SIZE + 1];
+	  if (size < BGP_HEADER_SIZE || size > BGP_MAX_PACKET_SIZE)
+	    {
+	      fprintf (stderr, "%s: bad packet size %d\n", peer->name, size);
+	      exit (1);
+	    }
+	  if (peer->len == size)
+	    {
+	      peer->len = 0;
+	      return peer->buf[BGP_MARKER_SIZE + 2];
+	    }
+	}
+      else
+	size = BGP_HEADER_SIZE;
+
+      nbytes = read (peer->fd, peer->buf + peer->len, size - peer->len);
+      if (nbytes <= 0)
+	{
+	  peer->len = 0;
+	  return -1;
+	}
+      peer->len += nbytes;
+      peer->bytes += nbytes;
+    }
+}
+
+/* Connect from the peer's address and get the session up.  bgpd
+   closes the connection while it is trying one of its own to the
+   peer, so it may take a few goes. */
+static int
+peer_start (struct bench_peer *peer, struct sockaddr_in *bgpd)
+{
+  struct sockaddr_in sin;
+  u_char packet[BGP_MAX_PACKET_SIZE];
+  u_char *p;
+  int type;
+
+  peer->fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (peer->fd < 0)
+    die ("socket");
+
+  memset (&sin, 0, sizeof (struct sockaddr_in));
+  sin.sin_family = AF_INET;
+  sin.sin_addr = peer->addr;
+  if (bind (peer->fd, (struct sockaddr *) &sin, sizeof sin) < 0)
+    die (peer->name);
+  if (connect (peer->fd, (struct sockaddr *) bgpd, sizeof *bgpd) < 0)
+    {
+      close (peer->fd);
+      return -1;
+    }
+
+  p = put_header (packet, BGP_MSG_OPEN);
+  *p++ = 4;
+  *p++ = peer->as >> 8;
+  *p++ = peer->as;
+  *p++ = 0;			/* Hold time 180. */
+  *p++ = 180;
+  memcpy (p, &peer->addr, 4);
+  p += 4;
+  *p++ = 0;			/* No optional parameters. */
+  send_packet (peer, packet, p - packet);
+
+  /* OPEN, then KEEPALIVE. */
+  while ((type = read_packet (peer)) != BGP_MSG_KEEPALIVE)
+    {
+      if (type < 0 || type == BGP_MSG_NOTIFY)
+	{
+	  close (peer->fd);
+	  return -1;
+	}
+      if (type == BGP_MSG_OPEN)
+	send_keepalive (peer);
+    }
+  return 0;
+}
+
+static void
+peer_up (struct bench_peer *peer, struct sockaddr_in *bgpd)
+{
+  int i;
+
+  for (i = 0; peer_start (peer, bgpd) < 0; i++)
+    {
+      if (i == 120)
+	{
+	  fprintf (stderr, "%s: can't get the session up\n", peer->name);
+	  exit (1);
+	}
+      sleep (1);
+    }
+}
+
+/* Count what one UPDATE carries. */
+static void
+count_update (struct bench_peer *peer)
+{
+  u_char *p;
+  u_char *end;
+  int size;
+  int len;
+
+  size = (peer->buf[BGP_MARKER_SIZE] << 8) | peer->buf[BGP_MARKER_SIZE + 1];
+  p = peer->buf + BGP_HEADER_SIZE;
+  peer->update++;
+
+  /* Withdrawn routes. */
+  len = (p[0] << 8) | p[1];
+  p += 2;
+  for (end = p + len; p < end; p += (*p + 7) / 8 + 1)
+    peer->withdrawn++;
+
+  /* Skip the attributes, then NLRI. */
+  len = (p[0] << 8) | p[1];
+  p += 2 + len;
+  for (end = peer->buf + size; p < end; p += (*p + 7) / 8 + 1)
+    peer->nlri++;
+}
+
+/* Routes the announcing peer has still to send. */
+u_char *output;
+int output_len;
+int output_size;
+
+static u_char *
+output_packet ()
+{
+  if (output_len + BGP_MAX_PACKET_SIZE > output_size)
+    {
+      output_size = output_size ? output_size * 2 : 1024 * 1024;
+      output = realloc (output, output_size);
+      if (! output)
+	die ("realloc");
+    }
+  return output + output_len;
+}
+
+/* Close the UPDATE which starts at packet, with its NLRI (or withdrawn
+   routes) between nlri and p. */
+static void
+output_update (u_char *packet, u_char *nlri, u_char *p, int withdraw)
+{
+  if (withdraw)
+    {
+      nlri[-2] = (p - nlri) >> 8;
+      nlri[-1] = p - nlri;
+      *p++ = 0;
+      *p++ = 0;
+    }
+  set_size (packet, p - packet);
+  output_len += p - packet;
+}
+
+/* Make the announcing peer's UPDATEs, packed the way a busy router
+   would send them: one per AS path, as full as they go. */
+static void
+make_routes (struct bench_peer *peer, int npath, int withdraw)
+{
+  u_char head[BGP_HEADER_SIZE + 4 + 22];
+  u_char *packet;
+  u_char *nlri;
+  u_char *p;
+  int head_len;
+  int path;
+  int size;
+  int i;
+
+  for (path = 0; path < npath && path < nprefix; path++)
+    {
+      /* Header and attributes, the same for every packet of the path. */
+      p = put_header (head, BGP_MSG_UPDATE);
+      if (withdraw)
+	p += 2;
+      else
+	{
+	  *p++ = 0;
+	  *p++ = 0;
+	  *p++ = 0;
+	  *p++ = 4 + 11 + 7;
+
+	  /* ORIGIN IGP. */
+	  *p++ = 0x40; *p++ = 1; *p++ = 1; *p++ = 0;
+
+	  /* AS_PATH: this peer, then two made from the path number. */
+	  *p++ = 0x40; *p++ = 2; *p++ = 8;
+	  *p++ = 2; *p++ = 3;
+	  *p++ = peer->as >> 8; *p++ = peer->as;
+	  *p++ = (1000 + path) >> 8; *p++ = 1000 + path;
+	  *p++ = (1000 + path % 97) >> 8; *p++ = 1000 + path % 97;
+
+	  /* NEXT_HOP. */
+	  *p++ = 0x40; *p++ = 3; *p++ = 4;
+	  memcpy (p, &peer->addr, 4);
+	  p += 4;
+	}
+      head_len = p - head;
+
+      packet = output_packet ();
+      memcpy (packet, head, head_len);
+      p = nlri = packet + head_len;
+
+      for (i = path; i < nprefix; i += npath)
+	{
+	  size = (prefixlens[i] + 7) / 8 + 1;
+	  if (p + size + 2 > packet + BGP_MAX_PACKET_SIZE)
+	    {
+	      output_update (packet, nlri, p, withdraw);
+	      packet = output_packet ();
+	      memcpy (packet, head, head_len);
+	      p = nlri = packet + head_len;
+	    }
+	  *p = prefixlens[i];
+	  p[1] = prefixes[i] >> 24;
+	  p[2] = prefixes[i] >> 16;
+	  p[3] = prefixes[i] >> 8;
+	  p[4] = prefixes[i];
+	  p += size;
+	}
+      output_update (packet, nlri, p, withdraw);
+    }
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval end;
+
+  gettimeofday (&end, NULL);
+  return (end.tv_sec - start->tv_sec)
+    + (end.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Send the announcing peer's output and read what the receiving peer
+   gets until count has reached goal.  bgpd may block writing to the
+   receiver, so both have to go on at once. */
+static void
+run (struct bench_peer *a, struct bench_peer *b, long *count, long goal,
+     char *what)
+{
+  struct timeval start;
+  struct timeval last;
+  struct timeval tv;
+  fd_set readfds;
+  fd_set writefds;
+  long update;
+  long bytes;
+  int sent;
+  int maxfd;
+  int nbytes;
+  int type;
+
+  gettimeofday (&start, NULL);
+  last = start;
+  update = b->update;
+  bytes = b->bytes;
+  maxfd = (a->fd > b->fd ? a->fd : b->fd) + 1;
+  sent = 0;
+
+  while (*count < goal)
+    {
+      FD_ZERO (&readfds);
+      FD_ZERO (&writefds);
+      FD_SET (a->fd, &readfds);
+      FD_SET (b->fd, &readfds);
+      if (sent < output_len)
+	FD_SET (a->fd, &writefds);
+      tv.tv_sec = 10;
+      tv.tv_usec = 0;
+
+      if (select (maxfd, &readfds, &writefds, NULL, &tv) < 0)
+	die ("select");
+
+      if (FD_ISSET (a->fd, &writefds))
+	{
+	  nbytes = write (a->fd, output + sent, output_len - sent);
+	  if (nbytes < 0 && errno != EAGAIN)
+	    die (a->name);
+	  if (nbytes > 0)
+	    sent += nbytes;
+	}
+
+      /* Nothing but KEEPALIVEs should arrive there. */
+      if (FD_ISSET (a->fd, &readfds) && read_packet (a) < 0)
+	{
+	  fprintf (stderr, "%s: connection closed\n", a->name);
+	  exit (1);
+	}
+
+      if (FD_ISSET (b->fd, &readfds))
+	{
+	  type = read_packet (b);
+	  if (type == BGP_MSG_UPDATE)
+	    count_update (b);
+	  else if (type < 0 || type == BGP_MSG_NOTIFY)
+	    {
+	      fprintf (stderr, "%s: connection closed\n", b->name);
+	      exit (1);
+	    }
+	}
+
+      /* Keep the sessions up on long runs. */
+      if (elapsed (&last) > 30)
+	{
+	  send_keepalive (b);
+	  if (sent == output_len)
+	    send_keepalive (a);
+	  gettimeofday (&last, NULL);
+	}
+    }
+
+  printf ("%-8s %8.3f sec, %ld UPDATEs, %ld bytes, %.1f prefixes/UPDATE\n",
+	  what, elapsed (&start), b->update - update, b->bytes - bytes,
+	  (double) goal / (b->update - update));
+  output_len = 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct bench_peer a;
+  struct bench_peer b;
+  struct sockaddr_in bgpd;
+  char *address = "127.0.0.1";
+  int port = 179;
+  int count = 120000;
+  int npath = 4000;
+  int c;
+
+  while ((c = getopt (argc, argv, "a:p:n:P:")) != -1)
+    switch (c)
+      {
+      case 'a':
+	address = optarg;
+	break;
+      case 'p':
+	port = atoi (optarg);
+	break;
+      case 'n':
+	count = atoi (optarg);
+	break;
+      case 'P':
+	npath = atoi (optarg);
+	break;
+      default:
+	fprintf (stderr,
+		 "usage: %s [-a bgpd-addr] [-p port] [-n prefixes] [-P paths]\n",
+		 argv[0]);
+	exit (1);
+      }
+
+  if (npath < 1 || npath > 60000)
+    npath = 4000;
+  if (count < 1 || count > 223 * 1024)
+    count = 120000;
+
+  make_prefixes (count);
+
+  memset (&bgpd, 0, sizeof (struct sockaddr_in));
+  bgpd.sin_family = AF_INET;
+  bgpd.sin_port = htons (port);
+  bgpd.sin_addr.s_addr = inet_addr (address);
+
+  memset (&a, 0, sizeof (struct bench_peer));
+  a.name = "announcer";
+  a.as = 65001;
+  a.addr.s_addr = inet_addr ("127.0.0.2");
+
+  memset (&b, 0, sizeof (struct bench_peer));
+  b.name = "receiver";
+  b.as = 65002;
+  b.addr.s_addr = inet_addr ("127.0.0.3");
+
+  /* The receiver first, so that the routes reach it as updates and not
+     as a table dump. */
+  peer_up (&b, &bgpd);
+  peer_up (&a, &bgpd);
+  fcntl (a.fd, F_SETFL, fcntl (a.fd, F_GETFL, 0) | O_NONBLOCK);
+
+  printf ("%d prefixes, %d AS paths\n", nprefix, npath);
+
+  make_routes (&a, npath, 0);
+  run (&a, &b, &b.nlri, nprefix, "announce");
+
+  make_routes (&a, npath, 1);
+  run (&a, &b, &b.withdrawn, nprefix, "withdraw");
+
+  close (a.fd);
+  close (b.fd);
+  return 0;
+}
@@ -972,7 +972,7 @@ bgp_create ()
   bgp->aggregate[AFI_IP] = route_table_init ();
   bgp->aggregate[AFI_IP6] = route_table_init ();
 
-  bgp->rib[AFI_IP][SAFI_UNICAST] = route_table_init ();
+  bgp->rib[AFI_IP][SAFI_UNICAST] = route_table_init_stride (8);
   bgp->rib[AFI_IP][SAFI_MULTICAST] = route_table_init ();
   bgp->rib[AFI_IP][SAFI_MPLS_VPN] = route_table_init ();
   bgp->rib[AFI_IP6][SAFI_UNICAST] = route_table_init ();
@@ -5895,6 +5895,24 @@ DEFUN (show_ip_mbgp_paths,
   return CMD_SUCCESS;
 }
 
+/* Show memory used by BGP's interned path attributes.  "show memory
+   bgp" gives the allocation counts, this gives the bytes. */
+DEFUN (show_ip_bgp_memory, 
+       show_ip_bgp_memory_cmd,
+       "show ip bgp memory",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Memory used by path attributes\n")
+{
+  vty_out (vty, "%-16s %8s %8s %10s%s", "Table", "Entries", "Refcnt",
+	   "Bytes", VTY_NEWLINE);
+  bgp_attr_memory_vty (vty);
+  aspath_memory_vty (vty);
+  community_memory_vty (vty);
+  return CMD_SUCCESS;
+}
+
 /* Show BGP's community internal data. */
 DEFUN (show_ip_bgp_community, 
        show_ip_bgp_community_cmd,
@@ -6535,6 +6553,10 @@ bgp_init ()
   install_element (ENABLE_NODE, &show_ip_bgp_paths_cmd);
   install_element (ENABLE_NODE, &show_ip_mbgp_paths_cmd);
 
+  /* "show ip bgp memory" commands. */
+  install_element (VIEW_NODE, &show_ip_bgp_memory_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_memory_cmd);
+
   /* "show ip bgp community" commands. */
   install_element (VIEW_NODE, &show_ip_bgp_community_cmd);
   install_element (VIEW_NODE, &show_ip_mbgp_community_cmd);
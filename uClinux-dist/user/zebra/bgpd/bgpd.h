@@ -243,6 +243,10 @@ struct peer
   struct stream *ibuf;
   struct stream_fifo *obuf;
 
+  /* IPv4 unicast routes not yet packed into obuf, see
+     bgp_update_send (). */
+  struct bgp_update_queue *update_queue;
+
   /* Status of the peer. */
   int status;
   int ostatus;
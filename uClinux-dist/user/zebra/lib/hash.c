@@ -72,7 +72,7 @@ hash_search (struct Hash *hash, void *data)
   unsigned int key;
   HashBacket *backet;
 
-  key = (*hash->hash_key) (data);
+  key = (*hash->hash_key) (data) % hash->size;
 
   if (hash->index[key] == NULL)
     return NULL;
@@ -91,7 +91,7 @@ hash_push (struct Hash *hash, void *data)
   unsigned int key;
   HashBacket  *backet, *mp;
 
-  key = (*hash->hash_key) (data);
+  key = (*hash->hash_key) (data) % hash->size;
   backet = hash_backet_new (data);
 
   hash->alloc++;
@@ -129,7 +129,7 @@ hash_pull (struct Hash *hash, void *data)
   HashBacket *mp;
   HashBacket *mpp;
 
-  key = (*hash->hash_key) (data);
+  key = (*hash->hash_key) (data) % hash->size;
 
   if(hash->index[key] == NULL) 
     return NULL;
@@ -162,7 +162,7 @@ hash_clean (struct Hash *hash, void (* func) (void *))
   HashBacket *mp;
   HashBacket *next;
 
-  for (i = 0; i < HASHTABSIZE; i++)
+  for (i = 0; i < hash->size; i++)
     {
       for (mp = hash_head (hash, i); mp; mp = next)
 	{
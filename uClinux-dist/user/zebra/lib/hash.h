@@ -40,7 +40,8 @@ struct Hash
   /* Hash size. */
   int size;
 
-  /* Key make function. */
+  /* Key make function.  The result is taken modulo size, so it
+     need not be reduced by the caller. */
   unsigned int (*hash_key)();
 
   /* Data compare function. */
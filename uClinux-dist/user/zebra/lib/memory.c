@@ -24,9 +24,6 @@
 
 #include "log.h"
 #include "memory.h"
-
-void alloc_inc (int);
-void alloc_dec (int);
 
 struct message mstr [] =
 {
@@ -34,6 +31,7 @@ struct message mstr [] =
   { MTYPE_COMMAND_CONST, "command_const" },
   { MTYPE_THREAD, "thread" },
   { MTYPE_THREAD_MASTER, "thread_master" },
+  { MTYPE_THREAD_STATS, "thread_stats" },
   { MTYPE_VECTOR, "vector" },
   { MTYPE_VECTOR_INDEX, "vector_index" },
   { MTYPE_IF, "interface" },
@@ -240,11 +238,14 @@ struct memory_list memory_list_lib[] =
   { MTYPE_TMP,                "Temporary memory: %ld\r\n" },
   { MTYPE_ROUTE_TABLE,        "Route table     : %ld\r\n" },
   { MTYPE_ROUTE_NODE,         "Route node      : %ld\r\n" },
+  { MTYPE_ROUTE_NODE_POOL,    "Route node pool : %ld\r\n" },
   { MTYPE_RIB,                "RIB             : %ld\r\n" },
   { MTYPE_LINK_LIST,          "Link List       : %ld\r\n" },
   { MTYPE_LINK_NODE,          "Link Node       : %ld\r\n" },
   { MTYPE_HASH,               "Hash            : %ld\r\n" },
   { MTYPE_HASH_BACKET,        "Hash Bucket     : %ld\r\n" },
+  { MTYPE_THREAD,             "Thread          : %ld\r\n" },
+  { MTYPE_THREAD_STATS,       "Thread stats    : %ld\r\n" },
   { MTYPE_ACCESS_LIST,        "Access List     : %ld\r\n" },
   { MTYPE_ACCESS_FILTER,      "Access Filter   : %ld\r\n" },
   { MTYPE_PREFIX_LIST,        "Prefix List     : %ld\r\n" },
@@ -263,10 +264,18 @@ struct memory_list memory_list_lib[] =
 
 struct memory_list memory_list_bgp[] =
 {
+  { MTYPE_BGP_ROUTE,          "BGP route       : %ld\r\n" },
   { MTYPE_ATTR,               "BGP attribute   : %ld\r\n" },
   { MTYPE_AS_PATH,            "BGP aspath      : %ld\r\n" },
   { MTYPE_AS_SEG,             "BGP aspath seg  : %ld\r\n" },
   { MTYPE_AS_STR,             "BGP aspath str  : %ld\r\n" },
+  { MTYPE_COMMUNITY,          "BGP community   : %ld\r\n" },
+  { MTYPE_COMMUNITY_VAL,      "BGP community val: %ld\r\n" },
+  { MTYPE_COMMUNITY_STR,      "BGP community str: %ld\r\n" },
+  { MTYPE_ECOMMUNITY,         "BGP ext community: %ld\r\n" },
+  { MTYPE_ECOMMUNITY_VAL,     "BGP ext comm val: %ld\r\n" },
+  { MTYPE_BGP_UPDATE_GROUP,   "BGP update group: %ld\r\n" },
+  { MTYPE_BGP_UPDATE_DATA,    "BGP update data : %ld\r\n" },
   { 0,                        "---------------------\r\n" },
   { MTYPE_AS_LIST,            "BGP as list     : %ld\r\n" },
   { MTYPE_AS_FILTER,          "BGP as filter   : %ld\r\n" },
@@ -38,6 +38,7 @@ enum
   MTYPE_LINK_NODE,
   MTYPE_THREAD,
   MTYPE_THREAD_MASTER,
+  MTYPE_THREAD_STATS,
   MTYPE_VTY,
   MTYPE_VTY_HIST,
   MTYPE_IF,
@@ -47,6 +48,7 @@ enum
   MTYPE_AS_PATH,
   MTYPE_COMMUNITY,
   MTYPE_COMMUNITY_VAL,
+  MTYPE_COMMUNITY_STR,
   MTYPE_ECOMMUNITY,
   MTYPE_ECOMMUNITY_VAL,
   MTYPE_CLUSTER,
@@ -70,6 +72,7 @@ enum
   MTYPE_RIPNG_AGGREGATE,
   MTYPE_ROUTE_TABLE,
   MTYPE_ROUTE_NODE,
+  MTYPE_ROUTE_NODE_POOL,
   MTYPE_RIPNG_SLOT,
   MTYPE_ACCESS_LIST,
   MTYPE_ACCESS_FILTER,
@@ -125,6 +128,7 @@ enum
   MTYPE_ZEBRA,
   MTYPE_NEXTHOP,
   MTYPE_RTADV_PREFIX,
+  MTYPE_NETLINK_QUEUE,
   MTYPE_IF_RMAP,
   MTYPE_NEWLIST,
   MTYPE_NEWNODE,
@@ -135,6 +139,8 @@ enum
   MTYPE_BGP_STATIC,
   MTYPE_BGP_AGGREGATE,
   MTYPE_BGP_CONFED_LIST,
+  MTYPE_BGP_UPDATE_GROUP,
+  MTYPE_BGP_UPDATE_DATA,
   MTYPE_MAX
 };
 
@@ -164,6 +170,10 @@ void *zrealloc (int type, void *ptr, size_t size);
 void  zfree (int type, void *ptr);
 char *zstrdup (int type, char *str);
 
+/* For allocators which hand out memory from their own pools. */
+void alloc_inc (int);
+void alloc_dec (int);
+
 void *mtype_zmalloc (const char *file,
 		     int line,
 		     int type,
@@ -40,6 +40,28 @@ route_table_init (void)
   return rt;
 }
 
+/* Make a level-compressed routing table.  It is the same radix tree
+   as route_table_init () makes, plus an index on the first stride
+   bits of the prefix that lets lookups skip the top of the tree.  The
+   index costs 2^stride pointers, so use it for big tables only. */
+struct route_table *
+route_table_init_stride (int stride)
+{
+  struct route_table *rt;
+
+  assert (stride >= 0 && stride <= ROUTE_TABLE_STRIDE_MAX);
+
+  rt = route_table_init ();
+  if (stride)
+    {
+      rt->jump = XMALLOC (MTYPE_ROUTE_TABLE,
+			  sizeof (struct route_node *) << stride);
+      bzero (rt->jump, sizeof (struct route_node *) << stride);
+      rt->stride = stride;
+    }
+  return rt;
+}
+
 void
 route_table_finish (struct route_table *rt)
 {
@@ -50,14 +72,37 @@ route_table_finish (struct route_table *rt)
 #endif /*0*/
 }
 
+/* Route nodes are carved out of blocks of ROUTE_NODE_BLOCK and kept
+   on a free list, chained through parent, when released.  A full BGP
+   table is hundreds of thousands of nodes; this saves a malloc header
+   on each and keeps the heap from fragmenting as routes come and go.
+   Blocks are never given back. */
+#define ROUTE_NODE_BLOCK 128
+
+static struct route_node *route_node_free_list;
+
 /* Allocate new route node. */
 struct route_node *
 route_node_new ()
 {
   struct route_node *node;
-  
-  node = XMALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
+  int i;
+
+  if (route_node_free_list == NULL)
+    {
+      node = XMALLOC (MTYPE_ROUTE_NODE_POOL,
+		      sizeof (struct route_node) * ROUTE_NODE_BLOCK);
+      for (i = 0; i < ROUTE_NODE_BLOCK; i++)
+	{
+	  node[i].parent = route_node_free_list;
+	  route_node_free_list = &node[i];
+	}
+    }
+
+  node = route_node_free_list;
+  route_node_free_list = node->parent;
   bzero (node, sizeof (struct route_node));
+  alloc_inc (MTYPE_ROUTE_NODE);
 
   return node;
 }
@@ -68,8 +113,7 @@ route_node_set (struct route_table *table, struct prefix *prefix)
 {
   struct route_node *node;
   
-  node = XMALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
-  bzero (node, sizeof (struct route_node));
+  node = route_node_new ();
 
   prefix_copy (&node->p, prefix);
   node->table = table;
@@ -81,22 +125,48 @@ route_node_set (struct route_table *table, struct prefix *prefix)
 void
 route_node_free (struct route_node *node)
 {
-  XFREE (MTYPE_ROUTE_NODE, node);
+  alloc_dec (MTYPE_ROUTE_NODE);
+  node->parent = route_node_free_list;
+  route_node_free_list = node;
 }
 
 /* Free route table. */
 void
 route_table_free (struct route_table *rt)
 {
-  struct route_node *rn;
-  struct route_node *next;
+  struct route_node *node;
+  struct route_node *tmp;
 
-  for (rn = route_top (rt); rn; rn = next)
+  /* Free children before their parent.  Walking with route_next ()
+     would lock and unlock nodes and could delete them under us. */
+  node = rt->top;
+  while (node)
     {
-      next = route_next (rn);
-      route_node_free (rn);
+      if (node->l_left)
+	{
+	  node = node->l_left;
+	  continue;
+	}
+      if (node->l_right)
+	{
+	  node = node->l_right;
+	  continue;
+	}
+
+      tmp = node;
+      node = node->parent;
+      if (node)
+	{
+	  if (node->l_left == tmp)
+	    node->l_left = NULL;
+	  else
+	    node->l_right = NULL;
+	}
+      route_node_free (tmp);
     }
 
+  if (rt->jump)
+    XFREE (MTYPE_ROUTE_TABLE, rt->jump);
   XFREE (MTYPE_ROUTE_TABLE, rt);
 }
 
@@ -177,6 +247,65 @@ set_link (struct route_node *node, struct route_node *new)
   new->parent = node;
 }
 
+/* First stride bits of the prefix, as an index into table->jump. */
+static unsigned int
+route_jump_index (struct route_table *table, struct prefix *p)
+{
+  u_char *pp = (u_char *)&p->u.prefix;
+
+  return ((pp[0] << 8) | pp[1]) >> (16 - table->stride);
+}
+
+/* Where to start descending the tree for p: the jump entry if p is
+   at least stride bits long and one exists, else the top. */
+static struct route_node *
+route_jump_start (struct route_table *table, struct prefix *p)
+{
+  struct route_node *node;
+
+  if (table->jump && p->prefixlen >= table->stride)
+    if ((node = table->jump[route_jump_index (table, p)]) != NULL)
+      return node;
+  return table->top;
+}
+
+/* A node of at most stride bits has been added: it is now the
+   longest cover of the part of the index it spans, unless there is a
+   longer one already. */
+static void
+route_jump_add (struct route_table *table, struct route_node *node)
+{
+  unsigned int i, first, count;
+
+  if (! table->jump || node->p.prefixlen > table->stride)
+    return;
+
+  count = 1 << (table->stride - node->p.prefixlen);
+  first = route_jump_index (table, &node->p) & ~(count - 1);
+
+  for (i = first; i < first + count; i++)
+    if (table->jump[i] == NULL
+	|| table->jump[i]->p.prefixlen < node->p.prefixlen)
+      table->jump[i] = node;
+}
+
+/* A node is going away: its parent takes over its jump entries. */
+static void
+route_jump_delete (struct route_table *table, struct route_node *node)
+{
+  unsigned int i, first, count;
+
+  if (! table->jump || node->p.prefixlen > table->stride)
+    return;
+
+  count = 1 << (table->stride - node->p.prefixlen);
+  first = route_jump_index (table, &node->p) & ~(count - 1);
+
+  for (i = first; i < first + count; i++)
+    if (table->jump[i] == node)
+      table->jump[i] = node->parent;
+}
+
 /* Lock node. */
 struct route_node *
 route_lock_node (struct route_node *node)
@@ -217,10 +346,11 @@ struct route_node *
 route_node_match (struct route_table *table, struct prefix *p)
 {
   struct route_node *node;
+  struct route_node *start;
   struct route_node *matched;
 
   matched = NULL;
-  node = table->top;
+  start = node = route_jump_start (table, p);
 
   /* Walk down tree.  If there is matched route then store it to
      matched. */
@@ -229,9 +359,18 @@ route_node_match (struct route_table *table, struct prefix *p)
     {
       if (node->info)
 	matched = node;
-      node = node->link[check_bit(&p->u.prefix, node->p.prefixlen)];
+      node = node->link[CHECK_BIT(&p->u.prefix, node->p.prefixlen)];
     }
 
+  /* Started below the top: the best match may be above us. */
+  if (! matched && start != table->top)
+    for (node = start->parent; node; node = node->parent)
+      if (node->info)
+	{
+	  matched = node;
+	  break;
+	}
+
   /* If matched route found, return it. */
   if (matched)
     return route_lock_node (matched);
@@ -245,7 +384,7 @@ route_node_lookup (struct route_table *table, struct prefix *p)
 {
   struct route_node *node;
 
-  node = table->top;
+  node = route_jump_start (table, p);
 
   while (node && node->p.prefixlen <= p->prefixlen && 
 	 prefix_match (&node->p, p))
@@ -253,7 +392,7 @@ route_node_lookup (struct route_table *table, struct prefix *p)
       if (node->p.prefixlen == p->prefixlen && node->info)
 	return route_lock_node (node);
 
-      node = node->link[check_bit(&p->u.prefix, node->p.prefixlen)];
+      node = node->link[CHECK_BIT(&p->u.prefix, node->p.prefixlen)];
     }
 
   return NULL;
@@ -268,7 +407,7 @@ route_node_get (struct route_table *table, struct prefix *p)
   struct route_node *match;
 
   match = NULL;
-  node = table->top;
+  node = route_jump_start (table, p);
   while (node && node->p.prefixlen <= p->prefixlen && 
 	 prefix_match (&node->p, p))
     {
@@ -278,7 +417,7 @@ route_node_get (struct route_table *table, struct prefix *p)
 	  return node;
 	}
       match = node;
-      node = node->link[check_bit(&p->u.prefix, node->p.prefixlen)];
+      node = node->link[CHECK_BIT(&p->u.prefix, node->p.prefixlen)];
     }
 
   if (node == NULL)
@@ -302,6 +441,7 @@ route_node_get (struct route_table *table, struct prefix *p)
 	set_link (match, new);
       else
 	table->top = new;
+      route_jump_add (table, new);
 
       if (new->p.prefixlen != p->prefixlen)
 	{
@@ -310,6 +450,7 @@ route_node_get (struct route_table *table, struct prefix *p)
 	  set_link (match, new);
 	}
     }
+  route_jump_add (table, new);
   route_lock_node (new);
 
   /* For debug. */
@@ -353,6 +494,7 @@ route_node_delete (struct route_node *node)
   else
     node->table->top = child;
 
+  route_jump_delete (node->table, node);
   route_node_free (node);
 
   /* If parent node is stub then delete it also. */
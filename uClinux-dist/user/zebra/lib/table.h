@@ -27,8 +27,16 @@
 struct route_table
 {
   struct route_node *top;
+
+  /* Level-compressed tables only, see route_table_init_stride ().
+     jump[i] is the longest node of at most stride bits covering
+     prefixes whose first stride bits are i. */
+  struct route_node **jump;
+  int stride;
 };
 
+#define ROUTE_TABLE_STRIDE_MAX 16
+
 /* Each routing entry. */
 struct route_node
 {
@@ -54,6 +62,7 @@ struct route_node
 
 /* Prototypes. */
 struct route_table *route_table_init (void);
+struct route_table *route_table_init_stride (int);
 void route_table_finish (struct route_table *);
 struct route_node *route_top (struct route_table *);
 struct route_node *route_next (struct route_node *);
@@ -0,0 +1,273 @@
+/* Route table benchmark.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Loads a full-table sized set of IPv4 prefixes into a route_table
+   and times route_node_get (), route_node_match () of host
+   addresses, route_node_lookup () and deletion, then reports memory
+   per prefix.  Prefixes come from a file of "a.b.c.d/len" lines
+   (e.g. cut out of "show ip bgp"), or are made up with roughly the
+   length mix of a BGP table.  Every match is checked against a
+   table without the stride index.
+
+   usage: tablebench [-n prefixes] [-s stride] [-f file] */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "memory.h"
+
+struct prefix_ipv4 *prefixes;
+int nprefix;
+
+/* Made-up BGP table: mostly /24, a lot of /16 - /23, a few short. */
+static void
+make_prefixes (int count)
+{
+  int i, r;
+  u_int32_t addr;
+
+  prefixes = malloc (sizeof (struct prefix_ipv4) * count);
+  srandom (1);
+
+  for (i = 0; i < count; i++)
+    {
+      r = random () % 100;
+      prefixes[i].family = AF_INET;
+      if (r < 55)
+	prefixes[i].prefixlen = 24;
+      else if (r < 90)
+	prefixes[i].prefixlen = 16 + random () % 8;
+      else if (r < 97)
+	prefixes[i].prefixlen = 8 + random () % 8;
+      else
+	prefixes[i].prefixlen = 25 + random () % 8;
+
+      /* Cluster the addresses in the unicast space, the way real
+	 allocations are. */
+      addr = ((u_int32_t) (1 + random () % 223) << 24) | (random () & 0xffffff);
+      prefixes[i].prefix.s_addr = htonl (addr);
+      apply_mask_ipv4 (&prefixes[i]);
+    }
+  nprefix = count;
+}
+
+static void
+read_prefixes (char *file, int count)
+{
+  FILE *fp;
+  char buf[BUFSIZ];
+
+  fp = fopen (file, "r");
+  if (fp == NULL)
+    {
+      perror (file);
+      exit (1);
+    }
+
+  prefixes = malloc (sizeof (struct prefix_ipv4) * count);
+  while (nprefix < count && fgets (buf, sizeof buf, fp))
+    {
+      buf[strcspn (buf, " \t\r\n")] = '\0';
+      if (str2prefix_ipv4 (buf, &prefixes[nprefix]) > 0)
+	{
+	  apply_mask_ipv4 (&prefixes[nprefix]);
+	  nprefix++;
+	}
+    }
+  fclose (fp);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval end;
+
+  gettimeofday (&end, NULL);
+  return (end.tv_sec - start->tv_sec) * 1000000.0
+    + (end.tv_usec - start->tv_usec);
+}
+
+static void
+report (char *what, double usec, int count)
+{
+  printf ("%-8s %8.3f usec/op\n", what, usec / count);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct route_table *table;
+  struct route_table *plain;
+  struct route_node *rn;
+  struct route_node *rn2;
+  struct prefix_ipv4 p;
+  struct timeval start;
+  char *file = NULL;
+  int count = 120000;
+  int stride = 8;
+  int lookups;
+  int nodes;
+  int routes;
+  int c, i;
+  u_int32_t *hosts;
+  long mem;
+
+  while ((c = getopt (argc, argv, "n:s:f:")) != -1)
+    switch (c)
+      {
+      case 'n':
+	count = atoi (optarg);
+	break;
+      case 's':
+	stride = atoi (optarg);
+	break;
+      case 'f':
+	file = optarg;
+	break;
+      default:
+	fprintf (stderr, "usage: %s [-n prefixes] [-s stride] [-f file]\n",
+		 argv[0]);
+	exit (1);
+      }
+
+  if (stride < 0 || stride > ROUTE_TABLE_STRIDE_MAX)
+    {
+      fprintf (stderr, "stride must be 0 to %d\n", ROUTE_TABLE_STRIDE_MAX);
+      exit (1);
+    }
+
+  if (file)
+    read_prefixes (file, count);
+  else
+    make_prefixes (count);
+
+  /* Host addresses to look up: half inside known prefixes, half
+     anywhere. */
+  lookups = nprefix * 4;
+  hosts = malloc (sizeof (u_int32_t) * lookups);
+  for (i = 0; i < lookups; i++)
+    if (i & 1)
+      hosts[i] = ntohl (prefixes[random () % nprefix].prefix.s_addr)
+	| (random () & 0xff);
+    else
+      hosts[i] = (random () << 1) ^ random ();
+
+  table = route_table_init_stride (stride);
+  plain = route_table_init ();
+
+  printf ("%d prefixes, stride %d, %lu byte route_node\n",
+	  nprefix, stride, (unsigned long) sizeof (struct route_node));
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < nprefix; i++)
+    {
+      rn = route_node_get (table, (struct prefix *) &prefixes[i]);
+      if (rn->info)
+	route_unlock_node (rn);
+      else
+	rn->info = &prefixes[i];
+    }
+  report ("get", elapsed (&start), nprefix);
+
+  for (i = 0; i < nprefix; i++)
+    {
+      rn = route_node_get (plain, (struct prefix *) &prefixes[i]);
+      if (rn->info)
+	route_unlock_node (rn);
+      else
+	rn->info = &prefixes[i];
+    }
+
+  p.family = AF_INET;
+  p.prefixlen = IPV4_MAX_BITLEN;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < lookups; i++)
+    {
+      p.prefix.s_addr = htonl (hosts[i]);
+      rn = route_node_match (table, (struct prefix *) &p);
+      if (rn)
+	route_unlock_node (rn);
+    }
+  report ("match", elapsed (&start), lookups);
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < nprefix; i++)
+    {
+      rn = route_node_lookup (table, (struct prefix *) &prefixes[i]);
+      if (rn)
+	route_unlock_node (rn);
+    }
+  report ("lookup", elapsed (&start), nprefix);
+
+  /* Same answers as without the index? */
+  for (i = 0; i < lookups; i++)
+    {
+      p.prefix.s_addr = htonl (hosts[i]);
+      rn = route_node_match (table, (struct prefix *) &p);
+      rn2 = route_node_match (plain, (struct prefix *) &p);
+      if ((rn ? rn->info : NULL) != (rn2 ? rn2->info : NULL))
+	{
+	  fprintf (stderr, "match mismatch for %s\n", inet_ntoa (p.prefix));
+	  exit (1);
+	}
+      if (rn)
+	route_unlock_node (rn);
+      if (rn2)
+	route_unlock_node (rn2);
+    }
+
+  nodes = routes = 0;
+  for (rn = route_top (table); rn; rn = route_next (rn))
+    {
+      nodes++;
+      if (rn->info)
+	routes++;
+    }
+  mem = (long) nodes * sizeof (struct route_node)
+    + (stride ? (long) sizeof (struct route_node *) << stride : 0);
+  printf ("%d routes in %d nodes, %ld bytes, %.1f bytes/route\n",
+	  routes, nodes, mem, (double) mem / routes);
+
+  /* Withdraw every route, the way the daemons do. */
+  gettimeofday (&start, NULL);
+  for (i = 0; i < nprefix; i++)
+    {
+      rn = route_node_lookup (table, (struct prefix *) &prefixes[i]);
+      if (rn)
+	{
+	  rn->info = NULL;
+	  route_unlock_node (rn);
+	  route_unlock_node (rn);
+	}
+    }
+  report ("delete", elapsed (&start), nprefix);
+
+  if (route_top (table))
+    {
+      fprintf (stderr, "table not empty after delete\n");
+      exit (1);
+    }
+
+  route_table_finish (table);
+  route_table_finish (plain);
+  return 0;
+}
@@ -29,6 +29,8 @@
 #include "thread.h"
 #include "memory.h"
 #include "log.h"
+#include "vty.h"
+#include "command.h"
 
 #ifdef DEBUG
 void thread_master_debug (struct thread_master *);
@@ -41,6 +43,9 @@ void thread_master_debug (struct thread_master *);
 #define THREAD_EVENT 3
 #define THREAD_UNUSED 4
 
+/* All thread masters, for show thread cpu. */
+static struct thread_master *thread_master_list;
+
 /* Make thread master. */
 struct thread_master *
 thread_make_master ()
@@ -50,6 +55,9 @@ thread_make_master ()
   new = XMALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_master));
   bzero (new, sizeof (struct thread_master));
 
+  new->next = thread_master_list;
+  thread_master_list = new;
+
   return new;
 }
 
@@ -68,22 +76,6 @@ thread_list_add (struct thread_list *list, struct thread *thread)
   list->count++;
 }
 
-/* Add a new thread to the list. */
-static void
-thread_list_add_before (struct thread_list *list, 
-			struct thread *point, 
-			struct thread *thread)
-{
-  thread->next = point;
-  thread->prev = point->prev;
-  if (point->prev)
-    point->prev->next = thread;
-  else
-    list->head = thread;
-  point->prev = thread;
-  list->count++;
-}
-
 /* Delete a thread from the list. */
 struct thread *
 thread_list_delete (struct thread_list *list, struct thread *thread)
@@ -132,11 +124,189 @@ thread_add_unuse (struct thread_master *m, struct thread *thread)
   thread_list_add (&m->unuse, thread);
 }
 
+/* timer compare */
+static int
+thread_timer_cmp (struct timeval a, struct timeval b)
+{
+  if (a.tv_sec > b.tv_sec) 
+    return 1;
+  if (a.tv_sec < b.tv_sec)
+    return -1;
+  if (a.tv_usec > b.tv_usec)
+    return 1;
+  if (a.tv_usec < b.tv_usec)
+    return -1;
+  return 0;
+}
+
+/* Move the timer at index i up the heap until its parent is due no
+   later than it is. */
+static void
+thread_heap_up (struct thread_heap *heap, int i)
+{
+  struct thread *thread = heap->array[i];
+
+  while (i > 0)
+    {
+      int parent = (i - 1) / 2;
+
+      if (thread_timer_cmp (heap->array[parent]->u.sands, thread->u.sands) <= 0)
+	break;
+      heap->array[i] = heap->array[parent];
+      heap->array[i]->index = i;
+      i = parent;
+    }
+  heap->array[i] = thread;
+  thread->index = i;
+}
+
+/* Move the timer at index i down the heap until no child is due
+   before it. */
+static void
+thread_heap_down (struct thread_heap *heap, int i)
+{
+  struct thread *thread = heap->array[i];
+
+  while (2 * i + 1 < heap->count)
+    {
+      int child = 2 * i + 1;
+
+      if (child + 1 < heap->count
+	  && thread_timer_cmp (heap->array[child + 1]->u.sands,
+			       heap->array[child]->u.sands) < 0)
+	child++;
+      if (thread_timer_cmp (thread->u.sands, heap->array[child]->u.sands) <= 0)
+	break;
+      heap->array[i] = heap->array[child];
+      heap->array[i]->index = i;
+      i = child;
+    }
+  heap->array[i] = thread;
+  thread->index = i;
+}
+
+static void
+thread_heap_add (struct thread_heap *heap, struct thread *thread)
+{
+  if (heap->count == heap->size)
+    {
+      heap->size = heap->size ? heap->size * 2 : 32;
+      if (heap->array)
+	heap->array = XREALLOC (MTYPE_THREAD_MASTER, heap->array,
+				heap->size * sizeof (struct thread *));
+      else
+	heap->array = XMALLOC (MTYPE_THREAD_MASTER,
+			       heap->size * sizeof (struct thread *));
+    }
+  heap->array[heap->count] = thread;
+  thread_heap_up (heap, heap->count++);
+}
+
+static void
+thread_heap_delete (struct thread_heap *heap, struct thread *thread)
+{
+  int i = thread->index;
+  struct thread *last;
+
+  assert (i < heap->count && heap->array[i] == thread);
+
+  last = heap->array[--heap->count];
+  if (i == heap->count)
+    return;
+
+  /* Fill the hole with the last timer and restore the order. */
+  heap->array[i] = last;
+  last->index = i;
+  if (i > 0 && thread_timer_cmp (last->u.sands,
+				 heap->array[(i - 1) / 2]->u.sands) < 0)
+    thread_heap_up (heap, i);
+  else
+    thread_heap_down (heap, i);
+}
+
+/* Add a read or write thread to the poll array. */
+static void
+thread_poll_add (struct thread_master *m, struct thread *thread, short events)
+{
+  int i;
+
+  if (m->pollcount == m->pollsize)
+    {
+      m->pollsize = m->pollsize ? m->pollsize * 2 : 32;
+      if (m->pollfd)
+	{
+	  m->pollfd = XREALLOC (MTYPE_THREAD_MASTER, m->pollfd,
+				m->pollsize * sizeof (struct pollfd));
+	  m->pollthread = XREALLOC (MTYPE_THREAD_MASTER, m->pollthread,
+				    m->pollsize * sizeof (struct thread *));
+	}
+      else
+	{
+	  m->pollfd = XMALLOC (MTYPE_THREAD_MASTER,
+			       m->pollsize * sizeof (struct pollfd));
+	  m->pollthread = XMALLOC (MTYPE_THREAD_MASTER,
+				   m->pollsize * sizeof (struct thread *));
+	}
+    }
+
+  i = m->pollcount++;
+  m->pollfd[i].fd = thread->u.fd;
+  m->pollfd[i].events = events;
+  m->pollfd[i].revents = 0;
+  m->pollthread[i] = thread;
+  thread->index = i;
+}
+
+/* Remove a thread from the poll array.  The last entry moves into
+   its slot. */
+static void
+thread_poll_delete (struct thread_master *m, struct thread *thread)
+{
+  int i = thread->index;
+  int last = --m->pollcount;
+
+  assert (m->pollthread[i] == thread);
+
+  if (i != last)
+    {
+      m->pollfd[i] = m->pollfd[last];
+      m->pollthread[i] = m->pollthread[last];
+      m->pollthread[i]->index = i;
+    }
+}
+
+/* Find or make the statistics for an event function. */
+static struct thread_cpu *
+thread_cpu_get (struct thread_master *m,
+		int (*func) (struct thread *),
+		char *funcname)
+{
+  struct thread_cpu *cpu;
+  unsigned int key;
+
+  key = ((unsigned long) func >> 2) % THREAD_CPU_HASH_SIZE;
+
+  for (cpu = m->cpu[key]; cpu; cpu = cpu->next)
+    if (cpu->func == func)
+      return cpu;
+
+  cpu = XMALLOC (MTYPE_THREAD_STATS, sizeof (struct thread_cpu));
+  bzero (cpu, sizeof (struct thread_cpu));
+  cpu->func = func;
+  cpu->funcname = funcname;
+  cpu->next = m->cpu[key];
+  m->cpu[key] = cpu;
+
+  return cpu;
+}
+
 /* Stop thread scheduler. */
 void
 thread_destroy_master (struct thread_master *m)
 {
   struct thread *thread;
+  struct thread_master **mp;
+  int i;
 
   thread = m->read.head;
   while (thread)
@@ -164,15 +334,12 @@ thread_destroy_master (struct thread_master *m)
       thread_add_unuse (m, t);
     }
 
-  thread = m->timer.head;
-  while (thread)
+  while (m->timer.count)
     {
       struct thread *t;
 
-      t = thread;
-      thread = t->next;
-
-      thread_list_delete (&m->timer, t);
+      t = m->timer.array[m->timer.count - 1];
+      thread_heap_delete (&m->timer, t);
       t->type = THREAD_UNUSED;
       thread_add_unuse (m, t);
     }
@@ -191,6 +358,31 @@ thread_destroy_master (struct thread_master *m)
     }
 
   thread_clean_unuse (m);
+
+  for (mp = &thread_master_list; *mp; mp = &(*mp)->next)
+    if (*mp == m)
+      {
+	*mp = m->next;
+	break;
+      }
+
+  for (i = 0; i < THREAD_CPU_HASH_SIZE; i++)
+    while (m->cpu[i])
+      {
+	struct thread_cpu *cpu;
+
+	cpu = m->cpu[i];
+	m->cpu[i] = cpu->next;
+	XFREE (MTYPE_THREAD_STATS, cpu);
+      }
+
+  if (m->timer.array)
+    XFREE (MTYPE_THREAD_MASTER, m->timer.array);
+  if (m->pollfd)
+    {
+      XFREE (MTYPE_THREAD_MASTER, m->pollfd);
+      XFREE (MTYPE_THREAD_MASTER, m->pollthread);
+    }
   XFREE (MTYPE_THREAD_MASTER, m);
 }
 
@@ -220,10 +412,11 @@ thread_new (struct thread_master *m)
 
 /* Add new read thread. */
 struct thread *
-thread_add_read (struct thread_master *m, 
-		 int (*func)(struct thread *),
-		 void *arg,
-		 int fd)
+funcname_thread_add_read (struct thread_master *m, 
+			  int (*func)(struct thread *),
+			  void *arg,
+			  int fd,
+			  char *funcname)
 {
   struct thread *thread;
 
@@ -245,22 +438,25 @@ thread_add_read (struct thread_master *m,
   thread->master = m;
   thread->func = func;
   thread->arg = arg;
+  thread->cpu = thread_cpu_get (m, func, funcname);
 #ifdef DEBUG
   printf ("fd added [%d]\n", fd);
 #endif /* DEBUG */
   FD_SET (fd, &m->readfd);
   thread->u.fd = fd;
   thread_list_add (&m->read, thread);
+  thread_poll_add (m, thread, POLLIN);
 
   return thread;
 }
 
 /* Add new write thread. */
 struct thread *
-thread_add_write (struct thread_master *m,
-		 int (*func)(struct thread *),
-		 void *arg,
-		 int fd)
+funcname_thread_add_write (struct thread_master *m,
+			   int (*func)(struct thread *),
+			   void *arg,
+			   int fd,
+			   char *funcname)
 {
   struct thread *thread;
 
@@ -282,38 +478,25 @@ thread_add_write (struct thread_master *m,
   thread->master = m;
   thread->func = func;
   thread->arg = arg;
+  thread->cpu = thread_cpu_get (m, func, funcname);
   FD_SET (fd, &m->writefd);
   thread->u.fd = fd;
   thread_list_add (&m->write, thread);
+  thread_poll_add (m, thread, POLLOUT);
 
   return thread;
 }
 
-/* timer compare */
-static int
-thread_timer_cmp (struct timeval a, struct timeval b)
-{
-  if (a.tv_sec > b.tv_sec) 
-    return 1;
-  if (a.tv_sec < b.tv_sec)
-    return -1;
-  if (a.tv_usec > b.tv_usec)
-    return 1;
-  if (a.tv_usec < b.tv_usec)
-    return -1;
-  return 0;
-}
-
 /* Add timer event thread. */
 struct thread *
-thread_add_timer (struct thread_master *m,
-		  int (*func)(struct thread *),
-		  void *arg,
-		  long timer)
+funcname_thread_add_timer (struct thread_master *m,
+			   int (*func)(struct thread *),
+			   void *arg,
+			   long timer,
+			   char *funcname)
 {
   struct timeval timer_now;
   struct thread *thread;
-  struct thread *tt;
 
 #ifdef DEBUG
   printf ("add timer\n");
@@ -327,31 +510,25 @@ thread_add_timer (struct thread_master *m,
   thread->master = m;
   thread->func = func;
   thread->arg = arg;
+  thread->cpu = thread_cpu_get (m, func, funcname);
 
   /* Do we need jitter here? */
   gettimeofday (&timer_now, NULL);
   timer_now.tv_sec += timer;
   thread->u.sands = timer_now;
 
-  /* Sort by timeval. */
-  for (tt = m->timer.head; tt; tt = tt->next)
-    if (thread_timer_cmp (thread->u.sands, tt->u.sands) <= 0)
-      break;
-
-  if (tt)
-    thread_list_add_before (&m->timer, tt, thread);
-  else
-    thread_list_add (&m->timer, thread);
+  thread_heap_add (&m->timer, thread);
 
   return thread;
 }
 
 /* Add simple event thread. */
 struct thread *
-thread_add_event (struct thread_master *m,
-		  int (*func)(struct thread *), 
-		  void *arg,
-		  int val)
+funcname_thread_add_event (struct thread_master *m,
+			   int (*func)(struct thread *), 
+			   void *arg,
+			   int val,
+			   char *funcname)
 {
   struct thread *thread;
 
@@ -367,6 +544,7 @@ thread_add_event (struct thread_master *m,
   thread->master = m;
   thread->func = func;
   thread->arg = arg;
+  thread->cpu = thread_cpu_get (m, func, funcname);
   thread->u.val = val;
   thread_list_add (&m->event, thread);
 
@@ -387,6 +565,7 @@ thread_cancel (struct thread *thread)
       assert (FD_ISSET (thread->u.fd, &thread->master->readfd));
       FD_CLR (thread->u.fd, &thread->master->readfd);
       thread_list_delete (&thread->master->read, thread);
+      thread_poll_delete (thread->master, thread);
       break;
     case THREAD_WRITE:
 #ifdef DEBUG
@@ -395,12 +574,13 @@ thread_cancel (struct thread *thread)
       assert (FD_ISSET (thread->u.fd, &thread->master->writefd));
       FD_CLR (thread->u.fd, &thread->master->writefd);
       thread_list_delete (&thread->master->write, thread);
+      thread_poll_delete (thread->master, thread);
       break;
     case THREAD_TIMER:
 #ifdef DEBUG
       printf ("cancel timer\n");
 #endif /* DEBUG */  
-      thread_list_delete (&thread->master->timer, thread);
+      thread_heap_delete (&thread->master->timer, thread);
       break;
     case THREAD_EVENT:
 #ifdef DEBUG
@@ -481,14 +661,12 @@ struct thread *
 thread_fetch (struct thread_master *m, 
 	      struct thread *fetch)
 {
+  int i;
   int ret;
   struct thread *thread;
-  fd_set readfd;
-  fd_set writefd;
-  fd_set exceptfd;
   struct timeval timer_now;
   struct timeval timer_min;
-  struct timeval *timer_wait;
+  int timeout;
 
   assert (m != NULL);
 
@@ -503,18 +681,17 @@ thread_fetch (struct thread_master *m,
       return fetch;
     }
 
-  /* Calculate select wait timer. */
-  if (m->timer.head)
+  /* Calculate poll wait timer, rounded up to a millisecond so that
+     we don't wake up just before the first timer is due. */
+  if (m->timer.count)
     {
       gettimeofday (&timer_now, NULL);
-      timer_min = m->timer.head->u.sands;
+      timer_min = m->timer.array[0]->u.sands;
       timer_min = thread_timer_sub (timer_min, timer_now);
       if (timer_min.tv_sec < 0)
-	{
-	  timer_min.tv_sec = 0;
-	  timer_min.tv_usec = 10;
-	}
-      timer_wait = &timer_min;
+	timeout = 0;
+      else
+	timeout = timer_min.tv_sec * 1000 + (timer_min.tv_usec + 999) / 1000;
 #ifdef DEBUG
       thread_timer_dump (timer_min);
 #endif /* DEBUG */
@@ -524,24 +701,10 @@ thread_fetch (struct thread_master *m,
 #ifdef DEBUG
       printf ("timer_wait is NULL\n");
 #endif /* DEBUG */
-      timer_wait = NULL;
+      timeout = -1;
     }
 
-  /* Call select function. */
-  readfd = m->readfd;
-  writefd = m->writefd;
-  exceptfd = m->exceptfd;
-
 #ifdef DEBUG
-  {
-    int i;
-    printf ("readfd : ");
-    for (i = 0; i < FD_SETSIZE; i++)
-      if (FD_ISSET (i, &readfd))
-	printf ("[%d] ", i);
-    printf ("\n");
-
-  }
   {
     struct thread *t;
 
@@ -552,98 +715,64 @@ thread_fetch (struct thread_master *m,
   }
 #endif /* DEBUG */
 
-  ret = select (FD_SETSIZE, &readfd, &writefd, &exceptfd, timer_wait);
+  /* The poll array is kept current as threads come and go, so there
+     is nothing to rebuild here. */
+  ret = poll (m->pollfd, m->pollcount, timeout);
   if (ret < 0)
     {
       if (errno != EINTR)
 	{
 	  /* Real error. */
-	  zlog_warn ("select error: %s", strerror (errno));
+	  zlog_warn ("poll error: %s", strerror (errno));
 	  assert (0);
 	}
       /* Signal is coming. */
       goto retry;
     }
 
-#ifdef DEBUG
-  {
-    int i;
-    printf ("after select readfd : ");
-    for (i = 0; i < FD_SETSIZE; i++)
-      if (FD_ISSET (i, &readfd))
-	printf ("[%d] ", i);
-    printf ("\n");
-  }
-#endif /* DEBUG */
-
-  /* Read thead. */
-  thread = m->read.head;
-  while (thread)
+  /* Read and write threads whose fd is ready.  Deleting slot i moves
+     the last entry into it, so look at i again before going on. */
+  for (i = 0; ret > 0 && i < m->pollcount;)
     {
       struct thread *t;
-      
-      t = thread;
-      thread = t->next;
 
-      if (FD_ISSET (t->u.fd, &readfd))
+      if (! m->pollfd[i].revents)
+	{
+	  i++;
+	  continue;
+	}
+      ret--;
+
+      t = m->pollthread[i];
+      if (t->type == THREAD_READ)
 	{
 	  assert (FD_ISSET (t->u.fd, &m->readfd));
 	  FD_CLR(t->u.fd, &m->readfd);
 	  thread_list_delete (&m->read, t);
-	  thread_list_add (&m->event, t);
-	  t->type = THREAD_EVENT;
 	}
-    }
-#ifdef DEBUG
-  {
-    struct thread *t;
-
-    printf ("readms : ");
-    for (t = m->read.head; t; t = t->next)
-      printf ("[%d] ", t->u.fd);
-    printf ("\n");
-  }
-#endif /* DEBUG */      
-
-  /* Write thead. */
-  thread = m->write.head;
-  while (thread)
-    {
-      struct thread *t;
-
-      t = thread;
-      thread = t->next;
-
-      if (FD_ISSET (t->u.fd, &writefd))
+      else
 	{
 	  assert (FD_ISSET (t->u.fd, &m->writefd));
 	  FD_CLR(t->u.fd, &m->writefd);
 	  thread_list_delete (&m->write, t);
-	  thread_list_add (&m->event, t);
-	  t->type = THREAD_EVENT;
 	}
+      thread_poll_delete (m, t);
+      thread_list_add (&m->event, t);
+      t->type = THREAD_EVENT;
     }
 
-  /* Exception thead. */
-  /*...*/
-
   /* Timer update. */
   gettimeofday (&timer_now, NULL);
 
-  thread = m->timer.head;
-  while (thread)
+  while (m->timer.count
+	 && thread_timer_cmp (timer_now, m->timer.array[0]->u.sands) >= 0)
     {
       struct thread *t;
 
-      t = thread;
-      thread = t->next;
-
-      if (thread_timer_cmp (timer_now, t->u.sands) >= 0)
-      {
-	thread_list_delete (&m->timer, t);
-	thread_list_add (&m->event, t);
-	t->type = THREAD_EVENT;
-      }
+      t = m->timer.array[0];
+      thread_heap_delete (&m->timer, t);
+      thread_list_add (&m->event, t);
+      t->type = THREAD_EVENT;
     }
 
   /* Return one event. */
@@ -680,8 +809,10 @@ thread_master_debug (struct thread_master *m)
   thread_list_debug (&m->read);
   printf ("writelist : ");
   thread_list_debug (&m->write);
-  printf ("timerlist : ");
-  thread_list_debug (&m->timer);
+  printf ("timerheap : count [%d] size [%d]\n",
+	  m->timer.count, m->timer.size);
+  printf ("pollarray : count [%d] size [%d]\n",
+	  m->pollcount, m->pollsize);
   printf ("eventlist : ");
   thread_list_debug (&m->event);
   printf ("unuselist : ");
@@ -716,8 +847,36 @@ thread_call (struct thread *thread)
   pthread_create (&thread->id, NULL, (void *(*)(void *))thread->func, thread);
   pthread_detach (thread->id);
 #else
+  struct timeval before, after;
+  unsigned long elapsed;
+
   thread->id = thread_get_id ();
+
+  if (! thread->cpu)
+    {
+      (*thread->func) (thread);
+      return;
+    }
+
+  gettimeofday (&before, NULL);
   (*thread->func) (thread);
+  gettimeofday (&after, NULL);
+
+  after = thread_timer_sub (after, before);
+  if (after.tv_sec < 0)
+    after.tv_sec = after.tv_usec = 0;	/* clock stepped back */
+  elapsed = after.tv_sec * TIMER_SEC_MICRO + after.tv_usec;
+
+  thread->cpu->calls++;
+  thread->cpu->total.tv_sec += after.tv_sec;
+  thread->cpu->total.tv_usec += after.tv_usec;
+  if (thread->cpu->total.tv_usec >= TIMER_SEC_MICRO)
+    {
+      thread->cpu->total.tv_usec -= TIMER_SEC_MICRO;
+      thread->cpu->total.tv_sec++;
+    }
+  if (elapsed > thread->cpu->max)
+    thread->cpu->max = elapsed;
 #endif /* HAVE_PTHREAD */
 }
 
@@ -746,3 +905,73 @@ thread_execute (struct thread_master *m,
 
   return (struct thread *)NULL;
 }
+
+/* Print callbacks run and time spent per event function. */
+static void
+thread_cpu_show (struct vty *vty, struct thread_master *m)
+{
+  int i;
+  struct thread_cpu *cpu;
+  double total;
+
+  vty_out (vty, "%10s %10s %10s %10s  %s%s",
+	   "Total ms", "Calls", "Avg us", "Max us", "Function", VTY_NEWLINE);
+
+  for (i = 0; i < THREAD_CPU_HASH_SIZE; i++)
+    for (cpu = m->cpu[i]; cpu; cpu = cpu->next)
+      {
+	if (! cpu->calls)
+	  continue;
+	total = cpu->total.tv_sec * 1000000.0 + cpu->total.tv_usec;
+	vty_out (vty, "%10.0f %10lu %10.0f %10lu  %s%s",
+		 total / 1000, cpu->calls, total / cpu->calls, cpu->max,
+		 cpu->funcname, VTY_NEWLINE);
+      }
+}
+
+DEFUN (show_thread_cpu,
+       show_thread_cpu_cmd,
+       "show thread cpu",
+       SHOW_STR
+       "Thread information\n"
+       "Thread CPU usage\n")
+{
+  struct thread_master *m;
+
+  for (m = thread_master_list; m; m = m->next)
+    thread_cpu_show (vty, m);
+
+  return CMD_SUCCESS;
+}
+
+DEFUN (clear_thread_cpu,
+       clear_thread_cpu_cmd,
+       "clear thread cpu",
+       CLEAR_STR
+       "Thread information\n"
+       "Thread CPU usage\n")
+{
+  struct thread_master *m;
+  struct thread_cpu *cpu;
+  int i;
+
+  for (m = thread_master_list; m; m = m->next)
+    for (i = 0; i < THREAD_CPU_HASH_SIZE; i++)
+      for (cpu = m->cpu[i]; cpu; cpu = cpu->next)
+	{
+	  cpu->calls = 0;
+	  cpu->total.tv_sec = cpu->total.tv_usec = 0;
+	  cpu->max = 0;
+	}
+
+  return CMD_SUCCESS;
+}
+
+/* Install thread commands. */
+void
+thread_init ()
+{
+  install_element (VIEW_NODE, &show_thread_cpu_cmd);
+  install_element (ENABLE_NODE, &show_thread_cpu_cmd);
+  install_element (ENABLE_NODE, &clear_thread_cpu_cmd);
+}
@@ -31,18 +31,49 @@ struct thread_list
   int count;
 };
 
+/* Timer threads as a binary heap ordered by expiry. */
+struct thread_heap
+{
+  struct thread **array;
+  int count;
+  int size;
+};
+
+/* Callbacks run and time spent in them, per event function. */
+struct thread_cpu
+{
+  int (*func) (struct thread *);
+  char *funcname;
+  unsigned long calls;
+  struct timeval total;
+  unsigned long max;		/* longest call, microseconds */
+  struct thread_cpu *next;	/* hash chain */
+};
+
+#define THREAD_CPU_HASH_SIZE 64
+
 /* Master of the theads. */
 struct thread_master
 {
   struct thread_list read;
   struct thread_list write;
-  struct thread_list timer;
+  struct thread_heap timer;
   struct thread_list event;
   struct thread_list unuse;
   fd_set readfd;
   fd_set writefd;
   fd_set exceptfd;
   unsigned long alloc;
+
+  /* poll() array kept up to date by thread_add_read/write and
+     thread_cancel, with the thread waiting on each entry. */
+  struct pollfd *pollfd;
+  struct thread **pollthread;
+  int pollcount;
+  int pollsize;
+
+  struct thread_cpu *cpu[THREAD_CPU_HASH_SIZE];
+  struct thread_master *next;	/* all masters, for show thread cpu */
 };
 
 /* Thread itself. */
@@ -60,6 +91,8 @@ struct thread
     int fd;			/* file descriptor in case of read/write. */
     struct timeval sands;	/* rest of time sands value. */
   } u;
+  int index;			/* slot in the timer heap or poll array. */
+  struct thread_cpu *cpu;	/* statistics for func. */
 };
 
 /* Macros. */
@@ -67,32 +100,45 @@ struct thread
 #define THREAD_FD(X)  ((X)->u.fd)
 #define THREAD_VAL(X) ((X)->u.val)
 
+/* The event function's name is recorded for show thread cpu. */
+#define thread_add_read(m,f,a,v) funcname_thread_add_read(m,f,a,v,#f)
+#define thread_add_write(m,f,a,v) funcname_thread_add_write(m,f,a,v,#f)
+#define thread_add_timer(m,f,a,v) funcname_thread_add_timer(m,f,a,v,#f)
+#define thread_add_event(m,f,a,v) funcname_thread_add_event(m,f,a,v,#f)
+
 /* Prototypes. */
 struct thread_master *thread_make_master ();
 
+void
+thread_init ();
+
 struct thread *
-thread_add_read (struct thread_master *m, 
-		 int (*func)(struct thread *),
-		 void *arg,
-		 int fd);
+funcname_thread_add_read (struct thread_master *m, 
+			  int (*func)(struct thread *),
+			  void *arg,
+			  int fd,
+			  char *funcname);
 
 struct thread *
-thread_add_write (struct thread_master *m,
-		 int (*func)(struct thread *),
-		 void *arg,
-		 int fd);
+funcname_thread_add_write (struct thread_master *m,
+			   int (*func)(struct thread *),
+			   void *arg,
+			   int fd,
+			   char *funcname);
 
 struct thread *
-thread_add_timer (struct thread_master *m,
-		  int (*func)(struct thread *),
-		  void *arg,
-		  long timer);
+funcname_thread_add_timer (struct thread_master *m,
+			   int (*func)(struct thread *),
+			   void *arg,
+			   long timer,
+			   char *funcname);
 
 struct thread *
-thread_add_event (struct thread_master *m,
-		  int (*func)(struct thread *), 
-		  void *arg,
-		  int val);
+funcname_thread_add_event (struct thread_master *m,
+			   int (*func)(struct thread *), 
+			   void *arg,
+			   int val,
+			   char *funcname);
 
 void
 thread_cancel (struct thread *thread);
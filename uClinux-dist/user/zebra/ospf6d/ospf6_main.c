@@ -234,6 +234,7 @@ main (int argc, char **argv)
   vty_init ();
   ospf6_init ();
   memory_init ();
+  thread_init ();
   sort_node ();
 
   nexthop_init ();
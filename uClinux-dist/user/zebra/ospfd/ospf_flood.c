@@ -206,7 +206,16 @@ ospf_flood (struct ospf_neighbor *nbr, struct ospf_lsa *current,
      procedure cannot overwrite the newly installed LSA until
      MinLSArrival seconds have elapsed. */  
   if (!current || ospf_lsa_different (current, new))
-    ospf_spf_calculate_schedule ();
+    {
+      /* Only router- and network-LSAs change the shortest-path
+	 trees; the rest need just the inter-area and AS-external
+	 routes done again (RFC2328 16.5, 16.6). */
+      if (new->data->type == OSPF_ROUTER_LSA
+	  || new->data->type == OSPF_NETWORK_LSA)
+	ospf_spf_calculate_schedule ();
+      else
+	ospf_ia_calculate_schedule ();
+    }
 
   SET_FLAG (new->flags, OSPF_LSA_RECEIVED);
   ospf_lsa_is_self_originated (new); /* Let it set the flag */
@@ -1647,9 +1647,9 @@ ospf_summary_lsa_install (struct ospf_area *area, struct ospf_lsa *new)
   if (IS_DEBUG_OSPF (lsa, LSA_FLOODING))
     zlog_info ("Z: ospf_summary_lsa_install(): Well done !");
 
-  /* Schedule SPF calculation. */
+  /* Schedule inter-area route calculation. */
   if (!CHECK_FLAG (lsa->flags, OSPF_LSA_SELF))
-    ospf_spf_calculate_schedule ();
+    ospf_ia_calculate_schedule ();
 
   if (IS_DEBUG_OSPF (lsa, LSA_FLOODING))
     zlog_info ("Z: ospf_summary_lsa_install(): SPF scheduled");
@@ -1691,8 +1691,9 @@ ospf_summary_asbr_lsa_install (struct ospf_area *area, struct ospf_lsa *new)
   lsa = new_lsdb_insert (area->lsdb, new);
   lsa->lsdb = area->lsdb;
 
-  /* Schedule SPF calculation. */
-  ospf_spf_calculate_schedule ();
+  /* Schedule inter-area route calculation. */
+  if (!CHECK_FLAG (lsa->flags, OSPF_LSA_SELF))
+    ospf_ia_calculate_schedule ();
 
 #if 0
   if (CHECK_FLAG (lsa->flags, OSPF_LSA_SELF))
@@ -2080,6 +2081,7 @@ ospf_lsa_lookup_by_id (struct ospf_area *area, u_int32_t type,
 {
   struct ospf_lsa *lsa;
   struct route_node *rn;
+  struct prefix_ls lp;
 
   switch (type)
     {
@@ -2087,13 +2089,22 @@ ospf_lsa_lookup_by_id (struct ospf_area *area, u_int32_t type,
       return new_lsdb_lookup_by_id (area->lsdb, type, id, id);
       break;
     case OSPF_NETWORK_LSA:
-      for (rn = route_top (NETWORK_LSDB (area)); rn; rn = route_next (rn))
+      /* The LSDB is keyed on ID then advertising router, so all the
+	 network-LSAs with this ID are under the ID's /32 node. */
+      memset (&lp, 0, sizeof (struct prefix_ls));
+      lp.prefixlen = IPV4_MAX_BITLEN;
+      lp.id = id;
+
+      for (rn = route_node_get (NETWORK_LSDB (area), (struct prefix *) &lp);
+	   rn && prefix_match ((struct prefix *) &lp, &rn->p);
+	   rn = route_next (rn))
 	if ((lsa = rn->info))
-	  if (IPV4_ADDR_SAME (&lsa->data->id, &id))
-	    {
-	      route_unlock_node (rn);
-	      return lsa;
-	    }
+	  {
+	    route_unlock_node (rn);
+	    return lsa;
+	  }
+      if (rn)
+	route_unlock_node (rn);
       break;
     case OSPF_SUMMARY_LSA:
     case OSPF_SUMMARY_LSA_ASBR:
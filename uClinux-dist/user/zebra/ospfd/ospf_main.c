@@ -220,6 +220,7 @@ main (int argc, char **argv)
   debug_init ();
   vty_init ();
   memory_init ();
+  thread_init ();
 
   access_list_init ();
 
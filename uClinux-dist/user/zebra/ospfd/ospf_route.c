@@ -98,6 +98,25 @@ ospf_path_free (struct ospf_path *op)
   XFREE (MTYPE_OSPF_PATH, op);
 }
 
+struct ospf_route *
+ospf_route_dup (struct ospf_route *or)
+{
+  struct ospf_route *new;
+  listnode node;
+
+  new = ospf_route_new ();
+  memcpy (new, or, sizeof (struct ospf_route));
+
+  if (or->path)
+    {
+      new->path = list_init ();
+      for (node = listhead (or->path); node; nextnode (node))
+	list_add_node (new->path, ospf_path_dup (node->data));
+    }
+
+  return new;
+}
+
 void
 ospf_route_delete (struct route_table *rt)
 {
@@ -141,6 +160,24 @@ ospf_route_table_free (struct route_table *rt)
    route_table_finish (rt);
 }
 
+struct route_table *
+ospf_route_table_dup (struct route_table *rt)
+{
+  struct route_table *new;
+  struct route_node *rn, *rn2;
+
+  new = route_table_init ();
+
+  for (rn = route_top (rt); rn; rn = route_next (rn))
+    if (rn->info)
+      {
+	rn2 = route_node_get (new, &rn->p);
+	rn2->info = ospf_route_dup (rn->info);
+      }
+
+  return new;
+}
+
 /* If a prefix and a nexthop match any route in the routing table,
    then return 1, otherwise return 0. */
 int
@@ -155,40 +192,33 @@ ospf_route_match_same (struct route_table *rt, int type,
   if (!rt || !prefix)
     return 0;
 
-  /* Check each route exists in the routing table. */
-  for (rn = route_top (rt); rn; rn = route_next (rn))
-    if ((or = rn->info) != NULL)
-      if (or->type == type)
+  /* Check the route exists in the routing table. */
+  rn = route_node_lookup (rt, (struct prefix *) prefix);
+  if (! rn)
+    return 0;
+  route_unlock_node (rn);
+
+  if ((or = rn->info) == NULL || or->type != type)
+    return 0;
+
+  if (or->type == OSPF_DESTINATION_NETWORK)
+    {
+      for (node = listhead (or->path); node; nextnode (node))
 	{
-	  if (or->type == OSPF_DESTINATION_NETWORK)
-	    for (node = listhead (or->path); node; nextnode (node))
-	      {
-		op = getdata (node);
-
-		if (op->nexthop.s_addr != INADDR_ANY && nexthop &&
-		    prefix_same (&rn->p, (struct prefix *) prefix) &&
-		    IPV4_ADDR_SAME (&op->nexthop, &nexthop))
-		  /*
-		    !memcmp (&rn->p, prefix, sizeof (struct prefix_ipv4)) &&
-		    !memcmp (&op->nexthop, nexthop, sizeof (struct in_addr)))*/
-		  {
-		    route_unlock_node (rn);
-		    return 1;
-		  }
-	      }
-	  else if (or->type == OSPF_DESTINATION_DISCARD)
-	    if (prefix_same (&rn->p, (struct prefix *) prefix))
-         /* if (!memcmp (&rn->p, prefix, sizeof (struct prefix_ipv4))) */
-	      {
-		route_unlock_node (rn);
-		return 1;
-	      }
+	  op = getdata (node);
+
+	  if (op->nexthop.s_addr != INADDR_ANY && nexthop &&
+	      IPV4_ADDR_SAME (&op->nexthop, nexthop))
+	    return 1;
 	}
+    }
+  else if (or->type == OSPF_DESTINATION_DISCARD)
+    return 1;
 
   return 0;
 }
 
-/* rt: Old, cmprt: New */
+/* rt: Installed, cmprt: New */
 void
 ospf_route_delete_uniq (struct route_table *rt, struct route_table *cmprt)
 {
@@ -231,9 +261,12 @@ ospf_route_install (struct route_table *rt)
   struct ospf_path *path;
   listnode node;
 
+  /* Compare against ospf_top->new_table, which is what the previous
+     run installed.  old_table is a run older still. */
+
   /* Delete old routes. */
-  if (ospf_top->old_table)
-    ospf_route_delete_uniq (ospf_top->old_table, rt);
+  if (ospf_top->new_table)
+    ospf_route_delete_uniq (ospf_top->new_table, rt);
 
   /* Install new routes. */
   for (rn = route_top (rt); rn; rn = route_next (rn))
@@ -245,13 +278,13 @@ ospf_route_install (struct route_table *rt)
 	      path = getdata (node);
 
 	      if (path->nexthop.s_addr != INADDR_ANY &&
-		  !ospf_route_match_same (ospf_top->old_table, or->type,
+		  !ospf_route_match_same (ospf_top->new_table, or->type,
 					  (struct prefix_ipv4 *) &rn->p, 
 					  &path->nexthop))
 		ospf_zebra_add ((struct prefix_ipv4 *) &rn->p, &path->nexthop);
 	    }
 	else if (or->type == OSPF_DESTINATION_DISCARD)
-	  if (!ospf_route_match_same (ospf_top->old_table, or->type,
+	  if (!ospf_route_match_same (ospf_top->new_table, or->type,
 				      (struct prefix_ipv4 *) &rn->p, 0))
 	    ospf_zebra_add_discard ((struct prefix_ipv4 *) &rn->p);
       }
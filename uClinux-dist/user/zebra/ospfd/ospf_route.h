@@ -210,8 +210,10 @@ void ospf_path_free (struct ospf_path *op);
 struct ospf_path *ospf_path_lookup (list, struct ospf_path *);
 struct ospf_route *ospf_route_new ();
 void ospf_route_free (struct ospf_route *or);
+struct ospf_route *ospf_route_dup (struct ospf_route *or);
 void ospf_route_delete (struct route_table *rt);
 void ospf_route_table_free (struct route_table *rt);
+struct route_table *ospf_route_table_dup (struct route_table *rt);
 
 void ospf_route_install (struct route_table *);
 void ospf_route_table_dump (struct route_table *);
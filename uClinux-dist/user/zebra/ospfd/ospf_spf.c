@@ -141,44 +141,32 @@ ospf_spf_init (struct ospf_area *area)
   area->spf = v;
 }
 
-int
-ospf_spf_has_vertex (struct route_table *rv, struct route_table *nv,
-                     struct lsa_header *lsa)
-{
-  struct prefix p;
-  struct route_node *rn;
-
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_BITLEN;
-  p.u.prefix4 = lsa->id;
+/* Every vertex of a calculation, on the tree or a candidate, is kept
+   in a hash on (type, id), which replaces the walks of the candidate
+   list and the per-type route tables of the tree. */
+#define OSPF_VERTEX_HASH_SIZE 1024
 
-  if (lsa->type == OSPF_ROUTER_LSA)
-    rn = route_node_get (rv, &p);
-  else
-    rn = route_node_get (nv, &p);
+unsigned int
+ospf_vertex_hash_key (struct vertex *v)
+{
+  return (ntohl (v->id.s_addr) << 1) + v->type;
+}
 
-  if (rn->info != NULL)
-    {
-      route_unlock_node (rn);
-      return 1;
-    }
-  return 0;
+int
+ospf_vertex_hash_cmp (struct vertex *v1, struct vertex *v2)
+{
+  return v1->type == v2->type && IPV4_ADDR_SAME (&v1->id, &v2->id);
 }
 
-listnode
-ospf_vertex_lookup (list list, struct in_addr id, int type)
+struct vertex *
+ospf_vertex_lookup (struct Hash *vertices, struct in_addr id, int type)
 {
-  listnode node;
-  struct vertex *v;
+  struct vertex key;
 
-  for (node = listhead (list); node; nextnode (node))
-    {
-      v = (struct vertex *) getdata (node);
-      if (IPV4_ADDR_SAME (&id, &v->id) && type == v->type)
-        return node;
-    }
+  key.type = type;
+  key.id = id;
 
-  return NULL;
+  return hash_search (vertices, &key);
 }
 
 int
@@ -211,7 +199,7 @@ ospf_lsa_has_link (struct lsa_header *w, struct lsa_header *v)
 
       length = ntohs (w->length);
 
-      for (i = 0; i < ntohs (rl->links) || length >= 0; i++, length -= 12)
+      for (i = 0; i < ntohs (rl->links) && length >= 0; i++, length -= 12)
         {
           switch (rl->link[i].type)
             {
@@ -339,7 +327,7 @@ ospf_nexthop_calculation (struct ospf_area *area,
         nh->router.s_addr = 0; 
 
       zlog_info ("Z: resolved next hop: int: %s, next hop: %s",
-                 nh->ifp->name, inet_ntoa (nh->router));
+                 nh->ifp ? nh->ifp->name : "none", inet_ntoa (nh->router));
 
 /*      if (oi)*/
 
@@ -380,43 +368,117 @@ ospf_nexthop_calculation (struct ospf_area *area,
     }
 }
 
-void
-ospf_install_candidate (list candidate, struct vertex *w)
+/* The candidate list is a binary heap on distance.  When there is a
+   choice of vertices closest to the root, network vertices must be
+   chosen before router vertices in order to necessarily find all
+   equal-cost paths (RFC2328 16.1 (3)), so they sort first. */
+struct ospf_candidate
 {
-  listnode node;
-  struct vertex *cw;
+  struct vertex **vertex;
+  int count;
+  int size;
+};
+
+static int
+ospf_candidate_less (struct vertex *v1, struct vertex *v2)
+{
+  if (v1->distance != v2->distance)
+    return v1->distance < v2->distance;
+  return v1->type == OSPF_VERTEX_NETWORK && v2->type == OSPF_VERTEX_ROUTER;
+}
+
+static void
+ospf_candidate_set (struct ospf_candidate *candidate, int i, struct vertex *v)
+{
+  candidate->vertex[i] = v;
+  v->index = i;
+}
 
-  if (list_isempty (candidate))
+/* Move the vertex at I towards the root of the heap. */
+static void
+ospf_candidate_up (struct ospf_candidate *candidate, int i)
+{
+  struct vertex *v;
+  int parent;
+
+  v = candidate->vertex[i];
+  while (i > 0)
     {
-      list_add_node (candidate, w);
-      return;
+      parent = (i - 1) / 2;
+      if (! ospf_candidate_less (v, candidate->vertex[parent]))
+	break;
+      ospf_candidate_set (candidate, i, candidate->vertex[parent]);
+      i = parent;
     }
+  ospf_candidate_set (candidate, i, v);
+}
 
-  /* Install vertex with sorting by distance. */
-  for (node = listhead (candidate); node; nextnode (node))
+/* Move the vertex at I away from the root of the heap. */
+static void
+ospf_candidate_down (struct ospf_candidate *candidate, int i)
+{
+  struct vertex *v;
+  int child;
+
+  v = candidate->vertex[i];
+  while ((child = 2 * i + 1) < candidate->count)
     {
-      cw = (struct vertex *) getdata (node);
-      if (cw->distance > w->distance)
-        {
-          list_add_node_prev (candidate, node, w);
-          break;
-        }
-      else if (node->next == NULL)
-        {
-          list_add_node_next (candidate, node, w);
-          break;
-        }
+      if (child + 1 < candidate->count
+	  && ospf_candidate_less (candidate->vertex[child + 1],
+				  candidate->vertex[child]))
+	child++;
+      if (! ospf_candidate_less (candidate->vertex[child], v))
+	break;
+      ospf_candidate_set (candidate, i, candidate->vertex[child]);
+      i = child;
+    }
+  ospf_candidate_set (candidate, i, v);
+}
+
+void
+ospf_install_candidate (struct ospf_candidate *candidate, struct vertex *w)
+{
+  if (candidate->count == candidate->size)
+    {
+      candidate->size = candidate->size ? candidate->size * 2 : 64;
+      candidate->vertex = XREALLOC (MTYPE_OSPF_VERTEX, candidate->vertex,
+				    sizeof (struct vertex *) * candidate->size);
+    }
+
+  SET_FLAG (w->flags, OSPF_VERTEX_CANDIDATE);
+  ospf_candidate_set (candidate, candidate->count++, w);
+  ospf_candidate_up (candidate, w->index);
+}
+
+/* Remove the vertex closest to the root from the candidate list. */
+struct vertex *
+ospf_candidate_pop (struct ospf_candidate *candidate)
+{
+  struct vertex *v;
+
+  if (candidate->count == 0)
+    return NULL;
+
+  v = candidate->vertex[0];
+  UNSET_FLAG (v->flags, OSPF_VERTEX_CANDIDATE);
+
+  if (--candidate->count > 0)
+    {
+      ospf_candidate_set (candidate, 0, candidate->vertex[candidate->count]);
+      ospf_candidate_down (candidate, 0);
     }
+
+  return v;
 }
 
 /* RFC2328 Section 16.1 (2). */
 void
 ospf_spf_next (struct vertex *v, struct ospf_area *area,
-               list candidate, struct route_table *rv,
-               struct route_table *nv)
+               struct ospf_candidate *candidate, struct Hash *vertices)
 {
   struct ospf_lsa *w_lsa = NULL;
-  struct vertex *w, *cw;
+  struct vertex *w;
+  u_int32_t distance;
   u_char *p;
   u_char *lim;
   struct router_lsa_link *l = NULL;
@@ -508,7 +570,8 @@ ospf_spf_next (struct vertex *v, struct ospf_area *area,
 
       /* (c) If vertex W is already on the shortest-path tree, examine
          the next link in the LSA. */
-      if (ospf_spf_has_vertex (rv, nv, w_lsa->data))
+      w = ospf_vertex_lookup (vertices, w_lsa->data->id, w_lsa->data->type);
+      if (w && ! CHECK_FLAG (w->flags, OSPF_VERTEX_CANDIDATE))
         {
           zlog_info ("Z: The LSA is already in SPF");
           continue;
@@ -520,100 +583,52 @@ ospf_spf_next (struct vertex *v, struct ospf_area *area,
          vertex V and the advertised cost of the link between vertices
          V and W.  If D is: */
 
-      /* prepare vertex W. */
-      w = ospf_vertex_new (w_lsa);
-
       /* calculate link cost D. */
       if (v->lsa->type == OSPF_ROUTER_LSA)
-        w->distance = v->distance + ntohs (l->m[0].metric);
+        distance = v->distance + ntohs (l->m[0].metric);
       else
-        w->distance = v->distance;
+        distance = v->distance;
 
       /* Is there already vertex W in candidate list? */
-      node = ospf_vertex_lookup (candidate, w->id, w->type);
-      if (node == NULL)
+      if (w == NULL)
         {
+          w = ospf_vertex_new (w_lsa);
+          w->distance = distance;
+          hash_push (vertices, w);
+
           /* Calculate nexthop to W. */
           ospf_nexthop_calculation (area, v, w);
 
           ospf_install_candidate (candidate, w);
         }
+      /* if D is greater than. */
+      else if (w->distance < distance)
+        continue;
+      /* equal to. */
+      else if (w->distance == distance)
+        {
+          /* Calculate nexthop to W. */
+          ospf_nexthop_calculation (area, v, w);
+        }
+      /* less than. */
       else
         {
-          cw = (struct vertex *) getdata (node);
+          /* Forget the old paths and move W up the candidate list. */
+          for (node = listhead (w->nexthop); node; nextnode (node))
+            ospf_nexthop_free (node->data);
+          list_delete_all_node (w->nexthop);
 
-          /* if D is greater than. */
-          if (cw->distance < w->distance)
-            {
-              ospf_vertex_free (w);
-              continue;
-            }
-          /* equal to. */
-          else if (cw->distance == w->distance)
-            {
-              /* Calculate nexthop to W. */
-              ospf_nexthop_calculation (area, v, w);
-              list_add_list (cw->nexthop, w->nexthop);
-              list_delete_all_node (w->nexthop);
-              ospf_vertex_free (w);
-            }
-          /* less than. */
-          else
-            {
-              /* Calculate nexthop. */
-              ospf_nexthop_calculation (area, v, w);
+          w->lsa = w_lsa->data;
+          w->distance = distance;
 
-              /* Remove old vertex from candidate list. */
-              ospf_vertex_free (cw);
-              list_delete_by_val (candidate, cw);
+          /* Calculate nexthop. */
+          ospf_nexthop_calculation (area, v, w);
 
-              /* Install new to candidate. */
-              ospf_install_candidate (candidate, w);
-            }
+          ospf_candidate_up (candidate, w->index);
         }
     }
 }
 
-/* Add vertex V to SPF tree. */
-void
-ospf_spf_register (struct vertex *v, struct route_table *rv, 
-                   struct route_table *nv)
-{
-  struct prefix p;
-  struct route_node *rn;
-
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_BITLEN;
-  p.u.prefix4 = v->id;
-
-  if (v->type == OSPF_VERTEX_ROUTER)
-    rn = route_node_get (rv, &p);
-  else
-    rn = route_node_get (nv, &p);
-
-  rn->info = v;
-}
-
-void
-ospf_spf_route_free (struct route_table *table)
-{
-  struct route_node *rn;
-  struct vertex *v;
-
-  for (rn = route_top (table); rn; rn = route_next (rn))
-    {
-      if ((v = rn->info))
-	{
-	  ospf_vertex_free (v);
-	  rn->info = NULL;
-	}
-
-      route_unlock_node (rn);
-    }
-
-  route_table_finish (table);
-}
-
 void
 ospf_spf_dump (struct vertex *v, int i)
 {
@@ -730,6 +745,29 @@ ospf_rtrs_free (struct route_table *rtrs)
   route_table_finish (rtrs);
 }
 
+struct route_table *
+ospf_rtrs_dup (struct route_table *rtrs)
+{
+  struct route_table *new;
+  struct route_node *rn, *rn2;
+  list or_list;
+  listnode node;
+
+  new = route_table_init ();
+
+  for (rn = route_top (rtrs); rn; rn = route_next (rn))
+    if ((or_list = rn->info) != NULL)
+      {
+	rn2 = route_node_get (new, &rn->p);
+	rn2->info = list_init ();
+
+	for (node = listhead (or_list); node; nextnode (node))
+	  list_add_node (rn2->info, ospf_route_dup (node->data));
+      }
+
+  return new;
+}
+
 void
 ospf_rtrs_print (struct route_table *rtrs)
 {
@@ -787,11 +825,9 @@ void
 ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table, 
                     struct route_table *new_rtrs)
 {
-  list candidate;
-  listnode node;
+  struct ospf_candidate candidate;
   struct vertex *v;
-  struct route_table *rv;
-  struct route_table *nv;
+  struct Hash *vertices;
 
   zlog_info ("ospf_spf_calculate: Start");
   zlog_info ("ospf_spf_calculate: running Dijkstra for area %s", 
@@ -809,17 +845,18 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
 
   /* RFC2328 16.1. (1). */
   /* Initialize the algorithm's data structures. */ 
-  rv = route_table_init ();
-  nv = route_table_init ();
+  vertices = hash_new (OSPF_VERTEX_HASH_SIZE);
+  vertices->hash_key = ospf_vertex_hash_key;
+  vertices->hash_cmp = ospf_vertex_hash_cmp;
 
   /* Clear the list of candidate vertices. */ 
-  candidate = list_init ();
+  memset (&candidate, 0, sizeof (struct ospf_candidate));
 
   /* Initialize the shortest-path tree to only the root (which is the
      router doing the calculation). */
   ospf_spf_init (area);
   v = area->spf;
-  ospf_spf_register (v, rv, nv);
+  hash_push (vertices, v);
 
   /* Set Area A's TransitCapability to FALSE. */
   area->transit = OSPF_TRANSIT_FALSE;
@@ -828,34 +865,20 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
   for (;;)
     {
       /* RFC2328 16.1. (2). */
-      ospf_spf_next (v, area, candidate, rv, nv);
+      ospf_spf_next (v, area, &candidate, vertices);
 
       /* RFC2328 16.1. (3). */
       /* If at this step the candidate list is empty, the shortest-
          path tree (of transit vertices) has been completely built and
          this stage of the procedure terminates. */
-      if (listcount (candidate) == 0)
-        break;
-
       /* Otherwise, choose the vertex belonging to the candidate list
          that is closest to the root, and add it to the shortest-path
          tree (removing it from the candidate list in the
          process). */ 
-      node = listhead (candidate);
-      v = getdata (node);
-      ospf_vertex_add_parent (v);
-
-      /* Reveve from the candidate list. */
-      list_delete_by_val (candidate, v);
-
-      /* Add to SPF tree. */
-      ospf_spf_register (v, rv, nv);
+      if ((v = ospf_candidate_pop (&candidate)) == NULL)
+        break;
 
-      /* Note that when there is a choice of vertices closest to the
-         root, network vertices must be chosen before router vertices
-         in order to necessarily find all equal-cost paths. */
-      /* We don't do this at this moment, we should add the treatment
-         above codes. -- kunihiro. */
+      ospf_vertex_add_parent (v);
 
       /* RFC2328 16.1. (4). */
       if (v->type == OSPF_VERTEX_ROUTER)
@@ -876,11 +899,12 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
   ospf_spf_process_stubs (area, area->spf, new_table);
 
   /* Free all vertices which allocated for SPF calculation */
-  ospf_spf_route_free (rv);
-  ospf_spf_route_free (nv);
+  hash_clean (vertices, (void (*) (void *)) ospf_vertex_free);
+  hash_free (vertices);
 
   /* Free candidate list */
-  list_free (candidate);
+  if (candidate.vertex)
+    XFREE (MTYPE_OSPF_VERTEX, candidate.vertex);
 
   /* Increment SPF Calculation Counter. */
   area->spf_calculation++;
@@ -889,33 +913,14 @@ ospf_spf_calculate (struct ospf_area *area, struct route_table *new_table,
 
   zlog_info ("ospf_spf_calculate: Stop");
 }
-
-/* Timer for SPF calculation. */
-int
-ospf_spf_calculate_timer (struct thread *t)
-{
-  struct route_table *new_table, *new_rtrs;
-  struct ospf *ospf;
-  /* struct ospf_area *area; */
-  listnode node;
-
-  zlog_info ("SPF: Timer (SPF calculation expire)");
-  
-  ospf = THREAD_ARG (t);
-  ospf->t_spf_calc = NULL;
-
-  /* Allocate new table tree. */
-  new_table = route_table_init ();
-  new_rtrs  = route_table_init ();
-
-  ospf_vl_unapprove ();
-
-  /* Calculate SPF for each area. */
-  for (node = listhead (ospf->areas); node; node = nextnode (node))
-    ospf_spf_calculate (node->data, new_table, new_rtrs);
-
-  ospf_vl_shut_unapproved ();
 
+/* Everything after the per-area shortest-path trees: inter-area
+   routes, pruning, AS-external schedule, installing the new tables
+   and the ABR's summaries. */
+void
+ospf_spf_route_update (struct route_table *new_table,
+		       struct route_table *new_rtrs)
+{
   ospf_ia_routing (new_table, new_rtrs);
 
   ospf_prune_unreachable_networks (new_table);
@@ -951,12 +956,78 @@ ospf_spf_calculate_timer (struct thread *t)
   if (OSPF_IS_ASBR) 
     ospf_asbr_check ();
 #endif
+}
+
+/* Timer for SPF calculation. */
+int
+ospf_spf_calculate_timer (struct thread *t)
+{
+  struct route_table *new_table, *new_rtrs;
+  struct ospf *ospf;
+  /* struct ospf_area *area; */
+  listnode node;
+
+  zlog_info ("SPF: Timer (SPF calculation expire)");
+  
+  ospf = THREAD_ARG (t);
+  ospf->t_spf_calc = NULL;
+
+  /* Allocate new table tree. */
+  new_table = route_table_init ();
+  new_rtrs  = route_table_init ();
+
+  ospf_vl_unapprove ();
+
+  /* Calculate SPF for each area. */
+  for (node = listhead (ospf->areas); node; node = nextnode (node))
+    ospf_spf_calculate (node->data, new_table, new_rtrs);
+
+  ospf_vl_shut_unapproved ();
+
+  /* Keep the intra-area routes, so that a change of summary or
+     AS-external-LSAs alone need not run Dijkstra again. */
+  if (ospf->intra_table)
+    ospf_route_table_free (ospf->intra_table);
+  if (ospf->intra_rtrs)
+    ospf_rtrs_free (ospf->intra_rtrs);
+  ospf->intra_table = ospf_route_table_dup (new_table);
+  ospf->intra_rtrs = ospf_rtrs_dup (new_rtrs);
+
+  ospf_spf_route_update (new_table, new_rtrs);
 
   zlog_info ("SPF: calculation complete");
 
   return 0;
 }
 
+/* Timer for the partial calculation of RFC2328 16.5 and 16.6: start
+   again from the intra-area routes of the last full calculation. */
+int
+ospf_ia_calculate_timer (struct thread *t)
+{
+  struct ospf *ospf;
+
+  zlog_info ("SPF: Timer (partial calculation expire)");
+
+  ospf = THREAD_ARG (t);
+  ospf->t_ia_calc = NULL;
+
+  if (ospf->intra_table == NULL)
+    {
+      ospf_spf_calculate_schedule ();
+      return 0;
+    }
+
+  ospf_spf_route_update (ospf_route_table_dup (ospf->intra_table),
+			 ospf_rtrs_dup (ospf->intra_rtrs));
+
+  ospf->ia_calculation++;
+
+  zlog_info ("SPF: partial calculation complete");
+
+  return 0;
+}
+
 /* Add schedule for SPF calculation.  To avoid frequenst SPF calc, we
    set timer for SPF calc. */
 void
@@ -970,6 +1041,10 @@ ospf_spf_calculate_schedule ()
   if (!ospf_top)
     return;
 
+  /* The partial calculation would start from intra-area routes which
+     are about to change; the full one does its work as well. */
+  OSPF_TIMER_OFF (ospf_top->t_ia_calc);
+
   /* SPF calculation timer is already scheduled. */
   if (ospf_top->t_spf_calc)
     {
@@ -996,3 +1071,22 @@ ospf_spf_calculate_schedule ()
     thread_add_timer (master, ospf_spf_calculate_timer, ospf_top, delay);
 }
 
+/* Schedule the partial calculation, for changes to summary-LSAs and
+   AS-external-LSAs which leave the shortest-path trees alone. */
+void
+ospf_ia_calculate_schedule ()
+{
+  /* OSPF instance does not exist. */
+  if (!ospf_top)
+    return;
+
+  /* A full calculation is on its way, or this one already. */
+  if (ospf_top->t_spf_calc || ospf_top->t_ia_calc)
+    return;
+
+  zlog_info ("SPF: partial calculation timer scheduled");
+  ospf_top->t_ia_calc =
+    thread_add_timer (master, ospf_ia_calculate_timer, ospf_top,
+		      ospf_top->spf_delay);
+}
+
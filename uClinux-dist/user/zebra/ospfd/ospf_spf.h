@@ -24,6 +24,7 @@
 #define OSPF_VERTEX_NETWORK 2
 
 #define OSPF_VERTEX_PROCESSED      0x01
+#define OSPF_VERTEX_CANDIDATE      0x02
 
 
 struct vertex
@@ -33,6 +34,7 @@ struct vertex
   struct in_addr id;
   struct lsa_header *lsa;
   u_int32_t distance;
+  int index;			/* Position in the candidate heap. */
   list child;
   list nexthop;
 };
@@ -45,4 +47,7 @@ struct ospf_nexthop
 };
 
 void ospf_spf_calculate_schedule ();
+void ospf_ia_calculate_schedule ();
+struct route_table *ospf_rtrs_dup (struct route_table *);
+void ospf_rtrs_free (struct route_table *);
 /* void ospf_spf_calculate_timer_add (); */
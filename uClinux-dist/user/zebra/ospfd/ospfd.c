@@ -44,6 +44,7 @@
 #include "ospfd/ospf_neighbor.h"
 #include "ospfd/ospf_nsm.h"
 #include "ospfd/ospf_spf.h"
+#include "ospfd/ospf_route.h"
 #include "ospfd/ospf_packet.h"
 #include "ospfd/ospf_dump.h"
 #include "ospfd/ospf_zebra.h"
@@ -638,6 +639,7 @@ DEFUN (no_router_ospf,
   OSPF_TIMER_OFF (ospf_top->t_external_origin);
   OSPF_TIMER_OFF (ospf_top->t_router_id_update);
   OSPF_TIMER_OFF (ospf_top->t_spf_calc);
+  OSPF_TIMER_OFF (ospf_top->t_ia_calc);
   OSPF_TIMER_OFF (ospf_top->t_ase_calc);
   OSPF_TIMER_OFF (ospf_top->t_maxage);
   OSPF_TIMER_OFF (ospf_top->t_maxage_walker);
@@ -647,6 +649,11 @@ DEFUN (no_router_ospf,
   OSPF_TIMER_OFF (ospf_top->t_lsa_refresher);
   OSPF_TIMER_OFF (ospf_top->t_refresh_group);
 
+  if (ospf_top->intra_table)
+    ospf_route_table_free (ospf_top->intra_table);
+  if (ospf_top->intra_rtrs)
+    ospf_rtrs_free (ospf_top->intra_rtrs);
+
   XFREE (MTYPE_OSPF_TOP, ospf_top);
 
   ospf_top = NULL;
@@ -2362,6 +2369,10 @@ DEFUN (show_ip_ospf,
   vty_out (vty, " Number of external LSA %d%s",
 	   new_lsdb_count (ospf_top->external_lsa), VTY_NEWLINE);
 
+  /* Show partial route calculations. */
+  vty_out (vty, " Partial route calculation executed %lu times%s",
+	   ospf_top->ia_calculation, VTY_NEWLINE);
+
   /* Show number of areas attached. */
   vty_out (vty, " Number of areas attached to this router: %d%s%s",
            listcount (ospf_top->areas), VTY_NEWLINE, VTY_NEWLINE);
@@ -166,12 +166,16 @@ struct ospf
   struct route_table *old_rtrs;         /* Old ABR/ASBR RT. */
   struct route_table *new_rtrs;         /* New ABR/ASBR RT. */
 
+  struct route_table *intra_table;      /* Intra-area routes of the last */
+  struct route_table *intra_rtrs;       /* full SPF, for partial calc. */
+
   struct route_table *external_route;   /* External Route. */
   struct route_table *rtrs_external;	/* Table for Looking up AS-external-LSA
 					   related to an ASBR route. */
 
   /* Time stamps. */
   time_t ts_spf;			/* SPF calculation time stamp. */
+  unsigned long ia_calculation;		/* Partial calculation count. */
 
   list maxage_lsa;                      /* List of MaxAge LSA for deletion. */
   int redistribute;                     /* Num of redistributed protocols. */
@@ -183,6 +187,7 @@ struct ospf
   struct thread *t_asbr_check;          /* ASBR check timer. */
   struct thread *t_distribute_update;   /* Distirbute list update timer. */
   struct thread *t_spf_calc;	        /* SPF calculation timer. */
+  struct thread *t_ia_calc;	        /* Partial calculation timer. */
   struct thread *t_ase_calc;		/* ASE calculation timer. */
   struct thread *t_external_origin;	/* AS-external-LSA origin timer. */
   struct thread *t_maxage;              /* MaxAge LSA remover timer. */
@@ -0,0 +1,414 @@
+/* OSPF route calculation benchmark.
+ *
+ * This file is part of GNU Zebra.
+ *
+ * GNU Zebra is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * GNU Zebra is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Fills the backbone of an ospfd with a made-up topology: routers on
+   a ring with random point-to-point links across it, transit LANs of
+   a few routers each, a stub network per router, and some of the
+   routers ABRs announcing summary-LSAs, each prefix from two of them.
+   Then times the full calculation (Dijkstra and all that follows)
+   against the partial one run for a summary-LSA change, and checks
+   that both come to the same routing table.  Links against the ospfd
+   objects other than ospf_main.o.
+
+   usage: spfbench [-n routers] [-d degree] [-l lans] [-a abrs]
+		   [-s summaries] [-r rounds] */
+
+#include <zebra.h>
+
+#include "thread.h"
+#include "memory.h"
+#include "linklist.h"
+#include "prefix.h"
+#include "if.h"
+#include "table.h"
+#include "log.h"
+#include "zclient.h"
+
+#include "ospfd/ospfd.h"
+#include "ospfd/ospf_interface.h"
+#include "ospfd/ospf_asbr.h"
+#include "ospfd/ospf_lsa.h"
+#include "ospfd/ospf_lsdb.h"
+#include "ospfd/ospf_spf.h"
+#include "ospfd/ospf_route.h"
+
+struct thread_master *master;
+extern struct zebra *zclient;
+
+int ospf_if_new_hook (struct interface *);
+int ospf_spf_calculate_timer (struct thread *);
+int ospf_ia_calculate_timer (struct thread *);
+struct ospf *ospf_new ();
+
+#define ROUTER_ID(i)	htonl (0x0a000001 + (i))	  /* 10.0.0.1 up */
+#define STUB_NET(i)	htonl (0x0a800000 + ((i) << 8))	  /* 10.128.0.0/24 up */
+#define LAN_ADDR(l, j)	htonl (0xac100000 + ((l) << 8) + (j) + 1)
+#define ROOT_ADDR	htonl (0x0aff0001)		  /* 10.255.0.1 */
+
+int nrouter = 500;
+int degree = 4;
+int nlan;
+int nabr = 8;
+int nsummary = 2000;
+
+/* Adjacency, both ways. */
+struct link
+{
+  int to;
+  int cost;
+  int lan;			/* -1 for point-to-point. */
+  u_int32_t addr;		/* Interface address on the LAN. */
+};
+
+struct link **links;
+int *nlinks;
+
+struct ospf_area *area;
+struct ospf_lsa **summaries;
+
+static void
+add_link (int from, int to, int cost, int lan, u_int32_t addr)
+{
+  int i;
+
+  for (i = 0; i < nlinks[from]; i++)
+    if (links[from][i].to == to && links[from][i].lan == lan)
+      return;
+
+  links[from] = realloc (links[from], sizeof (struct link) * (nlinks[from] + 1));
+  links[from][nlinks[from]].to = to;
+  links[from][nlinks[from]].cost = cost;
+  links[from][nlinks[from]].lan = lan;
+  links[from][nlinks[from]].addr = addr;
+  nlinks[from]++;
+}
+
+static struct ospf_lsa *
+install (struct lsa_header *lsah, int type, struct in_addr id,
+	 struct in_addr adv_router, int length)
+{
+  struct ospf_lsa *lsa;
+
+  lsah->type = type;
+  lsah->id = id;
+  lsah->adv_router = adv_router;
+  lsah->options = OSPF_OPTION_E;
+  lsah->ls_seqnum = htonl (OSPF_INITIAL_SEQUENCE_NUMBER);
+  lsah->length = htons (length);
+
+  lsa = ospf_lsa_new ();
+  lsa->data = lsah;
+  lsa->area = area;
+  lsa->lsdb = area->lsdb;
+  new_lsdb_insert (area->lsdb, lsa);
+
+  return lsa;
+}
+
+static void
+make_topology ()
+{
+  struct router_lsa *rl;
+  struct network_lsa *nl;
+  struct summary_lsa *sl;
+  struct in_addr id, adv;
+  int **members;
+  int i, j, k, n, length;
+
+  links = calloc (nrouter, sizeof (struct link *));
+  nlinks = calloc (nrouter, sizeof (int));
+  srandom (1);
+
+  for (i = 0; i < nrouter * degree / 2; i++)
+    {
+      /* The ring first, so that everything is reachable. */
+      j = i < nrouter ? i : random () % nrouter;
+      k = i < nrouter ? (i + 1) % nrouter : random () % nrouter;
+      if (j == k)
+	continue;
+      n = 1 + random () % 20;
+      add_link (j, k, n, -1, 0);
+      add_link (k, j, n, -1, 0);
+    }
+
+  /* Transit LANs of four routers; the first is the DR. */
+  members = calloc (nlan, sizeof (int *));
+  for (i = 0; i < nlan; i++)
+    {
+      members[i] = calloc (4, sizeof (int));
+      for (j = 0; j < 4; j++)
+	{
+	  members[i][j] = random () % nrouter;
+	  add_link (members[i][j], members[i][0], 1 + random () % 10, i,
+		    LAN_ADDR (i, j));
+	}
+    }
+
+  for (i = 0; i < nrouter; i++)
+    {
+      length = OSPF_LSA_HEADER_SIZE + 4 + 12 * (nlinks[i] + 1);
+      rl = (struct router_lsa *) ospf_lsa_data_new (length);
+      if (i > 0 && i <= nabr)
+	rl->flags = ROUTER_LSA_BORDER;
+      rl->links = htons (nlinks[i] + 1);
+
+      for (j = 0; j < nlinks[i]; j++)
+	{
+	  if (links[i][j].lan < 0)
+	    {
+	      rl->link[j].type = LSA_LINK_TYPE_POINTOPOINT;
+	      rl->link[j].link_id.s_addr = ROUTER_ID (links[i][j].to);
+	      rl->link[j].link_data.s_addr = i ? htonl (j + 1) : ROOT_ADDR;
+	    }
+	  else
+	    {
+	      rl->link[j].type = LSA_LINK_TYPE_TRANSIT;
+	      rl->link[j].link_id.s_addr = LAN_ADDR (links[i][j].lan, 0);
+	      rl->link[j].link_data.s_addr = i ? links[i][j].addr : ROOT_ADDR;
+	    }
+	  rl->link[j].metric = htons (links[i][j].cost);
+	}
+      rl->link[j].type = LSA_LINK_TYPE_STUB;
+      rl->link[j].link_id.s_addr = STUB_NET (i);
+      rl->link[j].link_data.s_addr = htonl (0xffffff00);
+      rl->link[j].metric = htons (1);
+
+      id.s_addr = ROUTER_ID (i);
+      if (i == 0)
+	area->router_lsa_self = install ((struct lsa_header *) rl,
+					 OSPF_ROUTER_LSA, id, id, length);
+      else
+	install ((struct lsa_header *) rl, OSPF_ROUTER_LSA, id, id, length);
+    }
+
+  for (i = 0; i < nlan; i++)
+    {
+      length = OSPF_LSA_HEADER_SIZE + 4 + 4 * 4;
+      nl = (struct network_lsa *) ospf_lsa_data_new (length);
+      nl->mask.s_addr = htonl (0xffffff00);
+      for (j = 0; j < 4; j++)
+	nl->routers[j].s_addr = ROUTER_ID (members[i][j]);
+
+      id.s_addr = LAN_ADDR (i, 0);
+      adv.s_addr = ROUTER_ID (members[i][0]);
+      install ((struct lsa_header *) nl, OSPF_NETWORK_LSA, id, adv, length);
+    }
+
+  /* Every prefix from two ABRs. */
+  summaries = calloc (nsummary * 2, sizeof (struct ospf_lsa *));
+  for (i = 0; nabr && i < nsummary * 2; i++)
+    {
+      length = sizeof (struct summary_lsa);
+      sl = (struct summary_lsa *) ospf_lsa_data_new (length);
+      sl->mask.s_addr = htonl (0xffffff00);
+      sl->metric[2] = 1 + random () % 100;
+
+      id.s_addr = htonl (0x14000000 + ((i / 2) << 8));
+      adv.s_addr = ROUTER_ID (1 + (i / 2 + i % 2) % nabr);
+      summaries[i] = install ((struct lsa_header *) sl, OSPF_SUMMARY_LSA,
+			      id, adv, length);
+    }
+}
+
+/* The interface all the root's links go out of. */
+static void
+make_interface ()
+{
+  struct interface *ifp;
+  struct ospf_interface *oi;
+
+  ifp = if_get_by_name ("bench0");
+  ifp->flags = IFF_UP | IFF_RUNNING;
+
+  oi = ifp->info;
+  oi->flag = OSPF_IF_ENABLE;
+  oi->area = area;
+  oi->address = prefix_new ();
+  oi->address->family = AF_INET;
+  oi->address->prefixlen = 16;
+  oi->address->u.prefix4.s_addr = ROOT_ADDR;
+}
+
+struct result
+{
+  struct prefix p;
+  u_int32_t cost;
+  u_char path_type;
+  int paths;
+};
+
+static int
+snapshot (struct result **res)
+{
+  struct route_node *rn;
+  struct ospf_route *or;
+  int n = 0;
+
+  for (rn = route_top (ospf_top->new_table); rn; rn = route_next (rn))
+    n++;
+
+  *res = calloc (n, sizeof (struct result));
+
+  n = 0;
+  for (rn = route_top (ospf_top->new_table); rn; rn = route_next (rn))
+    if ((or = rn->info) != NULL)
+      {
+	(*res)[n].p = rn->p;
+	(*res)[n].cost = or->cost;
+	(*res)[n].path_type = or->path_type;
+	(*res)[n].paths = or->path ? listcount (or->path) : 0;
+	n++;
+      }
+
+  return n;
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval end;
+
+  gettimeofday (&end, NULL);
+  return (end.tv_sec - start->tv_sec) * 1000.0
+    + (end.tv_usec - start->tv_usec) / 1000.0;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct thread t;
+  struct timeval start;
+  struct result *full, *partial;
+  struct summary_lsa *sl;
+  struct in_addr area_id;
+  int rounds = 10;
+  int nfull, npartial;
+  int c, i;
+
+  nlan = -1;
+
+  while ((c = getopt (argc, argv, "n:d:l:a:s:r:")) != -1)
+    switch (c)
+      {
+      case 'n':
+	nrouter = atoi (optarg);
+	break;
+      case 'd':
+	degree = atoi (optarg);
+	break;
+      case 'l':
+	nlan = atoi (optarg);
+	break;
+      case 'a':
+	nabr = atoi (optarg);
+	break;
+      case 's':
+	nsummary = atoi (optarg);
+	break;
+      case 'r':
+	rounds = atoi (optarg);
+	break;
+      default:
+	fprintf (stderr, "usage: %s [-n routers] [-d degree] [-l lans] "
+		 "[-a abrs] [-s summaries] [-r rounds]\n", argv[0]);
+	exit (1);
+      }
+
+  if (nlan < 0)
+    nlan = nrouter / 10;
+  if (nrouter < 3 || degree < 2 || nabr == 1 || nabr >= nrouter
+      || rounds < 1)
+    {
+      fprintf (stderr, "need 3 routers, degree 2, no or 2 ABRs and more "
+	       "routers than ABRs\n");
+      exit (1);
+    }
+
+  zlog_default = openzlog (argv[0], ZLOG_NOLOG, ZLOG_OSPF,
+			   LOG_CONS|LOG_NDELAY|LOG_PID, LOG_DAEMON);
+  zlog_default->maskpri = LOG_WARNING;
+
+  master = thread_make_master ();
+  zclient = zclient_new ();
+  if_init ();
+  if_add_hook (IF_NEW_HOOK, ospf_if_new_hook);
+
+  ospf_top = ospf_new ();
+  ospf_top->router_id.s_addr = ROUTER_ID (0);
+  area_id.s_addr = OSPF_AREA_BACKBONE;
+  area = ospf_area_new (area_id);
+  list_add_node (ospf_top->areas, area);
+
+  make_interface ();
+  make_topology ();
+
+  printf ("%d routers, %d LANs, %lu LSAs (%d summaries from %d ABRs)\n",
+	  nrouter, nlan, new_lsdb_count (area->lsdb), nabr ? nsummary * 2 : 0,
+	  nabr);
+
+  memset (&t, 0, sizeof (struct thread));
+  t.arg = ospf_top;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < rounds; i++)
+    ospf_spf_calculate_timer (&t);
+  printf ("%-8s %10.3f msec/run\n", "full", elapsed (&start) / rounds);
+
+  /* A summary-LSA changes its metric before each run, as it would
+     from the flooding. */
+  gettimeofday (&start, NULL);
+  for (i = 0; i < rounds; i++)
+    {
+      if (nabr)
+	{
+	  sl = (struct summary_lsa *) summaries[i % (nsummary * 2)]->data;
+	  sl->metric[2] ^= 1;
+	}
+      ospf_ia_calculate_timer (&t);
+    }
+  printf ("%-8s %10.3f msec/run\n", "partial", elapsed (&start) / rounds);
+
+  /* Same answers as the full calculation? */
+  ospf_spf_calculate_timer (&t);
+  nfull = snapshot (&full);
+  ospf_ia_calculate_timer (&t);
+  npartial = snapshot (&partial);
+
+  if (nfull != npartial)
+    {
+      fprintf (stderr, "%d routes after full, %d after partial\n",
+	       nfull, npartial);
+      exit (1);
+    }
+  for (i = 0; i < nfull; i++)
+    if (! prefix_same (&full[i].p, &partial[i].p)
+	|| full[i].cost != partial[i].cost
+	|| full[i].path_type != partial[i].path_type
+	|| full[i].paths != partial[i].paths)
+      {
+	fprintf (stderr, "route mismatch for %s/%d\n",
+		 inet_ntoa (full[i].p.u.prefix4), full[i].p.prefixlen);
+	exit (1);
+      }
+
+  printf ("%d routes, %lu partial calculations\n", nfull,
+	  ospf_top->ia_calculation);
+  return 0;
+}
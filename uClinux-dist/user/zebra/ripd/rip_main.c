@@ -217,6 +217,7 @@ main (int argc, char **argv)
   cmd_init ();
   vty_init ();
   memory_init ();
+  thread_init ();
 
   /* RIP related initialization. */
   rip_init ();
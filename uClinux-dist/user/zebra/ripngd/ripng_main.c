@@ -206,6 +206,7 @@ main (int argc, char **argv)
   signal_init ();
   cmd_init ();
   vty_init ();
+  thread_init ();
 
   /* RIPngd inits. */
   ripng_init ();
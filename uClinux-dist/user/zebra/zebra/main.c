@@ -235,6 +235,7 @@ main (int argc, char **argv)
   cmd_init ();
   vty_init ();
   memory_init ();
+  thread_init ();
 
   /* Zebra related initialize. */
   zebra_init ();
@@ -262,6 +262,83 @@ rib_fib_unset (struct route_node *np, struct rib *rib)
   redistribute_delete (np, rib);
 }
 
+/* Does rib go to the kernel with this nexthop? */
+static int
+rib_kernel_same (int family, struct rib *rib, void *gate, int ifindex)
+{
+  if (ifindex && rib->u.ifindex && rib->u.ifindex != ifindex)
+    return 0;
+
+#ifdef HAVE_IPV6
+  if (family == AF_INET6)
+    {
+      if (gate)
+	return IPV6_ADDR_SAME (&rib->u.gate6, gate);
+      return IN6_IS_ADDR_UNSPECIFIED (&rib->u.gate6);
+    }
+#endif /* HAVE_IPV6 */
+
+  if (gate)
+    return IPV4_ADDR_SAME (&rib->u.gate4, gate);
+  return rib->u.gate4.s_addr == 0;
+}
+
+/* The kernel interface found out after kernel_add_ipv4 () or
+   kernel_add_ipv6 () had returned that a route is (installed) or
+   isn't in the kernel after all; a queued change failed.  Set the
+   fib flag to match, which is what the error paths of rib_add_ipv4 ()
+   and friends do for a change that fails at once. */
+void
+rib_kernel_update (int family, void *dest, int length, void *gate,
+		   int ifindex, int table, int installed)
+{
+  struct prefix p;
+  struct route_table *rib_table;
+  struct route_node *np;
+  struct rib *rib;
+  struct rib *fib;
+
+  bzero (&p, sizeof (struct prefix));
+  p.family = family;
+  p.prefixlen = length;
+#ifdef HAVE_IPV6
+  if (family == AF_INET6)
+    {
+      memcpy (&p.u.prefix6, dest, sizeof (struct in6_addr));
+      rib_table = ipv6_rib_table;
+    }
+  else
+#endif /* HAVE_IPV6 */
+    {
+      memcpy (&p.u.prefix4, dest, sizeof (struct in_addr));
+      rib_table = ipv4_rib_table;
+    }
+
+  np = route_node_lookup (rib_table, &p);
+  if (! np)
+    return;
+
+  fib = NULL;
+  for (rib = np->info; rib; rib = rib->next)
+    if (IS_RIB_FIB (rib))
+      fib = rib;
+
+  for (rib = np->info; rib; rib = rib->next)
+    if (! rib_system_route (rib->type) && rib->table == table
+	&& rib_kernel_same (family, rib, gate, ifindex))
+      break;
+
+  if (rib)
+    {
+      if (! installed && IS_RIB_FIB (rib))
+	rib_fib_unset (np, rib);
+      else if (installed && ! fib)
+	rib_fib_set (np, rib);
+    }
+
+  route_unlock_node (np);
+}
+
 int
 rib_add_ipv4_internal (struct prefix_ipv4 *p, struct rib *rib, int table)
 {
@@ -1531,7 +1608,7 @@ config_write_ip (struct vty *vty)
 void
 rib_init ()
 {
-  ipv4_rib_table = route_table_init ();
+  ipv4_rib_table = route_table_init_stride (8);
   ipv4_rib_static = route_table_init ();
   install_element (VIEW_NODE, &show_ip_cmd);
   install_element (ENABLE_NODE, &show_ip_cmd);
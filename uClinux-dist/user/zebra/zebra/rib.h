@@ -101,6 +101,8 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 		 struct in6_addr *gate, unsigned int ifindex, int table);
 #endif /* HAVE_IPV6 */
 
+void rib_kernel_update (int, void *, int, void *, int, int, int);
+
 void rib_if_up (struct interface *);
 void rib_if_down (struct interface *);
 void rib_if_delete (struct interface *);
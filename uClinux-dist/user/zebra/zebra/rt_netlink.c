@@ -39,55 +39,57 @@
 
 /* #define DEBUG */ 
 
-/* Socket interface to kernel */
-struct 
+/* Socket interface to kernel.  Route changes go out on their own
+   socket, which is in no multicast group, so that their acks don't
+   have to be picked out of the kernel's notifications. */
+struct nlsock
 {
   int sock;
   int seq;
   struct sockaddr_nl snl;
-} netlink = { -1, 0, {0} };
+  char *name;
+} netlink     = { -1, 0, {0}, "netlink-listen" },	/* kernel messages */
+  netlink_cmd = { -1, 0, {0}, "netlink-cmd" };		/* command channel */
 
 extern int rtm_table_default;
 
 /* Make socket for Linux netlink interface. */
 int
-netlink_socket ()
+netlink_socket (struct nlsock *nl, unsigned long groups)
 {
   int ret;
   struct sockaddr_nl snl;
 
-  netlink.sock = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-  if (netlink.sock < 0)
+  nl->sock = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+  if (nl->sock < 0)
     {
-      zlog (NULL, LOG_ERR, "Can't open netlink socket: %s", strerror (errno));
+      zlog (NULL, LOG_ERR, "Can't open %s socket: %s", nl->name,
+	    strerror (errno));
       return -1;
     }
 
-  ret = fcntl (netlink.sock, F_SETFL, O_NONBLOCK);
+  ret = fcntl (nl->sock, F_SETFL, O_NONBLOCK);
   if (ret < 0)
     {
-      zlog (NULL, LOG_ERR, "Can't set netlink socket flags: %s",
-           strerror (errno));
+      zlog (NULL, LOG_ERR, "Can't set %s socket flags: %s", nl->name,
+	    strerror (errno));
+      close (nl->sock);
+      nl->sock = -1;
       return -1;
     }
   
   bzero (&snl, sizeof snl);
   snl.nl_family = AF_NETLINK;
-  snl.nl_groups = 0;
-
-  snl.nl_groups = RTMGRP_LINK|RTMGRP_IPV4_ROUTE|RTMGRP_IPV4_IFADDR;
-#ifdef HAVE_IPV6
-  snl.nl_groups |= RTMGRP_IPV6_ROUTE|RTMGRP_IPV6_IFADDR;
-#endif /* HAVE_IPV6 */
+  snl.nl_groups = groups;
   
   /* Bind the socket to the netlink structure for anything. */
-  ret = bind (netlink.sock, (struct sockaddr *) &snl, sizeof snl);
+  ret = bind (nl->sock, (struct sockaddr *) &snl, sizeof snl);
   if (ret < 0)
     {
-      zlog (NULL, LOG_ERR, "Can't bind netlink socket to group 0: %s", 
-	    strerror (errno));
-      close (netlink.sock);
-      netlink.sock = -1;
+      zlog (NULL, LOG_ERR, "Can't bind %s socket to group 0x%x: %s", 
+	    nl->name, snl.nl_groups, strerror (errno));
+      close (nl->sock);
+      nl->sock = -1;
       return -1;
     }
   return ret;
@@ -967,179 +969,717 @@ addattr32 (struct nlmsghdr *n, int maxlen, int type, int data)
   return 0;
 }
 
-/* sendmsg() to netlink socket then recvmsg(). */
-int
-netlink_talk (struct nlmsghdr *n)
+#include "thread.h"
+#include "table.h"
+#include "memory.h"
+#include "command.h"
+
+extern struct thread_master *master;
+
+/* Route changes are not sent to the kernel one at a time.  They are
+   queued, and the queue goes out NETLINK_BATCH messages to a
+   sendmsg () on the command socket, each message asking for an ack.
+   Acks are matched back to the change by sequence number when they
+   come in.  kernel_add_ipv4 () has long since returned by then, so a
+   failed add is logged and reported to the rib through
+   rib_kernel_update (), and the route it took the place of is put
+   back, as rib_add_ipv4 () does for a change that fails at once.
+
+   While a change is queued a later one for the same prefix and table
+   is folded into it: an IPv4 delete followed by an add becomes a
+   single replace, an add followed by its own delete goes away, and a
+   replace followed by the delete of the new route goes back to being
+   the original delete.  IPv6 has no replace (fib6_add_rt2node ()
+   ignores NLM_F_REPLACE), so there the add goes in behind the delete.
+   Anything else is queued behind it, so the kernel still sees the
+   changes for a prefix in the order they were made.
+
+   The queue is flushed when a batch is full, or from a timer once a
+   pass of the main loop has gone by without anything new being
+   queued, so a burst from a routing daemon goes out in full batches
+   and a lone change waits only a pass of the loop. */
+
+/* Most messages per sendmsg () and most acks outstanding. */
+#define NETLINK_BATCH            64
+
+/* Largest route message: rtmsg plus gateway, destination and oif. */
+#define NETLINK_ROUTE_MSGSIZE   128
+
+/* Room for the acks of a full batch, and for errors to echo the
+   message they refer to. */
+#define NETLINK_CMD_RCVBUF   (256 * 1024)
+
+/* A queued route change. */
+struct netlink_route_req
 {
-  int status;
-  struct sockaddr_nl snl;
-  struct iovec iov = { (void*) n, n->nlmsg_len };
-  struct msghdr msg = {(void*) &snl, sizeof snl, &iov, 1, NULL, 0, 0};
-  char   buf[4096];
-  struct nlmsghdr *h;
+  struct netlink_route_req *next;
 
-  bzero (&snl, sizeof snl);
-  snl.nl_family = AF_NETLINK;
-  
-  n->nlmsg_seq = ++netlink.seq;
+  /* Index node, while a later change can still be folded into this
+     one. */
+  struct route_node *rn;
+
+  /* RTM_NEWROUTE or RTM_DELROUTE, 0 when folded away. */
+  int cmd;
+  int nlflags;
+
+  int family;
+  int length;
+  int table;
+  int flags;
+  int index;
+  int has_gate;
+  u_char dest[16];
+  u_char gate[16];
+
+  /* For an add that followed the delete of another route, folded
+     into a replace or queued behind it, the route it deleted. */
+  int replaces;
+  int del_flags;
+  int del_index;
+  int del_has_gate;
+  u_char del_gate[16];
+};
+
+struct
+{
+  /* Changes waiting to be sent, oldest first. */
+  struct netlink_route_req *head;
+  struct netlink_route_req *tail;
+  int count;
 
-  /* Send message to netlink interface. */
-  status = sendmsg (netlink.sock, &msg, 0);
-  if (status < 0)
+  /* The last queued change for each prefix. */
+  struct route_table *ipv4;
+#ifdef HAVE_IPV6
+  struct route_table *ipv6;
+#endif /* HAVE_IPV6 */
+
+  /* Changes sent and not yet acked; slot i went out with sequence
+     number seq + i. */
+  struct netlink_route_req *sent[NETLINK_BATCH];
+  int nsent;
+  int seq;
+  int unacked;
+
+  /* Changes queued since the flush timer was last looked at, and how
+     many times it has been put off. */
+  int changes;
+  int defer;
+
+  /* Adds the kernel turned down or that never reached it, for
+     netlink_queue_failed (). */
+  struct netlink_route_req *failed;
+
+  struct thread *t_flush;
+  struct thread *t_ack;
+  struct thread *t_failed;
+
+  /* Statistics. */
+  unsigned long queued;
+  unsigned long folded;
+  unsigned long cancelled;
+  unsigned long batches;
+  unsigned long messages;
+  unsigned long errors;
+} netlink_queue;
+
+void netlink_queue_flush ();
+int netlink_queue_timer (struct thread *);
+int netlink_queue_failed (struct thread *);
+
+static int
+netlink_queue_bytelen (int family)
+{
+  return (family == AF_INET ? 4 : 16);
+}
+
+/* Index node of a prefix, locked. */
+static struct route_node *
+netlink_queue_node (int family, void *dest, int length)
+{
+  struct prefix p;
+  struct route_table *table;
+
+  bzero (&p, sizeof p);
+  p.family = family;
+  p.prefixlen = length;
+  memcpy (&p.u.prefix, dest, netlink_queue_bytelen (family));
+
+#ifdef HAVE_IPV6
+  if (family == AF_INET6)
     {
-      zlog (NULL, LOG_ERR, "netlink_talk sendmsg() error: %s", strerror (errno));
-      return -1;
+      if (netlink_queue.ipv6 == NULL)
+	netlink_queue.ipv6 = route_table_init ();
+      table = netlink_queue.ipv6;
+    }
+  else
+#endif /* HAVE_IPV6 */
+    {
+      if (netlink_queue.ipv4 == NULL)
+	netlink_queue.ipv4 = route_table_init ();
+      table = netlink_queue.ipv4;
     }
 
-  /* At this point we don't detect error.  Because if sendmsg success,
-     there will be no error so recvmsg() blocks. */
-  /* return 0; */
-  
-  /* Result of netlink message. */
-  iov.iov_base = buf;
-  iov.iov_len = sizeof buf;
+  return route_node_get (table, &p);
+}
 
-  while (1)
+/* Take a change out of the index, nothing more can be folded into
+   it. */
+static void
+netlink_queue_unindex (struct netlink_route_req *req)
+{
+  if (req->rn)
     {
-      /* Call recvmsg ().  But it block when sendmsg result is success... */
+      req->rn->info = NULL;
+      route_unlock_node (req->rn);
+      req->rn = NULL;
+    }
+}
 
-      /* Now it should be work fine.  So I activate this routine from
-         zebra-0.69. */
-      status = recvmsg (netlink.sock, &msg, 0);
-      if (status < 0)
+static int
+netlink_queue_same_gate (struct netlink_route_req *req, void *gate,
+			 int index)
+{
+  if (req->index != index || req->has_gate != (gate != NULL))
+    return 0;
+  if (gate == NULL)
+    return 1;
+  return ! memcmp (req->gate, gate, netlink_queue_bytelen (req->family));
+}
+
+static void
+netlink_queue_set_gate (struct netlink_route_req *req, void *gate, int index)
+{
+  req->index = index;
+  req->has_gate = (gate != NULL);
+  if (gate)
+    memcpy (req->gate, gate, netlink_queue_bytelen (req->family));
+}
+
+/* Queue a route change for the kernel. */
+int
+netlink_queue_route (int cmd, int nlflags, int family, void *dest,
+		     int length, void *gate, int index, int zebra_flags,
+		     int table)
+{
+  struct route_node *rn;
+  struct netlink_route_req *req;
+  struct netlink_route_req *prev;
+
+  netlink_queue.queued++;
+  netlink_queue.changes++;
+
+  rn = netlink_queue_node (family, dest, length);
+  req = rn->info;
+
+  if (req && req->table == table)
+    {
+      if (cmd == RTM_NEWROUTE && req->cmd == RTM_DELROUTE
+	  && family == AF_INET)
 	{
-	  if (errno == EINTR)
-	    continue;
-	  if (errno == EWOULDBLOCK)
-            return 0;
-	  zlog (NULL, LOG_ERR, "netlink_talk recvmsg() error: %s", strerror (errno));
-	  return -1;
+	  /* Delete then add: replace the route in one go. */
+	  req->replaces = 1;
+	  req->del_flags = req->flags;
+	  req->del_index = req->index;
+	  req->del_has_gate = req->has_gate;
+	  memcpy (req->del_gate, req->gate, sizeof req->gate);
+
+	  req->cmd = RTM_NEWROUTE;
+	  req->nlflags = nlflags | NLM_F_REPLACE;
+	  req->flags = zebra_flags;
+	  netlink_queue_set_gate (req, gate, index);
+
+	  netlink_queue.folded++;
+	  route_unlock_node (rn);
+	  return 0;
 	}
-      if (status == 0)
+
+      if (cmd == RTM_DELROUTE && req->cmd == RTM_NEWROUTE
+	  && netlink_queue_same_gate (req, gate, index))
 	{
-	  zlog (NULL, LOG_ERR, "netlink_talk EOF on netlink: %s", strerror (errno));
-	  return -1;
+	  if (req->nlflags & NLM_F_REPLACE)
+	    {
+	      /* The replaced route goes, nothing comes in its place. */
+	      req->replaces = 0;
+	      req->cmd = RTM_DELROUTE;
+	      req->nlflags = nlflags;
+	      req->flags = req->del_flags;
+	      req->index = req->del_index;
+	      req->has_gate = req->del_has_gate;
+	      memcpy (req->gate, req->del_gate, sizeof req->gate);
+	      netlink_queue.folded++;
+	    }
+	  else
+	    {
+	      /* Added and deleted before the kernel heard of it. */
+	      req->cmd = 0;
+	      netlink_queue_unindex (req);
+	      netlink_queue.cancelled++;
+	    }
+	  route_unlock_node (rn);
+	  return 0;
+	}
+    }
+
+  req = XMALLOC (MTYPE_NETLINK_QUEUE, sizeof (struct netlink_route_req));
+  bzero (req, sizeof (struct netlink_route_req));
+  req->cmd = cmd;
+  req->nlflags = nlflags;
+  req->family = family;
+  req->length = length;
+  req->table = table;
+  req->flags = zebra_flags;
+  memcpy (req->dest, dest, netlink_queue_bytelen (family));
+  netlink_queue_set_gate (req, gate, index);
+
+  /* An IPv6 add behind the delete of the route it takes the place of,
+     which has to come back if the add fails. */
+  prev = rn->info;
+  if (cmd == RTM_NEWROUTE && prev && prev->cmd == RTM_DELROUTE
+      && prev->table == table)
+    {
+      req->replaces = 1;
+      req->del_flags = prev->flags;
+      req->del_index = prev->index;
+      req->del_has_gate = prev->has_gate;
+      memcpy (req->del_gate, prev->gate, sizeof prev->gate);
+    }
+
+  /* Later changes fold into this one now. */
+  if (prev)
+    {
+      prev->rn = NULL;
+      route_unlock_node (rn);
+    }
+  rn->info = req;
+  req->rn = rn;
+
+  if (netlink_queue.tail)
+    netlink_queue.tail->next = req;
+  else
+    netlink_queue.head = req;
+  netlink_queue.tail = req;
+  netlink_queue.count++;
+
+  if (netlink_queue.count >= NETLINK_BATCH)
+    netlink_queue_flush ();
+  else if (netlink_queue.t_flush == NULL)
+    {
+      netlink_queue.t_flush =
+	thread_add_timer (master, netlink_queue_timer, NULL, 0);
+      netlink_queue.changes = 0;
+      netlink_queue.defer = 0;
+    }
+
+  return 0;
+}
+
+/* Build the netlink message for a change. */
+static void
+netlink_route_msg (struct nlmsghdr *n, int maxlen,
+		   struct netlink_route_req *req, int seq)
+{
+  struct rtmsg *rtm;
+  int bytelen;
+
+  bytelen = netlink_queue_bytelen (req->family);
+
+  bzero (n, NLMSG_LENGTH (sizeof (struct rtmsg)));
+  n->nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg));
+  n->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | req->nlflags;
+  n->nlmsg_type = req->cmd;
+  n->nlmsg_seq = seq;
+
+  rtm = NLMSG_DATA (n);
+  rtm->rtm_family = req->family;
+  rtm->rtm_table = req->table;
+  rtm->rtm_dst_len = req->length;
+
+  if (req->cmd != RTM_DELROUTE)
+    {
+      rtm->rtm_protocol = RTPROT_ZEBRA;
+      rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+      /* rtm->rtm_scope = RT_SCOPE_HOST; */
+      /* rtm->rtm_scope = RT_SCOPE_LINK; */
+      if (req->flags & ZEBRA_FLAG_BLACKHOLE)
+	rtm->rtm_type = RTN_BLACKHOLE;
+      else
+	rtm->rtm_type = RTN_UNICAST;
+    }
+
+  if (req->has_gate)
+    addattr_l (n, maxlen, RTA_GATEWAY, req->gate, bytelen);
+  addattr_l (n, maxlen, RTA_DST, req->dest, bytelen);
+  if (req->index > 0)
+    addattr32 (n, maxlen, RTA_OIF, req->index);
+}
+
+/* Hand an add that did not make it into the kernel to
+   netlink_queue_failed (), keeping the order they failed in. */
+static void
+netlink_queue_fail (struct netlink_route_req *req)
+{
+  struct netlink_route_req **tail;
+
+  for (tail = &netlink_queue.failed; *tail; tail = &(*tail)->next)
+    ;
+  *tail = req;
+  if (netlink_queue.t_failed == NULL)
+    netlink_queue.t_failed =
+      thread_add_event (master, netlink_queue_failed, NULL, 0);
+}
+
+/* Send the next batch off the queue.  Returns -1 when it couldn't be
+   sent and is still queued. */
+static int
+netlink_queue_send ()
+{
+  static char buf[NETLINK_BATCH * NETLINK_ROUTE_MSGSIZE];
+  struct netlink_route_req *req;
+  struct nlmsghdr *n;
+  struct sockaddr_nl snl;
+  struct iovec iov = { (void *) buf, 0 };
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  int taken;
+  int nmsg;
+  int dropped;
+  int status;
+
+  /* Build the batch in place; the changes stay queued until the
+     kernel has taken it. */
+  taken = nmsg = dropped = 0;
+  for (req = netlink_queue.head; req && nmsg < NETLINK_BATCH; req = req->next)
+    {
+      taken++;
+      if (req->cmd == 0)
+	continue;
+      n = (struct nlmsghdr *) (buf + iov.iov_len);
+      netlink_route_msg (n, NETLINK_ROUTE_MSGSIZE, req,
+			 netlink_cmd.seq + 1 + nmsg);
+      iov.iov_len += NLMSG_ALIGN (n->nlmsg_len);
+      nmsg++;
+    }
+
+  if (nmsg)
+    {
+      bzero (&snl, sizeof snl);
+      snl.nl_family = AF_NETLINK;
+
+      do
+	status = sendmsg (netlink_cmd.sock, &msg, 0);
+      while (status < 0 && errno == EINTR);
+
+      if (status < 0)
+	{
+	  zlog (NULL, LOG_ERR, "%s sendmsg() error: %s", netlink_cmd.name,
+		strerror (errno));
+	  /* Out of buffer space is worth another try later. */
+	  if (errno == EAGAIN || errno == ENOBUFS)
+	    return -1;
+	  netlink_queue.errors += nmsg;
+	  dropped = 1;
+	  nmsg = 0;
 	}
-      if (msg.msg_namelen != sizeof snl) 
+      else
 	{
-	  zlog (NULL, LOG_ERR, "netlink_talk sender address length %d", msg.msg_namelen);
-	  return -1;
+	  netlink_queue.seq = netlink_cmd.seq + 1;
+	  netlink_cmd.seq += nmsg;
+	  netlink_queue.batches++;
+	  netlink_queue.messages += nmsg;
 	}
+    }
 
-      /* Parse return value. */
-      for (h = (struct nlmsghdr*) buf; status >= sizeof (struct nlmsghdr); ) {
-	int len = h->nlmsg_len;
-	pid_t pid = h->nlmsg_pid;
-	int l = len - sizeof(*h);
-	unsigned seq = h->nlmsg_seq;
-
-	/* Chech length. */
-	if (l < 0 || len > status) 
-	  {
-	    if (msg.msg_flags & MSG_TRUNC) 
-	      {
-		zlog (NULL, LOG_ERR, "netlink_talk truncated message\n");
-		return -1;
-	      }
-	    zlog (NULL, LOG_ERR, "netlink_talk malformed message: len=%d", len);
-	    return -1;
-	  }
-	
-	if (h->nlmsg_pid != pid || h->nlmsg_seq != seq) 
-	  continue;
+  /* Off the queue and into the ack slots. */
+  netlink_queue.nsent = 0;
+  while (taken--)
+    {
+      req = netlink_queue.head;
+      netlink_queue.head = req->next;
+      if (netlink_queue.head == NULL)
+	netlink_queue.tail = NULL;
+      netlink_queue.count--;
+
+      netlink_queue_unindex (req);
+      req->next = NULL;
+      if (req->cmd && nmsg)
+	netlink_queue.sent[netlink_queue.nsent++] = req;
+      else if (req->cmd == RTM_NEWROUTE && dropped)
+	netlink_queue_fail (req);
+      else
+	XFREE (MTYPE_NETLINK_QUEUE, req);
+    }
+  netlink_queue.unacked = netlink_queue.nsent;
 
-	if (h->nlmsg_type == NLMSG_ERROR) 
-	  {
-	    struct nlmsgerr *err = (struct nlmsgerr*)NLMSG_DATA(h);
+  return 0;
+}
 
-	    if (l < sizeof(struct nlmsgerr)) 
-	      zlog (NULL, LOG_ERR, "netlink_talk message truncated\n");
-	    else 
-	      zlog (NULL, LOG_ERR, "netlink_talk error: %s", strerror (-err->error));
-	    return -1;
-	  }
+/* Forget the changes still waiting for an ack. */
+static void
+netlink_queue_sent_clear ()
+{
+  int i;
 
-	/* zlog (NULL, LOG_ERR, "netlink_talk unexpected reply."); */
-	
-	status -= NLMSG_ALIGN(len);
-	h = (struct nlmsghdr*) ((char*)h + NLMSG_ALIGN(len));
+  for (i = 0; i < netlink_queue.nsent; i++)
+    if (netlink_queue.sent[i])
+      {
+	XFREE (MTYPE_NETLINK_QUEUE, netlink_queue.sent[i]);
+	netlink_queue.sent[i] = NULL;
       }
+  netlink_queue.nsent = 0;
+  netlink_queue.unacked = 0;
+}
 
-      if (msg.msg_flags & MSG_TRUNC) 
-	{
-	  zlog (NULL, LOG_ERR, "netlink_talk message truncated\n");
-	  continue;
-      }
+/* Is there a later change for this prefix still to go out? */
+static int
+netlink_queue_pending (struct netlink_route_req *req)
+{
+  struct route_node *rn;
+  int pending;
+
+  rn = netlink_queue_node (req->family, req->dest, req->length);
+  pending = (rn->info != NULL);
+  route_unlock_node (rn);
+
+  return pending;
+}
+
+/* Tell the rib about adds the kernel turned down, outside the call
+   to kernel_add_ipv4 () that may have read their acks, and about adds
+   that could not be sent at all. */
+int
+netlink_queue_failed (struct thread *thread)
+{
+  struct netlink_route_req *req;
+
+  netlink_queue.t_failed = NULL;
+
+  while ((req = netlink_queue.failed) != NULL)
+    {
+      netlink_queue.failed = req->next;
 
-      if (status) 
+      rib_kernel_update (req->family, req->dest, req->length,
+			 req->has_gate ? req->gate : NULL, req->index,
+			 req->table, 0);
+
+      /* A failed IPv4 replace leaves the old route where it was.  An
+	 IPv6 add went out after its delete, so the old route has to be
+	 put back, unless something newer for the prefix is queued. */
+      if (req->replaces)
 	{
-	  zlog (NULL, LOG_ERR, "netlink_talk error remnant of size %d", status);
-	  return -1;
+	  if (req->family != AF_INET && ! netlink_queue_pending (req))
+	    netlink_queue_route (RTM_NEWROUTE, NLM_F_CREATE, req->family,
+				 req->dest, req->length,
+				 req->del_has_gate ? req->del_gate : NULL,
+				 req->del_index, req->del_flags, req->table);
+	  rib_kernel_update (req->family, req->dest, req->length,
+			     req->del_has_gate ? req->del_gate : NULL,
+			     req->del_index, req->table, 1);
 	}
+
+      XFREE (MTYPE_NETLINK_QUEUE, req);
     }
-  
+
   return 0;
 }
 
-/* Routing table change via netlink interface. */
-int
-netlink_route (int cmd, unsigned long flags, int family, void *dest,
-	       int length, void *gate, int index, int zebra_flags, int table)
+/* Match an ack against the change it was for. */
+static void
+netlink_queue_ack (struct nlmsghdr *h)
 {
-  int ret;
-  int bytelen;
+  struct nlmsgerr *err;
+  struct netlink_route_req *req;
+  char buf[BUFSIZ];
+  int slot;
+
+  slot = h->nlmsg_seq - netlink_queue.seq;
+  if (slot < 0 || slot >= netlink_queue.nsent
+      || netlink_queue.sent[slot] == NULL)
+    {
+      zlog_warn ("%s: unexpected reply type %d seq %u", netlink_cmd.name,
+		 h->nlmsg_type, h->nlmsg_seq);
+      return;
+    }
+
+  req = netlink_queue.sent[slot];
+  netlink_queue.sent[slot] = NULL;
+  netlink_queue.unacked--;
+
+  if (h->nlmsg_type == NLMSG_ERROR)
+    {
+      err = (struct nlmsgerr *) NLMSG_DATA (h);
+      if (h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+	{
+	  zlog (NULL, LOG_ERR, "%s error: message truncated",
+		netlink_cmd.name);
+	  netlink_queue.errors++;
+	}
+      else if (err->error)
+	{
+	  zlog (NULL, LOG_ERR, "%s error: %s %s/%d: %s", netlink_cmd.name,
+		req->cmd == RTM_DELROUTE ? "delete" : "add",
+		inet_ntop (req->family, req->dest, buf, sizeof buf),
+		req->length, strerror (-err->error));
+	  netlink_queue.errors++;
+
+	  if (req->cmd == RTM_NEWROUTE)
+	    {
+	      netlink_queue_fail (req);
+	      return;
+	    }
+	}
+    }
+
+  XFREE (MTYPE_NETLINK_QUEUE, req);
+}
+
+/* Read whatever acks have come in. */
+static void
+netlink_queue_read_acks ()
+{
+  int status;
+  char buf[4096];
+  struct iovec iov = { buf, sizeof buf };
   struct sockaddr_nl snl;
+  struct msghdr msg = { (void*)&snl, sizeof snl, &iov, 1, NULL, 0, 0};
+  struct nlmsghdr *h;
 
-  struct 
-  {
-    struct nlmsghdr n;
-    struct rtmsg r;
-    char buf[1024];
-  } req;
+  while (netlink_queue.unacked)
+    {
+      status = recvmsg (netlink_cmd.sock, &msg, 0);
+      if (status < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno == EWOULDBLOCK)
+	    return;
+	  /* Acks were dropped for want of buffer space, we won't see
+	     the rest of this batch. */
+	  zlog (NULL, LOG_ERR, "%s recvmsg() error: %s, %d changes unconfirmed",
+		netlink_cmd.name, strerror (errno), netlink_queue.unacked);
+	  netlink_queue_sent_clear ();
+	  return;
+	}
 
-  bzero (&req, sizeof req);
+      if (status == 0)
+	{
+	  zlog (NULL, LOG_ERR, "%s EOF", netlink_cmd.name);
+	  netlink_queue_sent_clear ();
+	  return;
+	}
+
+      for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, status);
+	   h = NLMSG_NEXT (h, status))
+	netlink_queue_ack (h);
 
-  bytelen = (family == AF_INET ? 4 : 16);
+      if (msg.msg_flags & MSG_TRUNC)
+	zlog (NULL, LOG_ERR, "%s error: message truncated", netlink_cmd.name);
+    }
 
-  req.n.nlmsg_len = NLMSG_LENGTH (sizeof (struct rtmsg));
-  req.n.nlmsg_flags = NLM_F_REQUEST | flags;
-  req.n.nlmsg_type = cmd;
-  req.r.rtm_family = family;
-  req.r.rtm_table = table;
-  req.r.rtm_dst_len = length;
+  netlink_queue.nsent = 0;
+}
+
+int
+netlink_queue_ack_read (struct thread *thread)
+{
+  netlink_queue.t_ack = NULL;
 
-  if (cmd != RTM_DELROUTE) 
+  netlink_queue_read_acks ();
+  netlink_queue_flush ();
+
+  return 0;
+}
+
+/* Send everything queued, a batch at a time.  A batch that isn't
+   acked straight away leaves the rest for netlink_queue_ack_read (). */
+void
+netlink_queue_flush ()
+{
+  if (netlink_cmd.sock < 0)
+    return;
+
+  while (netlink_queue.unacked == 0 && netlink_queue.head)
     {
-      req.r.rtm_protocol = RTPROT_ZEBRA;
-      req.r.rtm_scope = RT_SCOPE_UNIVERSE;
-      /* req.r.rtm_scope = RT_SCOPE_HOST; */
-      /* req.r.rtm_scope = RT_SCOPE_LINK; */
-      if (zebra_flags & ZEBRA_FLAG_BLACKHOLE)
-	req.r.rtm_type = RTN_BLACKHOLE;
-      else
-	req.r.rtm_type = RTN_UNICAST;
+      if (netlink_queue_send () < 0)
+	{
+	  if (netlink_queue.t_flush == NULL)
+	    netlink_queue.t_flush =
+	      thread_add_timer (master, netlink_queue_timer, NULL, 1);
+	  return;
+	}
+      netlink_queue_read_acks ();
     }
 
-  if (gate)
-    addattr_l (&req.n, sizeof req, RTA_GATEWAY, gate, bytelen);
-  if (dest)
-    addattr_l (&req.n, sizeof req, RTA_DST, dest, bytelen);
-  if (index > 0)
-    addattr32 (&req.n, sizeof req, RTA_OIF, index);
+  if (netlink_queue.unacked && netlink_queue.t_ack == NULL)
+    netlink_queue.t_ack =
+      thread_add_read (master, netlink_queue_ack_read, NULL,
+		       netlink_cmd.sock);
+}
 
-  /* Destination netlink address. */
-  bzero (&snl, sizeof snl);
-  snl.nl_family = AF_NETLINK;
+/* Flush once the main loop has had a pass with nothing new queued, or
+   has been put off for as long as it would take to fill a batch. */
+int
+netlink_queue_timer (struct thread *thread)
+{
+  netlink_queue.t_flush = NULL;
 
-  /* Talk to netlink socket. */
-  ret = netlink_talk (&req.n);
-  if (ret < 0)
-    return -1;
+  if (netlink_queue.changes && netlink_queue.defer < NETLINK_BATCH)
+    {
+      netlink_queue.changes = 0;
+      netlink_queue.defer++;
+      netlink_queue.t_flush =
+	thread_add_timer (master, netlink_queue_timer, NULL, 0);
+      return 0;
+    }
 
+  netlink_queue_flush ();
   return 0;
 }
 
-/* Add IPv4 route to the kernel. */
+/* Send everything and wait for the acks, on the way out. */
+void
+netlink_queue_finish ()
+{
+  struct pollfd pfd;
+
+  while (netlink_queue.head || netlink_queue.unacked)
+    {
+      if (netlink_queue.unacked)
+	{
+	  pfd.fd = netlink_cmd.sock;
+	  pfd.events = POLLIN;
+	  if (poll (&pfd, 1, 1000) <= 0)
+	    {
+	      zlog (NULL, LOG_ERR, "%s: no ack for %d changes",
+		    netlink_cmd.name, netlink_queue.unacked);
+	      netlink_queue_sent_clear ();
+	    }
+	  else
+	    netlink_queue_read_acks ();
+	}
+      else if (netlink_cmd.sock < 0 || netlink_queue_send () < 0)
+	break;
+      else
+	netlink_queue_read_acks ();
+    }
+}
+
+/* Routing table change via netlink interface. */
+int
+netlink_route (int cmd, unsigned long flags, int family, void *dest,
+	       int length, void *gate, int index, int zebra_flags, int table)
+{
+  if (netlink_cmd.sock < 0)
+    {
+      zlog (NULL, LOG_ERR, "%s socket isn't active.", netlink_cmd.name);
+      return -1;
+    }
+
+  return netlink_queue_route (cmd, flags, family, dest, length, gate, index,
+			      zebra_flags, table);
+}
+
+/* Add IPv4 route to the kernel.  Returns once the change is queued;
+   if the kernel turns it down, netlink_queue_failed () tells the
+   rib. */
 int
 kernel_add_ipv4 (struct prefix_ipv4 *dest, struct in_addr *gate,
 		 int index, int flags, int table)
@@ -1164,7 +1704,7 @@ kernel_delete_ipv4 (struct prefix_ipv4 *dest, struct in_addr *gate,
 }
 
 #ifdef HAVE_IPV6
-/* Add IPv6 route to the kernel. */
+/* Add IPv6 route to the kernel, as kernel_add_ipv4 (). */
 int
 kernel_add_ipv6 (struct prefix_ipv6 *dest, struct in6_addr *gate,
 		    int index, int flags, int table)
@@ -1189,9 +1729,23 @@ kernel_delete_ipv6 (struct prefix_ipv6 *dest, struct in6_addr *gate,
 }
 #endif /* HAVE_IPV6 */
 
-#include "thread.h"
-
-extern struct thread_master *master;
+DEFUN (show_ip_netlink_queue,
+       show_ip_netlink_queue_cmd,
+       "show ip netlink-queue",
+       SHOW_STR
+       "IP information\n"
+       "Kernel route change queue\n")
+{
+  vty_out (vty, "Route changes: %lu, folded %lu, cancelled %lu%s",
+	   netlink_queue.queued, netlink_queue.folded,
+	   netlink_queue.cancelled, VTY_NEWLINE);
+  vty_out (vty, "Messages sent: %lu in %lu batches, %lu errors%s",
+	   netlink_queue.messages, netlink_queue.batches,
+	   netlink_queue.errors, VTY_NEWLINE);
+  vty_out (vty, "Queued: %d, waiting for ack: %d%s",
+	   netlink_queue.count, netlink_queue.unacked, VTY_NEWLINE);
+  return CMD_SUCCESS;
+}
 
 /* Kernel route reflection. */
 int
@@ -1212,9 +1766,32 @@ kernel_read (struct thread *thread)
 void
 kernel_init ()
 {
-  netlink_socket ();
+  unsigned long groups;
+  int size;
+
+  groups = RTMGRP_LINK|RTMGRP_IPV4_ROUTE|RTMGRP_IPV4_IFADDR;
+#ifdef HAVE_IPV6
+  groups |= RTMGRP_IPV6_ROUTE|RTMGRP_IPV6_IFADDR;
+#endif /* HAVE_IPV6 */
+  netlink_socket (&netlink, groups);
+  netlink_socket (&netlink_cmd, 0);
 
   /* Register kernel socket. */
   if (netlink.sock > 0)
     thread_add_read (master, kernel_read, NULL, netlink.sock);
+
+  if (netlink_cmd.sock > 0)
+    {
+      size = NETLINK_CMD_RCVBUF;
+      if (setsockopt (netlink_cmd.sock, SOL_SOCKET, SO_RCVBUF,
+		      &size, sizeof size) < 0)
+	zlog_warn ("Can't set %s receive buffer size: %s",
+		   netlink_cmd.name, strerror (errno));
+
+      /* Changes made on the way out still have to reach the kernel. */
+      atexit (netlink_queue_finish);
+    }
+
+  install_element (VIEW_NODE, &show_ip_netlink_queue_cmd);
+  install_element (ENABLE_NODE, &show_ip_netlink_queue_cmd);
 }